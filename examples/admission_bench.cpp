@@ -0,0 +1,161 @@
+// Measures the latency of requests under overload, with and without an
+// admission::controller (util/admission.hpp).
+//
+// The main thread generates requests in an open loop, at LOAD times the rate
+// that the executor's threads can complete them, and posts a task for each
+// one, like an accept loop that forks a handler per connection. Each request
+// spins for about WORK_US. The modes are:
+// - unbounded: every request runs. Above a load of 1, the executor's queue
+//   grows for as long as the overload lasts.
+// - codel: a controller with the default 5ms target and 100ms interval.
+//   Requests that it sheds complete immediately without doing their work.
+// - codel + defer: the same, with max_running set to the thread count, so
+//   excess requests wait in the controller's FIFO instead of the executor.
+//
+// For each load, reports the percentage of requests that were served, the
+// p50 / p99 latency in milliseconds of the served requests (from arrival to
+// completion), and the number of requests served per second.
+//
+// Usage: admission_bench [requests per run]
+
+#include "tmc/all_headers.hpp"
+#include "util/admission.hpp"
+#include "util/latency_histogram.hpp"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <mutex>
+#include <optional>
+#include <thread>
+
+static constexpr size_t WORK_US = 50;
+static constexpr auto BATCH_INTERVAL = std::chrono::microseconds(100);
+static constexpr std::array<double, 3> LOADS{0.8, 1.5, 3.0};
+
+enum class mode { UNBOUNDED, CODEL, CODEL_DEFER };
+
+struct run_state {
+  std::mutex lock;
+  latency_histogram latency;
+  std::atomic<size_t> served{0};
+  std::atomic<size_t> done{0};
+  std::atomic<uint64_t> sink{0};
+  size_t spinIters = 0;
+};
+
+static uint64_t spin(uint64_t X, size_t Iters) {
+  for (size_t i = 0; i < Iters; ++i) {
+    X = X * 6364136223846793005ULL + 1442695040888963407ULL;
+  }
+  return X;
+}
+
+// The number of spin() iterations that take about WORK_US.
+static size_t calibrate(std::atomic<uint64_t>& Sink) {
+  static constexpr size_t ITERS = 1000000;
+  auto start = std::chrono::steady_clock::now();
+  Sink.fetch_add(spin(1, ITERS), std::memory_order_relaxed);
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  double perIter = std::chrono::duration<double, std::micro>(elapsed).count() /
+                   static_cast<double>(ITERS);
+  return static_cast<size_t>(static_cast<double>(WORK_US) / perIter);
+}
+
+static tmc::task<void> request(
+  run_state& State, std::chrono::steady_clock::time_point Arrival,
+  std::optional<admission::ticket> Ticket
+) {
+  if (!Ticket || (*Ticket && co_await Ticket->enter())) {
+    State.sink.fetch_add(spin(1, State.spinIters), std::memory_order_relaxed);
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - Arrival
+    );
+    {
+      std::lock_guard<std::mutex> lg{State.lock};
+      State.latency.record(static_cast<uint64_t>(ns.count()));
+    }
+    State.served.fetch_add(1, std::memory_order_relaxed);
+  }
+  Ticket.reset();
+  State.done.fetch_add(1, std::memory_order_release);
+}
+
+static void run_mode(
+  const char* Name, tmc::ex_cpu& Ex, mode Mode, double Load, size_t RequestCount
+) {
+  run_state state;
+  state.spinIters = calibrate(state.sink);
+  admission::controller admit;
+  if (Mode == mode::CODEL_DEFER) {
+    admit.set_max_running(Ex.thread_count());
+  }
+  double perSec = Load * static_cast<double>(Ex.thread_count()) * 1000000.0 /
+                  static_cast<double>(WORK_US);
+  size_t perBatch = static_cast<size_t>(
+    perSec * std::chrono::duration<double>(BATCH_INTERVAL).count()
+  );
+  if (perBatch == 0) {
+    perBatch = 1;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  auto next = start;
+  size_t posted = 0;
+  while (posted < RequestCount) {
+    std::this_thread::sleep_until(next);
+    next += BATCH_INTERVAL;
+    auto now = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < perBatch && posted < RequestCount; ++i, ++posted) {
+      std::optional<admission::ticket> ticket;
+      if (Mode != mode::UNBOUNDED) {
+        ticket.emplace(admit.arrive());
+      }
+      tmc::post(Ex, request(state, now, std::move(ticket)), 0);
+    }
+  }
+  while (state.done.load(std::memory_order_acquire) != RequestCount) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  auto end = std::chrono::steady_clock::now();
+
+  size_t served = state.served.load(std::memory_order_relaxed);
+  double sec = std::chrono::duration<double>(end - start).count();
+  std::printf(
+    "| %.1f\t| %s\t| %.1f\t\t| %.1f\t\t| %.1f\t\t| %.0f\t|\n", Load, Name,
+    100.0 * static_cast<double>(served) / static_cast<double>(RequestCount),
+    static_cast<double>(state.latency.percentile(50.0)) / 1000000.0,
+    static_cast<double>(state.latency.percentile(99.0)) / 1000000.0,
+    static_cast<double>(served) / sec
+  );
+}
+
+int main(int argc, char* argv[]) {
+  size_t requestCount = 200000;
+  if (argc > 1) {
+    requestCount = static_cast<size_t>(std::atoll(argv[1]));
+  }
+  tmc::ex_cpu ex;
+  ex.init();
+  std::printf(
+    "admission_bench: %zu requests | %zu us each | %zu threads\n", requestCount,
+    WORK_US, ex.thread_count()
+  );
+  std::printf(
+    "| load\t| mode\t\t| served %%\t| p50 ms\t| p99 ms\t| served/sec\t|\n"
+  );
+  std::printf(
+    "| ----- | ------------- | ------------- | ------------- | ------------- | "
+    "------------- |\n"
+  );
+  for (double load : LOADS) {
+    run_mode("unbounded", ex, mode::UNBOUNDED, load, requestCount);
+    run_mode("codel\t", ex, mode::CODEL, load, requestCount);
+    run_mode("codel + defer", ex, mode::CODEL_DEFER, load, requestCount);
+  }
+  ex.teardown();
+}
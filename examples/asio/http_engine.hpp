@@ -0,0 +1,239 @@
+// A keep-alive HTTP/1.1 connection handler for Asio sockets, built on
+// util/http_parser.hpp.
+//
+// serve_connection() reads into a single buffer and parses requests in place.
+// Every complete request in the buffer is handled before anything is written,
+// so a batch of pipelined requests produces a single scatter/gather write of
+// all of the responses. A request that is split across reads is kept in the
+// buffer until the rest of it arrives; only that partial request is moved
+// back to the front of the buffer.
+//
+// The handler receives an http::request and returns an http::reply (or a
+// tmc::task<http::reply>). The reply body is a string_view, which is not
+// copied: it must stay valid until the response has been written. A body that
+// points to static data, or into the request, satisfies this.
+
+#pragma once
+
+#ifdef _WIN32
+#include <sdkddkver.h>
+#endif
+
+#include "../util/http_parser.hpp"
+#include "tmc/asio/aw_asio.hpp"
+#include "tmc/task.hpp"
+
+#ifdef TMC_USE_BOOST_ASIO
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/write.hpp>
+#else
+#include <asio/buffer.hpp>
+#include <asio/ip/tcp.hpp>
+#include <asio/write.hpp>
+#endif
+
+#include <charconv>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace http {
+#ifdef TMC_USE_BOOST_ASIO
+namespace asio = boost::asio;
+using boost::system::error_code;
+#else
+using asio::error_code;
+#endif
+
+struct reply {
+  int status = 200;
+  std::string_view content_type = "text/plain; charset=utf-8";
+  std::string_view body;
+};
+
+struct connection_options {
+  // Initial size of the read buffer.
+  size_t buffer_size = 16384;
+  // A single request larger than this is rejected: with 413 if its
+  // Content-Length is too large, or with 431 if its headers are.
+  size_t max_request_size = 1024 * 1024;
+};
+
+namespace detail {
+inline std::string_view status_reason(int Status) {
+  switch (Status) {
+  case 200:
+    return "OK";
+  case 204:
+    return "No Content";
+  case 400:
+    return "Bad Request";
+  case 404:
+    return "Not Found";
+  case 413:
+    return "Content Too Large";
+  case 431:
+    return "Request Header Fields Too Large";
+  case 500:
+    return "Internal Server Error";
+  case 503:
+    return "Service Unavailable";
+  default:
+    return "Unknown";
+  }
+}
+
+// Appends the status line and headers for Reply to Out.
+inline void append_head(std::string& Out, const reply& Reply, bool KeepAlive) {
+  char num[24];
+  Out += "HTTP/1.1 ";
+  auto r = std::to_chars(num, num + sizeof(num), Reply.status);
+  Out.append(num, r.ptr);
+  Out += ' ';
+  Out += status_reason(Reply.status);
+  Out += "\r\nContent-Length: ";
+  r = std::to_chars(num, num + sizeof(num), Reply.body.size());
+  Out.append(num, r.ptr);
+  if (!Reply.content_type.empty()) {
+    Out += "\r\nContent-Type: ";
+    Out += Reply.content_type;
+  }
+  if (!KeepAlive) {
+    Out += "\r\nConnection: close";
+  }
+  Out += "\r\n\r\n";
+}
+
+// A response in the current batch. The head is stored in a shared string, so
+// it is referenced by offset until the batch is complete.
+struct pending_reply {
+  size_t head_offset;
+  size_t head_size;
+  std::string_view body;
+};
+
+template <typename T> struct is_reply_task : std::false_type {};
+template <> struct is_reply_task<tmc::task<reply>> : std::true_type {};
+} // namespace detail
+
+/// The handler of the example servers. The body is static, so it doesn't need
+/// to outlive anything.
+inline reply hello_world(const request&) {
+  return reply{200, "text/plain; charset=utf-8", "Hello World!"};
+}
+
+/// Serves HTTP/1.1 requests on Socket until the peer closes the connection,
+/// a request asks to close it, or an error occurs.
+// Socket is taken by value so that it is moved into the coroutine frame.
+template <typename Socket, typename Handler>
+tmc::task<void>
+serve_connection(Socket Sock, Handler Handle, connection_options Opts = {}) {
+  using handler_result = std::invoke_result_t<Handler&, const request&>;
+  std::vector<char> buf(Opts.buffer_size);
+  // Unconsumed bytes are in [begin, end)
+  size_t begin = 0;
+  size_t end = 0;
+  request_parser parser;
+  std::string heads;
+  std::vector<detail::pending_reply> replies;
+  std::vector<asio::const_buffer> iov;
+  bool open = true;
+
+  while (open) {
+    if (end == buf.size()) {
+      if (begin != 0) {
+        // Move the partial request to the front of the buffer.
+        std::memmove(buf.data(), buf.data() + begin, end - begin);
+        end -= begin;
+        begin = 0;
+      } else if (buf.size() < Opts.max_request_size) {
+        buf.resize(buf.size() * 2);
+      } else {
+        // Oversized bodies are caught below, as soon as their headers are
+        // parsed, so the headers alone don't fit.
+        reply tooLarge{431, {}, {}};
+        heads.clear();
+        detail::append_head(heads, tooLarge, false);
+        [[maybe_unused]] auto [werror, wn] =
+          co_await asio::async_write(Sock, asio::buffer(heads), tmc::aw_asio);
+        break;
+      }
+    }
+
+    auto [error, n] = co_await Sock.async_read_some(
+      asio::buffer(buf.data() + end, buf.size() - end), tmc::aw_asio
+    );
+    if (error) {
+      break;
+    }
+    end += n;
+
+    // Handle every complete request that is in the buffer.
+    heads.clear();
+    replies.clear();
+    while (begin < end) {
+      request req;
+      auto result = parser.parse(buf.data() + begin, end - begin, req);
+      if (result.status == parse_status::INCOMPLETE) {
+        if (result.expected > Opts.max_request_size) {
+          // Don't wait for a body that will never fit. Reply after the
+          // responses to the earlier requests in this batch.
+          size_t offset = heads.size();
+          detail::append_head(heads, reply{413, {}, {}}, false);
+          replies.push_back({offset, heads.size() - offset, {}});
+          open = false;
+        }
+        break;
+      }
+      reply rep;
+      bool keepAlive = false;
+      if (result.status == parse_status::BAD_MESSAGE) {
+        rep = reply{400, {}, {}};
+        begin = end;
+      } else {
+        if constexpr (detail::is_reply_task<handler_result>::value) {
+          rep = co_await Handle(req);
+        } else {
+          rep = Handle(req);
+        }
+        keepAlive = req.keep_alive;
+        begin += result.consumed;
+      }
+      size_t offset = heads.size();
+      detail::append_head(heads, rep, keepAlive);
+      replies.push_back({offset, heads.size() - offset, rep.body});
+      if (!keepAlive) {
+        open = false;
+        break;
+      }
+    }
+    if (begin == end) {
+      begin = end = 0;
+    }
+
+    if (!replies.empty()) {
+      // Write all of the responses to this batch at once.
+      iov.clear();
+      for (auto& r : replies) {
+        iov.push_back(asio::buffer(heads.data() + r.head_offset, r.head_size));
+        if (!r.body.empty()) {
+          iov.push_back(asio::buffer(r.body.data(), r.body.size()));
+        }
+      }
+      auto [werror, wn] = co_await asio::async_write(Sock, iov, tmc::aw_asio);
+      if (werror) {
+        break;
+      }
+    }
+  }
+
+  error_code ec;
+  Sock.shutdown(Socket::shutdown_both, ec);
+  Sock.close(ec);
+}
+} // namespace http
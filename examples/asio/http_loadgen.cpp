@@ -0,0 +1,316 @@
+// An in-process HTTP/1.1 load generator, for measuring the HTTP server
+// examples without an external tool like wrk.
+//
+// Opens N keep-alive connections on loopback. Each connection writes `depth`
+// pipelined requests with a single write, then reads and parses responses
+// until all of them have arrived, and repeats. Reports requests/sec and
+// p50 / p99 / p999 latency. The latency of a request is measured from the
+// write of its batch to the arrival of its response, so with depth 1 it is
+// the round trip time. Responses are parsed with util/http_parser.hpp, so a
+// server that mishandles pipelined or partial requests shows up as an error
+// or a stall rather than a good number.
+//
+// Usage: http_loadgen [options]
+//   --port P          (default 55550)
+//   --connections N   (default 64)
+//   --depth D         pipelined requests per connection (default 1)
+//   --duration S      seconds to measure (default 5)
+//   --warmup S        seconds to run before measuring (default 1)
+//   --threads T       CPU executor threads (default: all in the partition)
+//   --groups a,b,...  pin the load generator to these cache groups
+//   --cores a,b,...   pin the load generator to these cores
+//
+// By default, the load generator pins itself to the last cache group on the
+// system, since the server examples pin themselves starting from the first
+// one. To compare server layouts, run e.g. hwloc_asio_thread_per_core and
+// hwloc_asio_server_per_cache on one set of cores, and this on another.
+#ifdef _WIN32
+#include <sdkddkver.h>
+#endif
+
+#include "../util/http_parser.hpp"
+#include "../util/latency_histogram.hpp"
+#include "tmc/asio/aw_asio.hpp"
+#include "tmc/asio/ex_asio.hpp"
+#include "tmc/ex_cpu.hpp"
+#include "tmc/spawn_many.hpp"
+#include "tmc/task.hpp"
+#include "tmc/topology.hpp"
+
+#ifdef TMC_USE_BOOST_ASIO
+#include <boost/asio/buffer.hpp>
+#include <boost/asio/ip/address_v4.hpp>
+#include <boost/asio/ip/tcp.hpp>
+#include <boost/asio/write.hpp>
+
+namespace asio = boost::asio;
+#else
+#include <asio/buffer.hpp>
+#include <asio/ip/address_v4.hpp>
+#include <asio/ip/tcp.hpp>
+#include <asio/write.hpp>
+#endif
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+using asio::ip::tcp;
+using clock_type = std::chrono::steady_clock;
+
+static constexpr std::string_view REQUEST = "GET / HTTP/1.1\r\n"
+                                            "Host: localhost\r\n"
+                                            "\r\n";
+
+// The read buffer grows to fit a single response of up to this size.
+static constexpr size_t MAX_RESPONSE_SIZE = 16 * 1024 * 1024;
+
+struct options {
+  uint16_t port = 55550;
+  size_t connections = 64;
+  size_t depth = 1;
+  size_t duration_s = 5;
+  size_t warmup_s = 1;
+  size_t threads = 0;
+  std::vector<size_t> groups;
+  std::vector<size_t> cores;
+};
+
+struct connection_result {
+  latency_histogram latency;
+  bool failed = false;
+};
+
+static tmc::task<connection_result> run_connection(
+  const options& Opts, clock_type::time_point MeasureStart,
+  clock_type::time_point Deadline
+) {
+  connection_result result;
+  tcp::socket sock(tmc::asio_executor());
+  auto [error] = co_await sock.async_connect(
+    tcp::endpoint(asio::ip::address_v4::loopback(), Opts.port), tmc::aw_asio
+  );
+  if (error) {
+    std::printf("connect failed: %s\n", error.message().c_str());
+    result.failed = true;
+    co_return result;
+  }
+  sock.set_option(tcp::no_delay(true));
+
+  std::string batch;
+  for (size_t i = 0; i < Opts.depth; ++i) {
+    batch += REQUEST;
+  }
+
+  std::vector<char> buf(65536);
+  size_t begin = 0;
+  size_t end = 0;
+  http::response_parser parser;
+  while (true) {
+    auto sendTime = clock_type::now();
+    if (sendTime >= Deadline) {
+      break;
+    }
+    // Requests sent during the warmup period are not measured.
+    bool measure = sendTime >= MeasureStart;
+    auto [werror, wn] =
+      co_await asio::async_write(sock, asio::buffer(batch), tmc::aw_asio);
+    if (werror) {
+      result.failed = true;
+      break;
+    }
+    size_t remaining = Opts.depth;
+    while (remaining != 0) {
+      http::response resp;
+      auto r = parser.parse(buf.data() + begin, end - begin, resp);
+      if (r.status == http::parse_status::COMPLETE) {
+        if (measure) {
+          auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            clock_type::now() - sendTime
+          );
+          result.latency.record(static_cast<uint64_t>(ns.count()));
+        }
+        begin += r.consumed;
+        --remaining;
+        continue;
+      }
+      if (r.status == http::parse_status::BAD_MESSAGE) {
+        std::printf("received a malformed response\n");
+        result.failed = true;
+        co_return result;
+      }
+      if (begin == end) {
+        begin = end = 0;
+      } else if (end == buf.size()) {
+        if (begin != 0) {
+          std::memmove(buf.data(), buf.data() + begin, end - begin);
+          end -= begin;
+          begin = 0;
+        } else if (buf.size() < MAX_RESPONSE_SIZE) {
+          // A single response fills the buffer.
+          buf.resize(buf.size() * 2);
+        } else {
+          std::printf("received a response larger than %zu bytes\n", MAX_RESPONSE_SIZE);
+          result.failed = true;
+          co_return result;
+        }
+      }
+      auto [rerror, n] = co_await sock.async_read_some(
+        asio::buffer(buf.data() + end, buf.size() - end), tmc::aw_asio
+      );
+      if (rerror) {
+        result.failed = true;
+        co_return result;
+      }
+      end += n;
+    }
+  }
+  sock.close();
+  co_return result;
+}
+
+static std::vector<size_t> parse_list(const char* Arg) {
+  std::vector<size_t> out;
+  const char* p = Arg;
+  while (*p != '\0') {
+    char* next;
+    out.push_back(static_cast<size_t>(std::strtoul(p, &next, 10)));
+    if (next == p) {
+      break;
+    }
+    p = *next == ',' ? next + 1 : next;
+  }
+  return out;
+}
+
+static bool parse_args(int argc, char* argv[], options& Opts) {
+  for (int i = 1; i + 1 < argc; i += 2) {
+    std::string_view name = argv[i];
+    const char* value = argv[i + 1];
+    if (name == "--port") {
+      Opts.port = static_cast<uint16_t>(std::atoi(value));
+    } else if (name == "--connections") {
+      Opts.connections = static_cast<size_t>(std::atoi(value));
+    } else if (name == "--depth") {
+      Opts.depth = static_cast<size_t>(std::atoi(value));
+    } else if (name == "--duration") {
+      Opts.duration_s = static_cast<size_t>(std::atoi(value));
+    } else if (name == "--warmup") {
+      Opts.warmup_s = static_cast<size_t>(std::atoi(value));
+    } else if (name == "--threads") {
+      Opts.threads = static_cast<size_t>(std::atoi(value));
+    } else if (name == "--groups") {
+      Opts.groups = parse_list(value);
+    } else if (name == "--cores") {
+      Opts.cores = parse_list(value);
+    } else {
+      std::printf("unknown option: %s\n", argv[i]);
+      return false;
+    }
+  }
+  if ((argc - 1) % 2 != 0) {
+    std::printf("missing value for option: %s\n", argv[argc - 1]);
+    return false;
+  }
+  if (Opts.depth == 0) {
+    Opts.depth = 1;
+  }
+  if (Opts.duration_s == 0) {
+    Opts.duration_s = 1;
+  }
+  return true;
+}
+
+#ifdef TMC_USE_HWLOC
+// Pins both executors to the requested cores. Returns a description of the
+// placement.
+static std::string configure_placement(const options& Opts) {
+  auto topo = tmc::topology::query();
+  tmc::topology::topology_filter f;
+  std::string desc;
+  if (!Opts.cores.empty()) {
+    f.set_core_indexes(Opts.cores);
+    desc = "cores";
+    for (auto c : Opts.cores) {
+      desc += " " + std::to_string(c);
+    }
+  } else {
+    std::vector<size_t> groups = Opts.groups;
+    if (groups.empty()) {
+      if (topo.groups.size() < 2) {
+        // Nowhere to go that is away from the server.
+        return "unpinned (only 1 cache group)";
+      }
+      groups.push_back(topo.groups.size() - 1);
+    }
+    f.set_group_indexes(groups);
+    desc = "cache groups";
+    for (auto g : groups) {
+      desc += " " + std::to_string(g);
+    }
+  }
+  tmc::asio_executor().add_partition(f);
+  tmc::cpu_executor().add_partition(f);
+  return desc;
+}
+#endif
+
+int main(int argc, char* argv[]) {
+  options opts;
+  if (!parse_args(argc, argv, opts)) {
+    return 1;
+  }
+
+  std::string placement = "unpinned";
+#ifdef TMC_USE_HWLOC
+  placement = configure_placement(opts);
+#endif
+  if (opts.threads != 0) {
+    tmc::cpu_executor().set_thread_count(opts.threads);
+  }
+  tmc::asio_executor().init();
+  tmc::cpu_executor().init();
+
+  auto run = [](const options& Opts, std::string Placement) -> tmc::task<int> {
+    std::printf(
+      "http://localhost:%d/ | %zu connections | depth %zu | %zu s + %zu s warmup | "
+      "%zu threads | %s\n",
+      Opts.port, Opts.connections, Opts.depth, Opts.duration_s, Opts.warmup_s,
+      tmc::cpu_executor().thread_count(), Placement.c_str()
+    );
+    auto measureStart = clock_type::now() + std::chrono::seconds(Opts.warmup_s);
+    auto deadline = measureStart + std::chrono::seconds(Opts.duration_s);
+    std::vector<tmc::task<connection_result>> tasks;
+    tasks.reserve(Opts.connections);
+    for (size_t i = 0; i < Opts.connections; ++i) {
+      tasks.push_back(run_connection(Opts, measureStart, deadline));
+    }
+    std::vector<connection_result> results = co_await tmc::spawn_many(tasks);
+
+    latency_histogram total;
+    size_t failed = 0;
+    for (auto& r : results) {
+      total.merge(r.latency);
+      failed += r.failed ? 1 : 0;
+    }
+    std::printf(
+      "%llu requests in %zu s: %.0f requests/sec\n",
+      static_cast<unsigned long long>(total.count()), Opts.duration_s,
+      static_cast<double>(total.count()) / static_cast<double>(Opts.duration_s)
+    );
+    total.print("latency");
+    if (failed != 0) {
+      std::printf("%zu connections failed\n", failed);
+      co_return 1;
+    }
+    co_return 0;
+  };
+  return tmc::async_main(run(opts, placement));
+}
@@ -1,11 +1,20 @@
 // A simple "Hello, World!" HTTP response server
 // Listens on http://localhost:55550/
+//
+// Run with `--admit` to pass each request through an admission controller
+// (util/admission.hpp), which answers requests that waited too long under
+// overload with a 503. This costs an extra trip through the executor's queue
+// per request, so it is off by default; admission_bench measures it in
+// isolation.
 #ifdef _WIN32
 #include <sdkddkver.h>
 #endif
 
+#include "../util/admission.hpp"
+#include "http_engine.hpp"
 #include "tmc/asio/aw_asio.hpp"
 #include "tmc/asio/ex_asio.hpp"
+#include "tmc/aw_yield.hpp"
 #include "tmc/ex_cpu.hpp"
 #include "tmc/fork_group.hpp"
 #include "tmc/task.hpp"
@@ -32,58 +41,60 @@ using asio::error_code;
 
 #include <cstdint>
 #include <cstdio>
-#include <string>
+#include <cstring>
 #include <utility>
 
 using asio::ip::tcp;
 
-const std::string static_response = R"(HTTP/1.1 200 OK
-Content-Length: 12
-Content-Type: text/plain; charset=utf-8
-
-Hello World!)";
-
-// not safe to accept rvalue reference
-// have to accept value so that it gets moved when the coro is constructed
-tmc::task<void> handler(auto Socket) {
-  char data[4096];
-  while (Socket.is_open()) {
-    auto d = asio::buffer(data);
-    auto [error, n] = co_await Socket.async_read_some(d, tmc::aw_asio);
-    if (error) {
-      Socket.close();
-      co_return;
-    }
-
-    auto d2 = asio::buffer(static_response);
-    auto [error2, n2] = co_await asio::async_write(Socket, d2, tmc::aw_asio);
-    if (error2) {
-      Socket.close();
-      co_return;
-    }
+// With --admit, each request is admitted on its own, so a keep-alive
+// connection only holds a running slot while one of its requests is being
+// handled. The request is queued on the executor once more between arrive()
+// and enter(), so its delay is that of the executor's queue at the time it
+// arrived. Under overload, a request that waited too long is turned away with
+// a 503. See util/admission.hpp.
+static tmc::task<http::reply>
+admitted_hello(admission::controller& Admit, const http::request& Req) {
+  auto ticket = Admit.arrive();
+  if (!ticket) {
+    co_return http::reply{503, {}, {}};
+  }
+  co_await tmc::yield();
+  if (!co_await ticket.enter()) {
+    co_return http::reply{503, {}, {}};
   }
-  Socket.shutdown(tcp::socket::shutdown_both);
-  Socket.close();
+  co_return http::hello_world(Req);
 }
 
-static tmc::task<void> accept(uint16_t Port) {
+static tmc::task<void> accept(uint16_t Port, bool Admit) {
   std::printf("serving on http://localhost:%d/\n", Port);
   asio::basic_socket_acceptor<asio::ip::tcp, asio::io_context::executor_type>
     acceptor(tmc::asio_executor(), {tcp::v4(), Port});
 
+  admission::controller admit;
   auto handlers = tmc::fork_group();
   while (true) {
     auto [error, sock] = co_await acceptor.async_accept(tmc::aw_asio);
     if (error) {
       break;
     }
-    handlers.fork(handler(std::move(sock)));
+    if (Admit) {
+      handlers.fork(http::serve_connection(
+        std::move(sock),
+        [&admit](const http::request& Req) { return admitted_hello(admit, Req); }
+      ));
+    } else {
+      handlers.fork(http::serve_connection(std::move(sock), http::hello_world));
+    }
   }
   // Wait for all running handlers to complete.
   co_await std::move(handlers);
 }
 
-int main() {
+int main(int argc, char* argv[]) {
+  bool admit = argc > 1 && 0 == strcmp(argv[1], "--admit");
+  if (admit) {
+    std::printf("admitting each request\n");
+  }
 
 #ifdef TMC_USE_HWLOC
   // A performance trick - pin the Asio thread to the first cache on the system.
@@ -104,7 +115,7 @@ int main() {
   tmc::asio_executor().init();
   tmc::cpu_executor().init();
 
-  return tmc::async_main([]() -> tmc::task<int> {
+  return tmc::async_main([](bool Admit) -> tmc::task<int> {
     auto acceptors = tmc::fork_group();
     // The default behavior is to submit each I/O call to ASIO, then
     // resume the coroutine back on tmc::cpu_executor(). Although there
@@ -113,19 +124,19 @@ int main() {
     // process any continuations inline. Additionally, it eliminates
     // any risk of accidentally blocking the I/O thread.
     // On my server, with the core-pinning behavior above (7 CPU threads +
-    // 1 Asio thread), this can serve 800k RPS.
-    acceptors.fork(accept(55550));
+    // 1 Asio thread), this can serve 800k RPS without --admit.
+    acceptors.fork(accept(55550, Admit));
 
     // This customization runs both the I/O calls and the continuations
     // inline on the single-threaded tmc::asio_executor(). This may
     // improve latency in low load scenarios, but will have worse
     // bandwidth under high load. Additionally, care must be taken to
     // manually offload CPU-bound work to the cpu executor.
-    // On my server, this can serve 340k RPS.
-    acceptors.fork(accept(55551), tmc::asio_executor());
+    // On my server, this can serve 340k RPS without --admit.
+    acceptors.fork(accept(55551, Admit), tmc::asio_executor());
 
     co_await std::move(acceptors);
 
     co_return 0;
-  }());
+  }(admit));
 }
@@ -2,10 +2,30 @@
 // Connections to http://localhost:55551/ will be served at lower priority
 // Connections on http://localhost:55550/ will be served at higher priority
 // Try load testing both sockets at the same time and observe
+//
+// Run with `--arena` to allocate each request's tree of tasks from its own
+// arena (util/arena_scope.hpp), which is released when the request completes.
+// This enables the frame pool; without it, the system allocator is used.
+//
+// Run with `--arena-compare [concurrency] [seconds]` to run skynet requests
+// in-process instead of serving HTTP, with the system allocator, the frame
+// pool, and an arena per request. Each allocator runs in its own process.
+// Reports the requests per second and the peak RSS of each. An arena keeps
+// every frame of its request until the request completes, so each concurrent
+// request holds a few hundred MB.
 #ifdef _WIN32
 #include <sdkddkver.h>
 #endif
 
+// Install the frame pool as the global allocator for this program, but leave
+// it disabled unless FRAME_POOL=on: the default server forwards every
+// allocation to the system allocator, as it would without the pool. `--arena`
+// needs the pool, so it runs this program again with the pool enabled.
+#define FRAME_POOL_DEFAULT_ENABLED 0
+#define FRAME_POOL_IMPL
+#include "../util/arena_scope.hpp"
+#include "../util/frame_pool.hpp"
+
 #include "tmc/asio/aw_asio.hpp"
 #include "tmc/asio/ex_asio.hpp"
 #include "tmc/ex_cpu.hpp"
@@ -36,17 +56,26 @@ using boost::system::error_code;
 using asio::error_code;
 #endif
 
+#include <atomic>
 #include <chrono>
 #include <cstddef>
 #include <cstdint>
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
 #include <ostream>
 #include <ranges>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <tuple>
 #include <utility>
 
+#ifdef __linux__
+#include <unistd.h>
+#endif
+
 // The proper sum of skynet (1M tasks) is 499999500000.
 // 32-bit platforms can't hold the full sum, but signed integer overflow is
 // defined so it will wrap to this number.
@@ -85,9 +114,18 @@ tmc::task<size_t> skynet_one(size_t BaseNum, size_t Depth) {
   }
   co_return count;
 }
+template <size_t DepthMax> tmc::task<size_t> skynet_count(bool UseArena) {
+  if (UseArena) {
+    co_return co_await frame_pool::arena_scope(skynet_one<DepthMax>(0, 0));
+  }
+  co_return co_await skynet_one<DepthMax>(0, 0);
+}
+
+static bool useArena = false;
+
 template <size_t DepthMax> tmc::task<std::string> skynet() {
   auto startTime = std::chrono::high_resolution_clock::now();
-  size_t count = co_await skynet_one<DepthMax>(0, 0);
+  size_t count = co_await skynet_count<DepthMax>(useArena);
   auto endTime = std::chrono::high_resolution_clock::now();
   std::ostringstream output;
   if (count != EXPECTED_RESULT) {
@@ -149,8 +187,159 @@ static tmc::task<void> accept(uint16_t Port) {
   co_await std::move(handlers);
 }
 
-int main() {
+// Returns the resident set size of this process, or 0 if it is unknown.
+static size_t current_rss_bytes() {
+#ifdef __linux__
+  std::ifstream statm("/proc/self/statm");
+  size_t pages = 0;
+  size_t residentPages = 0;
+  if (statm >> pages >> residentPages) {
+    return residentPages * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  }
+#endif
+  return 0;
+}
+
+// Samples the RSS on a separate thread, and keeps the highest value.
+class rss_sampler {
+  std::atomic<bool> done{false};
+  std::atomic<size_t> peak_bytes{0};
+  std::thread thread;
+
+public:
+  rss_sampler() {
+    thread = std::thread([this]() {
+      while (!done.load(std::memory_order_relaxed)) {
+        size_t rss = current_rss_bytes();
+        if (rss > peak_bytes.load(std::memory_order_relaxed)) {
+          peak_bytes.store(rss, std::memory_order_relaxed);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      }
+    });
+  }
+
+  size_t stop() {
+    done.store(true, std::memory_order_relaxed);
+    thread.join();
+    return peak_bytes.load(std::memory_order_relaxed);
+  }
+};
+
+template <size_t DepthMax>
+tmc::task<void> request_loop(
+  bool UseArena, std::chrono::steady_clock::time_point End,
+  std::atomic<size_t>& Count
+) {
+  while (std::chrono::steady_clock::now() < End) {
+    size_t count = co_await skynet_count<DepthMax>(UseArena);
+    if (count != EXPECTED_RESULT) {
+      std::printf("got wrong result: %zu\n", count);
+    }
+    Count.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+struct alloc_mode {
+  const char* arg;
+  const char* name;
+  bool use_pool;
+  bool use_arena;
+};
+
+static constexpr alloc_mode ALLOC_MODES[] = {
+  {"system", "system allocator", false, false},
+  {"pool", "frame pool\t", true, false},
+  {"arena", "arena per request", true, true},
+};
+
+// Runs Concurrency request loops for Seconds with the allocator that this
+// process was started with, and prints a row of the table.
+template <size_t DepthMax>
+tmc::task<void> measure_mode(alloc_mode Mode, size_t Concurrency, size_t Seconds) {
+  rss_sampler sampler;
+  std::atomic<size_t> count{0};
+  auto startTime = std::chrono::steady_clock::now();
+  auto endTime = startTime + std::chrono::seconds(Seconds);
+  auto loops = tmc::fork_group();
+  for (size_t i = 0; i < Concurrency; ++i) {
+    loops.fork(request_loop<DepthMax>(Mode.use_arena, endTime, count));
+  }
+  co_await std::move(loops);
+  auto elapsed = std::chrono::steady_clock::now() - startTime;
+  size_t peak = sampler.stop();
+  double rps = static_cast<double>(count.load()) /
+               std::chrono::duration<double>(elapsed).count();
+  std::printf(
+    "| %s\t| %.1f\t\t| %.1f\t\t| %.1f\t\t|\n", Mode.name, rps,
+    static_cast<double>(peak) / (1024.0 * 1024.0),
+    static_cast<double>(current_rss_bytes()) / (1024.0 * 1024.0)
+  );
+}
+
+// Runs this program with `--arena-run` in a new process for each allocator,
+// so that the RSS of one doesn't carry over to the next.
+static int compare_arena(char* Program, size_t Concurrency, size_t Seconds) {
+  std::printf(
+    "Comparing allocators: %zu concurrent skynet requests for %zu s each\n",
+    Concurrency, Seconds
+  );
+  std::printf("| allocator\t\t| requests/sec\t| peak RSS MiB\t| RSS after MiB\t|\n");
+  std::printf(
+    "| -------------------- | ------------- | ------------- | ------------- |\n"
+  );
+  std::string concurrency = std::to_string(Concurrency);
+  std::string seconds = std::to_string(Seconds);
+  char arenaRun[] = "--arena-run";
+  for (const alloc_mode& m : ALLOC_MODES) {
+    std::string arg = m.arg;
+    char* args[] = {
+      Program, arenaRun, arg.data(), concurrency.data(), seconds.data(), nullptr
+    };
+    if (frame_pool::run_program(m.use_pool, args) != 0) {
+      std::printf("failed to run %s\n", Program);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+int main(int argc, char* argv[]) {
+  if (argc > 1 && 0 == strcmp(argv[1], "--arena-compare")) {
+    size_t concurrency = argc > 2 ? static_cast<size_t>(atoi(argv[2])) : 2;
+    size_t seconds = argc > 3 ? static_cast<size_t>(atoi(argv[3])) : 5;
+    return compare_arena(argv[0], concurrency, seconds);
+  }
+  if (argc > 1 && 0 == strcmp(argv[1], "--arena") && !frame_pool::is_enabled()) {
+    // Arenas are only used while the pool is enabled, which is fixed when the
+    // process starts.
+    int status = frame_pool::run_program(true, argv);
+    if (status < 0) {
+      std::printf("failed to run %s\n", argv[0]);
+    }
+    return status;
+  }
   tmc::cpu_executor().set_priority_count(2).init();
+  if (argc > 4 && 0 == strcmp(argv[1], "--arena-run")) {
+    alloc_mode mode = ALLOC_MODES[0];
+    for (const alloc_mode& m : ALLOC_MODES) {
+      if (0 == strcmp(argv[2], m.arg)) {
+        mode = m;
+      }
+    }
+    size_t concurrency = static_cast<size_t>(atoi(argv[3]));
+    size_t seconds = static_cast<size_t>(atoi(argv[4]));
+    return tmc::async_main(
+      [](alloc_mode Mode, size_t Concurrency, size_t Seconds) -> tmc::task<int> {
+        co_await measure_mode<6>(Mode, Concurrency, Seconds);
+        co_return 0;
+      }(mode, concurrency, seconds)
+    );
+  }
+  useArena = argc > 1 && 0 == strcmp(argv[1], "--arena");
+  if (useArena) {
+    std::printf("allocating each request from an arena\n");
+  }
   tmc::asio_executor().init();
   return tmc::async_main([]() -> tmc::task<int> {
     auto acceptors = tmc::fork_group();
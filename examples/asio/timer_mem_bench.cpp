@@ -10,10 +10,17 @@
 
 // So most of the overhead is coming from the asio timer itself.
 // Perhaps someday I can write a smaller timer.
+
+// The "wheel" mode runs the same wait_on_timers benchmark using the timer
+// wheel in util/timer_wheel.hpp instead. Each mode also reports the peak
+// RSS of the process, and then measures wakeup jitter: how late each of
+// JITTER_COUNT timers fires, relative to its deadline.
 #ifdef _WIN32
 #include <sdkddkver.h>
 #endif
 
+#include "../util/timer_wheel.hpp"
+
 #include "tmc/asio/aw_asio.hpp"
 #include "tmc/asio/ex_asio.hpp"
 #include "tmc/ex_cpu.hpp"
@@ -28,13 +35,22 @@ namespace asio = boost::asio;
 #include <asio/steady_timer.hpp>
 #endif
 
+#include <algorithm>
 #include <chrono>
 #include <cstddef>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <ranges>
 #include <vector>
 
+#ifdef __linux__
+#include <fstream>
+#include <string>
+#endif
+
+static constexpr size_t JITTER_COUNT = 10000;
+
 static asio::steady_timer sleep_timer(ptrdiff_t seconds) {
   return asio::steady_timer{
     tmc::asio_executor(), std::chrono::seconds(seconds)
@@ -69,20 +85,100 @@ static tmc::task<int> wait_on_timers(size_t Count) {
   co_return 0;
 }
 
+static tmc::task<int> wait_on_wheel_timers(size_t Count) {
+  std::vector<timer_wheel::timer> timers;
+  timers.reserve(Count);
+  for (size_t i = 0; i < Count; ++i) {
+    timers.emplace_back(std::chrono::seconds(10));
+  }
+  co_await tmc::spawn_many(
+    std::ranges::views::transform(timers, [](timer_wheel::timer& timer) -> auto {
+      return timer.wait();
+    })
+  );
+  co_return 0;
+}
+
+// Returns the peak resident set size of this process, in KiB, or 0 if unknown.
+static size_t peak_rss_kib() {
+#ifdef __linux__
+  std::ifstream status("/proc/self/status");
+  std::string line;
+  while (std::getline(status, line)) {
+    if (line.rfind("VmHWM:", 0) == 0) {
+      return std::strtoull(line.c_str() + 6, nullptr, 10);
+    }
+  }
+#endif
+  return 0;
+}
+
+// Each task sleeps until its deadline and records how late it woke up.
+static tmc::task<void> measure_lateness(
+  bool UseWheel, std::chrono::steady_clock::time_point Deadline, size_t& LateUs
+) {
+  if (UseWheel) {
+    co_await timer_wheel::sleep_until(Deadline);
+  } else {
+    co_await asio::steady_timer{tmc::asio_executor(), Deadline}.async_wait(
+      tmc::aw_asio
+    );
+  }
+  auto late = std::chrono::steady_clock::now() - Deadline;
+  LateUs = static_cast<size_t>(
+    std::chrono::duration_cast<std::chrono::microseconds>(late).count()
+  );
+}
+
+static tmc::task<void> measure_jitter(bool UseWheel) {
+  // Spread deadlines evenly over 10ms - 1010ms from now.
+  auto start = std::chrono::steady_clock::now() + std::chrono::milliseconds(10);
+  std::vector<size_t> lateUs(JITTER_COUNT);
+  std::vector<tmc::task<void>> tasks;
+  tasks.reserve(JITTER_COUNT);
+  for (size_t i = 0; i < JITTER_COUNT; ++i) {
+    auto deadline = start + std::chrono::microseconds(i * 1000000 / JITTER_COUNT);
+    tasks.emplace_back(measure_lateness(UseWheel, deadline, lateUs[i]));
+  }
+  co_await tmc::spawn_many(tasks);
+
+  std::sort(lateUs.begin(), lateUs.end());
+  std::printf(
+    "wakeup lateness over %zu timers: p50 %zu us | p99 %zu us | max %zu us\n",
+    JITTER_COUNT, lateUs[JITTER_COUNT / 2], lateUs[JITTER_COUNT * 99 / 100],
+    lateUs[JITTER_COUNT - 1]
+  );
+}
+
 int main([[maybe_unused]] int argc, [[maybe_unused]] char* argv[]) {
+  bool useWheel = argc > 2 && std::strcmp(argv[2], "wheel") == 0;
 #ifndef NDEBUG
   // Hardcode the size in debug mode so we don't have to fuss around with input
   // arguments in the debug config.
   size_t taskCount = 30;
 #else
-  if (argc != 2) {
-    printf("Usage: asio_timer_mem_bench <number of tasks>\n");
+  if (argc < 2 || argc > 3 ||
+      (argc == 3 && !useWheel && std::strcmp(argv[2], "asio") != 0)) {
+    printf("Usage: asio_timer_mem_bench <number of tasks> [asio|wheel]\n");
     exit(0);
   }
 
   size_t taskCount = static_cast<size_t>(atoi(argv[1]));
 #endif
   tmc::asio_executor().init();
-  return tmc::async_main(wait_on_timers(taskCount));
-  // return tmc::async_main(wait_on_tasks(taskCount));
+  return tmc::async_main([](size_t Count, bool UseWheel) -> tmc::task<int> {
+    int result;
+    if (UseWheel) {
+      result = co_await wait_on_wheel_timers(Count);
+    } else {
+      result = co_await wait_on_timers(Count);
+      // result = co_await wait_on_tasks(Count);
+    }
+    std::printf(
+      "%s: %zu timers | peak RSS %zu KiB\n", UseWheel ? "wheel" : "asio", Count,
+      peak_rss_kib()
+    );
+    co_await measure_jitter(UseWheel);
+    co_return result;
+  }(taskCount, useWheel));
 }
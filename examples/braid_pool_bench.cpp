@@ -0,0 +1,192 @@
+// Per-key serialization with braid_pool (util/braid_pool.hpp) under skewed
+// key distributions.
+//
+// KEY_COUNT accounts each have a balance. TASKS_PER_THREAD tasks per thread
+// each apply a number of updates to accounts chosen from a Zipfian
+// distribution: the probability of the account of rank k is proportional to
+// 1 / k^s. s = 0 is uniform; at s = 1.2, the hottest account receives about
+// a fifth of the updates. Each update enters the account's braid, adds to its
+// balance, and exits.
+//
+// For each pool size and skew, reports:
+// - ops/sec: updates completed per second
+// - hot %: the share of updates that went through the busiest braid. This is
+//   the lower bound of the fraction of the run that must be serialized.
+// - p99 enter us: the 99th percentile time to enter a braid, which grows
+//   with contention.
+//
+// A pool of size 1 serializes every update, like a single global lock.
+//
+// Usage: braid_pool_bench [ops per task]
+
+#include "tmc/all_headers.hpp"
+#include "util/braid_pool.hpp"
+#include "util/latency_histogram.hpp"
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+static constexpr size_t KEY_COUNT = 1000000;
+static constexpr size_t TASKS_PER_THREAD = 16;
+// Amount of simulated work in each update.
+static constexpr size_t WORK_ITERS = 50;
+
+static constexpr std::array<double, 3> SKEWS{0.0, 0.99, 1.2};
+
+// Generates keys in [0, Count) with a Zipfian distribution. The rank of a key
+// is scrambled, so the hottest keys are not adjacent.
+class zipf_keys {
+  std::vector<double> cdf;
+  uint64_t state;
+
+public:
+  zipf_keys(size_t Count, double Skew, uint64_t Seed) : cdf(Count), state(Seed | 1) {
+    double sum = 0;
+    for (size_t k = 0; k < Count; ++k) {
+      sum += 1.0 / std::pow(static_cast<double>(k + 1), Skew);
+      cdf[k] = sum;
+    }
+    for (auto& c : cdf) {
+      c /= sum;
+    }
+  }
+
+  uint64_t next() {
+    // xorshift64
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    double u = static_cast<double>(state >> 11) * 0x1.0p-53;
+    size_t rank = static_cast<size_t>(
+      std::lower_bound(cdf.begin(), cdf.end(), u) - cdf.begin()
+    );
+    rank = std::min(rank, cdf.size() - 1);
+    return (rank * 0x9E3779B97F4A7C15ULL) % cdf.size();
+  }
+};
+
+static uint64_t spin(uint64_t X) {
+  for (size_t i = 0; i < WORK_ITERS; ++i) {
+    X = X * 6364136223846793005ULL + 1442695040888963407ULL;
+  }
+  return X;
+}
+
+template <size_t N> struct bench_state {
+  braid_pool<N> pool;
+  std::unique_ptr<uint64_t[]> balances{new uint64_t[KEY_COUNT]{}};
+  // The number of updates that map onto each braid.
+  std::array<size_t, N> braidOps{};
+};
+
+template <size_t N>
+static tmc::task<latency_histogram>
+updater(bench_state<N>& State, const std::vector<uint64_t>& Keys) {
+  latency_histogram enterWait;
+  for (uint64_t key : Keys) {
+    auto start = std::chrono::steady_clock::now();
+    auto scope = co_await State.pool.enter(key);
+    enterWait.record(static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start
+      )
+        .count()
+    ));
+    State.balances[key] = spin(State.balances[key] + 1);
+    co_await scope.exit();
+  }
+  co_return enterWait;
+}
+
+template <size_t N>
+static tmc::task<void> run_pool(const std::vector<std::vector<uint64_t>>& Keys) {
+  bench_state<N> state;
+  for (auto& keys : Keys) {
+    for (uint64_t key : keys) {
+      ++state.braidOps[state.pool.index_of(key)];
+    }
+  }
+  std::vector<tmc::task<latency_histogram>> tasks;
+  for (auto& keys : Keys) {
+    tasks.push_back(updater(state, keys));
+  }
+  size_t totalOps = 0;
+  for (auto& keys : Keys) {
+    totalOps += keys.size();
+  }
+
+  auto start = std::chrono::high_resolution_clock::now();
+  std::vector<latency_histogram> waits =
+    co_await tmc::spawn_many(tasks.begin(), tasks.size());
+  auto end = std::chrono::high_resolution_clock::now();
+
+  latency_histogram merged;
+  for (auto& w : waits) {
+    merged.merge(w);
+  }
+  size_t hottest = 0;
+  for (size_t ops : state.braidOps) {
+    hottest = std::max(hottest, ops);
+  }
+  double sec = std::chrono::duration<double>(end - start).count();
+  std::printf(
+    " %.0f\t| %.1f\t\t| %.1f\t\t|", static_cast<double>(totalOps) / sec,
+    100.0 * static_cast<double>(hottest) / static_cast<double>(totalOps),
+    static_cast<double>(merged.percentile(99.0)) / 1000.0
+  );
+}
+
+int main(int argc, char* argv[]) {
+  size_t opsPerTask = 10000;
+  if (argc > 1) {
+    opsPerTask = static_cast<size_t>(std::atoll(argv[1]));
+  }
+  tmc::cpu_executor().init();
+  size_t taskCount = TASKS_PER_THREAD * tmc::cpu_executor().thread_count();
+  std::printf(
+    "braid_pool_bench: %zu keys | %zu tasks | %zu ops per task\n", KEY_COUNT,
+    taskCount, opsPerTask
+  );
+  std::printf("| skew | pool\t| ops/sec\t| hot %%\t\t| p99 enter us\t|\n");
+  std::printf(
+    "| ---- | ------------- | ------------- | ------------- | ------------- |\n"
+  );
+
+  tmc::post_waitable(
+    tmc::cpu_executor(),
+    [](size_t TaskCount, size_t OpsPerTask) -> tmc::task<void> {
+      for (double skew : SKEWS) {
+        zipf_keys gen(KEY_COUNT, skew, 12345);
+        std::vector<std::vector<uint64_t>> keys(TaskCount);
+        for (auto& k : keys) {
+          k.resize(OpsPerTask);
+          for (auto& key : k) {
+            key = gen.next();
+          }
+        }
+        std::printf("| %.2f | 1\t\t|", skew);
+        co_await run_pool<1>(keys);
+        std::printf("\n| %.2f | 16\t\t|", skew);
+        co_await run_pool<16>(keys);
+        std::printf("\n| %.2f | 64\t\t|", skew);
+        co_await run_pool<64>(keys);
+        std::printf("\n| %.2f | 256\t\t|", skew);
+        co_await run_pool<256>(keys);
+        std::printf("\n| %.2f | 1024\t\t|", skew);
+        co_await run_pool<1024>(keys);
+        std::printf("\n");
+      }
+    }(taskCount, opsPerTask),
+    0
+  )
+    .wait();
+  tmc::cpu_executor().teardown();
+}
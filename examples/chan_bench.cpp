@@ -1,12 +1,36 @@
 // A benchmark for the throughput of tmc::chan.
 // Sweeps from 1 to 10 producers and 1 to 10 consumers.
+//
+// Usage: chan_bench [mode] [capacity]
+// mode is one of:
+// - unbounded: tmc::chan with no backpressure
+// - semaphore: tmc::chan with a tmc::semaphore that limits the number of
+//   elements in the channel to `capacity`, as pipeline.hpp used to do
+// - bounded: bounded_channel (util/bounded_channel.hpp) with `capacity`
+// - pull_bulk: tmc::chan with no backpressure; consumers take a batch of up
+//   to 64 elements per co_await with pull_bulk (util/pull_bulk.hpp)
+// - all (default): each of the above in turn
+// If capacity is 0 (the default), it is 2x the number of consumers, which
+// matches the per-stage capacity used by pipeline.hpp.
 
 #include "tmc/all_headers.hpp"
+#include "util/bounded_channel.hpp"
+#include "util/pull_bulk.hpp"
+#include "util/scheduler_stats.hpp"
 
+#include <algorithm>
+#include <array>
+#include <bit>
 #include <cassert>
 #include <chrono>
+#include <cstddef>
 #include <cstdio>
+#include <cstdlib>
+#include <numeric>
+#include <span>
 #include <string>
+#include <string_view>
+#include <type_traits>
 #include <utility>
 #include <vector>
 
@@ -18,11 +42,27 @@ struct chan_config : tmc::chan_default_config {
   // static inline constexpr bool EmbedFirstBlock = false;
 };
 using token = tmc::chan_tok<size_t, chan_config>;
+using bounded_token = bounded_chan_tok<size_t>;
 
-static tmc::task<void> producer(token chan, size_t count, size_t base) {
+// Configure with -DTMC_ENABLE_STATS=ON to print scheduler stats. A high
+// voluntary switch count and off-CPU time indicates that consumers are waiting
+// on an empty queue; a high migration count indicates that work is being spread
+// by stealing.
+static sched_stats::collector stats;
+
+// If Sem is not null, each push first acquires Sem, and each pull releases it.
+template <typename Token>
+static tmc::task<void> producer(
+  Token chan, tmc::semaphore* sem, size_t count, size_t base,
+  sched_stats::origin origin = sched_stats::task_origin()
+) {
+  sched_stats::record_task(origin);
   // It would be more efficient to call `chan.post_bulk()`,
   // but for this benchmark we test pushing 1 at a time.
   for (size_t i = 0; i < count; ++i) {
+    if (sem != nullptr) {
+      co_await *sem;
+    }
     [[maybe_unused]] bool ok = co_await chan.push(base + i);
     assert(ok);
   }
@@ -33,12 +73,20 @@ struct result {
   size_t sum;
 };
 
-static tmc::task<result> consumer(token chan) {
+template <typename Token>
+static tmc::task<result> consumer(
+  Token chan, tmc::semaphore* sem,
+  sched_stats::origin origin = sched_stats::task_origin()
+) {
+  sched_stats::record_task(origin);
   size_t count = 0;
   size_t sum = 0;
 
   // pull() implementation
   while (auto data = co_await chan.pull()) {
+    if (sem != nullptr) {
+      sem->release();
+    }
     ++count;
     sum += *data;
   }
@@ -66,6 +114,20 @@ static tmc::task<result> consumer(token chan) {
   // }
 }
 
+template <typename Token>
+static tmc::task<result>
+consumer_bulk(Token chan, sched_stats::origin origin = sched_stats::task_origin()) {
+  sched_stats::record_task(origin);
+  size_t count = 0;
+  size_t sum = 0;
+  std::array<size_t, 64> buf;
+  while (size_t n = co_await pull_bulk(chan, std::span{buf})) {
+    count += n;
+    sum = std::accumulate(buf.begin(), buf.begin() + static_cast<ptrdiff_t>(n), sum);
+  }
+  co_return result{count, sum};
+}
+
 static std::string formatWithCommas(size_t n) {
   auto s = std::to_string(n);
   int i = static_cast<int>(s.length()) - 3;
@@ -76,80 +138,148 @@ static std::string formatWithCommas(size_t n) {
   return s;
 }
 
-int main() {
+enum class mode { UNBOUNDED, SEMAPHORE, BOUNDED, PULL_BULK };
+
+template <typename Token>
+static tmc::task<void> run_one(
+  Token chan, tmc::semaphore* sem, bool bulk, size_t prodCount, size_t consCount,
+  std::string label
+) {
+  size_t per_task = NELEMS / prodCount;
+  size_t rem = NELEMS % prodCount;
+  std::vector<tmc::task<void>> prod(prodCount);
+  size_t base = 0;
+  for (size_t i = 0; i < prodCount; ++i) {
+    size_t count = i < rem ? per_task + 1 : per_task;
+    prod[i] = producer(chan, sem, count, base);
+    base += count;
+  }
+  std::vector<tmc::task<result>> cons(consCount);
+  for (size_t i = 0; i < consCount; ++i) {
+    cons[i] = bulk ? consumer_bulk(chan) : consumer(chan, sem);
+  }
+  auto startStats = stats.stats();
+  auto startTime = std::chrono::high_resolution_clock::now();
+  auto c = tmc::spawn_many(cons).fork();
+  co_await tmc::spawn_many(prod);
+
+  chan.close();
+  if constexpr (std::is_same_v<Token, token>) {
+    // The call to close() is not necessary, but is included here for
+    // exposition.
+    co_await chan.drain();
+  }
+  auto consResults = co_await std::move(c);
+
+  auto endTime = std::chrono::high_resolution_clock::now();
+
+  size_t count = 0;
+  size_t sum = 0;
+  for (size_t i = 0; i < consResults.size(); ++i) {
+    count += consResults[i].count;
+    sum += consResults[i].sum;
+  }
+  if (count != NELEMS) {
+    std::printf(
+      "FAIL: Expected %zu elements but consumed %zu elements\n",
+      static_cast<size_t>(NELEMS), count
+    );
+  }
+
+  size_t expectedSum = 0;
+  for (size_t i = 0; i < NELEMS; ++i) {
+    expectedSum += i;
+  }
+  if (sum != expectedSum) {
+    std::printf("FAIL: Expected %zu sum but got %zu sum\n", expectedSum, sum);
+  }
+
+  size_t execDur = static_cast<size_t>(
+    std::chrono::duration_cast<std::chrono::microseconds>(endTime - startTime)
+      .count()
+  );
+
+  double durMs = static_cast<double>(execDur) / 1000.0;
+  size_t elementsPerSec =
+    static_cast<size_t>(static_cast<double>(NELEMS) * 1000.0 / durMs);
+  std::printf(
+    "%s\t%zu prod\t%zu cons\t %.2f ms\t%s elements/sec\n", label.c_str(), prodCount,
+    consCount, durMs, formatWithCommas(elementsPerSec).c_str()
+  );
+#ifdef TMC_ENABLE_STATS
+  (stats.stats() - startStats).print_summary("  scheduler");
+#endif
+}
+
+int main(int argc, char* argv[]) {
+  std::vector<mode> modes;
+  std::string_view modeArg = argc > 1 ? argv[1] : "all";
+  if (modeArg == "unbounded" || modeArg == "all") {
+    modes.push_back(mode::UNBOUNDED);
+  }
+  if (modeArg == "semaphore" || modeArg == "all") {
+    modes.push_back(mode::SEMAPHORE);
+  }
+  if (modeArg == "bounded" || modeArg == "all") {
+    modes.push_back(mode::BOUNDED);
+  }
+  if (modeArg == "pull_bulk" || modeArg == "all") {
+    modes.push_back(mode::PULL_BULK);
+  }
+  if (modes.empty()) {
+    std::printf(
+      "usage: chan_bench [unbounded|semaphore|bounded|pull_bulk|all] [capacity]\n"
+    );
+    return 1;
+  }
+  size_t capacityArg = argc > 2 ? static_cast<size_t>(std::atoi(argv[2])) : 0;
+
+  stats.install(tmc::cpu_executor());
   tmc::cpu_executor().init();
   std::printf(
     "chan_bench: %zu threads | %s elements\n",
     tmc::cpu_executor().thread_count(), formatWithCommas(NELEMS).c_str()
   );
-  return tmc::async_main([]() -> tmc::task<int> {
+  auto run = [](std::vector<mode> Modes, size_t CapacityArg) -> tmc::task<int> {
     auto overallStart = std::chrono::high_resolution_clock::now();
 
-    for (size_t consCount = 1; consCount <= 10; ++consCount) {
-      for (size_t prodCount = 1; prodCount <= 10; ++prodCount) {
-        auto chan = tmc::make_channel<size_t, chan_config>();
-        size_t per_task = NELEMS / prodCount;
-        size_t rem = NELEMS % prodCount;
-        std::vector<tmc::task<void>> prod(prodCount);
-        size_t base = 0;
-        for (size_t i = 0; i < prodCount; ++i) {
-          size_t count = i < rem ? per_task + 1 : per_task;
-          prod[i] = producer(chan, count, base);
-          base += count;
-        }
-        std::vector<tmc::task<result>> cons(consCount);
-        for (size_t i = 0; i < consCount; ++i) {
-          cons[i] = consumer(chan);
-        }
-        auto startTime = std::chrono::high_resolution_clock::now();
-        auto c = tmc::spawn_many(cons).fork();
-        co_await tmc::spawn_many(prod);
-
-        // The call to close() is not necessary, but is included here for
-        // exposition.
-        chan.close();
-        co_await chan.drain();
-        auto consResults = co_await std::move(c);
-
-        auto endTime = std::chrono::high_resolution_clock::now();
-
-        size_t count = 0;
-        size_t sum = 0;
-        for (size_t i = 0; i < consResults.size(); ++i) {
-          count += consResults[i].count;
-          sum += consResults[i].sum;
-        }
-        if (count != NELEMS) {
-          std::printf(
-            "FAIL: Expected %zu elements but consumed %zu elements\n",
-            static_cast<size_t>(NELEMS), count
-          );
-        }
-
-        size_t expectedSum = 0;
-        for (size_t i = 0; i < NELEMS; ++i) {
-          expectedSum += i;
+    for (mode m : Modes) {
+      for (size_t consCount = 1; consCount <= 10; ++consCount) {
+        for (size_t prodCount = 1; prodCount <= 10; ++prodCount) {
+          // bounded_channel rounds its capacity up to a power of 2. Use the
+          // same capacity for the semaphore so that the results are
+          // comparable.
+          size_t capacity = CapacityArg != 0 ? CapacityArg : 2 * consCount;
+          capacity = std::bit_ceil(std::max<size_t>(2, capacity));
+          switch (m) {
+          case mode::UNBOUNDED:
+            co_await run_one(
+              tmc::make_channel<size_t, chan_config>(), nullptr, false, prodCount,
+              consCount, "unbounded"
+            );
+            break;
+          case mode::SEMAPHORE: {
+            tmc::semaphore sem(capacity);
+            co_await run_one(
+              tmc::make_channel<size_t, chan_config>(), &sem, false, prodCount,
+              consCount, "semaphore(" + std::to_string(capacity) + ")"
+            );
+            break;
+          }
+          case mode::BOUNDED:
+            co_await run_one(
+              make_bounded_channel<size_t>(capacity), nullptr, false, prodCount,
+              consCount, "bounded(" + std::to_string(capacity) + ")"
+            );
+            break;
+          case mode::PULL_BULK:
+            co_await run_one(
+              tmc::make_channel<size_t, chan_config>(), nullptr, true, prodCount,
+              consCount, "pull_bulk"
+            );
+            break;
+          }
         }
-        if (sum != expectedSum) {
-          std::printf(
-            "FAIL: Expected %zu sum but got %zu sum\n", expectedSum, sum
-          );
-        }
-
-        size_t execDur = static_cast<size_t>(
-          std::chrono::duration_cast<std::chrono::microseconds>(
-            endTime - startTime
-          )
-            .count()
-        );
-
-        double durMs = static_cast<double>(execDur) / 1000.0;
-        size_t elementsPerSec =
-          static_cast<size_t>(static_cast<double>(NELEMS) * 1000.0 / durMs);
-        std::printf(
-          "%zu prod\t%zu cons\t %.2f ms\t%s elements/sec\n", prodCount,
-          consCount, durMs, formatWithCommas(elementsPerSec).c_str()
-        );
       }
     }
 
@@ -162,5 +292,6 @@ int main() {
     double overallSec = static_cast<double>(overallDur) / 1000000.0;
     std::printf("overall: %.2f sec\n", overallSec);
     co_return 0;
-  }());
+  };
+  return tmc::async_main(run(std::move(modes), capacityArg));
 }
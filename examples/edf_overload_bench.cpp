@@ -0,0 +1,207 @@
+// Compares earliest-deadline-first scheduling (util/ex_edf.hpp) against a
+// 16-priority tmc::ex_cpu, for requests with deadlines under overload.
+//
+// The main thread generates requests in an open loop, at LOAD times the rate
+// that the executor's threads can complete them. Each request spins for
+// about WORK_US and belongs to one of 3 classes:
+// - tight: 20% of requests, must complete within 1ms of arrival.
+// - medium: 30%, within 5ms.
+// - loose: 50%, within 20ms.
+// The ex_cpu has 16 priorities, as in tests/test_prio.cpp, and each class is
+// assigned a fixed priority by its budget (tight 0, medium 5, loose 10). The
+// ex_edf is posted each request's deadline. The modes are:
+// - prio16: ex_cpu.
+// - edf run: ex_edf with miss_policy::RUN (plain EDF).
+// - edf demote: ex_edf with miss_policy::DEMOTE.
+// - "+ shed": requests that start after their deadline skip their work.
+//
+// For each load, reports the percentage of each class that met its deadline,
+// and the goodput: requests that met their deadline per second.
+//
+// Usage: edf_overload_bench [requests per run]
+
+#include "tmc/all_headers.hpp"
+#include "util/ex_edf.hpp"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+static constexpr size_t WORK_US = 20;
+static constexpr auto BATCH_INTERVAL = std::chrono::microseconds(100);
+static constexpr std::array<double, 3> LOADS{0.8, 1.2, 2.0};
+
+struct sla_class {
+  const char* name;
+  std::chrono::microseconds budget;
+  size_t priority;
+  // Out of 10 requests
+  size_t share;
+};
+
+static constexpr std::array<sla_class, 3> CLASSES{{
+  {"tight", std::chrono::microseconds(1000), 0, 2},
+  {"medium", std::chrono::microseconds(5000), 5, 3},
+  {"loose", std::chrono::microseconds(20000), 10, 5},
+}};
+
+static size_t class_of(size_t Index) {
+  size_t slot = Index % 10;
+  for (size_t c = 0; c < CLASSES.size(); ++c) {
+    if (slot < CLASSES[c].share) {
+      return c;
+    }
+    slot -= CLASSES[c].share;
+  }
+  return CLASSES.size() - 1;
+}
+
+struct class_stats {
+  std::atomic<size_t> met{0};
+  std::atomic<size_t> missed{0};
+  std::atomic<size_t> shed{0};
+};
+
+struct run_state {
+  std::array<class_stats, CLASSES.size()> stats;
+  std::atomic<size_t> done{0};
+  std::atomic<uint64_t> sink{0};
+  size_t spinIters = 0;
+};
+
+static uint64_t spin(uint64_t X, size_t Iters) {
+  for (size_t i = 0; i < Iters; ++i) {
+    X = X * 6364136223846793005ULL + 1442695040888963407ULL;
+  }
+  return X;
+}
+
+// The number of spin() iterations that take about WORK_US.
+static size_t calibrate(std::atomic<uint64_t>& Sink) {
+  static constexpr size_t ITERS = 1000000;
+  auto start = std::chrono::steady_clock::now();
+  Sink.fetch_add(spin(1, ITERS), std::memory_order_relaxed);
+  auto elapsed = std::chrono::steady_clock::now() - start;
+  double perIter = std::chrono::duration<double, std::micro>(elapsed).count() /
+                   static_cast<double>(ITERS);
+  return static_cast<size_t>(static_cast<double>(WORK_US) / perIter);
+}
+
+static tmc::task<void> request(
+  run_state& State, size_t Class, std::chrono::steady_clock::time_point Deadline,
+  bool Shed
+) {
+  auto& stats = State.stats[Class];
+  if (Shed && std::chrono::steady_clock::now() > Deadline) {
+    stats.shed.fetch_add(1, std::memory_order_relaxed);
+  } else {
+    State.sink.fetch_add(spin(Class, State.spinIters), std::memory_order_relaxed);
+    if (std::chrono::steady_clock::now() <= Deadline) {
+      stats.met.fetch_add(1, std::memory_order_relaxed);
+    } else {
+      stats.missed.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+  State.done.fetch_add(1, std::memory_order_release);
+  co_return;
+}
+
+template <typename Executor, typename PriorityFn>
+static void run_mode(
+  const char* Name, Executor& Ex, double Load, size_t RequestCount, bool Shed,
+  PriorityFn Priority
+) {
+  run_state state;
+  state.spinIters = calibrate(state.sink);
+  double perSec = Load * static_cast<double>(Ex.thread_count()) * 1000000.0 /
+                  static_cast<double>(WORK_US);
+  size_t perBatch = static_cast<size_t>(
+    perSec * std::chrono::duration<double>(BATCH_INTERVAL).count()
+  );
+  if (perBatch == 0) {
+    perBatch = 1;
+  }
+
+  auto start = std::chrono::steady_clock::now();
+  auto next = start;
+  size_t posted = 0;
+  while (posted < RequestCount) {
+    std::this_thread::sleep_until(next);
+    next += BATCH_INTERVAL;
+    auto now = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < perBatch && posted < RequestCount; ++i, ++posted) {
+      size_t c = class_of(posted);
+      auto deadline = now + CLASSES[c].budget;
+      tmc::post(Ex, request(state, c, deadline, Shed), Priority(c, deadline));
+    }
+  }
+  while (state.done.load(std::memory_order_acquire) != RequestCount) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  auto end = std::chrono::steady_clock::now();
+
+  size_t met = 0;
+  std::printf("| %.1f\t| %s\t|", Load, Name);
+  for (auto& s : state.stats) {
+    size_t m = s.met.load(std::memory_order_relaxed);
+    size_t total = m + s.missed.load(std::memory_order_relaxed) +
+                   s.shed.load(std::memory_order_relaxed);
+    met += m;
+    std::printf(
+      " %.1f\t\t|", 100.0 * static_cast<double>(m) / static_cast<double>(total)
+    );
+  }
+  double sec = std::chrono::duration<double>(end - start).count();
+  std::printf(" %.0f\t|\n", static_cast<double>(met) / sec);
+}
+
+int main(int argc, char* argv[]) {
+  size_t requestCount = 200000;
+  if (argc > 1) {
+    requestCount = static_cast<size_t>(std::atoll(argv[1]));
+  }
+  tmc::ex_cpu cpu;
+  cpu.set_priority_count(16).init();
+  edf::ex_edf edfRun;
+  edfRun.set_thread_count(cpu.thread_count())
+    .set_miss_policy(edf::miss_policy::RUN)
+    .init();
+  edf::ex_edf edfDemote;
+  edfDemote.set_thread_count(cpu.thread_count())
+    .set_miss_policy(edf::miss_policy::DEMOTE)
+    .init();
+
+  std::printf(
+    "edf_overload_bench: %zu requests | %zu us each | %zu threads\n", requestCount,
+    WORK_US, cpu.thread_count()
+  );
+  std::printf(
+    "| load\t| mode\t\t\t| tight met %%\t| medium met %%\t| loose met %%\t| "
+    "goodput/sec\t|\n"
+  );
+  std::printf(
+    "| ----- | --------------------- | ------------- | ------------- | "
+    "------------- | ------------- |\n"
+  );
+  auto byClass = [](size_t Class, std::chrono::steady_clock::time_point) {
+    return CLASSES[Class].priority;
+  };
+  auto byDeadline = [](size_t, std::chrono::steady_clock::time_point Deadline) {
+    return edf::deadline(Deadline);
+  };
+  for (double load : LOADS) {
+    run_mode("prio16\t\t", cpu, load, requestCount, false, byClass);
+    run_mode("prio16 + shed\t", cpu, load, requestCount, true, byClass);
+    run_mode("edf run\t\t", edfRun, load, requestCount, false, byDeadline);
+    run_mode("edf demote\t", edfDemote, load, requestCount, false, byDeadline);
+    run_mode("edf demote + shed", edfDemote, load, requestCount, true, byDeadline);
+  }
+  edfDemote.teardown();
+  edfRun.teardown();
+  cpu.teardown();
+}
@@ -2,10 +2,27 @@
 // serializing executors. Tasks are posted from tmc::cpu_executor() into the
 // single threaded executor, and then awaited. Sweeps from 1 to N producers,
 // where N is the number of cores on the machine.
+//
+// Configure with -DTMC_ENABLE_WAIT_HISTOGRAMS=ON to report the p50 / p99 time
+// (in ns) that each round trip spends suspended, measured with
+// util/wait_histograms.hpp, instead of tasks/sec.
+//
+// fc_braid is flat_combining::ex_braid (util/combining_braid.hpp), which runs
+// queued items inline on the posting thread in batches of up to 64.
+//
+// The mutex columns compare tmc::mutex with the fairness policies of
+// util/fair_sync.hpp: unfair, strict FIFO handoff, and bounded(8), which
+// hands off after 8 acquisitions have overtaken the oldest waiter. With wait
+// histograms enabled, each mutex column is followed by the longest time (in
+// us) that any single lock() was suspended. Otherwise, that column is empty, so
+// that the tasks/sec columns don't include the cost of reading the clock.
 
 #include "tmc/all_headers.hpp"
 #include "tmc/asio/ex_asio.hpp"
 #include "tmc/topology.hpp"
+#include "util/combining_braid.hpp"
+#include "util/fair_sync.hpp"
+#include "util/wait_histograms.hpp"
 
 #include <array>
 #include <chrono>
@@ -21,10 +38,12 @@ static tmc::task<void> consumer([[maybe_unused]] int i) {
 }
 
 template <typename Exec>
-static tmc::task<void> producer(Exec& ex, size_t count) {
+static tmc::task<void> producer(Exec& ex, size_t count, wait_stats::kind kind) {
   // Single task ping-pong latency
   for (size_t i = 0; i < count; ++i) {
-    co_await tmc::spawn(consumer(static_cast<int>(i))).run_on(ex);
+    co_await wait_stats::timed(
+      kind, tmc::spawn(consumer(static_cast<int>(i))).run_on(ex)
+    );
   }
 
   // // Single task post, bulk await
@@ -37,10 +56,12 @@ static tmc::task<void> producer(Exec& ex, size_t count) {
 
 // A mutex is faster than the serializing executors - perhaps because mutex is
 // LIFO/unfair and the others are FIFO/fair
-static tmc::task<void> mutex_producer(tmc::mutex& mut, size_t count) {
+template <typename Mutex>
+static tmc::task<void> mutex_producer(Mutex& mut, size_t count) {
   // Single task ping-pong latency
   for (size_t i = 0; i < count; ++i) {
-    auto scope = co_await mut.lock_scope();
+    auto scope =
+      co_await wait_stats::timed(wait_stats::kind::MUTEX, mut.lock_scope());
     co_await consumer(static_cast<int>(i));
   }
 }
@@ -56,7 +77,9 @@ static std::string formatWithCommas(size_t n) {
 }
 
 template <typename Exec, bool Mutex = false>
-tmc::task<size_t> run_bench(Exec& ex, size_t prodCount) {
+tmc::task<size_t> run_bench(
+  Exec& ex, size_t prodCount, wait_stats::kind kind = wait_stats::kind::EXECUTOR
+) {
   size_t per_task = NELEMS / prodCount;
   size_t rem = NELEMS % prodCount;
   std::vector<tmc::task<void>> prod(prodCount);
@@ -65,10 +88,11 @@ tmc::task<size_t> run_bench(Exec& ex, size_t prodCount) {
     if constexpr (Mutex) {
       prod[i] = mutex_producer(ex, count);
     } else {
-      prod[i] = producer(ex, count);
+      prod[i] = producer(ex, count, kind);
     }
   }
 
+  wait_stats::reset();
   auto startTime = std::chrono::high_resolution_clock::now();
   co_await tmc::spawn_many(prod);
 
@@ -81,7 +105,27 @@ tmc::task<size_t> run_bench(Exec& ex, size_t prodCount) {
   size_t elementsPerSec = static_cast<size_t>(
     static_cast<double>(NELEMS) * 1000.0 / static_cast<double>(durMs)
   );
-  std::printf(" %s\t|", formatWithCommas(elementsPerSec).c_str());
+  if constexpr (wait_stats::ENABLED) {
+    auto waits = wait_stats::merged(Mutex ? wait_stats::kind::MUTEX : kind);
+    std::printf(
+      " %llu / %llu\t|", static_cast<unsigned long long>(waits.percentile(50.0)),
+      static_cast<unsigned long long>(waits.percentile(99.0))
+    );
+  } else {
+    std::printf(" %s\t|", formatWithCommas(elementsPerSec).c_str());
+  }
+  if constexpr (Mutex) {
+    if constexpr (wait_stats::ENABLED) {
+      std::printf(
+        " %llu\t\t|",
+        static_cast<unsigned long long>(
+          wait_stats::merged(wait_stats::kind::MUTEX).max() / 1000
+        )
+      );
+    } else {
+      std::printf(" -\t\t|");
+    }
+  }
   co_return durMs;
 }
 
@@ -108,15 +152,19 @@ int main() {
       std::printf(
         "ex_st_roundtrip_bench: sweep 1 to %zu producers | %s elements | "
         "output "
-        "units: tasks/sec\n",
-        maxProducers, formatWithCommas(NELEMS).c_str()
+        "units: %s\n",
+        maxProducers, formatWithCommas(NELEMS).c_str(),
+        wait_stats::ENABLED ? "p50 / p99 ns suspended" : "tasks/sec"
       );
       std::printf(
-        "| prods  \t| ex_cpu(1)\t| ex_cpu_st\t| ex_braid\t| ex_asio\t| "
-        "tmc::mutex\t|"
+        "| prods  \t| ex_cpu(1)\t| ex_cpu_st\t| ex_braid\t| fc_braid\t| "
+        "ex_asio\t| tmc::mutex\t| max wait us\t| unfair\t| max wait us\t| "
+        "fifo\t\t| max wait us\t| bounded(8)\t| max wait us\t|"
       );
       std::printf(
         "\n| ------------- | ------------- | ------------- | ------------- | "
+        "------------- | ------------- | ------------- | ------------- | "
+        "------------- | ------------- | ------------- | ------------- | "
         "------------- | ------------- |"
       );
 
@@ -136,6 +184,8 @@ int main() {
 
       tmc::ex_braid exbr;
 
+      flat_combining::ex_braid exfc;
+
       tmc::ex_asio exasio;
 #ifdef TMC_USE_HWLOC
       exasio.add_partition(group0);
@@ -143,16 +193,24 @@ int main() {
       exasio.init();
 
       tmc::mutex mut;
+      fair_sync::mutex<fair_sync::unfair> unfairMut;
+      fair_sync::mutex<fair_sync::fifo> fifoMut;
+      fair_sync::mutex<fair_sync::bounded<8>> boundedMut;
 
-      std::array<size_t, 5> totals{};
+      std::array<size_t, 9> totals{};
 
       for (size_t prodCount = 1; prodCount <= maxProducers; ++prodCount) {
         std::printf("\n| %zu prod\t|", prodCount);
         totals[0] += co_await run_bench(exc, prodCount);
         totals[1] += co_await run_bench(excst, prodCount);
-        totals[2] += co_await run_bench(exbr, prodCount);
-        totals[3] += co_await run_bench(exasio, prodCount);
-        totals[4] += co_await run_bench<tmc::mutex, true>(mut, prodCount);
+        totals[2] += co_await run_bench(exbr, prodCount, wait_stats::kind::BRAID);
+        totals[3] += co_await run_bench(exfc, prodCount, wait_stats::kind::BRAID);
+        totals[4] += co_await run_bench(exasio, prodCount);
+        totals[5] += co_await run_bench<tmc::mutex, true>(mut, prodCount);
+        totals[6] += co_await run_bench<decltype(unfairMut), true>(unfairMut, prodCount);
+        totals[7] += co_await run_bench<decltype(fifoMut), true>(fifoMut, prodCount);
+        totals[8] +=
+          co_await run_bench<decltype(boundedMut), true>(boundedMut, prodCount);
       }
       std::printf("\n\ntotals:\n");
       for (size_t i = 0; i < totals.size(); ++i) {
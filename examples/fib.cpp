@@ -2,11 +2,20 @@
 // This is not intended to be an efficient fibonacci calculator,
 // but a test of the runtime's fork/join efficiency.
 
+// Pass `--alloc-compare` after the size argument to measure the allocation rate
+// of the frame pool against the system allocator. Each allocator runs twice, in
+// the order system, pool, pool, system, and each run is a separate process.
+
+// Install the frame pool as the global allocator for this program.
+#define FRAME_POOL_IMPL
+#include "util/frame_pool.hpp"
+
 #include "tmc/all_headers.hpp"
 
 #include <chrono>
 #include <cstdio>
 #include <cstdlib>
+#include <cstring>
 #include <utility>
 
 static tmc::task<size_t> fib(size_t n) {
@@ -54,20 +63,73 @@ static tmc::task<void> top_fib(size_t n) {
   co_return;
 }
 
+// Runs the workload with the allocator that this process was started with,
+// and reports the number of allocations per second that it achieved. The
+// first run warms up the executor and the allocator, and isn't counted.
+static tmc::task<void> measure_allocator(size_t n) {
+  co_await fib(n);
+  size_t allocsBefore = frame_pool::total_allocations();
+  auto startTime = std::chrono::high_resolution_clock::now();
+  co_await top_fib(n);
+  auto endTime = std::chrono::high_resolution_clock::now();
+  size_t allocCount = frame_pool::total_allocations() - allocsBefore;
+
+  size_t execDur = static_cast<size_t>(
+    std::chrono::duration_cast<std::chrono::microseconds>(endTime - startTime)
+      .count()
+  );
+  size_t allocsPerSec = static_cast<size_t>(
+    static_cast<double>(allocCount) * 1000000.0 /
+    static_cast<double>(execDur)
+  );
+  std::printf(
+    "%-16s | %zu us | %zu allocs | %zu allocs/sec\n",
+    frame_pool::is_enabled() ? "frame pool" : "system allocator", execDur,
+    allocCount, allocsPerSec
+  );
+}
+
+// Runs this program with `--alloc-run` in a new process for each allocator.
+static int compare_allocators(char* Program, char* Size) {
+  char allocRun[] = "--alloc-run";
+  char* args[] = {Program, Size, allocRun, nullptr};
+  for (bool usePool : {false, true, true, false}) {
+    if (frame_pool::run_program(usePool, args) != 0) {
+      std::printf("failed to run %s\n", Program);
+      return 1;
+    }
+  }
+  return 0;
+}
+
 constexpr size_t NRUNS = 1;
 int main([[maybe_unused]] int argc, [[maybe_unused]] char* argv[]) {
+  bool allocCompare =
+    argc > 1 && 0 == strcmp(argv[argc - 1], "--alloc-compare");
+  bool allocRun = argc > 1 && 0 == strcmp(argv[argc - 1], "--alloc-run");
 #ifndef NDEBUG
   // Hardcode the size in debug mode so we don't have to fuss around with
   // input arguments in the debug config.
   size_t n = 30;
 #else
-  if (argc != 2) {
-    printf("Usage: fib <n-th fibonacci number requested>\n");
+  if (argc != 2 && !(argc == 3 && (allocCompare || allocRun))) {
+    printf(
+      "Usage: fib <n-th fibonacci number requested> [--alloc-compare]\n"
+    );
     return -1;
   }
 
   size_t n = static_cast<size_t>(atoi(argv[1]));
 #endif
+  if (allocCompare) {
+    return compare_allocators(argv[0], argv[1]);
+  }
+  if (allocRun) {
+    return tmc::async_main([](size_t N) -> tmc::task<int> {
+      co_await measure_allocator(N);
+      co_return 0;
+    }(n));
+  }
   tmc::async_main([](size_t N) -> tmc::task<int> {
     auto startTime = std::chrono::high_resolution_clock::now();
     for (size_t i = 0; i < NRUNS; ++i) {
@@ -11,6 +11,7 @@
 #include <sdkddkver.h>
 #endif
 
+#include "../asio/http_engine.hpp"
 #include "tmc/asio/aw_asio.hpp"
 #include "tmc/asio/ex_asio.hpp"
 #include "tmc/fork_group.hpp"
@@ -39,7 +40,6 @@ using asio::error_code;
 
 #include <cstdint>
 #include <cstdio>
-#include <string>
 #include <utility>
 
 using asio::ip::tcp;
@@ -50,35 +50,6 @@ int main() {
 }
 #else
 
-const std::string static_response = R"(HTTP/1.1 200 OK
-Content-Length: 12
-Content-Type: text/plain; charset=utf-8
-
-Hello World!)";
-
-// not safe to accept rvalue reference
-// have to accept value so that it gets moved when the coro is constructed
-tmc::task<void> handler(auto Socket) {
-  char data[4096];
-  while (Socket.is_open()) {
-    auto d = asio::buffer(data);
-    auto [error, n] = co_await Socket.async_read_some(d, tmc::aw_asio);
-    if (error) {
-      Socket.close();
-      co_return;
-    }
-
-    auto d2 = asio::buffer(static_response);
-    auto [error2, n2] = co_await asio::async_write(Socket, d2, tmc::aw_asio);
-    if (error2) {
-      Socket.close();
-      co_return;
-    }
-  }
-  Socket.shutdown(tcp::socket::shutdown_both);
-  Socket.close();
-}
-
 static tmc::task<void> accept(tmc::ex_asio& ex, uint16_t Port) {
   std::printf("serving on http://localhost:%d/\n", Port);
 
@@ -108,7 +79,7 @@ static tmc::task<void> accept(tmc::ex_asio& ex, uint16_t Port) {
     if (error) {
       break;
     }
-    handlers.fork(handler(std::move(sock)));
+    handlers.fork(http::serve_connection(std::move(sock), http::hello_world));
   }
   // Wait for all running handlers to complete.
   co_await std::move(handlers);
@@ -0,0 +1,179 @@
+// Compares 3 ways to run a skewed, memory-bound workload on a NUMA machine:
+// - flat: a single tmc::ex_cpu that uses every node. Work may be stolen by any
+//   thread, so the load is balanced, but many jobs read remote memory.
+// - per node: ex_numa (util/ex_numa.hpp) with spilling disabled. Each job
+//   runs on the node that owns its data, like the executor-per-cache layout of
+//   asio_server_per_cache.cpp, but the hot node is saturated while the others
+//   are idle.
+// - per node + spill: ex_numa with the default spill threshold. Jobs run on
+//   their home node unless it is saturated and another node has had idle
+//   threads for longer than the idle threshold.
+//
+// Each node owns a data array that is allocated on that node (see
+// util/numa_alloc.hpp). Each job is tagged with a home node and sums a slice
+// of that node's array. `skew` percent of the jobs belong to node 0; the rest
+// are spread evenly over the other nodes.
+//
+// Usage: hwloc_numa_executor [jobs] [skew] [idle threshold us]
+
+#include "../util/ex_numa.hpp"
+#include "../util/numa_alloc.hpp"
+#include "tmc/all_headers.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <latch>
+#include <thread>
+#include <vector>
+
+#ifndef TMC_USE_HWLOC
+int main() {
+  std::printf("This example requires TMC_USE_HWLOC to be enabled.\n");
+}
+#else
+
+static constexpr size_t ARRAY_ELEMS = size_t{1} << 24; // 128MB per node
+static constexpr size_t SLICE_ELEMS = size_t{1} << 15; // 256KB per job
+
+inline thread_local size_t flatNode = 0;
+
+struct job_stats {
+  std::atomic<size_t> ran_on_home{0};
+  std::atomic<uint64_t> checksum{0};
+};
+
+// Ex is null for the flat executor.
+static tmc::task<void> job(
+  const uint64_t* Data, size_t Slice, size_t Home, numa::ex_numa* Ex,
+  job_stats& Stats, std::latch& Done
+) {
+  const uint64_t* begin = Data + (Slice * SLICE_ELEMS) % ARRAY_ELEMS;
+  uint64_t sum = 0;
+  for (size_t i = 0; i < SLICE_ELEMS; ++i) {
+    sum += begin[i];
+  }
+  Stats.checksum.fetch_add(sum, std::memory_order_relaxed);
+  size_t node = Ex != nullptr ? Ex->current_node() : flatNode;
+  if (node == Home) {
+    Stats.ran_on_home.fetch_add(1, std::memory_order_relaxed);
+  }
+  Done.count_down();
+  co_return;
+}
+
+static size_t home_of(size_t Job, size_t NodeCount, size_t Skew) {
+  if (NodeCount == 1 || (Job * 37) % 100 < Skew) {
+    return 0;
+  }
+  return 1 + Job % (NodeCount - 1);
+}
+
+static void print_row(
+  const char* Name, std::chrono::steady_clock::duration Elapsed, job_stats& Stats,
+  size_t Jobs, size_t Migrations
+) {
+  std::printf(
+    "| %s\t| %.2f\t\t| %.1f%%\t\t| %zu\t\t|\n", Name,
+    static_cast<double>(
+      std::chrono::duration_cast<std::chrono::microseconds>(Elapsed).count()
+    ) / 1000.0,
+    100.0 * static_cast<double>(Stats.ran_on_home.load()) / static_cast<double>(Jobs),
+    Migrations
+  );
+}
+
+int main(int argc, char* argv[]) {
+  size_t jobs = 100000;
+  size_t skew = 90;
+  size_t idleUs = 50;
+  if (argc > 1) {
+    jobs = static_cast<size_t>(std::atoi(argv[1]));
+  }
+  if (argc > 2) {
+    skew = static_cast<size_t>(std::atoi(argv[2]));
+  }
+  if (argc > 3) {
+    idleUs = static_cast<size_t>(std::atoi(argv[3]));
+  }
+
+  auto topo = tmc::topology::query();
+  size_t nodeCount = topo.numa_count();
+  std::printf(
+    "numa_executor: %zu jobs | %zu%% on node 0 | %zu nodes | idle threshold %zuus\n",
+    jobs, skew, nodeCount, idleUs
+  );
+  if (nodeCount < 2) {
+    std::printf(
+      "Only 1 NUMA node was found, so all configurations are expected to "
+      "perform the same.\n"
+    );
+  }
+
+  // Allocate each node's array from a thread that is pinned to that node.
+  std::vector<uint64_t*> data(nodeCount);
+  for (size_t n = 0; n < nodeCount; ++n) {
+    std::thread([&data, n]() {
+      tmc::topology::topology_filter f;
+      f.set_numa_indexes({n});
+      tmc::topology::pin_thread(f);
+      data[n] =
+        static_cast<uint64_t*>(numa::alloc_local(ARRAY_ELEMS * sizeof(uint64_t)));
+      for (size_t i = 0; i < ARRAY_ELEMS; ++i) {
+        data[n][i] = i;
+      }
+    }).join();
+  }
+
+  std::printf("| executor\t| time ms\t| ran on home\t| migrations\t|\n");
+  std::printf("| ------------- | ------------- | ------------- | ------------- |\n");
+
+  // Each executor is declared after the latch and stats, so that its
+  // destructor joins its threads before they are destroyed.
+  {
+    job_stats stats;
+    std::latch done(static_cast<std::ptrdiff_t>(jobs));
+    tmc::ex_cpu ex;
+    ex.set_thread_init_hook([](tmc::topology::thread_info Info) {
+        flatNode = Info.group.numa_index;
+      })
+      .init();
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < jobs; ++i) {
+      size_t home = home_of(i, nodeCount, skew);
+      tmc::post(ex, job(data[home], i, home, nullptr, stats, done));
+    }
+    done.wait();
+    print_row("flat\t", std::chrono::steady_clock::now() - start, stats, jobs, 0);
+  }
+
+  for (bool spill : {false, true}) {
+    job_stats stats;
+    std::latch done(static_cast<std::ptrdiff_t>(jobs));
+    numa::ex_numa ex;
+    if (spill) {
+      ex.set_idle_threshold(std::chrono::microseconds(idleUs));
+    } else {
+      ex.set_idle_threshold(std::chrono::steady_clock::duration::max());
+    }
+    ex.init();
+    auto start = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < jobs; ++i) {
+      size_t home = home_of(i, nodeCount, skew);
+      ex.post(job(data[home], i, home, &ex, stats, done), 0, home);
+    }
+    done.wait();
+    print_row(
+      spill ? "per node + spill" : "per node", std::chrono::steady_clock::now() - start,
+      stats, jobs, ex.migrations()
+    );
+  }
+
+  for (size_t n = 0; n < nodeCount; ++n) {
+    numa::free_local(data[n], ARRAY_ELEMS * sizeof(uint64_t));
+  }
+}
+#endif
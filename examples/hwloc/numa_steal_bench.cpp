@@ -0,0 +1,192 @@
+// Measures how the NUMA placement of a worker's deque affects the owner's
+// push / pop cost, and the latency of steals from another NUMA node.
+//
+// Two threads are pinned to different NUMA nodes (the first and the last).
+// Each owns a steal_half_deque. In each round, each thread in turn acts as the
+// owner: it times pushing and popping `items` elements, then pushes `items`
+// elements again. The other thread then steals all of them one at a time,
+// timing each steal. Every steal reads memory that belongs to the other node.
+//
+// This compares 2 placements of the deques:
+// - init thread: both deques are allocated by the main thread, which is pinned
+//   to the first node, as when an executor's init() allocates every worker's
+//   structures. The second worker's deque is on the remote node.
+// - first touch: each worker allocates its own deque after it has been pinned,
+//   using util/numa_alloc.hpp, so each deque is on its owner's node.
+//
+// Usage: hwloc_numa_steal_bench [items] [rounds]
+// The default of 2^19 items (4MB per deque, the deque's MAX_CAPACITY) is
+// larger than a typical L2, so most accesses go past the owner's private
+// caches.
+
+#include "../util/latency_histogram.hpp"
+#include "../util/numa_alloc.hpp"
+#include "../util/steal_half_deque.hpp"
+#include "tmc/topology.hpp"
+
+#include <algorithm>
+#include <array>
+#include <barrier>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+#ifndef TMC_USE_HWLOC
+int main() {
+  std::printf("This examples requires TMC_USE_HWLOC to be enabled.\n");
+}
+#else
+using clock_type = std::chrono::steady_clock;
+
+enum class placement { INIT_THREAD, FIRST_TOUCH };
+
+struct alignas(64) worker_state {
+  steal_half_deque<size_t> deque;
+  explicit worker_state(size_t Capacity) : deque(Capacity) {}
+};
+
+struct owner_result {
+  // Total time spent in the owner's pushes and pops
+  uint64_t owner_ns = 0;
+  size_t owner_ops = 0;
+  // ns per successful steal by the other thread
+  latency_histogram steal_ns;
+};
+
+static void pin_to_node(size_t Node) {
+  tmc::topology::topology_filter f;
+  f.set_numa_indexes({Node});
+  tmc::topology::pin_thread(f);
+}
+
+static uint64_t elapsed_ns(clock_type::time_point Start, clock_type::time_point End) {
+  return static_cast<uint64_t>(
+    std::chrono::duration_cast<std::chrono::nanoseconds>(End - Start).count()
+  );
+}
+
+static std::array<owner_result, 2> run(
+  placement Placement, std::array<size_t, 2> Nodes, size_t Items, size_t Rounds
+) {
+  std::array<worker_state*, 2> workers{};
+  std::array<owner_result, 2> results;
+  if (Placement == placement::INIT_THREAD) {
+    pin_to_node(Nodes[0]);
+    for (auto& w : workers) {
+      w = new worker_state(Items);
+    }
+  }
+
+  std::barrier sync(2);
+  auto body = [&](size_t Self) {
+    pin_to_node(Nodes[Self]);
+    if (Placement == placement::FIRST_TOUCH) {
+      workers[Self] = numa::new_local<worker_state>(Items);
+    }
+    sync.arrive_and_wait();
+
+    size_t item;
+    for (size_t round = 0; round < Rounds; ++round) {
+      for (size_t owner = 0; owner < 2; ++owner) {
+        if (Self == owner) {
+          auto& dq = workers[Self]->deque;
+          auto start = clock_type::now();
+          for (size_t i = 0; i < Items; ++i) {
+            dq.push(i);
+          }
+          for (size_t i = 0; i < Items; ++i) {
+            dq.try_pop(item);
+          }
+          results[owner].owner_ns += elapsed_ns(start, clock_type::now());
+          results[owner].owner_ops += 2 * Items;
+          for (size_t i = 0; i < Items; ++i) {
+            dq.push(i);
+          }
+        }
+        sync.arrive_and_wait();
+        if (Self != owner) {
+          // The clock overhead is included in each sample, but it is the same
+          // for both placements.
+          auto& victim = workers[owner]->deque;
+          for (size_t i = 0; i < Items; ++i) {
+            auto start = clock_type::now();
+            bool ok = victim.steal(item);
+            auto end = clock_type::now();
+            if (ok) {
+              results[owner].steal_ns.record(elapsed_ns(start, end));
+            }
+          }
+        }
+        sync.arrive_and_wait();
+      }
+    }
+
+    // The barrier at the end of the last round guarantees that the other
+    // thread has finished stealing.
+    if (Placement == placement::FIRST_TOUCH) {
+      numa::delete_local(workers[Self]);
+    }
+  };
+
+  std::thread other(body, 1);
+  body(0);
+  other.join();
+
+  if (Placement == placement::INIT_THREAD) {
+    for (auto w : workers) {
+      delete w;
+    }
+  }
+  return results;
+}
+
+int main(int argc, char* argv[]) {
+  size_t items = steal_half_deque<size_t>::MAX_CAPACITY;
+  size_t rounds = 10;
+  if (argc > 1) {
+    items = static_cast<size_t>(std::atoi(argv[1]));
+  }
+  if (argc > 2) {
+    rounds = static_cast<size_t>(std::atoi(argv[2]));
+  }
+  items = std::min(items, steal_half_deque<size_t>::MAX_CAPACITY);
+
+  auto topo = tmc::topology::query();
+  std::array<size_t, 2> nodes{0, topo.numa_count() - 1};
+  std::printf(
+    "numa_steal_bench: %zu items | %zu rounds | nodes %zu and %zu\n", items, rounds,
+    nodes[0], nodes[1]
+  );
+  if (topo.numa_count() < 2) {
+    std::printf(
+      "Only 1 NUMA node was found, so both placements are expected to perform "
+      "the same.\n"
+    );
+  }
+
+  std::printf(
+    "| placement\t| deque owner\t| owner ns/op\t| steal p50 ns\t| steal p99 ns\t| "
+    "steal mean ns\t|\n"
+  );
+  std::printf(
+    "| ------------- | ------------- | ------------- | ------------- | ------------- "
+    "| ------------- |\n"
+  );
+  for (placement p : {placement::INIT_THREAD, placement::FIRST_TOUCH}) {
+    auto results = run(p, nodes, items, rounds);
+    for (size_t owner = 0; owner < 2; ++owner) {
+      auto& r = results[owner];
+      std::printf(
+        "| %s\t| node %zu\t| %.1f\t\t| %llu\t\t| %llu\t\t| %.1f\t\t|\n",
+        p == placement::INIT_THREAD ? "init thread" : "first touch", nodes[owner],
+        static_cast<double>(r.owner_ns) / static_cast<double>(r.owner_ops),
+        static_cast<unsigned long long>(r.steal_ns.percentile(50.0)),
+        static_cast<unsigned long long>(r.steal_ns.percentile(99.0)), r.steal_ns.mean()
+      );
+    }
+  }
+}
+#endif
@@ -0,0 +1,296 @@
+// Compares the parallel algorithms in util/parallel.hpp against a serial loop
+// and the C++17 parallel STL (std::execution::par) on the same data.
+//
+// Each algorithm runs ROUNDS times on a fresh copy of the input, and the best
+// time is reported. The output of each implementation is checked against the
+// serial result.
+//
+// The parallel STL column is only available if the standard library provides
+// it. libstdc++ implements it with TBB, so this target is linked with TBB if
+// CMake can find it. Otherwise that column shows n/a.
+//
+// Usage: parallel_bench [element count]
+
+#include "tmc/all_headers.hpp"
+#include "util/parallel.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <numeric>
+#include <vector>
+
+#ifdef TMC_HAS_PARALLEL_STL
+#include <execution>
+#endif
+
+static constexpr size_t ROUNDS = 5;
+
+static uint64_t scramble(uint64_t X) {
+  X ^= X >> 33;
+  X *= 0xff51afd7ed558ccdULL;
+  X ^= X >> 33;
+  return X;
+}
+
+// A few multiplies per element, so that for_each and transform are not purely
+// memory bound.
+static uint64_t work(uint64_t X) { return scramble(scramble(X) + 1); }
+
+static uint64_t digest(const std::vector<uint64_t>& V) {
+  uint64_t h = 0;
+  for (size_t i = 0; i < V.size(); ++i) {
+    h = h * 31 + V[i];
+  }
+  return h;
+}
+
+struct measurement {
+  double ms;
+  uint64_t checksum;
+};
+
+// Runs F ROUNDS times, calling R before each run. F returns a value
+// that is combined with the digest of the outputs to produce the checksum.
+template <typename Reset, typename Fn>
+static measurement measure(
+  Reset&& R, Fn&& F, const std::vector<uint64_t>& Work, const std::vector<uint64_t>& Out
+) {
+  double best = 0;
+  uint64_t result = 0;
+  for (size_t i = 0; i < ROUNDS; ++i) {
+    R();
+    auto start = std::chrono::high_resolution_clock::now();
+    result = F();
+    auto end = std::chrono::high_resolution_clock::now();
+    double ms =
+      static_cast<double>(
+        std::chrono::duration_cast<std::chrono::microseconds>(end - start).count()
+      ) /
+      1000.0;
+    if (i == 0 || ms < best) {
+      best = ms;
+    }
+  }
+  return measurement{best, result + digest(Work) * 7 + digest(Out)};
+}
+
+template <typename Task> static uint64_t run_tmc(Task&& T) {
+  return tmc::post_waitable(tmc::cpu_executor(), std::forward<Task>(T), 0).get();
+}
+
+static void print_row(
+  const char* Name, measurement Serial, measurement Tmc,
+  [[maybe_unused]] measurement Par
+) {
+  const char* tmcCheck = Tmc.checksum == Serial.checksum ? "" : " (MISMATCH)";
+#ifdef TMC_HAS_PARALLEL_STL
+  const char* parCheck = Par.checksum == Serial.checksum ? "" : " (MISMATCH)";
+  std::printf(
+    "| %s\t| %.2f\t\t| %.2f%s\t\t| %.2f%s\t\t|\n", Name, Serial.ms, Tmc.ms, tmcCheck,
+    Par.ms, parCheck
+  );
+#else
+  std::printf(
+    "| %s\t| %.2f\t\t| %.2f%s\t\t| n/a\t\t|\n", Name, Serial.ms, Tmc.ms, tmcCheck
+  );
+#endif
+}
+
+int main(int argc, char* argv[]) {
+  size_t count = size_t{1} << 24;
+  if (argc > 1) {
+    count = static_cast<size_t>(std::atoll(argv[1]));
+  }
+  tmc::cpu_executor().init();
+  std::printf(
+    "parallel_bench: %zu elements | %zu threads | best of %zu rounds\n", count,
+    tmc::cpu_executor().thread_count(), ROUNDS
+  );
+  std::printf("| algorithm\t\t| serial ms\t| tmc ms\t\t| std::par ms\t|\n");
+  std::printf(
+    "| --------------------- | ------------- | ------------- | ------------- |\n"
+  );
+
+  std::vector<uint64_t> input(count);
+  for (size_t i = 0; i < count; ++i) {
+    input[i] = scramble(i);
+  }
+  std::vector<uint64_t> data(count);
+  std::vector<uint64_t> out(count);
+  auto reset = [&]() {
+    std::copy(input.begin(), input.end(), data.begin());
+    std::fill(out.begin(), out.end(), 0);
+  };
+  auto increment = [](uint64_t& X) { X = work(X); };
+  auto square = [](uint64_t X) { return X * X; };
+
+  // When TMC_HAS_PARALLEL_STL is not defined, par is left empty and unused.
+  measurement serial, tmcRun, par{};
+
+  serial = measure(
+    reset,
+    [&]() -> uint64_t {
+      std::for_each(data.begin(), data.end(), increment);
+      return 0;
+    },
+    data, out
+  );
+  tmcRun = measure(
+    reset,
+    [&]() -> uint64_t {
+      return run_tmc([](std::vector<uint64_t>& Data, auto F) -> tmc::task<uint64_t> {
+        co_await parallel::for_each(Data.begin(), Data.end(), F);
+        co_return 0;
+      }(data, increment));
+    },
+    data, out
+  );
+#ifdef TMC_HAS_PARALLEL_STL
+  par = measure(
+    reset,
+    [&]() -> uint64_t {
+      std::for_each(std::execution::par, data.begin(), data.end(), increment);
+      return 0;
+    },
+    data, out
+  );
+#endif
+  print_row("for_each\t", serial, tmcRun, par);
+
+  serial = measure(
+    reset,
+    [&]() -> uint64_t {
+      std::transform(data.begin(), data.end(), out.begin(), work);
+      return 0;
+    },
+    data, out
+  );
+  tmcRun = measure(
+    reset,
+    [&]() -> uint64_t {
+      return run_tmc(
+        [](std::vector<uint64_t>& Data, std::vector<uint64_t>& Out
+        ) -> tmc::task<uint64_t> {
+          co_await parallel::transform(Data.begin(), Data.end(), Out.begin(), work);
+          co_return 0;
+        }(data, out)
+      );
+    },
+    data, out
+  );
+#ifdef TMC_HAS_PARALLEL_STL
+  par = measure(
+    reset,
+    [&]() -> uint64_t {
+      std::transform(std::execution::par, data.begin(), data.end(), out.begin(), work);
+      return 0;
+    },
+    data, out
+  );
+#endif
+  print_row("transform\t", serial, tmcRun, par);
+
+  serial = measure(
+    reset,
+    [&]() -> uint64_t {
+      return std::transform_reduce(
+        data.begin(), data.end(), uint64_t{0}, std::plus<>{}, square
+      );
+    },
+    data, out
+  );
+  tmcRun = measure(
+    reset,
+    [&]() -> uint64_t {
+      return run_tmc([](std::vector<uint64_t>& Data, auto F) -> tmc::task<uint64_t> {
+        co_return co_await parallel::transform_reduce(
+          Data.begin(), Data.end(), uint64_t{0}, std::plus<>{}, F
+        );
+      }(data, square));
+    },
+    data, out
+  );
+#ifdef TMC_HAS_PARALLEL_STL
+  par = measure(
+    reset,
+    [&]() -> uint64_t {
+      return std::transform_reduce(
+        std::execution::par, data.begin(), data.end(), uint64_t{0}, std::plus<>{},
+        square
+      );
+    },
+    data, out
+  );
+#endif
+  print_row("transform_reduce", serial, tmcRun, par);
+
+  serial = measure(
+    reset,
+    [&]() -> uint64_t {
+      std::inclusive_scan(data.begin(), data.end(), out.begin());
+      return 0;
+    },
+    data, out
+  );
+  tmcRun = measure(
+    reset,
+    [&]() -> uint64_t {
+      return run_tmc(
+        [](std::vector<uint64_t>& Data, std::vector<uint64_t>& Out
+        ) -> tmc::task<uint64_t> {
+          co_await parallel::inclusive_scan(Data.begin(), Data.end(), Out.begin());
+          co_return 0;
+        }(data, out)
+      );
+    },
+    data, out
+  );
+#ifdef TMC_HAS_PARALLEL_STL
+  par = measure(
+    reset,
+    [&]() -> uint64_t {
+      std::inclusive_scan(std::execution::par, data.begin(), data.end(), out.begin());
+      return 0;
+    },
+    data, out
+  );
+#endif
+  print_row("inclusive_scan", serial, tmcRun, par);
+
+  serial = measure(
+    reset,
+    [&]() -> uint64_t {
+      std::sort(data.begin(), data.end());
+      return 0;
+    },
+    data, out
+  );
+  tmcRun = measure(
+    reset,
+    [&]() -> uint64_t {
+      return run_tmc([](std::vector<uint64_t>& Data) -> tmc::task<uint64_t> {
+        co_await parallel::sort(Data.begin(), Data.end());
+        co_return 0;
+      }(data));
+    },
+    data, out
+  );
+#ifdef TMC_HAS_PARALLEL_STL
+  par = measure(
+    reset,
+    [&]() -> uint64_t {
+      std::sort(std::execution::par, data.begin(), data.end());
+      return 0;
+    },
+    data, out
+  );
+#endif
+  print_row("sort\t\t", serial, tmcRun, par);
+
+  tmc::cpu_executor().teardown();
+}
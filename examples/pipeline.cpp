@@ -9,13 +9,14 @@
 
 #include "tmc/ex_cpu.hpp"
 #include "tmc/fork_group.hpp"
-#include "tmc/semaphore.hpp"
 #include "tmc/task.hpp"
 
 // This is just the user application.
 // The generic pipeline implementation is in the header
 #include "pipeline.hpp"
 
+#include "util/task_trace.hpp"
+
 #include <chrono>
 #include <cstdio>
 #include <string>
@@ -35,13 +36,24 @@ static std::string formatElementsPerSec(size_t durMs) {
   return s;
 }
 
-// Example processing steps - these can be coroutines or regular functions
-static float plus_half(int i) { return static_cast<float>(i) + 0.5f; }
+// Example processing steps - these can be coroutines or regular functions.
+// Each step is marked as a slice in the trace; see the end of main().
+static float plus_half(int i) {
+  task_trace::slice s("plus_half");
+  return static_cast<float>(i) + 0.5f;
+}
 static tmc::task<double> times_two(float i) {
+  task_trace::slice s("times_two");
   co_return static_cast<double>(2.0f * i);
 }
-static int minus_one(double i) { return static_cast<int>(i) - 1; }
-static bool as_bool(int i) { return i > 2; }
+static int minus_one(double i) {
+  task_trace::slice s("minus_one");
+  return static_cast<int>(i) - 1;
+}
+static bool as_bool(int i) {
+  task_trace::slice s("as_bool");
+  return i > 2;
+}
 
 int main([[maybe_unused]] int argc, [[maybe_unused]] char* argv[]) {
   return tmc::async_main([]() -> tmc::task<int> {
@@ -51,9 +63,9 @@ int main([[maybe_unused]] int argc, [[maybe_unused]] char* argv[]) {
     // Track all pipeline stage workers here so we can cleanly join at the end
     auto fg = tmc::fork_group();
 
-    auto in = tmc::make_channel<int>();
-    tmc::semaphore inputSem(0);
-    auto first = start_pipeline(fg, in, &inputSem, plus_half, 10);
+    // The input channel capacity applies backpressure to the producer below
+    auto in = make_bounded_channel<int>(2 * 10);
+    auto first = start_pipeline(fg, in, plus_half, 10);
     auto second = pipeline_transform(fg, first, times_two, 10);
     auto third = pipeline_transform(fg, second, minus_one, 10);
     auto fourth = pipeline_transform(fg, third, as_bool, 10);
@@ -66,6 +78,7 @@ int main([[maybe_unused]] int argc, [[maybe_unused]] char* argv[]) {
     [[maybe_unused]] auto fifth = end_pipeline(
       fg, fourth,
       [&sum, &count](bool i) {
+        task_trace::slice s("consume");
         sum += static_cast<size_t>(i);
         ++count;
       },
@@ -78,11 +91,9 @@ int main([[maybe_unused]] int argc, [[maybe_unused]] char* argv[]) {
       // Run the initial producer task inline. Optionally, this could also be
       // added to the fg.
       for (int i = 0; i < NELEMS; ++i) {
-        // Also apply backpressure to the input to avoid overloading the queue
-        co_await inputSem;
-        in.post(i);
+        co_await task_trace::traced("push", in.push(i));
       }
-      co_await in.drain();
+      in.close();
     }
 
     co_await std::move(fg);
@@ -107,6 +118,15 @@ int main([[maybe_unused]] int argc, [[maybe_unused]] char* argv[]) {
     std::printf("construct time: %f ms\n", static_cast<double>(constructTime));
     std::printf("process time: %f ms\n", static_cast<double>(processTime));
     std::printf("%s elements/sec\n", formatElementsPerSec(processTime).c_str());
+
+    // With TMC_ENABLE_TRACE, each stage's slices and its waits in push() and
+    // pull() can be viewed in chrome://tracing or https://ui.perfetto.dev.
+    // Stalls show up as long waits in push() upstream of the slowest stage,
+    // and long waits in pull() downstream of it. Each thread keeps its most
+    // recent events, so the trace covers the end of the run.
+    if (task_trace::write_chrome_trace("pipeline_trace.json")) {
+      std::printf("wrote pipeline_trace.json\n");
+    }
     co_return 0;
   }());
 }
@@ -7,15 +7,24 @@
 // This pipeline may process tasks out of order. For a FIFO pipeline, see
 // pipeline_fifo.cpp.
 
-// This pipeline uses tmc::channel (MPMC) since each stage may have multiple
-// concurrent workers reading from the input channel.
+// This pipeline uses a bounded MPMC channel since each stage may have multiple
+// concurrent workers reading from the input channel. Each stage's input
+// channel holds up to 2x that stage's worker count; a worker that produces an
+// output while the next stage's channel is full suspends in push() until a
+// slot opens up. This provides backpressure without a separate semaphore
+// acquire / release per element.
+
+// Since a stage's output channel capacity depends on the worker count of the
+// next stage, a stage's workers are not started until the next stage is
+// attached to it by pipeline_transform() or end_pipeline(). Every stage must
+// be followed by one of these.
 
-#include "tmc/channel.hpp"
 #include "tmc/fork_group.hpp"
-#include "tmc/semaphore.hpp"
 #include "tmc/spawn_group.hpp"
 #include "tmc/task.hpp"
 #include "tmc/traits.hpp"
+#include "util/bounded_channel.hpp"
+#include "util/task_trace.hpp"
 
 #include <cstddef>
 #include <type_traits>
@@ -24,71 +33,58 @@ template <typename Input, typename Output, typename ProcessFunc>
 struct pipeline_stage {
   using output_t = Output;
 
-  tmc::chan_tok<Output> outChan_;
-  tmc::semaphore outSem_;
+  tmc::aw_fork_group<0, void>* fg_;
+  bounded_chan_tok<Input> inChan_;
+  ProcessFunc func_;
+  size_t workerCount_;
 
   static tmc::task<void> worker(
-    tmc::chan_tok<Input> inChan, tmc::semaphore* inSem,
-    tmc::chan_tok<Output> outChan, tmc::semaphore* outSem, ProcessFunc func
+    bounded_chan_tok<Input> inChan, bounded_chan_tok<Output> outChan, ProcessFunc func
   ) {
-    while (auto input = co_await inChan.pull()) {
-      if (inSem != nullptr) {
-        inSem->release();
-      }
-
-      if (outSem != nullptr) {
-        co_await *outSem;
-      }
-
+    while (auto input = co_await task_trace::traced("pull", inChan.pull())) {
       if constexpr (tmc::traits::is_awaitable<
                       std::invoke_result_t<ProcessFunc, Input&&>>) {
         // ProcessFunc is a coroutine
-        outChan.post(co_await func(std::move(*input)));
+        auto output = co_await func(std::move(*input));
+        co_await task_trace::traced("push", outChan.push(std::move(output)));
       } else {
         // ProcessFunc is a regular function
-        outChan.post(func(std::move(*input)));
+        co_await task_trace::traced("push", outChan.push(func(std::move(*input))));
       }
     }
   }
 
   pipeline_stage(
-    tmc::aw_fork_group<0, void>& fg, tmc::chan_tok<Input> inChan,
-    tmc::semaphore* inSem, ProcessFunc func, size_t workerCount
+    tmc::aw_fork_group<0, void>& fg, bounded_chan_tok<Input> inChan, ProcessFunc func,
+    size_t workerCount
   )
-      : outChan_(tmc::make_channel<Output>()),
-        // Initialize our output semaphore to 0. The next stage will set this
-        // semaphore capacity (for their input channel) based on their worker
-        // count.
-        outSem_(tmc::semaphore(0)) {
-
-    // Set our input channel capacity to 2x our worker count.
-    if (inSem != nullptr) {
-      inSem->release(2 * workerCount);
-    }
+      : fg_(&fg), inChan_(std::move(inChan)), func_(func), workerCount_(workerCount) {}
+
+  // Called by the next stage. Creates our output channel with capacity 2x the
+  // next stage's worker count, and starts our workers.
+  bounded_chan_tok<Output> connect(size_t nextWorkerCount) {
+    auto outChan = make_bounded_channel<Output>(2 * nextWorkerCount);
 
     auto sg = tmc::spawn_group();
-    for (size_t i = 0; i < workerCount; ++i) {
-      // Each worker receives its own independent token (via chan_tok copy).
-      sg.add(worker(inChan, inSem, outChan_, &outSem_, func));
+    for (size_t i = 0; i < workerCount_; ++i) {
+      // Each worker receives its own token copies.
+      sg.add(worker(inChan_, outChan, func_));
     }
 
-    // Create a task that automatically closes and drains the output channel
-    // after all of the workers finish. It also gets its own token copy.
-    fg.fork([](auto SG, auto Chan) -> tmc::task<void> {
+    // Create a task that closes the output channel after all of the workers
+    // finish. The next stage's workers exit once they have pulled the
+    // remaining elements.
+    fg_->fork([](auto SG, auto Chan) -> tmc::task<void> {
       co_await std::move(SG);
-      co_await Chan.drain(); // implicitly closes the channel
-    }(std::move(sg), outChan_));
+      Chan.close();
+    }(std::move(sg), outChan));
+    return outChan;
   }
-
-  tmc::chan_tok<Output> get_channel() { return outChan_; }
 };
 
 template <typename Input, typename ProcessFunc> struct pipeline_end_stage {
-  static tmc::task<void>
-  worker(tmc::chan_tok<Input> inChan, tmc::semaphore* inSem, ProcessFunc func) {
-    while (auto input = co_await inChan.pull()) {
-      inSem->release();
-
+  static tmc::task<void> worker(bounded_chan_tok<Input> inChan, ProcessFunc func) {
+    while (auto input = co_await task_trace::traced("pull", inChan.pull())) {
       if constexpr (tmc::traits::is_awaitable<
                       std::invoke_result_t<ProcessFunc, Input&&>>) {
         // ProcessFunc is a coroutine - await it and ignore result
@@ -101,34 +97,31 @@ template <typename Input, typename ProcessFunc> struct pipeline_end_stage {
   }
 
   pipeline_end_stage(
-    tmc::aw_fork_group<0, void>& fg, tmc::chan_tok<Input> inChan,
-    tmc::semaphore* inSem, ProcessFunc func, size_t workerCount
+    tmc::aw_fork_group<0, void>& fg, bounded_chan_tok<Input> inChan, ProcessFunc func,
+    size_t workerCount
   ) {
-    // Set our input channel capacity to 2x our worker count.
-    inSem->release(2 * workerCount);
-
     auto sg = tmc::spawn_group();
     for (size_t i = 0; i < workerCount; ++i) {
-      // Each worker receives its own independent token (via chan_tok copy).
-      sg.add(worker(inChan, inSem, func));
+      // Each worker receives its own independent token (via token copy).
+      sg.add(worker(inChan, func));
     }
 
     fg.fork(std::move(sg));
   }
 };
 
+// The capacity of the `from` channel provides backpressure to the producer
+// that feeds the pipeline. 2x workerCount matches the other stages.
 template <typename Input, typename Func>
 auto start_pipeline(
-  tmc::aw_fork_group<0, void>& fg, tmc::chan_tok<Input> from,
-  tmc::semaphore* inSem, Func transformFunc, size_t workerCount = 1
+  tmc::aw_fork_group<0, void>& fg, bounded_chan_tok<Input> from, Func transformFunc,
+  size_t workerCount = 1
 ) {
   using Intermediate = std::invoke_result_t<Func, Input&&>;
   using Output = std::conditional_t<
     tmc::traits::is_awaitable<Intermediate>,
     tmc::traits::awaitable_result_t<Intermediate>, Intermediate>;
-  return pipeline_stage<Input, Output, Func>{
-    fg, from, inSem, transformFunc, workerCount
-  };
+  return pipeline_stage<Input, Output, Func>{fg, from, transformFunc, workerCount};
 }
 
 template <typename PriorStage, typename Func>
@@ -142,7 +135,7 @@ auto pipeline_transform(
     tmc::traits::is_awaitable<Intermediate>,
     tmc::traits::awaitable_result_t<Intermediate>, Intermediate>;
   return pipeline_stage<Input, Output, Func>{
-    fg, from.outChan_, &from.outSem_, transformFunc, workerCount
+    fg, from.connect(workerCount), transformFunc, workerCount
   };
 }
 
@@ -153,6 +146,6 @@ auto end_pipeline(
 ) {
   using Input = typename PriorStage::output_t;
   return pipeline_end_stage<Input, Func>{
-    fg, from.outChan_, &from.outSem_, consumeFunc, workerCount
+    fg, from.connect(workerCount), consumeFunc, workerCount
   };
 }
@@ -13,6 +13,8 @@
 // The generic FIFO pipeline implementation is in the header
 #include "pipeline_fifo.hpp"
 
+#include "util/task_trace.hpp"
+
 #include <chrono>
 #include <cstdio>
 #include <string>
@@ -32,13 +34,24 @@ static std::string formatElementsPerSec(size_t durMs) {
   return s;
 }
 
-// Example processing steps - these can be coroutines or regular functions
-static float plus_half(int i) { return static_cast<float>(i) + 0.5f; }
+// Example processing steps - these can be coroutines or regular functions.
+// Each step is marked as a slice in the trace; see the end of main().
+static float plus_half(int i) {
+  task_trace::slice s("plus_half");
+  return static_cast<float>(i) + 0.5f;
+}
 static tmc::task<double> times_two(float i) {
+  task_trace::slice s("times_two");
   co_return static_cast<double>(2.0f * i);
 }
-static int minus_one(double i) { return static_cast<int>(i) - 1; }
-static bool as_bool(int i) { return i > 2; }
+static int minus_one(double i) {
+  task_trace::slice s("minus_one");
+  return static_cast<int>(i) - 1;
+}
+static bool as_bool(int i) {
+  task_trace::slice s("as_bool");
+  return i > 2;
+}
 
 int main([[maybe_unused]] int argc, [[maybe_unused]] char* argv[]) {
   return tmc::async_main([]() -> tmc::task<int> {
@@ -67,6 +80,7 @@ int main([[maybe_unused]] int argc, [[maybe_unused]] char* argv[]) {
     [[maybe_unused]] auto fifth = end_pipeline(
       fg, fourth,
       [&sum, &count](bool i) {
+        task_trace::slice s("consume");
         sum += static_cast<size_t>(i);
         count += 1;
       },
@@ -81,7 +95,7 @@ int main([[maybe_unused]] int argc, [[maybe_unused]] char* argv[]) {
       for (int i = 0; i < NELEMS; ++i) {
         // The bounded queue's push() suspends when the queue is full,
         // providing backpressure to the producer.
-        co_await first.input_queue->push(i);
+        co_await task_trace::traced("push", first.input_queue->push(i));
       }
       // Close the input queue. The first stage worker will drain remaining
       // items and then close its output queue, propagating closure through
@@ -111,6 +125,15 @@ int main([[maybe_unused]] int argc, [[maybe_unused]] char* argv[]) {
     std::printf("construct time: %f ms\n", static_cast<double>(constructTime));
     std::printf("process time: %f ms\n", static_cast<double>(processTime));
     std::printf("%s elements/sec\n", formatElementsPerSec(processTime).c_str());
+
+    // With TMC_ENABLE_TRACE, each stage's slices and its waits in push() and
+    // pull() can be viewed in chrome://tracing or https://ui.perfetto.dev.
+    // Stalls show up as long waits in push() upstream of the slowest stage,
+    // and long waits in pull() downstream of it. Each thread keeps its most
+    // recent events, so the trace covers the end of the run.
+    if (task_trace::write_chrome_trace("pipeline_fifo_trace.json")) {
+      std::printf("wrote pipeline_fifo_trace.json\n");
+    }
     co_return 0;
   }());
 }
@@ -30,6 +30,7 @@
 #include "tmc/spawn.hpp"
 #include "tmc/task.hpp"
 #include "tmc/traits.hpp"
+#include "util/task_trace.hpp"
 
 #include <cstddef>
 #include <memory>
@@ -81,25 +82,25 @@ struct pipeline_stage {
     pipeline_queue_ptr<CInput> inQueue, pipeline_queue_ptr<output_t> outQueue,
     ProcessFunc func
   ) {
-    while (auto input = co_await inQueue->pull()) {
+    while (auto input = co_await task_trace::traced("pull", inQueue->pull())) {
       if constexpr (tmc::traits::is_awaitable<CInput>) {
-        auto data = co_await std::move(input.value());
+        auto data = co_await task_trace::traced("result", std::move(input.value()));
         using FInput = tmc::traits::awaitable_result_t<CInput>;
         // The data element in the queue is an awaitable
         if constexpr (tmc::traits::is_awaitable<
                         std::invoke_result_t<ProcessFunc, FInput&&>>) {
           // ProcessFunc is a coroutine
-          co_await outQueue->push(with_result_of([&]() {
+          co_await task_trace::traced("push", outQueue->push(with_result_of([&]() {
             return tmc::spawn(func(std::move(data))).fork();
-          }));
+          })));
         } else {
           // ProcessFunc is a regular function
-          co_await outQueue->push(with_result_of([&]() {
+          co_await task_trace::traced("push", outQueue->push(with_result_of([&]() {
             return tmc::spawn([](ProcessFunc f, FInput i) -> tmc::task<Output> {
                      co_return f(std::move(i));
                    }(func, std::move(data)))
               .fork();
-          }));
+          })));
         }
       } else {
         using FInput = CInput;
@@ -107,17 +108,17 @@ struct pipeline_stage {
         if constexpr (tmc::traits::is_awaitable<
                         std::invoke_result_t<ProcessFunc, FInput&&>>) {
           // ProcessFunc is a coroutine
-          co_await outQueue->push(with_result_of([&]() {
+          co_await task_trace::traced("push", outQueue->push(with_result_of([&]() {
             return tmc::spawn(func(std::move(input.value()))).fork();
-          }));
+          })));
         } else {
           // ProcessFunc is a regular function
-          co_await outQueue->push(with_result_of([&]() {
+          co_await task_trace::traced("push", outQueue->push(with_result_of([&]() {
             return tmc::spawn([](ProcessFunc f, FInput i) -> tmc::task<Output> {
                      co_return f(std::move(i));
                    }(func, std::move(input.value())))
               .fork();
-          }));
+          })));
         }
       }
     }
@@ -200,9 +201,9 @@ template <typename Input, typename ProcessFunc> struct pipeline_end_stage {
   template <typename CInput>
   static tmc::task<void>
   inline_worker(pipeline_queue_ptr<CInput> inQueue, ProcessFunc func) {
-    while (auto input = co_await inQueue->pull()) {
+    while (auto input = co_await task_trace::traced("pull", inQueue->pull())) {
       if constexpr (tmc::traits::is_awaitable<CInput>) {
-        auto data = co_await std::move(input.value());
+        auto data = co_await task_trace::traced("result", std::move(input.value()));
         using FInput = tmc::traits::awaitable_result_t<CInput>;
         if constexpr (tmc::traits::is_awaitable<
                         std::invoke_result_t<ProcessFunc, FInput&&>>) {
@@ -238,10 +239,10 @@ template <typename Input, typename ProcessFunc> struct pipeline_end_stage {
     // parallelism limit, so the next push() never blocks on a full queue.
     size_t active = 0;
 
-    while (auto input = co_await inQueue->pull()) {
+    while (auto input = co_await task_trace::traced("pull", inQueue->pull())) {
       if constexpr (tmc::traits::is_awaitable<CInput>) {
         // Upstream queue contains forked task handles - await to get value.
-        auto data = co_await std::move(input.value());
+        auto data = co_await task_trace::traced("result", std::move(input.value()));
         using FInput = tmc::traits::awaitable_result_t<CInput>;
         co_await internalQueue->push(with_result_of([&]() {
           return tmc::spawn([](ProcessFunc f, FInput d) -> tmc::task<void> {
@@ -277,7 +278,7 @@ template <typename Input, typename ProcessFunc> struct pipeline_end_stage {
       // before the next iteration's push() could otherwise block.
       if (active >= parallelism) {
         auto handle = co_await internalQueue->pull();
-        co_await std::move(handle.value());
+        co_await task_trace::traced("result", std::move(handle.value()));
         --active;
       }
     }
@@ -285,7 +286,7 @@ template <typename Input, typename ProcessFunc> struct pipeline_end_stage {
     // Upstream is closed. Drain any remaining in-flight forks in order.
     while (active > 0) {
       auto handle = co_await internalQueue->pull();
-      co_await std::move(handle.value());
+      co_await task_trace::traced("result", std::move(handle.value()));
       --active;
     }
   }
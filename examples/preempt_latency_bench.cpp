@@ -0,0 +1,174 @@
+// Measures the latency of high priority work while every thread is busy with
+// low priority CPU hogs, for different ways that the hogs can check for
+// yield requests.
+//
+// The executor has 2 priorities. HOGS_PER_THREAD hog tasks per thread run at
+// priority 1. Each one runs a loop of short iterations (about 1 us each) until
+// it is stopped. Meanwhile, the main thread posts a priority 0 probe every
+// PROBE_INTERVAL, and measures the time from posting the probe until it
+// starts running. The modes are:
+// - never: the hogs do not check for yield requests. Instead, each one yields
+//   after every HOG_RUN, so a probe waits for up to that long.
+// - yield_if_requested: co_await tmc::yield_if_requested() every iteration.
+// - counter<N>: co_await tmc::check_yield_counter<N>() every iteration.
+// - slice <T>: co_await a preempt::slice_check (util/preempt.hpp) with a
+//   time slice of T every iteration.
+//
+// Reports the p50 / p99 / max probe latency in microseconds, and the number
+// of hog iterations per second.
+//
+// Usage: preempt_latency_bench [probe count]
+
+#include "tmc/all_headers.hpp"
+#include "util/latency_histogram.hpp"
+#include "util/preempt.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <optional>
+#include <thread>
+#include <vector>
+
+static constexpr size_t HOGS_PER_THREAD = 2;
+static constexpr size_t ITER_WORK = 300;
+static constexpr auto PROBE_INTERVAL = std::chrono::microseconds(500);
+// Hogs that never check for yield requests run for this long at a time.
+static constexpr auto HOG_RUN = std::chrono::milliseconds(20);
+
+enum class mode { NEVER, YIELD_IF_REQUESTED, COUNTER_100, COUNTER_10000, SLICE };
+
+struct hog_state {
+  std::atomic<bool> stop{false};
+  std::atomic<size_t> iterations{0};
+  std::atomic<uint64_t> sink{0};
+};
+
+static uint64_t iteration(uint64_t X) {
+  for (size_t i = 0; i < ITER_WORK; ++i) {
+    X = X * 6364136223846793005ULL + 1442695040888963407ULL;
+  }
+  return X;
+}
+
+static int64_t now_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+           std::chrono::steady_clock::now().time_since_epoch()
+  )
+    .count();
+}
+
+// Runs iterations until stopped, checking for yield requests as configured
+// by Mode. In NEVER mode, the hog yields after each HOG_RUN, so that probes
+// are not starved forever.
+static tmc::task<void>
+hog(mode Mode, hog_state& State, const preempt::watchdog* Watchdog) {
+  uint64_t x = 1;
+  size_t count = 0;
+  auto counter100 = tmc::check_yield_counter<100>();
+  auto counter10000 = tmc::check_yield_counter<10000>();
+  counter100.reset();
+  counter10000.reset();
+  std::optional<preempt::slice_check> slice;
+  if (Watchdog != nullptr) {
+    slice.emplace(Watchdog->check());
+  }
+  auto runEnd = std::chrono::steady_clock::now() + HOG_RUN;
+  while (!State.stop.load(std::memory_order_relaxed)) {
+    x = iteration(x);
+    ++count;
+    switch (Mode) {
+    case mode::NEVER:
+      if ((count & 63) == 0 && std::chrono::steady_clock::now() > runEnd) {
+        co_await tmc::yield();
+        runEnd = std::chrono::steady_clock::now() + HOG_RUN;
+      }
+      break;
+    case mode::YIELD_IF_REQUESTED:
+      co_await tmc::yield_if_requested();
+      break;
+    case mode::COUNTER_100:
+      co_await counter100;
+      break;
+    case mode::COUNTER_10000:
+      co_await counter10000;
+      break;
+    case mode::SLICE:
+      co_await *slice;
+      break;
+    }
+  }
+  State.iterations.fetch_add(count, std::memory_order_relaxed);
+  State.sink.fetch_add(x, std::memory_order_relaxed);
+}
+
+static tmc::task<uint64_t> probe(int64_t PostedAt) {
+  co_return static_cast<uint64_t>(now_ns() - PostedAt);
+}
+
+static void run_mode(
+  const char* Name, tmc::ex_cpu& Ex, mode Mode, size_t ProbeCount,
+  std::chrono::microseconds Slice = std::chrono::microseconds(0)
+) {
+  std::optional<preempt::watchdog> watchdog;
+  if (Mode == mode::SLICE) {
+    watchdog.emplace(Slice);
+  }
+  hog_state state;
+  std::vector<tmc::task<void>> hogs;
+  for (size_t i = 0; i < HOGS_PER_THREAD * Ex.thread_count(); ++i) {
+    hogs.push_back(hog(Mode, state, watchdog ? &*watchdog : nullptr));
+  }
+  auto hogsDone = tmc::post_bulk_waitable(Ex, hogs.begin(), hogs.size(), 1);
+
+  latency_histogram latency;
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < ProbeCount; ++i) {
+    std::this_thread::sleep_for(PROBE_INTERVAL);
+    latency.record(tmc::post_waitable(Ex, probe(now_ns()), 0).get());
+  }
+  auto end = std::chrono::steady_clock::now();
+  state.stop.store(true, std::memory_order_relaxed);
+  hogsDone.wait();
+
+  double sec = std::chrono::duration<double>(end - start).count();
+  std::printf(
+    "| %s\t| %.1f\t\t| %.1f\t\t| %.1f\t\t| %.0f\t|\n", Name,
+    static_cast<double>(latency.percentile(50.0)) / 1000.0,
+    static_cast<double>(latency.percentile(99.0)) / 1000.0,
+    static_cast<double>(latency.max()) / 1000.0,
+    static_cast<double>(state.iterations.load(std::memory_order_relaxed)) / sec
+  );
+}
+
+int main(int argc, char* argv[]) {
+  size_t probeCount = 2000;
+  if (argc > 1) {
+    probeCount = static_cast<size_t>(std::atoll(argv[1]));
+  }
+  tmc::ex_cpu ex;
+  ex.set_priority_count(2).init();
+  std::printf(
+    "preempt_latency_bench: %zu probes | %zu hogs | %zu threads\n", probeCount,
+    HOGS_PER_THREAD * ex.thread_count(), ex.thread_count()
+  );
+  std::printf("| mode\t\t\t| p50 us\t| p99 us\t| max us\t| hog iters/sec\t|\n");
+  std::printf(
+    "| --------------------- | ------------- | ------------- | ------------- | "
+    "------------- |\n"
+  );
+  run_mode("never\t\t", ex, mode::NEVER, probeCount);
+  run_mode("yield_if_requested", ex, mode::YIELD_IF_REQUESTED, probeCount);
+  run_mode("counter<100>\t", ex, mode::COUNTER_100, probeCount);
+  run_mode("counter<10000>\t", ex, mode::COUNTER_10000, probeCount);
+  run_mode(
+    "slice 50us\t", ex, mode::SLICE, probeCount, std::chrono::microseconds(50)
+  );
+  run_mode(
+    "slice 500us\t", ex, mode::SLICE, probeCount, std::chrono::microseconds(500)
+  );
+  ex.teardown();
+}
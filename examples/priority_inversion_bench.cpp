@@ -0,0 +1,204 @@
+// Measures the latency of high priority work that needs a lock which is
+// contended by a flood of low priority work, with and without priority
+// inheritance (util/priority_inheritance.hpp).
+//
+// The executor has 2 priorities. At priority 1, FLOOD_TASKS tasks repeatedly
+// take the lock, spin, suspend while holding it, spin, and release it.
+// NOISE_PER_THREAD tasks per thread spin and yield without touching the lock,
+// to keep the priority 1 queue full. Meanwhile, the main thread posts a
+// priority 0 probe every PROBE_INTERVAL, and measures the time from posting
+// the probe until it holds the lock.
+//
+// Without inheritance, a holder that suspends is queued at priority 1 behind
+// the noise, and the probe waits for it. With inheritance, the holder's
+// continuation is queued at the probe's priority instead.
+//
+// The braid modes do the same with tmc::enter() / exit() on a braid, except
+// that the flood tasks do not suspend inside the braid.
+//
+// Reports the p50 / p99 / max probe latency in microseconds, the number of
+// flood critical sections completed per second, and the number of times that
+// a holder was boosted.
+//
+// Usage: priority_inversion_bench [probe count]
+
+#include "tmc/all_headers.hpp"
+#include "util/latency_histogram.hpp"
+#include "util/priority_inheritance.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+static constexpr size_t FLOOD_TASKS = 64;
+static constexpr size_t NOISE_PER_THREAD = 16;
+// Amount of simulated work in each half of a critical section.
+static constexpr size_t HOLD_ITERS = 2000;
+static constexpr size_t NOISE_ITERS = 2000;
+static constexpr auto PROBE_INTERVAL = std::chrono::microseconds(200);
+
+static size_t spin(size_t Iters) {
+  size_t x = Iters;
+  for (size_t i = 0; i < Iters; ++i) {
+    x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+  }
+  return x;
+}
+
+struct flood_state {
+  std::atomic<bool> stop{false};
+  std::atomic<size_t> ops{0};
+  std::atomic<size_t> sink{0};
+};
+
+static int64_t now_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+           std::chrono::steady_clock::now().time_since_epoch()
+  )
+    .count();
+}
+
+// Acquires Lock, runs Body, and releases Lock. Body is awaited while the lock
+// is held, so it may suspend.
+template <typename Lock, typename Body>
+static tmc::task<void> with_lock(Lock& L, Body B) {
+  if constexpr (std::is_same_v<Lock, tmc::mutex> ||
+                std::is_same_v<Lock, prio_inherit::mutex>) {
+    co_await L;
+    co_await B();
+    L.unlock();
+  } else {
+    auto scope = co_await tmc::enter(L);
+    co_await B();
+    co_await scope.exit();
+  }
+}
+
+// Suspends while holding Lock. prio_inherit::mutex is told about the
+// suspension with held(), so that it can boost the holder.
+template <typename Lock> static tmc::task<void> suspend_holding(Lock& L) {
+  if constexpr (std::is_same_v<Lock, prio_inherit::mutex>) {
+    co_await L.held(tmc::yield());
+  } else if constexpr (std::is_same_v<Lock, tmc::mutex>) {
+    co_await tmc::yield();
+  } else {
+    // Yielding inside a braid would let another flood task into the braid.
+    (void)L;
+  }
+}
+
+template <typename Lock>
+static tmc::task<void> flood(Lock& L, flood_state& State) {
+  while (!State.stop.load(std::memory_order_relaxed)) {
+    co_await with_lock(L, [&]() -> tmc::task<void> {
+      State.sink.fetch_add(spin(HOLD_ITERS), std::memory_order_relaxed);
+      co_await suspend_holding(L);
+      State.sink.fetch_add(spin(HOLD_ITERS), std::memory_order_relaxed);
+    });
+    State.ops.fetch_add(1, std::memory_order_relaxed);
+  }
+}
+
+static tmc::task<void> noise(flood_state& State) {
+  while (!State.stop.load(std::memory_order_relaxed)) {
+    State.sink.fetch_add(spin(NOISE_ITERS), std::memory_order_relaxed);
+    co_await tmc::yield();
+  }
+}
+
+// Returns the time from PostedAt until the lock was acquired.
+template <typename Lock>
+static tmc::task<uint64_t> probe(Lock& L, int64_t PostedAt) {
+  int64_t acquiredAt = 0;
+  co_await with_lock(L, [&]() -> tmc::task<void> {
+    acquiredAt = now_ns();
+    co_return;
+  });
+  co_return static_cast<uint64_t>(acquiredAt - PostedAt);
+}
+
+template <typename Lock> static size_t boosts_of(Lock& L) {
+  if constexpr (std::is_same_v<Lock, prio_inherit::mutex>) {
+    return L.boosts();
+  } else {
+    (void)L;
+    return 0;
+  }
+}
+
+template <typename Lock>
+static void run_mode(const char* Name, tmc::ex_cpu& Ex, Lock& L, size_t ProbeCount) {
+  flood_state state;
+  std::vector<tmc::task<void>> tasks;
+  for (size_t i = 0; i < FLOOD_TASKS; ++i) {
+    tasks.push_back(flood(L, state));
+  }
+  for (size_t i = 0; i < NOISE_PER_THREAD * Ex.thread_count(); ++i) {
+    tasks.push_back(noise(state));
+  }
+  auto floodDone = tmc::post_bulk_waitable(Ex, tasks.begin(), tasks.size(), 1);
+
+  latency_histogram latency;
+  auto start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < ProbeCount; ++i) {
+    std::this_thread::sleep_for(PROBE_INTERVAL);
+    latency.record(tmc::post_waitable(Ex, probe(L, now_ns()), 0).get());
+  }
+  auto end = std::chrono::steady_clock::now();
+  size_t ops = state.ops.load(std::memory_order_relaxed);
+  state.stop.store(true, std::memory_order_relaxed);
+  floodDone.wait();
+
+  double sec = std::chrono::duration<double>(end - start).count();
+  std::printf(
+    "| %s\t| %.1f\t\t| %.1f\t\t| %.1f\t\t| %.0f\t\t| %zu\t\t|\n", Name,
+    static_cast<double>(latency.percentile(50.0)) / 1000.0,
+    static_cast<double>(latency.percentile(99.0)) / 1000.0,
+    static_cast<double>(latency.max()) / 1000.0, static_cast<double>(ops) / sec,
+    boosts_of(L)
+  );
+}
+
+int main(int argc, char* argv[]) {
+  size_t probeCount = 2000;
+  if (argc > 1) {
+    probeCount = static_cast<size_t>(std::atoll(argv[1]));
+  }
+  tmc::ex_cpu ex;
+  ex.set_priority_count(2).init();
+  std::printf(
+    "priority_inversion_bench: %zu probes | %zu flood tasks | %zu threads\n",
+    probeCount, FLOOD_TASKS, ex.thread_count()
+  );
+  std::printf(
+    "| mode\t\t\t| p50 us\t| p99 us\t| max us\t| flood ops/sec\t| boosts\t|\n"
+  );
+  std::printf(
+    "| --------------------- | ------------- | ------------- | ------------- | "
+    "------------- | ------------- |\n"
+  );
+
+  {
+    tmc::mutex mut;
+    run_mode("tmc::mutex\t", ex, mut, probeCount);
+  }
+  {
+    prio_inherit::mutex mut;
+    run_mode("prio_inherit::mutex", ex, mut, probeCount);
+  }
+  {
+    tmc::ex_braid br(ex.type_erased());
+    run_mode("tmc::ex_braid\t", ex, br, probeCount);
+  }
+  {
+    prio_inherit::ex_braid br(ex.type_erased());
+    run_mode("prio_inherit::ex_braid", ex, br, probeCount);
+  }
+  ex.teardown();
+}
@@ -1,10 +1,18 @@
 // A benchmark for the throughput of tmc::qu_spsc_unbounded / mpsc.
+// Runs once with a consumer that pulls 1 element per co_await, and once with
+// a consumer that pulls batches of up to 64 with pull_bulk
+// (util/pull_bulk.hpp).
 
 #include "tmc/all_headers.hpp"
+#include "util/pull_bulk.hpp"
 
+#include <array>
 #include <cassert>
 #include <chrono>
+#include <cstddef>
 #include <cstdio>
+#include <numeric>
+#include <span>
 #include <string>
 #include <utility>
 #include <vector>
@@ -73,6 +81,21 @@ consumer(queue_t& queue, size_t expected_count) {
   co_return result{count, sum};
 }
 
+[[maybe_unused]] static tmc::task<result>
+consumer_bulk(queue_t& queue, size_t expected_count) {
+  size_t count = 0;
+  size_t sum = 0;
+  std::array<size_t, 64> buf;
+
+  while (count < expected_count) {
+    size_t n = co_await pull_bulk(queue, std::span{buf});
+    count += n;
+    sum = std::accumulate(buf.begin(), buf.begin() + static_cast<ptrdiff_t>(n), sum);
+  }
+
+  co_return result{count, sum};
+}
+
 [[maybe_unused]] static tmc::task<result>
 consumer_try_pull(queue_t& queue, size_t expected_count) {
   size_t count = 0;
@@ -102,6 +125,77 @@ static std::string formatWithCommas(size_t n) {
   return s;
 }
 
+static tmc::task<void> run_one(tmc::ex_cpu_st& consEx, bool bulk) {
+  queue_t queue;
+  size_t per_task = NELEMS / PRODUCER_COUNT;
+  size_t rem = NELEMS % PRODUCER_COUNT;
+
+  // Construct producer and consumer tasks but don't initiate yet
+  std::vector<tmc::task<producer_result>> prod(PRODUCER_COUNT);
+  size_t base = 0;
+  for (size_t i = 0; i < PRODUCER_COUNT; ++i) {
+    size_t count = i < rem ? per_task + 1 : per_task;
+    prod[i] = producer(queue, count, base);
+    base += count;
+  }
+  std::vector<tmc::task<result>> cons(CONSUMER_COUNT);
+  cons[0] = bulk ? consumer_bulk(queue, NELEMS) : consumer(queue, NELEMS);
+
+  auto startTime = std::chrono::high_resolution_clock::now();
+  // Start consumers
+  auto c = tmc::spawn_many(cons).run_on(consEx).fork();
+  // Start producers and wait for them to finish
+  auto prodResults = co_await tmc::spawn_many(prod);
+  // Wait for consumers to finish
+  auto consResults = co_await std::move(c);
+  auto endTime = std::chrono::high_resolution_clock::now();
+
+  size_t count = 0;
+  size_t sum = 0;
+  for (size_t i = 0; i < consResults.size(); ++i) {
+    count += consResults[i].count;
+    sum += consResults[i].sum;
+  }
+  if (count != NELEMS) {
+    std::printf(
+      "FAIL: Expected %zu elements but consumed %zu elements\n",
+      static_cast<size_t>(NELEMS), count
+    );
+  }
+
+  size_t expectedSum = 0;
+  for (size_t i = 0; i < NELEMS; ++i) {
+    expectedSum += i;
+  }
+  if (sum != expectedSum) {
+    std::printf("FAIL: Expected %zu sum but got %zu sum\n", expectedSum, sum);
+  }
+  size_t maxProducerDuration = 0;
+  for (size_t i = 0; i < prodResults.size(); ++i) {
+    if (maxProducerDuration < prodResults[i].duration_us) {
+      maxProducerDuration = prodResults[i].duration_us;
+    }
+  }
+
+  size_t execDur = static_cast<size_t>(
+    std::chrono::duration_cast<std::chrono::microseconds>(endTime - startTime)
+      .count()
+  );
+
+  double durMs = static_cast<double>(execDur) / 1000.0;
+  size_t elementsPerSec =
+    static_cast<size_t>(static_cast<double>(NELEMS) * 1000.0 / durMs);
+  std::printf(
+    "%s\t%zu prod\t%zu cons\t %.2f ms\t%s elements/sec\n",
+    bulk ? "pull_bulk" : "pull", static_cast<size_t>(PRODUCER_COUNT),
+    static_cast<size_t>(CONSUMER_COUNT), durMs,
+    formatWithCommas(elementsPerSec).c_str()
+  );
+  std::printf(
+    "producer max: %.2f ms\n", static_cast<double>(maxProducerDuration) / 1000.0
+  );
+}
+
 int main() {
   tmc::ex_any* prodExPtr;
 #if PRODUCER_COUNT == 1
@@ -147,80 +241,8 @@ int main() {
 #endif
              consEx.init();
 
-             queue_t queue;
-             size_t per_task = NELEMS / PRODUCER_COUNT;
-             size_t rem = NELEMS % PRODUCER_COUNT;
-
-             // Construct producer and consumer tasks but don't initiate yet
-             std::vector<tmc::task<producer_result>> prod(PRODUCER_COUNT);
-             size_t base = 0;
-             for (size_t i = 0; i < PRODUCER_COUNT; ++i) {
-               size_t count = i < rem ? per_task + 1 : per_task;
-               prod[i] = producer(queue, count, base);
-               base += count;
-             }
-             std::vector<tmc::task<result>> cons(CONSUMER_COUNT);
-             cons[0] = consumer(queue, NELEMS);
-
-             auto startTime = std::chrono::high_resolution_clock::now();
-             // Start consumers
-             auto c = tmc::spawn_many(cons).run_on(consEx).fork();
-             // Start producers and wait for them to finish
-             auto prodResults = co_await tmc::spawn_many(prod);
-             // Wait for consumers to finish
-             auto consResults = co_await std::move(c);
-             auto endTime = std::chrono::high_resolution_clock::now();
-
-             size_t count = 0;
-             size_t sum = 0;
-             for (size_t i = 0; i < consResults.size(); ++i) {
-               count += consResults[i].count;
-               sum += consResults[i].sum;
-             }
-             if (count != NELEMS) {
-               std::printf(
-                 "FAIL: Expected %zu elements but consumed %zu elements\n",
-                 static_cast<size_t>(NELEMS), count
-               );
-             }
-
-             size_t expectedSum = 0;
-             for (size_t i = 0; i < NELEMS; ++i) {
-               expectedSum += i;
-             }
-             if (sum != expectedSum) {
-               std::printf(
-                 "FAIL: Expected %zu sum but got %zu sum\n", expectedSum, sum
-               );
-             }
-             size_t maxProducerDuration = 0;
-             for (size_t i = 0; i < prodResults.size(); ++i) {
-               if (maxProducerDuration < prodResults[i].duration_us) {
-                 maxProducerDuration = prodResults[i].duration_us;
-               }
-             }
-
-             size_t execDur = static_cast<size_t>(
-               std::chrono::duration_cast<std::chrono::microseconds>(
-                 endTime - startTime
-               )
-                 .count()
-             );
-
-             double durMs = static_cast<double>(execDur) / 1000.0;
-             size_t elementsPerSec = static_cast<size_t>(
-               static_cast<double>(NELEMS) * 1000.0 / durMs
-             );
-             std::printf(
-               "%zu prod\t%zu cons\t %.2f ms\t%s elements/sec\n",
-               static_cast<size_t>(PRODUCER_COUNT),
-               static_cast<size_t>(CONSUMER_COUNT), durMs,
-               formatWithCommas(elementsPerSec).c_str()
-             );
-             std::printf(
-               "producer max: %.2f ms\n",
-               static_cast<double>(maxProducerDuration) / 1000.0
-             );
+             co_await run_one(consEx, false);
+             co_await run_one(consEx, true);
              co_return 0;
            }()
   )
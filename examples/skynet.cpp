@@ -1,57 +1,29 @@
 // An implementation of the skynet benchmark as described here:
 // https://github.com/atemerev/skynet
 
+// Run with `--alloc-compare` to measure the allocation rate of the frame pool
+// against the system allocator. Each allocator runs twice, in the order
+// system, pool, pool, system, and each run is a separate process.
+
+// Install the frame pool as the global allocator for this program.
+#define FRAME_POOL_IMPL
+#include "util/frame_pool.hpp"
+
+#include "skynet.hpp"
+#include "util/scheduler_stats.hpp"
+
 #include "tmc/ex_cpu.hpp"
-#include "tmc/spawn_group.hpp"
-#include "tmc/spawn_many.hpp"
 #include "tmc/task.hpp"
 
 #include <chrono>
 #include <cstdio>
-#include <ranges>
-
-// The proper sum of skynet (1M tasks) is 499999500000.
-// 32-bit platforms can't hold the full sum, but unsigned integer overflow is
-// defined so it will wrap to this number.
-static constexpr inline size_t EXPECTED_RESULT =
-  sizeof(size_t) == 8 ? static_cast<size_t>(499999500000)
-                      : static_cast<size_t>(1783293664);
+#include <cstring>
 
 #define DEPTH 6
 
-template <size_t DepthMax>
-tmc::task<size_t> skynet_one(size_t BaseNum, size_t Depth) {
-  if (Depth == DepthMax) {
-    co_return BaseNum;
-  }
-  size_t count = 0;
-  size_t depthOffset = 1;
-  for (size_t i = 0; i < DepthMax - Depth - 1; ++i) {
-    depthOffset *= 10;
-  }
-
-  // // Simplest way to spawn subtasks
-  // auto sg = tmc::spawn_group<10, tmc::task<size_t>>();
-  // for (size_t idx = 0; idx < 10; ++idx) {
-  //   sg.add(skynet_one<DepthMax>(BaseNum + depthOffset * idx, Depth + 1));
-  // }
-  // std::array<size_t, 10> results = co_await std::move(sg);
+// Configure with -DTMC_ENABLE_STATS=ON to print scheduler stats.
+static sched_stats::collector stats;
 
-  // spawn_many from a sized iterator has slightly better performance
-  std::array<size_t, 10> results = co_await tmc::spawn_many<10>(
-    (
-      std::ranges::views::iota(0UL) |
-      std::ranges::views::transform([=](size_t idx) {
-        return skynet_one<DepthMax>(BaseNum + depthOffset * idx, Depth + 1);
-      })
-    ).begin()
-  );
-
-  for (size_t idx = 0; idx < 10; ++idx) {
-    count += results[idx];
-  }
-  co_return count;
-}
 template <size_t DepthMax> tmc::task<void> skynet() {
   size_t count = co_await skynet_one<DepthMax>(0, 0);
   if (count != EXPECTED_RESULT) {
@@ -61,7 +33,9 @@ template <size_t DepthMax> tmc::task<void> skynet() {
 
 template <size_t Depth> tmc::task<void> loop_skynet() {
   const size_t iter_count = 1000;
+  auto initialStats = stats.stats();
   for (size_t j = 0; j < 5; ++j) {
+    auto startStats = stats.stats();
     auto startTime = std::chrono::high_resolution_clock::now();
     for (size_t i = 0; i < iter_count; ++i) {
       co_await skynet<Depth>();
@@ -73,16 +47,76 @@ template <size_t Depth> tmc::task<void> loop_skynet() {
         .count()
     );
     std::printf("%zu skynet iterations in %zu us\n", iter_count, execDur);
+#ifdef TMC_ENABLE_STATS
+    (stats.stats() - startStats).print_summary("  scheduler");
+#endif
   }
+#ifdef TMC_ENABLE_STATS
+  (stats.stats() - initialStats).print("scheduler stats per thread");
+#endif
 }
 
-int main() {
-  std::printf("Running skynet benchmark x1000...\n");
+// Runs the workload with the allocator that this process was started with,
+// and reports the number of allocations per second that it achieved. The
+// first iteration warms up the executor and the allocator, and isn't counted.
+template <size_t Depth> tmc::task<void> measure_allocator() {
+  const size_t iter_count = 100;
+  co_await skynet<Depth>();
+  size_t allocsBefore = frame_pool::total_allocations();
+  auto startTime = std::chrono::high_resolution_clock::now();
+  for (size_t i = 0; i < iter_count; ++i) {
+    co_await skynet<Depth>();
+  }
+  auto endTime = std::chrono::high_resolution_clock::now();
+  size_t allocCount = frame_pool::total_allocations() - allocsBefore;
+
+  size_t execDur = static_cast<size_t>(
+    std::chrono::duration_cast<std::chrono::microseconds>(endTime - startTime)
+      .count()
+  );
+  size_t allocsPerSec = static_cast<size_t>(
+    static_cast<double>(allocCount) * 1000000.0 /
+    static_cast<double>(execDur)
+  );
+  std::printf(
+    "%-16s | %zu skynet iterations in %zu us | %zu allocs | %zu allocs/sec\n",
+    frame_pool::is_enabled() ? "frame pool" : "system allocator", iter_count,
+    execDur, allocCount, allocsPerSec
+  );
+}
+
+// Runs this program with `--alloc-run` in a new process for each allocator.
+static int compare_allocators(char* Program) {
+  std::printf("Comparing skynet allocation rate...\n");
+  char allocRun[] = "--alloc-run";
+  char* args[] = {Program, allocRun, nullptr};
+  for (bool usePool : {false, true, true, false}) {
+    if (frame_pool::run_program(usePool, args) != 0) {
+      std::printf("failed to run %s\n", Program);
+      return 1;
+    }
+  }
+  return 0;
+}
+
+int main(int argc, char* argv[]) {
+  if (argc > 1 && 0 == strcmp(argv[1], "--alloc-compare")) {
+    return compare_allocators(argv[0]);
+  }
+  bool allocRun = argc > 1 && 0 == strcmp(argv[1], "--alloc-run");
+  stats.install(tmc::cpu_executor());
   tmc::cpu_executor()
     // This specific benchmark performs better with LATTICE_MATRIX due to its
     // high degree of nested parallelism.
     .set_work_stealing_strategy(tmc::work_stealing_strategy::LATTICE_MATRIX)
     .init();
+  if (allocRun) {
+    return tmc::async_main([]() -> tmc::task<int> {
+      co_await measure_allocator<DEPTH>();
+      co_return 0;
+    }());
+  }
+  std::printf("Running skynet benchmark x1000...\n");
   return tmc::async_main([]() -> tmc::task<int> {
     co_await loop_skynet<DEPTH>();
     co_return 0;
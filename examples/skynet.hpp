@@ -0,0 +1,65 @@
+// The task tree of the skynet benchmark, as described here:
+// https://github.com/atemerev/skynet
+// Shared by skynet.cpp and steal_strategy_bench.cpp.
+
+#pragma once
+
+#include "tmc/spawn_many.hpp"
+#include "tmc/task.hpp"
+#include "util/scheduler_stats.hpp"
+
+#include <array>
+#include <cstddef>
+#include <ranges>
+
+// The proper sum of skynet (1M tasks) is 499999500000.
+// 32-bit platforms can't hold the full sum, but unsigned integer overflow is
+// defined so it will wrap to this number.
+inline constexpr size_t EXPECTED_RESULT =
+  sizeof(size_t) == 8 ? static_cast<size_t>(499999500000)
+                      : static_cast<size_t>(1783293664);
+
+// With stats compiled out, the origin parameter is too, so that each frame is
+// the same size as without the collector.
+template <size_t DepthMax>
+tmc::task<size_t> skynet_one(
+  size_t BaseNum, size_t Depth
+#ifdef TMC_ENABLE_STATS
+  ,
+  sched_stats::origin Origin = sched_stats::task_origin()
+#endif
+) {
+#ifdef TMC_ENABLE_STATS
+  sched_stats::record_task(Origin);
+#endif
+  if (Depth == DepthMax) {
+    co_return BaseNum;
+  }
+  size_t count = 0;
+  size_t depthOffset = 1;
+  for (size_t i = 0; i < DepthMax - Depth - 1; ++i) {
+    depthOffset *= 10;
+  }
+
+  // // Simplest way to spawn subtasks
+  // auto sg = tmc::spawn_group<10, tmc::task<size_t>>();
+  // for (size_t idx = 0; idx < 10; ++idx) {
+  //   sg.add(skynet_one<DepthMax>(BaseNum + depthOffset * idx, Depth + 1));
+  // }
+  // std::array<size_t, 10> results = co_await std::move(sg);
+
+  // spawn_many from a sized iterator has slightly better performance
+  std::array<size_t, 10> results = co_await tmc::spawn_many<10>(
+    (
+      std::ranges::views::iota(0UL) |
+      std::ranges::views::transform([=](size_t idx) {
+        return skynet_one<DepthMax>(BaseNum + depthOffset * idx, Depth + 1);
+      })
+    ).begin()
+  );
+
+  for (size_t idx = 0; idx < 10; ++idx) {
+    count += results[idx];
+  }
+  co_return count;
+}
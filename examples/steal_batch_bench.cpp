@@ -0,0 +1,158 @@
+// A microbenchmark for work distribution after a large fan-out.
+//
+// One thread posts TASK_COUNT small work items into its own deque, similar to
+// a single task calling spawn_many() with 10k children. The remaining threads
+// start with empty deques and must steal the work. This compares:
+// - steal: each steal takes a single item with one CAS
+// - steal_batch: each steal takes up to half of the victim's items with one
+//   CAS. The thief runs one item and pushes the rest into its own deque, where
+//   other idle threads can steal from it in turn.
+//
+// Reports the time to run all items, and the number of successful steal CASes.
+// This uses std::thread workers and steal_half_deque directly, so it measures
+// only the cost of distributing work and not the rest of the executor.
+
+#include "util/steal_half_deque.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <thread>
+#include <vector>
+
+static constexpr size_t TASK_COUNT = 10000;
+static constexpr size_t ROUNDS = 100;
+static constexpr size_t MAX_BATCH = 256;
+// Amount of simulated work per item.
+static constexpr size_t WORK_ITERS = 500;
+
+struct alignas(64) worker_state {
+  steal_half_deque<size_t> deque{TASK_COUNT};
+  size_t steals = 0;
+  size_t sink = 0;
+};
+
+static size_t do_work(size_t Item) {
+  size_t x = Item;
+  for (size_t i = 0; i < WORK_ITERS; ++i) {
+    x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+  }
+  return x;
+}
+
+struct round_result {
+  size_t duration_us;
+  size_t steals;
+};
+
+static round_result run_round(size_t ThreadCount, bool Batch) {
+  std::vector<std::unique_ptr<worker_state>> workers;
+  for (size_t i = 0; i < ThreadCount; ++i) {
+    workers.push_back(std::make_unique<worker_state>());
+  }
+  std::atomic<size_t> remaining{TASK_COUNT};
+  std::atomic<bool> go{false};
+
+  auto worker = [&](size_t Self) {
+    auto& me = *workers[Self];
+    size_t buf[MAX_BATCH];
+    while (!go.load(std::memory_order_acquire)) {
+    }
+    if (Self == 0) {
+      for (size_t i = 0; i < TASK_COUNT; ++i) {
+        me.deque.push(i);
+      }
+    }
+    size_t item = 0;
+    while (remaining.load(std::memory_order_relaxed) != 0) {
+      if (me.deque.try_pop(item)) {
+        me.sink += do_work(item);
+        remaining.fetch_sub(1, std::memory_order_relaxed);
+        continue;
+      }
+      for (size_t i = 1; i < ThreadCount; ++i) {
+        auto& victim = workers[(Self + i) % ThreadCount]->deque;
+        if (Batch) {
+          size_t n = victim.steal_batch(buf, MAX_BATCH);
+          if (n == 0) {
+            continue;
+          }
+          ++me.steals;
+          // Keep the first item to run now, and make the rest available to
+          // be stolen from this thread.
+          me.deque.post_bulk(buf + 1, n - 1);
+          me.sink += do_work(buf[0]);
+          remaining.fetch_sub(1, std::memory_order_relaxed);
+          break;
+        } else {
+          if (!victim.steal(item)) {
+            continue;
+          }
+          ++me.steals;
+          me.sink += do_work(item);
+          remaining.fetch_sub(1, std::memory_order_relaxed);
+          break;
+        }
+      }
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (size_t i = 0; i < ThreadCount; ++i) {
+    threads.emplace_back(worker, i);
+  }
+  auto startTime = std::chrono::high_resolution_clock::now();
+  go.store(true, std::memory_order_release);
+  for (auto& t : threads) {
+    t.join();
+  }
+  auto endTime = std::chrono::high_resolution_clock::now();
+
+  round_result result{
+    static_cast<size_t>(
+      std::chrono::duration_cast<std::chrono::microseconds>(endTime - startTime)
+        .count()
+    ),
+    0
+  };
+  size_t sink = 0;
+  for (auto& w : workers) {
+    result.steals += w->steals;
+    sink += w->sink;
+  }
+  if (sink == 0) {
+    std::printf("FAIL: no work was done\n");
+  }
+  return result;
+}
+
+int main(int argc, char* argv[]) {
+  size_t threadCount = std::thread::hardware_concurrency();
+  if (argc > 1) {
+    threadCount = static_cast<size_t>(std::atoi(argv[1]));
+  }
+  if (threadCount < 2) {
+    threadCount = 2;
+  }
+  std::printf(
+    "steal_batch_bench: %zu threads | %zu items per round | %zu rounds\n",
+    threadCount, TASK_COUNT, ROUNDS
+  );
+  std::printf("| mode\t\t| mean us/round\t| steals/round\t|\n");
+  std::printf("| ------------- | ------------- | ------------- |\n");
+  for (bool batch : {false, true}) {
+    size_t totalUs = 0;
+    size_t totalSteals = 0;
+    for (size_t i = 0; i < ROUNDS; ++i) {
+      auto r = run_round(threadCount, batch);
+      totalUs += r.duration_us;
+      totalSteals += r.steals;
+    }
+    std::printf(
+      "| %s\t| %zu\t\t| %zu\t\t|\n", batch ? "steal_batch" : "steal\t",
+      totalUs / ROUNDS, totalSteals / ROUNDS
+    );
+  }
+}
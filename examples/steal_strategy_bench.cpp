@@ -0,0 +1,179 @@
+// Compares the LATTICE_MATRIX and HIERARCHY_MATRIX work stealing strategies
+// against the strategy recommended by steal_strategy_advisor, on several
+// workloads with different shapes:
+// - skynet: deep nested fan-out (10 children per task)
+// - fib: binary fork/join
+// - chan: a few long-lived producers and consumers communicating by channel
+//
+// This is not adaptive work stealing: the strategy is never switched while an
+// executor is running. ex_cpu fixes its stealing order in init(), and it can't
+// be changed afterward, so the strategy can't be switched between phases of a
+// single run. Instead, in ADVISED mode, scheduler stats are collected during
+// each round and fed to the advisor, which picks the strategy that the next
+// round's executor is built with. The executor is rebuilt for every round in
+// all modes, so that their timings remain comparable. This measures whether
+// the advisor converges on the faster fixed strategy for each workload.
+//
+// Configure with -DTMC_ENABLE_STATS=ON; otherwise ADVISED mode can't observe
+// the workload and stays on its initial strategy.
+
+#include "skynet.hpp"
+#include "util/scheduler_stats.hpp"
+#include "util/steal_strategy_advisor.hpp"
+
+#include "tmc/all_headers.hpp"
+
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <utility>
+#include <vector>
+
+static constexpr size_t ROUNDS = 6;
+
+static tmc::task<void> skynet_workload() {
+  for (size_t i = 0; i < 20; ++i) {
+    size_t count = co_await skynet_one<6>(0, 0);
+    if (count != EXPECTED_RESULT) {
+      std::printf("got wrong result: %zu\n", count);
+    }
+  }
+}
+
+static tmc::task<size_t>
+fib(size_t n, sched_stats::origin Origin = sched_stats::task_origin()) {
+  sched_stats::record_task(Origin);
+  if (n < 2) {
+    co_return n;
+  }
+  auto xt = tmc::spawn(fib(n - 1)).fork();
+  auto y = co_await fib(n - 2);
+  auto x = co_await std::move(xt);
+  co_return x + y;
+}
+
+static tmc::task<void> fib_workload() { co_await fib(30); }
+
+static tmc::task<void> chan_workload() {
+  static constexpr size_t ELEMS = 1000000;
+  static constexpr size_t PRODUCERS = 4;
+  static constexpr size_t CONSUMERS = 4;
+  auto chan = tmc::make_channel<size_t>();
+
+  std::vector<tmc::task<void>> prod(PRODUCERS);
+  for (size_t i = 0; i < PRODUCERS; ++i) {
+    prod[i] = [](
+                tmc::chan_tok<size_t> Chan, size_t Count,
+                sched_stats::origin Origin = sched_stats::task_origin()
+              ) -> tmc::task<void> {
+      sched_stats::record_task(Origin);
+      for (size_t j = 0; j < Count; ++j) {
+        co_await Chan.push(j);
+      }
+    }(chan, ELEMS / PRODUCERS);
+  }
+  std::vector<tmc::task<void>> cons(CONSUMERS);
+  for (size_t i = 0; i < CONSUMERS; ++i) {
+    cons[i] = [](
+                tmc::chan_tok<size_t> Chan,
+                sched_stats::origin Origin = sched_stats::task_origin()
+              ) -> tmc::task<void> {
+      sched_stats::record_task(Origin);
+      while (co_await Chan.pull()) {
+      }
+    }(chan);
+  }
+
+  auto c = tmc::spawn_many(cons).fork();
+  co_await tmc::spawn_many(prod);
+  co_await chan.drain();
+  co_await std::move(c);
+}
+
+struct round_result {
+  size_t duration_us;
+  sched_stats::thread_stats stats;
+};
+
+static round_result
+run_round(tmc::work_stealing_strategy Strategy, tmc::task<void> (*Workload)()) {
+  // The collector must outlive the executor, since the executor's threads
+  // hold pointers into it.
+  sched_stats::collector stats;
+  tmc::ex_cpu ex;
+  stats.install(ex);
+  ex.set_work_stealing_strategy(Strategy).init();
+
+  auto startStats = stats.stats();
+  auto startTime = std::chrono::high_resolution_clock::now();
+  tmc::post_waitable(ex, Workload()).wait();
+  auto endTime = std::chrono::high_resolution_clock::now();
+
+  size_t execDur = static_cast<size_t>(
+    std::chrono::duration_cast<std::chrono::microseconds>(endTime - startTime)
+      .count()
+  );
+  return round_result{execDur, (stats.stats() - startStats).total()};
+}
+
+static void run_mode(
+  const char* WorkloadName, tmc::task<void> (*Workload)(), bool Advised,
+  tmc::work_stealing_strategy Fixed
+) {
+  steal_strategy_advisor advisor;
+  size_t totalUs = 0;
+  size_t switches = 0;
+  for (size_t i = 0; i < ROUNDS; ++i) {
+    auto strategy = Advised ? advisor.strategy() : Fixed;
+    auto result = run_round(strategy, Workload);
+    totalUs += result.duration_us;
+    if (Advised && advisor.update(result.stats)) {
+      ++switches;
+    }
+  }
+  std::printf(
+    "| %s\t| %s\t| %.2f ms\t|", WorkloadName,
+    Advised ? "ADVISED\t" : strategy_name(Fixed),
+    static_cast<double>(totalUs) / 1000.0 / static_cast<double>(ROUNDS)
+  );
+  if (Advised) {
+    std::printf(
+      " %zu switches, ended on %s", switches, strategy_name(advisor.strategy())
+    );
+  }
+  std::printf("\n");
+}
+
+int main() {
+#ifndef TMC_ENABLE_STATS
+  std::printf("WARNING: TMC_ENABLE_STATS is not enabled. ADVISED mode will not "
+              "switch strategies.\n");
+#endif
+  std::printf(
+    "steal_strategy_bench: %zu rounds per mode | output units: mean ms per "
+    "round\n",
+    ROUNDS
+  );
+  std::printf("| workload\t| strategy\t\t| mean\t\t|\n");
+  std::printf("| ------------- | --------------------- | ------------- |\n");
+
+  struct workload {
+    const char* name;
+    tmc::task<void> (*func)();
+  };
+  std::array<workload, 3> workloads{
+    workload{"skynet", skynet_workload}, workload{"fib", fib_workload},
+    workload{"chan", chan_workload}
+  };
+  for (auto& w : workloads) {
+    run_mode(
+      w.name, w.func, false, tmc::work_stealing_strategy::LATTICE_MATRIX
+    );
+    run_mode(
+      w.name, w.func, false, tmc::work_stealing_strategy::HIERARCHY_MATRIX
+    );
+    run_mode(
+      w.name, w.func, true, tmc::work_stealing_strategy::LATTICE_MATRIX
+    );
+  }
+}
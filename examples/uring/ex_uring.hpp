@@ -0,0 +1,1047 @@
+// A single-threaded I/O executor based on Linux io_uring, as an alternative to
+// tmc::ex_asio for network servers.
+//
+// Like tmc::ex_asio, it runs on a single thread and implements
+// tmc::detail::executor_traits, so tasks can be posted to it and it can be used
+// with tmc::enter(), resume_on(), and spawn().run_on(). The thread runs
+// posted work items, and submits and completes I/O operations.
+//
+// I/O operations are awaitables that produce an int, following the io_uring
+// convention: a non-negative value is the result of the operation (bytes
+// transferred or a file descriptor), and a negative value is -errno.
+// - accept, recv, send, read, write, read_fixed, write_fixed, timeout
+// - acceptor: a multishot accept that keeps a single SQE armed to accept many
+//   connections, and queues accepted fds (or errors) until they are awaited
+//
+// If an operation is awaited from another executor (such as tmc::ex_cpu), it
+// is handed over to the io_uring thread to be submitted. When it completes,
+// the awaiting task resumes on its original executor, the same as aw_asio.
+// Awaiting on the io_uring thread itself submits directly, and resumes inline.
+//
+// SQEs are batched: all of the SQEs prepared during one iteration of the
+// executor loop are submitted by a single io_uring_enter() call, which also
+// waits for completions if there is no other work to do.
+//
+// Registered buffers: call set_registered_buffers() before init() to
+// allocate a pool of buffers that are registered with the kernel. Then
+// acquire_buffer() / release_buffer() and read_fixed() / write_fixed() avoid
+// the per-operation cost of mapping user memory. The buffers are allocated by
+// the io_uring thread after it has been pinned, on its own NUMA node (see
+// util/numa_alloc.hpp).
+//
+// This uses the raw io_uring syscalls (no liburing dependency) and requires
+// Linux 5.19+ for multishot accept.
+
+#pragma once
+
+#include "../util/numa_alloc.hpp"
+#include "tmc/current.hpp"
+#include "tmc/detail/awaitable_customizer.hpp"
+#include "tmc/detail/compat.hpp"
+#include "tmc/detail/concepts_awaitable.hpp"
+#include "tmc/detail/thread_locals.hpp"
+#include "tmc/ex_any.hpp"
+#include "tmc/work_item.hpp"
+
+#ifdef TMC_USE_HWLOC
+#include "tmc/topology.hpp"
+#endif
+
+#include <linux/io_uring.h>
+#include <linux/time_types.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cerrno>
+#include <chrono>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace uring {
+class ex_uring;
+
+namespace detail {
+inline int sys_setup(unsigned Entries, io_uring_params* Params) {
+  return static_cast<int>(syscall(__NR_io_uring_setup, Entries, Params));
+}
+
+inline int
+sys_enter(int Fd, unsigned ToSubmit, unsigned MinComplete, unsigned Flags) {
+  return static_cast<int>(syscall(
+    __NR_io_uring_enter, Fd, ToSubmit, MinComplete, Flags, nullptr, size_t{0}
+  ));
+}
+
+inline int sys_register(int Fd, unsigned Opcode, const void* Arg, unsigned Count) {
+  return static_cast<int>(syscall(__NR_io_uring_register, Fd, Opcode, Arg, Count));
+}
+
+// The submission and completion queues shared with the kernel.
+class ring {
+  int fd = -1;
+  void* sq_map = MAP_FAILED;
+  size_t sq_map_len = 0;
+  void* cq_map = MAP_FAILED;
+  size_t cq_map_len = 0;
+  io_uring_sqe* sqes = nullptr;
+  size_t sqes_len = 0;
+
+  unsigned* sq_head = nullptr;
+  unsigned* sq_tail = nullptr;
+  unsigned sq_mask = 0;
+  unsigned sq_entries = 0;
+  unsigned* cq_head = nullptr;
+  unsigned* cq_tail = nullptr;
+  unsigned cq_mask = 0;
+  io_uring_cqe* cqes = nullptr;
+
+  // Tail of the SQEs that have been handed out but not yet published.
+  unsigned local_tail = 0;
+
+  template <typename T> static T* at(void* Base, uint32_t Offset) {
+    return static_cast<T*>(static_cast<void*>(static_cast<char*>(Base) + Offset));
+  }
+
+public:
+  ring() = default;
+  ring(const ring&) = delete;
+  ring& operator=(const ring&) = delete;
+
+  /// Returns 0 on success, or -errno.
+  int init(unsigned Entries) {
+    io_uring_params p{};
+    // These flags reduce the overhead of completions, but require newer
+    // kernels. Fall back to no flags if they are rejected.
+    p.flags = IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_COOP_TASKRUN;
+    fd = sys_setup(Entries, &p);
+    if (fd < 0 && errno == EINVAL) {
+      p = io_uring_params{};
+      fd = sys_setup(Entries, &p);
+    }
+    if (fd < 0) {
+      return -errno;
+    }
+
+    sq_map_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cq_map_len = p.cq_off.cqes + p.cq_entries * sizeof(io_uring_cqe);
+    bool singleMap = (p.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (singleMap) {
+      sq_map_len = cq_map_len = std::max(sq_map_len, cq_map_len);
+    }
+    sq_map = mmap(
+      nullptr, sq_map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+      IORING_OFF_SQ_RING
+    );
+    if (sq_map == MAP_FAILED) {
+      return -errno;
+    }
+    if (singleMap) {
+      cq_map = sq_map;
+    } else {
+      cq_map = mmap(
+        nullptr, cq_map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+        fd, IORING_OFF_CQ_RING
+      );
+      if (cq_map == MAP_FAILED) {
+        return -errno;
+      }
+    }
+    sqes_len = p.sq_entries * sizeof(io_uring_sqe);
+    void* sqeMap = mmap(
+      nullptr, sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+      IORING_OFF_SQES
+    );
+    if (sqeMap == MAP_FAILED) {
+      return -errno;
+    }
+    sqes = static_cast<io_uring_sqe*>(sqeMap);
+
+    sq_head = at<unsigned>(sq_map, p.sq_off.head);
+    sq_tail = at<unsigned>(sq_map, p.sq_off.tail);
+    sq_mask = *at<unsigned>(sq_map, p.sq_off.ring_mask);
+    sq_entries = *at<unsigned>(sq_map, p.sq_off.ring_entries);
+    cq_head = at<unsigned>(cq_map, p.cq_off.head);
+    cq_tail = at<unsigned>(cq_map, p.cq_off.tail);
+    cq_mask = *at<unsigned>(cq_map, p.cq_off.ring_mask);
+    cqes = at<io_uring_cqe>(cq_map, p.cq_off.cqes);
+
+    // SQEs are always used in order, so the indirection array is the identity.
+    unsigned* array = at<unsigned>(sq_map, p.sq_off.array);
+    for (unsigned i = 0; i < sq_entries; ++i) {
+      array[i] = i;
+    }
+    local_tail = *sq_tail;
+    return 0;
+  }
+
+  ~ring() {
+    if (sqes != nullptr) {
+      munmap(sqes, sqes_len);
+    }
+    if (cq_map != MAP_FAILED && cq_map != sq_map) {
+      munmap(cq_map, cq_map_len);
+    }
+    if (sq_map != MAP_FAILED) {
+      munmap(sq_map, sq_map_len);
+    }
+    if (fd >= 0) {
+      close(fd);
+    }
+  }
+
+  int raw_fd() const { return fd; }
+
+  /// Returns a zeroed SQE, or nullptr if the submission queue is full.
+  io_uring_sqe* get_sqe() {
+    unsigned head = std::atomic_ref<unsigned>(*sq_head).load(std::memory_order_acquire);
+    if (local_tail - head >= sq_entries) {
+      return nullptr;
+    }
+    io_uring_sqe* sqe = &sqes[local_tail & sq_mask];
+    std::memset(sqe, 0, sizeof(*sqe));
+    ++local_tail;
+    return sqe;
+  }
+
+  /// Publish all prepared SQEs and submit them to the kernel with a single
+  /// syscall. If WaitFor is nonzero, also blocks until that many completions
+  /// are available. Returns the io_uring_enter result.
+  int submit(unsigned WaitFor) {
+    std::atomic_ref<unsigned>(*sq_tail).store(local_tail, std::memory_order_release);
+    unsigned head = std::atomic_ref<unsigned>(*sq_head).load(std::memory_order_acquire);
+    unsigned toSubmit = local_tail - head;
+    if (toSubmit == 0 && WaitFor == 0) {
+      return 0;
+    }
+    unsigned flags = WaitFor != 0 ? IORING_ENTER_GETEVENTS : 0;
+    int result = sys_enter(fd, toSubmit, WaitFor, flags);
+    return result < 0 ? -errno : result;
+  }
+
+  bool has_cqes() const {
+    return *cq_head !=
+           std::atomic_ref<unsigned>(*cq_tail).load(std::memory_order_acquire);
+  }
+
+  /// Invoke Func on each available CQE. Func may prepare new SQEs.
+  template <typename F> void drain_cqes(F&& Func) {
+    unsigned head = *cq_head;
+    unsigned tail = std::atomic_ref<unsigned>(*cq_tail).load(std::memory_order_acquire);
+    while (head != tail) {
+      io_uring_cqe cqe = cqes[head & cq_mask];
+      ++head;
+      // Release the slot before running the callback, which may take a while.
+      std::atomic_ref<unsigned>(*cq_head).store(head, std::memory_order_release);
+      Func(cqe);
+    }
+  }
+
+  int register_buffers(const iovec* Buffers, unsigned Count) {
+    int result = sys_register(fd, IORING_REGISTER_BUFFERS, Buffers, Count);
+    return result < 0 ? -errno : result;
+  }
+};
+
+// Common header of every operation. The user_data of each SQE points to one of
+// these. Function pointers are used rather than virtual functions so that the
+// awaitables can be defined in this header without weak vtables.
+struct op_base {
+  // Called on the io_uring thread to start the operation.
+  void (*start)(op_base* Op, ex_uring& Ex);
+  // Called on the io_uring thread when a CQE for this operation arrives.
+  void (*complete)(op_base* Op, ex_uring& Ex, int Res, uint32_t Flags);
+};
+
+// Identifies the CQE of the eventfd poll that wakes the io_uring thread.
+inline constexpr uint64_t WAKE_USER_DATA = 0;
+} // namespace detail
+
+/// A buffer from the registered buffer pool. An index of -1 means that no
+/// buffer was available.
+struct registered_buffer {
+  int index;
+  char* data;
+  size_t size;
+};
+
+class ex_uring {
+  struct posted_item {
+    tmc::work_item item;
+    size_t prio;
+  };
+
+  detail::ring ring;
+  tmc::ex_any type_erased_this;
+  std::thread worker;
+  int wake_fd = -1;
+  uint64_t wake_value = 0;
+  bool wake_armed = false;
+
+  // Shared with other threads
+  std::mutex queue_lock;
+  std::vector<posted_item> queue;
+  std::vector<detail::op_base*> remote_ops;
+  std::atomic<bool> sleeping{false};
+  std::atomic<bool> stop_requested{false};
+
+  // Registered buffers
+  size_t buffer_count = 0;
+  size_t buffer_size = 0;
+  char* buffer_memory = nullptr;
+  std::mutex buffer_lock;
+  std::vector<int> free_buffers;
+
+  // Configuration
+  unsigned queue_depth = 4096;
+  std::function<void(size_t)> init_hook;
+  std::function<void(size_t)> teardown_hook;
+#ifdef TMC_USE_HWLOC
+  tmc::topology::topology_filter partition;
+  bool has_partition = false;
+#endif
+  bool is_initialized = false;
+
+  friend struct tmc::detail::executor_traits<ex_uring>;
+
+  void wake() {
+    if (sleeping.exchange(false, std::memory_order_seq_cst)) {
+      uint64_t one = 1;
+      [[maybe_unused]] auto n = ::write(wake_fd, &one, sizeof(one));
+    }
+  }
+
+  // If no SQE is available, wake_armed stays false, and run_loop() retries
+  // before it sleeps.
+  void arm_wake_poll() {
+    int err = 0;
+    io_uring_sqe* sqe = get_sqe(err);
+    if (sqe == nullptr) {
+      return;
+    }
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = wake_fd;
+    sqe->poll32_events = POLLIN;
+    sqe->len = IORING_POLL_ADD_MULTI;
+    sqe->user_data = detail::WAKE_USER_DATA;
+    wake_armed = true;
+  }
+
+  void handle_cqe(const io_uring_cqe& Cqe) {
+    if (Cqe.user_data == detail::WAKE_USER_DATA) {
+      // Reset the eventfd counter. The poll stays armed unless the kernel
+      // says otherwise.
+      [[maybe_unused]] auto n = ::read(wake_fd, &wake_value, sizeof(wake_value));
+      if ((Cqe.flags & IORING_CQE_F_MORE) == 0) {
+        wake_armed = false;
+        arm_wake_poll();
+      }
+      return;
+    }
+    auto op = reinterpret_cast<detail::op_base*>(Cqe.user_data);
+    op->complete(op, *this, Cqe.res, Cqe.flags);
+  }
+
+  // Returns true if any work was found.
+  bool run_posted() {
+    std::vector<posted_item> items;
+    std::vector<detail::op_base*> ops;
+    {
+      std::lock_guard<std::mutex> lg{queue_lock};
+      items.swap(queue);
+      ops.swap(remote_ops);
+    }
+    for (auto op : ops) {
+      op->start(op, *this);
+    }
+    for (auto& p : items) {
+      tmc::detail::this_thread::this_task().prio = p.prio;
+      p.item();
+    }
+    return !items.empty() || !ops.empty();
+  }
+
+  bool has_posted() {
+    std::lock_guard<std::mutex> lg{queue_lock};
+    return !queue.empty() || !remote_ops.empty();
+  }
+
+  void run_loop() {
+    arm_wake_poll();
+    while (!stop_requested.load(std::memory_order_relaxed)) {
+      bool didWork = run_posted();
+      ring.drain_cqes([this](const io_uring_cqe& Cqe) { handle_cqe(Cqe); });
+      if (!wake_armed) {
+        arm_wake_poll();
+      }
+      // Without the wake poll, a post() from another thread could not
+      // interrupt the wait below, so keep polling until it can be armed.
+      if (didWork || ring.has_cqes() || !wake_armed) {
+        // Flush new SQEs without waiting, and go around again.
+        ring.submit(0);
+        continue;
+      }
+      sleeping.store(true, std::memory_order_seq_cst);
+      if (has_posted() || stop_requested.load(std::memory_order_relaxed)) {
+        sleeping.store(false, std::memory_order_relaxed);
+        continue;
+      }
+      // Submit everything prepared this iteration and wait for a completion
+      // (or a wakeup via the eventfd) in one syscall.
+      ring.submit(1);
+      sleeping.store(false, std::memory_order_relaxed);
+      ring.drain_cqes([this](const io_uring_cqe& Cqe) { handle_cqe(Cqe); });
+    }
+  }
+
+public:
+  ex_uring() : type_erased_this(this) {}
+
+  ex_uring(const ex_uring&) = delete;
+  ex_uring& operator=(const ex_uring&) = delete;
+
+  ~ex_uring() { teardown(); }
+
+  /// Sets the number of submission queue entries. Default 4096.
+  ex_uring& set_queue_depth(unsigned Entries) {
+    assert(!is_initialized);
+    queue_depth = Entries;
+    return *this;
+  }
+
+  /// Allocates Count buffers of Size bytes each and registers them with the
+  /// kernel during init().
+  ex_uring& set_registered_buffers(size_t Count, size_t Size) {
+    assert(!is_initialized);
+    buffer_count = Count;
+    buffer_size = Size;
+    return *this;
+  }
+
+#ifdef TMC_USE_HWLOC
+  /// Pins the io_uring thread to the cores that match Filter.
+  ex_uring& add_partition(tmc::topology::topology_filter Filter) {
+    assert(!is_initialized);
+    partition = Filter;
+    has_partition = true;
+    return *this;
+  }
+#endif
+
+  ex_uring& set_thread_init_hook(std::function<void(size_t)> Hook) {
+    assert(!is_initialized);
+    init_hook = std::move(Hook);
+    return *this;
+  }
+
+  ex_uring& set_thread_teardown_hook(std::function<void(size_t)> Hook) {
+    assert(!is_initialized);
+    teardown_hook = std::move(Hook);
+    return *this;
+  }
+
+  /// Starts the io_uring thread. Terminates the process if io_uring is not
+  /// available.
+  void init() {
+    if (is_initialized) {
+      return;
+    }
+    is_initialized = true;
+    wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (buffer_count != 0) {
+      free_buffers.reserve(buffer_count);
+      for (size_t i = buffer_count; i > 0; --i) {
+        free_buffers.push_back(static_cast<int>(i - 1));
+      }
+    }
+
+    // With IORING_SETUP_SINGLE_ISSUER, all submissions must come from the
+    // thread that created the ring, so it is created on the worker thread.
+    std::promise<int> ready;
+    auto readyFuture = ready.get_future();
+    worker = std::thread([this, &ready]() {
+#ifdef TMC_USE_HWLOC
+      if (has_partition) {
+        tmc::topology::pin_thread(partition);
+      }
+#endif
+      // The ring's SQ / CQ memory is allocated by the kernel on behalf of this
+      // thread, so it is already local. Allocate the buffer pool here too, so
+      // that it is on this thread's NUMA node rather than init()'s.
+      int err = ring.init(queue_depth);
+      if (err == 0 && buffer_count != 0) {
+        buffer_memory =
+          static_cast<char*>(numa::alloc_local(buffer_count * buffer_size));
+        if (buffer_memory == nullptr) {
+          err = -ENOMEM;
+        }
+      }
+      if (err == 0 && buffer_count != 0) {
+        std::vector<iovec> iovs(buffer_count);
+        for (size_t i = 0; i < buffer_count; ++i) {
+          iovs[i].iov_base = buffer_memory + i * buffer_size;
+          iovs[i].iov_len = buffer_size;
+        }
+        err = ring.register_buffers(iovs.data(), static_cast<unsigned>(iovs.size()));
+      }
+      ready.set_value(err);
+      if (err != 0) {
+        return;
+      }
+      tmc::detail::this_thread::executor() = &type_erased_this;
+      if (init_hook) {
+        init_hook(0);
+      }
+      run_loop();
+      if (teardown_hook) {
+        teardown_hook(0);
+      }
+      tmc::detail::this_thread::executor() = nullptr;
+    });
+    int err = readyFuture.get();
+    if (err != 0) {
+      std::fprintf(stderr, "ex_uring: io_uring setup failed: %s\n", std::strerror(-err));
+      std::abort();
+    }
+  }
+
+  /// Stops the io_uring thread. Operations that are still pending are
+  /// abandoned.
+  void teardown() {
+    if (!is_initialized) {
+      return;
+    }
+    stop_requested.store(true, std::memory_order_seq_cst);
+    sleeping.store(true, std::memory_order_seq_cst);
+    wake();
+    worker.join();
+    close(wake_fd);
+    numa::free_local(buffer_memory, buffer_count * buffer_size);
+    buffer_memory = nullptr;
+    is_initialized = false;
+    stop_requested.store(false, std::memory_order_relaxed);
+  }
+
+  void post(tmc::work_item&& Item, size_t Priority = 0, size_t ThreadHint = NO_HINT) {
+    (void)ThreadHint;
+    {
+      std::lock_guard<std::mutex> lg{queue_lock};
+      queue.push_back(posted_item{std::move(Item), Priority});
+    }
+    wake();
+  }
+
+  template <typename Iter>
+  void
+  post_bulk(Iter It, size_t Count, size_t Priority = 0, size_t ThreadHint = NO_HINT) {
+    (void)ThreadHint;
+    {
+      std::lock_guard<std::mutex> lg{queue_lock};
+      for (size_t i = 0; i < Count; ++i) {
+        queue.push_back(posted_item{std::move(*It), Priority});
+        ++It;
+      }
+    }
+    wake();
+  }
+
+  /// Returns a pointer to the type erased `ex_any` version of this executor.
+  tmc::ex_any* type_erased() TMC_LIFETIMEBOUND { return &type_erased_this; }
+
+  /// True if the caller is running on this executor's thread.
+  bool is_current() const {
+    return tmc::detail::this_thread::executor() == &type_erased_this;
+  }
+
+  /// Returns a zeroed SQE, flushing the submission queue first if it is full.
+  /// If the flush fails (for example with -EBUSY when the completion queue
+  /// has overflowed), returns nullptr and sets Err to the -errno result.
+  /// Must be called on the io_uring thread.
+  io_uring_sqe* get_sqe(int& Err) {
+    io_uring_sqe* sqe = ring.get_sqe();
+    while (sqe == nullptr) {
+      int submitted = ring.submit(0);
+      if (submitted == -EINTR) {
+        continue;
+      }
+      if (submitted <= 0) {
+        Err = submitted < 0 ? submitted : -EAGAIN;
+        return nullptr;
+      }
+      sqe = ring.get_sqe();
+    }
+    return sqe;
+  }
+
+  /// Starts Op on the io_uring thread. If called from that thread, it starts
+  /// immediately. Otherwise, it is handed off to the thread.
+  void start(detail::op_base* Op) {
+    if (is_current()) {
+      Op->start(Op, *this);
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> lg{queue_lock};
+      remote_ops.push_back(Op);
+    }
+    wake();
+  }
+
+  /// Take a buffer from the registered buffer pool. Thread-safe.
+  registered_buffer acquire_buffer() {
+    std::lock_guard<std::mutex> lg{buffer_lock};
+    if (free_buffers.empty()) {
+      return registered_buffer{-1, nullptr, 0};
+    }
+    int idx = free_buffers.back();
+    free_buffers.pop_back();
+    return registered_buffer{
+      idx, buffer_memory + static_cast<size_t>(idx) * buffer_size, buffer_size
+    };
+  }
+
+  /// Return a buffer to the registered buffer pool. Thread-safe.
+  void release_buffer(registered_buffer Buffer) {
+    if (Buffer.index < 0) {
+      return;
+    }
+    std::lock_guard<std::mutex> lg{buffer_lock};
+    free_buffers.push_back(Buffer.index);
+  }
+};
+
+/// The fields of a single-shot SQE.
+struct sqe_args {
+  uint8_t opcode;
+  int fd;
+  uint64_t addr;
+  uint32_t len;
+  uint64_t off;
+  uint32_t op_flags;
+  uint16_t buf_index;
+};
+
+struct AwUringOpTag {};
+
+/// An awaitable for a single io_uring operation. Produces the CQE result.
+class [[nodiscard]] aw_uring_op : private detail::op_base, AwUringOpTag {
+  ex_uring* ex;
+  sqe_args args;
+  __kernel_timespec ts;
+  int result = 0;
+
+  static void start_impl(detail::op_base* Op, ex_uring& Ex) {
+    auto self = static_cast<aw_uring_op*>(Op);
+    int err = 0;
+    io_uring_sqe* sqe = Ex.get_sqe(err);
+    if (sqe == nullptr) {
+      // This may be running inside await_suspend() of the awaiting task, so
+      // don't resume it inline.
+      *self->customizer.result_ptr = err;
+      auto next = self->customizer.resume_continuation();
+      if (next != std::noop_coroutine()) {
+        Ex.post(std::move(next), tmc::current_priority());
+      }
+      return;
+    }
+    sqe->opcode = self->args.opcode;
+    sqe->fd = self->args.fd;
+    sqe->addr = self->args.addr;
+    sqe->len = self->args.len;
+    sqe->off = self->args.off;
+    // Shares storage with rw_flags, accept_flags, etc.
+    sqe->msg_flags = self->args.op_flags;
+    sqe->buf_index = self->args.buf_index;
+    if (self->args.opcode == IORING_OP_TIMEOUT) {
+      // Taken from this object rather than args, since it may have been moved
+      // before the operation was started.
+      sqe->addr = reinterpret_cast<uint64_t>(&self->ts);
+    }
+    sqe->user_data = reinterpret_cast<uint64_t>(Op);
+  }
+
+  static void
+  complete_impl(detail::op_base* Op, ex_uring&, int Res, uint32_t) {
+    auto self = static_cast<aw_uring_op*>(Op);
+    *self->customizer.result_ptr = Res;
+    auto next = self->customizer.resume_continuation();
+    if (next != std::noop_coroutine()) {
+      next.resume();
+    }
+  }
+
+public:
+  tmc::detail::awaitable_customizer<int> customizer;
+
+  aw_uring_op(ex_uring& Ex, sqe_args Args, __kernel_timespec Ts = {})
+      : detail::op_base{&start_impl, &complete_impl}, ex(&Ex), args(Args), ts(Ts) {
+    if (tmc::current_executor() == nullptr) {
+      customizer.flags = 0;
+    }
+  }
+
+  void async_initiate() { ex->start(this); }
+
+  bool await_ready() const noexcept { return false; }
+  void await_suspend(std::coroutine_handle<> Outer) noexcept {
+    customizer.continuation = Outer.address();
+    customizer.result_ptr = &result;
+    async_initiate();
+  }
+  int await_resume() const noexcept { return result; }
+};
+
+/// Accept a single connection on a listening socket.
+inline aw_uring_op accept(ex_uring& Ex, int ListenFd, int Flags = SOCK_CLOEXEC) {
+  return aw_uring_op(
+    Ex, sqe_args{IORING_OP_ACCEPT, ListenFd, 0, 0, 0, static_cast<uint32_t>(Flags), 0}
+  );
+}
+
+inline aw_uring_op
+recv(ex_uring& Ex, int Fd, void* Buf, size_t Len, int MsgFlags = 0) {
+  return aw_uring_op(
+    Ex, sqe_args{
+          IORING_OP_RECV, Fd, reinterpret_cast<uint64_t>(Buf),
+          static_cast<uint32_t>(Len), 0, static_cast<uint32_t>(MsgFlags), 0
+        }
+  );
+}
+
+inline aw_uring_op
+send(ex_uring& Ex, int Fd, const void* Buf, size_t Len, int MsgFlags = MSG_NOSIGNAL) {
+  return aw_uring_op(
+    Ex, sqe_args{
+          IORING_OP_SEND, Fd, reinterpret_cast<uint64_t>(Buf),
+          static_cast<uint32_t>(Len), 0, static_cast<uint32_t>(MsgFlags), 0
+        }
+  );
+}
+
+/// Offset -1 uses (and advances) the current file position.
+inline aw_uring_op
+read(ex_uring& Ex, int Fd, void* Buf, size_t Len, uint64_t Offset = ~uint64_t{0}) {
+  return aw_uring_op(
+    Ex, sqe_args{
+          IORING_OP_READ, Fd, reinterpret_cast<uint64_t>(Buf),
+          static_cast<uint32_t>(Len), Offset, 0, 0
+        }
+  );
+}
+
+inline aw_uring_op write(
+  ex_uring& Ex, int Fd, const void* Buf, size_t Len, uint64_t Offset = ~uint64_t{0}
+) {
+  return aw_uring_op(
+    Ex, sqe_args{
+          IORING_OP_WRITE, Fd, reinterpret_cast<uint64_t>(Buf),
+          static_cast<uint32_t>(Len), Offset, 0, 0
+        }
+  );
+}
+
+/// Read into (a prefix of) a registered buffer.
+inline aw_uring_op read_fixed(
+  ex_uring& Ex, int Fd, registered_buffer Buf, size_t Len,
+  uint64_t Offset = ~uint64_t{0}
+) {
+  return aw_uring_op(
+    Ex, sqe_args{
+          IORING_OP_READ_FIXED, Fd, reinterpret_cast<uint64_t>(Buf.data),
+          static_cast<uint32_t>(Len), Offset, 0, static_cast<uint16_t>(Buf.index)
+        }
+  );
+}
+
+/// Write from (a prefix of) a registered buffer.
+inline aw_uring_op write_fixed(
+  ex_uring& Ex, int Fd, registered_buffer Buf, size_t Len,
+  uint64_t Offset = ~uint64_t{0}
+) {
+  return aw_uring_op(
+    Ex, sqe_args{
+          IORING_OP_WRITE_FIXED, Fd, reinterpret_cast<uint64_t>(Buf.data),
+          static_cast<uint32_t>(Len), Offset, 0, static_cast<uint16_t>(Buf.index)
+        }
+  );
+}
+
+/// Completes with -ETIME after Duration elapses.
+template <typename Rep, typename Period>
+aw_uring_op timeout(ex_uring& Ex, std::chrono::duration<Rep, Period> Duration) {
+  auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(Duration).count();
+  __kernel_timespec ts{};
+  ts.tv_sec = ns / 1000000000;
+  ts.tv_nsec = ns % 1000000000;
+  return aw_uring_op(Ex, sqe_args{IORING_OP_TIMEOUT, -1, 0, 1, 0, 0, 0}, ts);
+}
+
+struct AwAcceptNextTag {};
+class acceptor;
+
+/// Awaitable returned by acceptor::accept(). Produces the accepted fd, or
+/// -errno. An error may have occurred before this was awaited.
+class [[nodiscard]] aw_accept_next : private detail::op_base, AwAcceptNextTag {
+  friend class acceptor;
+  acceptor* acc;
+  aw_accept_next* next_waiter = nullptr;
+  int result = 0;
+
+  static void start_impl(detail::op_base* Op, ex_uring& Ex);
+  void finish(ex_uring& Ex, int Res, bool Inline);
+
+public:
+  tmc::detail::awaitable_customizer<int> customizer;
+
+  explicit aw_accept_next(acceptor& Acc)
+      : detail::op_base{&start_impl, nullptr}, acc(&Acc) {
+    if (tmc::current_executor() == nullptr) {
+      customizer.flags = 0;
+    }
+  }
+
+  void async_initiate();
+
+  bool await_ready() noexcept;
+  void await_suspend(std::coroutine_handle<> Outer) noexcept {
+    customizer.continuation = Outer.address();
+    customizer.result_ptr = &result;
+    async_initiate();
+  }
+  int await_resume() const noexcept { return result; }
+};
+
+/// Accepts connections using a single multishot accept SQE. Connections that
+/// arrive while nobody is awaiting accept() are queued, as are accept errors,
+/// so that each result is delivered to exactly one waiter. All state is
+/// accessed only on the io_uring thread.
+class acceptor : private detail::op_base {
+  friend class aw_accept_next;
+  ex_uring& ex;
+  int listen_fd;
+  bool armed = false;
+  // Accepted fds, or -errno
+  std::deque<int> ready;
+  aw_accept_next* waiters_head = nullptr;
+  aw_accept_next* waiters_tail = nullptr;
+
+  // Returns 0, or -errno if no SQE could be obtained.
+  int arm() {
+    int err = 0;
+    io_uring_sqe* sqe = ex.get_sqe(err);
+    if (sqe == nullptr) {
+      return err;
+    }
+    sqe->opcode = IORING_OP_ACCEPT;
+    sqe->fd = listen_fd;
+    sqe->accept_flags = static_cast<uint32_t>(SOCK_CLOEXEC);
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+    sqe->user_data = reinterpret_cast<uint64_t>(static_cast<detail::op_base*>(this));
+    armed = true;
+    return 0;
+  }
+
+  // Completes every waiter with Err.
+  void fail_waiters(ex_uring& Ex, int Err, bool Inline) {
+    auto w = waiters_head;
+    waiters_head = nullptr;
+    waiters_tail = nullptr;
+    while (w != nullptr) {
+      auto next = w->next_waiter;
+      w->finish(Ex, Err, Inline);
+      w = next;
+    }
+  }
+
+  static void
+  complete_impl(detail::op_base* Op, ex_uring& Ex, int Res, uint32_t Flags) {
+    auto self = static_cast<acceptor*>(Op);
+    if ((Flags & IORING_CQE_F_MORE) == 0) {
+      self->armed = false;
+    }
+    auto w = self->waiters_head;
+    if (w != nullptr) {
+      self->waiters_head = w->next_waiter;
+      if (self->waiters_head == nullptr) {
+        self->waiters_tail = nullptr;
+      }
+      int err = 0;
+      if (!self->armed && self->waiters_head != nullptr) {
+        err = self->arm();
+      }
+      if (err != 0) {
+        // The remaining waiters would never be completed.
+        self->fail_waiters(Ex, err, false);
+      }
+      w->finish(Ex, Res, true);
+    } else {
+      self->ready.push_back(Res);
+    }
+  }
+
+  void add_waiter(aw_accept_next* W) {
+    W->next_waiter = nullptr;
+    if (waiters_tail == nullptr) {
+      waiters_head = W;
+    } else {
+      waiters_tail->next_waiter = W;
+    }
+    waiters_tail = W;
+    if (!armed) {
+      int err = arm();
+      if (err != 0) {
+        // This may be running inside await_suspend() of the awaiting task.
+        fail_waiters(ex, err, false);
+      }
+    }
+  }
+
+public:
+  acceptor(ex_uring& Ex, int ListenFd)
+      : detail::op_base{nullptr, &complete_impl}, ex(Ex), listen_fd(ListenFd) {}
+
+  acceptor(const acceptor&) = delete;
+  acceptor& operator=(const acceptor&) = delete;
+
+  aw_accept_next accept() { return aw_accept_next(*this); }
+};
+
+inline void aw_accept_next::start_impl(detail::op_base* Op, ex_uring& Ex) {
+  auto self = static_cast<aw_accept_next*>(Op);
+  auto& acc = *self->acc;
+  if (!acc.ready.empty()) {
+    int fd = acc.ready.front();
+    acc.ready.pop_front();
+    // This may be running inside await_suspend() of the awaiting task, so
+    // don't resume it inline.
+    self->finish(Ex, fd, false);
+    return;
+  }
+  acc.add_waiter(self);
+}
+
+inline void aw_accept_next::finish(ex_uring& Ex, int Res, bool Inline) {
+  *customizer.result_ptr = Res;
+  auto next = customizer.resume_continuation();
+  if (next != std::noop_coroutine()) {
+    if (Inline) {
+      next.resume();
+    } else {
+      Ex.post(std::move(next), tmc::current_priority());
+    }
+  }
+}
+
+inline void aw_accept_next::async_initiate() { acc->ex.start(this); }
+
+inline bool aw_accept_next::await_ready() noexcept {
+  // Take an already-accepted connection without suspending, if possible.
+  if (acc->ex.is_current() && !acc->ready.empty()) {
+    result = acc->ready.front();
+    acc->ready.pop_front();
+    return true;
+  }
+  return false;
+}
+
+inline ex_uring& uring_executor() {
+  static ex_uring ex;
+  return ex;
+}
+} // namespace uring
+
+namespace tmc::detail {
+template <> struct executor_traits<uring::ex_uring> {
+  static inline void
+  post(uring::ex_uring& Ex, tmc::work_item&& Item, size_t Priority, size_t ThreadHint) {
+    Ex.post(std::move(Item), Priority, ThreadHint);
+  }
+
+  template <typename It>
+  static inline void post_bulk(
+    uring::ex_uring& Ex, It&& Items, size_t Count, size_t Priority, size_t ThreadHint
+  ) {
+    Ex.post_bulk(std::forward<It>(Items), Count, Priority, ThreadHint);
+  }
+
+  static inline tmc::ex_any* type_erased(uring::ex_uring& Ex TMC_LIFETIMEBOUND) {
+    return Ex.type_erased();
+  }
+
+  static inline std::coroutine_handle<>
+  dispatch(uring::ex_uring& Ex, std::coroutine_handle<> Outer, size_t Priority) {
+    if (Ex.is_current()) {
+      tmc::detail::this_thread::this_task().prio = Priority;
+      return Outer;
+    }
+    Ex.post(std::move(Outer), Priority);
+    return std::noop_coroutine();
+  }
+};
+
+template <typename T>
+concept IsAwUring = std::is_base_of_v<uring::AwUringOpTag, T> ||
+                    std::is_base_of_v<uring::AwAcceptNextTag, T>;
+
+template <IsAwUring Awaitable> struct awaitable_traits<Awaitable> {
+  using result_type = int;
+  using self_type = Awaitable;
+
+  static decltype(auto) get_awaiter(self_type& awaitable) noexcept {
+    return awaitable;
+  }
+  static decltype(auto) get_awaiter(self_type&& awaitable) noexcept {
+    return static_cast<self_type&>(awaitable);
+  }
+
+  static constexpr configure_mode mode = ASYNC_INITIATE;
+  static void async_initiate(
+    self_type& awaitable, [[maybe_unused]] tmc::ex_any* Executor,
+    [[maybe_unused]] size_t Priority
+  ) {
+    awaitable.async_initiate();
+  }
+  static void async_initiate(
+    self_type&& awaitable, [[maybe_unused]] tmc::ex_any* Executor,
+    [[maybe_unused]] size_t Priority
+  ) {
+    awaitable.async_initiate();
+  }
+
+  static void set_result_ptr(
+    self_type& awaitable, tmc::detail::result_storage_t<result_type>* ResultPtr
+  ) {
+    awaitable.customizer.result_ptr = ResultPtr;
+  }
+  static void set_continuation(self_type& awaitable, void* Continuation) {
+    awaitable.customizer.continuation = Continuation;
+  }
+  static void set_continuation_executor(self_type& awaitable, void* ContExec) {
+    awaitable.customizer.continuation_executor = ContExec;
+  }
+  static void set_done_count(self_type& awaitable, void* DoneCount) {
+    awaitable.customizer.done_count = DoneCount;
+  }
+  static void set_flags(self_type& awaitable, size_t Flags) {
+    awaitable.customizer.flags = Flags;
+  }
+};
+} // namespace tmc::detail
@@ -0,0 +1,147 @@
+// A keep-alive HTTP/1.1 connection handler for ex_uring, built on
+// util/http_parser.hpp. This is the io_uring counterpart of
+// asio/http_engine.hpp, specialized for the "Hello World!" response that the
+// example servers send.
+//
+// serve_hello() reads into a single buffer (a registered buffer, if one is
+// available) and parses requests in place. Every complete request in the
+// buffer is answered before anything is written, so a batch of pipelined
+// requests produces a single send of all of the responses. A request that is
+// split across reads is kept in the buffer until the rest of it arrives; only
+// that partial request is moved back to the front of the buffer.
+
+#pragma once
+
+#include "../util/http_parser.hpp"
+#include "ex_uring.hpp"
+#include "tmc/task.hpp"
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <string_view>
+
+namespace uring {
+namespace detail {
+// The same bytes that http::serve_connection() writes for http::hello_world,
+// so that the servers can be compared directly.
+inline constexpr std::string_view HELLO_RESPONSE =
+  "HTTP/1.1 200 OK\r\nContent-Length: 12\r\n"
+  "Content-Type: text/plain; charset=utf-8\r\n\r\nHello World!";
+inline constexpr std::string_view HELLO_CLOSE_RESPONSE =
+  "HTTP/1.1 200 OK\r\nContent-Length: 12\r\n"
+  "Content-Type: text/plain; charset=utf-8\r\nConnection: close\r\n\r\n"
+  "Hello World!";
+inline constexpr std::string_view BAD_REQUEST_RESPONSE =
+  "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+inline constexpr std::string_view TOO_LARGE_RESPONSE =
+  "HTTP/1.1 413 Content Too Large\r\nContent-Length: 0\r\n"
+  "Connection: close\r\n\r\n";
+inline constexpr std::string_view HEADERS_TOO_LARGE_RESPONSE =
+  "HTTP/1.1 431 Request Header Fields Too Large\r\nContent-Length: 0\r\n"
+  "Connection: close\r\n\r\n";
+} // namespace detail
+
+/// Sends all of [Data, Data + Size). Returns false if the connection failed.
+inline tmc::task<bool> send_all(ex_uring& Ex, int Fd, const char* Data, size_t Size) {
+  size_t sent = 0;
+  while (sent < Size) {
+    int n = co_await send(Ex, Fd, Data + sent, Size - sent);
+    if (n <= 0) {
+      co_return false;
+    }
+    sent += static_cast<size_t>(n);
+  }
+  co_return true;
+}
+
+/// Answers every request on Fd with "Hello World!" until the peer closes the
+/// connection, a request asks to close it, or an error occurs. Then closes Fd.
+inline tmc::task<void> serve_hello(ex_uring& Ex, int Fd) {
+  // Use a registered buffer if one is available. Otherwise, fall back to a
+  // regular buffer. A single request must fit in the buffer.
+  auto reg = Ex.acquire_buffer();
+  char data[4096];
+  char* buf = reg.index >= 0 ? reg.data : data;
+  size_t capacity = reg.index >= 0 ? reg.size : sizeof(data);
+  // Unconsumed bytes are in [begin, end)
+  size_t begin = 0;
+  size_t end = 0;
+  http::request_parser parser;
+  std::string out;
+  bool open = true;
+
+  while (open) {
+    if (end == capacity) {
+      if (begin == 0) {
+        // Oversized bodies are caught below, as soon as their headers are
+        // parsed, so the headers alone don't fit.
+        co_await send_all(
+          Ex, Fd, detail::HEADERS_TOO_LARGE_RESPONSE.data(),
+          detail::HEADERS_TOO_LARGE_RESPONSE.size()
+        );
+        break;
+      }
+      // Move the partial request to the front of the buffer.
+      std::memmove(buf, buf + begin, end - begin);
+      end -= begin;
+      begin = 0;
+    }
+
+    int n;
+    if (reg.index >= 0) {
+      registered_buffer tail{reg.index, buf + end, capacity - end};
+      n = co_await read_fixed(Ex, Fd, tail, tail.size);
+    } else {
+      n = co_await recv(Ex, Fd, buf + end, capacity - end);
+    }
+    if (n <= 0) {
+      break;
+    }
+    end += static_cast<size_t>(n);
+
+    // Answer every complete request that is in the buffer.
+    out.clear();
+    while (begin < end) {
+      http::request req;
+      auto result = parser.parse(buf + begin, end - begin, req);
+      if (result.status == http::parse_status::INCOMPLETE) {
+        if (result.expected > capacity) {
+          // Don't wait for a body that will never fit. Reply after the
+          // responses to the earlier requests in this batch.
+          out += detail::TOO_LARGE_RESPONSE;
+          open = false;
+        }
+        break;
+      }
+      if (result.status == http::parse_status::BAD_MESSAGE) {
+        out += detail::BAD_REQUEST_RESPONSE;
+        open = false;
+        break;
+      }
+      begin += result.consumed;
+      if (!req.keep_alive) {
+        out += detail::HELLO_CLOSE_RESPONSE;
+        open = false;
+        break;
+      }
+      out += detail::HELLO_RESPONSE;
+    }
+    if (begin == end) {
+      begin = end = 0;
+    }
+
+    // Send all of the responses to this batch at once.
+    if (!out.empty() && !co_await send_all(Ex, Fd, out.data(), out.size())) {
+      break;
+    }
+  }
+
+  Ex.release_buffer(reg);
+  shutdown(Fd, SHUT_RDWR);
+  close(Fd);
+}
+} // namespace uring
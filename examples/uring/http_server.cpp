@@ -0,0 +1,97 @@
+// A simple "Hello, World!" HTTP response server using ex_uring.
+// Listens on http://localhost:55550/
+// This is a port of examples/asio/http_server.cpp. It serves the same
+// response on the same ports, and handles pipelined requests the same way
+// (see http_connection.hpp), so the RPS can be compared directly.
+
+#include "ex_uring.hpp"
+#include "http_connection.hpp"
+#include "tmc/ex_cpu.hpp"
+#include "tmc/fork_group.hpp"
+#include "tmc/task.hpp"
+#include "tmc/topology.hpp"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <utility>
+
+static int listen_on(uint16_t Port) {
+  int fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  int one = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(Port);
+  if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+      listen(fd, SOMAXCONN) != 0) {
+    std::printf("failed to listen on port %d\n", Port);
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+static tmc::task<void> accept(uint16_t Port) {
+  int listenFd = listen_on(Port);
+  if (listenFd < 0) {
+    co_return;
+  }
+  std::printf("serving on http://localhost:%d/\n", Port);
+  uring::acceptor acceptor(uring::uring_executor(), listenFd);
+
+  auto handlers = tmc::fork_group();
+  while (true) {
+    int fd = co_await acceptor.accept();
+    if (fd < 0) {
+      break;
+    }
+    handlers.fork(uring::serve_hello(uring::uring_executor(), fd));
+  }
+  // Wait for all running handlers to complete.
+  co_await std::move(handlers);
+  close(listenFd);
+}
+
+int main() {
+
+#ifdef TMC_USE_HWLOC
+  // Pin the io_uring thread to the first cache on the system, and the CPU
+  // executor to the same cache, leaving 1 core free for the I/O executor. This
+  // is the same configuration as the Asio version.
+  tmc::topology::topology_filter f;
+  f.set_group_indexes({0});
+  uring::uring_executor().add_partition(f);
+  auto topo = tmc::topology::query();
+
+  tmc::cpu_executor().add_partition(f).set_thread_count(
+    topo.groups[0].core_indexes.size() - 1
+  );
+#endif
+
+  // 1 registered buffer per connection. Connections beyond this use regular
+  // buffers.
+  uring::uring_executor().set_registered_buffers(1024, 4096).init();
+  tmc::cpu_executor().init();
+
+  return tmc::async_main([]() -> tmc::task<int> {
+    auto acceptors = tmc::fork_group();
+    // Submit each I/O call to the io_uring thread, then resume the coroutine
+    // back on tmc::cpu_executor(), as with the Asio version.
+    acceptors.fork(accept(55550));
+
+    // Run both the I/O calls and the continuations inline on the
+    // single-threaded io_uring executor. I/O calls submit their SQEs directly,
+    // without a thread transition.
+    acceptors.fork(accept(55551), uring::uring_executor());
+
+    co_await std::move(acceptors);
+
+    co_return 0;
+  }());
+}
@@ -0,0 +1,136 @@
+// A port of examples/hwloc/asio_server_per_cache.cpp to ex_uring.
+//
+// (no args): For each L3 cache group (e.g. on Zen Chiplet architecture where
+// there is a shared L3 cache per chiplet), create 1 io_uring thread and a CPU
+// thread pool bound to the same cache.
+
+// If called with '--query', returns the number of cache groups.
+// Then it can be called N times, passing the cache group index as the command
+// line argument each time, in parallel, to create a prefork process instead of
+// prefork threads. This is what the server_per_cache_prefork.sh script does.
+
+#include "ex_uring.hpp"
+#include "http_connection.hpp"
+#include "tmc/ex_cpu.hpp"
+#include "tmc/fork_group.hpp"
+#include "tmc/sync.hpp"
+#include "tmc/task.hpp"
+#include "tmc/topology.hpp"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <future>
+#include <utility>
+#include <vector>
+
+#ifndef TMC_USE_HWLOC
+int main() {
+  std::printf("This example requires TMC_USE_HWLOC to be enabled.\n");
+}
+#else
+
+static tmc::task<void> accept(uring::ex_uring& Ex, uint16_t Port) {
+  std::printf("serving on http://localhost:%d/\n", Port);
+
+  // Set SO_REUSEPORT to allow multiple threads to bind to the same port.
+  // The OS will distribute incoming connections among our preforked workers.
+  int listenFd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  int one = 1;
+  setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR | SO_REUSEPORT, &one, sizeof(one));
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(Port);
+  if (bind(listenFd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 ||
+      listen(listenFd, SOMAXCONN) != 0) {
+    std::printf("failed to listen on port %d\n", Port);
+    close(listenFd);
+    co_return;
+  }
+  uring::acceptor acceptor(Ex, listenFd);
+
+  auto handlers = tmc::fork_group();
+  while (true) {
+    int fd = co_await acceptor.accept();
+    if (fd < 0) {
+      break;
+    }
+    handlers.fork(uring::serve_hello(Ex, fd));
+  }
+  // Wait for all running handlers to complete.
+  co_await std::move(handlers);
+  close(listenFd);
+}
+
+// Create a single-threaded io_uring executor, bound to the cache specified by
+// CacheIdx. Also create a CPU thread pool, bound to the same cache.
+static void configure_executors(
+  uring::ex_uring& ExUring, tmc::ex_cpu& ExCpu, tmc::topology::cpu_topology Topo,
+  size_t CacheIdx
+) {
+  tmc::topology::topology_filter f{};
+  f.set_group_indexes({CacheIdx});
+
+  ExUring.add_partition(f);
+  ExUring.set_registered_buffers(1024, 4096);
+  ExUring.init();
+
+  ExCpu.add_partition(f);
+  // Create cores-1 CPU threads, leaving 1 core free for the I/O thread.
+  ExCpu.set_thread_count(Topo.groups[CacheIdx].core_indexes.size() - 1);
+  ExCpu.init();
+}
+
+int main(int argc, char* argv[]) {
+  auto topo = tmc::topology::query();
+  if (argc > 1) {
+    // Allow the shell to query how many caches there are for prefork
+    if (0 == strcmp(argv[1], "--query")) {
+      std::printf("%zu\n", topo.groups.size());
+      return 0;
+    }
+
+    // Only create 1 io_uring/CPU executor pair.
+    // The shell will create additional processes for each cache.
+    size_t cacheIdx = static_cast<size_t>(atoi(argv[1]));
+    uring::ex_uring exUring;
+    tmc::ex_cpu exCpu;
+    configure_executors(exUring, exCpu, topo, cacheIdx);
+
+    // Initiate the accept loop on the CPU executor to automate CPU offloading
+    tmc::post_waitable(exCpu, accept(exUring, 55550)).wait();
+  } else {
+    // Create 1 single-threaded io_uring executor, and a CPU thread pool, per
+    // cache. All executors live in this process.
+    size_t cacheCount = topo.groups.size();
+
+    // Executors are not movable, but they can be default-constructed, so
+    // initialize the vectors with the right size up front.
+    std::vector<uring::ex_uring> exUrings(cacheCount);
+    std::vector<tmc::ex_cpu> exCpus(cacheCount);
+    for (size_t i = 0; i < cacheCount; ++i) {
+      configure_executors(exUrings[i], exCpus[i], topo, i);
+    }
+
+    // Post 1 acceptor/worker loop to each executor group
+    std::vector<std::future<void>> workers;
+    workers.reserve(cacheCount);
+    for (size_t i = 0; i < cacheCount; ++i) {
+      workers.emplace_back(tmc::post_waitable(exCpus[i], accept(exUrings[i], 55550)));
+    }
+
+    // Wait for all of the workers to complete.
+    for (size_t i = 0; i < cacheCount; ++i) {
+      workers[i].wait();
+    }
+  }
+}
+
+#endif
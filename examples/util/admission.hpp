@@ -0,0 +1,392 @@
+// Admission control for servers that fork a task for each request or
+// connection.
+//
+// An accept loop that forks a handler for every connection into a
+// tmc::fork_group admits everything. Under overload the executor's queue
+// grows without bound, and every request waits behind it, so every request
+// misses its latency target. admission::controller bounds that queue, and
+// sheds work that has already waited too long, using the CoDel rule that
+// Facebook's wangle applies to RPC queues:
+//
+//   admission::controller admit;
+//   while (true) {
+//     auto sock = co_await accept();
+//     handlers.fork(handle(std::move(sock), admit.arrive()));
+//   }
+//
+//   tmc::task<void> handle(socket Sock, admission::ticket Ticket) {
+//     if (!Ticket || !co_await Ticket.enter()) {
+//       co_await reject(std::move(Sock)); // e.g. with a 503
+//       co_return;
+//     }
+//     ... // the ticket releases its slot when it is destroyed
+//   }
+//
+// A connection that carries many requests (HTTP keep-alive) should take a
+// ticket for each request instead, so that an idle connection doesn't hold a
+// running slot, and each request's delay is measured. See `--admit` in
+// asio/http_server.cpp.
+//
+// - arrive() is called where work is created. It rejects the work (returns an
+//   empty ticket) if max_queued tickets are already waiting to start.
+// - ticket.enter() is awaited when the work starts to run. The time since
+//   arrive() is the work's queueing delay. If max_running tickets are running,
+//   enter() suspends until one of them is released (the work is deferred).
+// - Queueing delays are tracked in intervals (100ms by default). If even the
+//   shortest delay in the last interval was above the target (5ms by
+//   default), the queue is not just absorbing a burst, and the controller is
+//   overloaded. While it is overloaded, enter() sheds work whose own delay is
+//   more than twice the target, by returning false. The work should fail
+//   fast, so that the queue drains. The overloaded state is re-evaluated at
+//   the end of each interval.
+//
+// The controller also keeps the depth of its queue and a histogram of the
+// queueing delays of the last full interval, so it can be monitored.
+
+#pragma once
+
+#include "latency_histogram.hpp"
+#include "tmc/current.hpp"
+#include "tmc/detail/concepts_awaitable.hpp"
+#include "tmc/ex_any.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <mutex>
+#include <utility>
+
+namespace admission {
+using clock = std::chrono::steady_clock;
+
+class controller;
+class ticket;
+class aw_enter;
+
+namespace detail {
+// A suspended enter().
+struct waiter {
+  waiter* next = nullptr;
+  std::coroutine_handle<> continuation;
+  tmc::ex_any* executor = nullptr;
+  size_t prio = 0;
+
+  void capture(std::coroutine_handle<> Outer) {
+    continuation = Outer;
+    executor = tmc::current_executor();
+    prio = tmc::current_priority();
+  }
+
+  // Resumes the waiting task on the executor that it was running on.
+  void wake() {
+    if (executor == nullptr) {
+      continuation.resume();
+    } else {
+      executor->post(std::move(continuation), prio);
+    }
+  }
+};
+
+// An intrusive FIFO list of waiters.
+struct waiter_list {
+  waiter* head = nullptr;
+  waiter* tail = nullptr;
+
+  bool empty() const { return head == nullptr; }
+
+  void push_back(waiter* W) {
+    W->next = nullptr;
+    if (tail == nullptr) {
+      head = W;
+    } else {
+      tail->next = W;
+    }
+    tail = W;
+  }
+
+  waiter* pop_front() {
+    waiter* w = head;
+    head = w->next;
+    if (head == nullptr) {
+      tail = nullptr;
+    }
+    return w;
+  }
+
+  // Wakes every waiter in the list. Must be called without holding the
+  // controller's lock, since a waiter may be resumed inline.
+  void wake_all() {
+    while (!empty()) {
+      // The waiter may be destroyed as soon as it is woken.
+      pop_front()->wake();
+    }
+  }
+};
+} // namespace detail
+
+/// A unit of work that was admitted by controller::arrive(). It is released
+/// when it is destroyed.
+class ticket {
+  friend class controller;
+  friend class aw_enter;
+
+  controller* ctl = nullptr;
+  clock::time_point arrival;
+  bool running = false;
+
+  explicit ticket(controller* Ctl) : ctl(Ctl), arrival(clock::now()) {}
+
+public:
+  /// An empty ticket, as returned by a rejected arrive().
+  ticket() = default;
+
+  ticket(ticket&& Other) noexcept
+      : ctl(std::exchange(Other.ctl, nullptr)), arrival(Other.arrival),
+        running(Other.running) {}
+
+  ticket& operator=(ticket&& Other) noexcept {
+    if (this != &Other) {
+      release();
+      ctl = std::exchange(Other.ctl, nullptr);
+      arrival = Other.arrival;
+      running = Other.running;
+    }
+    return *this;
+  }
+
+  ~ticket() { release(); }
+
+  /// False if the work was rejected or shed.
+  explicit operator bool() const { return ctl != nullptr; }
+
+  /// The time since the work arrived.
+  clock::duration age() const { return clock::now() - arrival; }
+
+  /// Starts the work. Returns false if the work was shed, after which the
+  /// ticket is empty. Must be awaited at most once, on a non-empty ticket.
+  [[nodiscard]] aw_enter enter();
+
+  /// Releases the ticket's place in the queue, or its running slot. Called by
+  /// the destructor.
+  void release();
+};
+
+class controller {
+  friend class ticket;
+  friend class aw_enter;
+
+  clock::duration target = std::chrono::milliseconds(5);
+  clock::duration interval = std::chrono::milliseconds(100);
+  size_t max_queued = std::numeric_limits<size_t>::max();
+  size_t max_running = std::numeric_limits<size_t>::max();
+
+  // Protects the deferred list and the CoDel state.
+  std::mutex lock;
+  detail::waiter_list deferred;
+  clock::time_point interval_end{};
+  clock::duration min_delay = clock::duration::max();
+  latency_histogram window;
+  latency_histogram last_window;
+
+  std::atomic<size_t> queued_count{0};
+  std::atomic<size_t> running_count{0};
+  std::atomic<bool> is_overloaded{false};
+  std::atomic<size_t> rejected_count{0};
+  std::atomic<size_t> shed_count{0};
+
+  // Records the queueing delay of work that is about to start, and returns
+  // true if it should be shed. Must hold lock.
+  bool shed_locked(clock::duration Delay, clock::time_point Now) {
+    if (Now >= interval_end) {
+      // If no work started for a whole interval, the queue was empty.
+      bool overloaded = Now < interval_end + interval && min_delay > target;
+      is_overloaded.store(overloaded, std::memory_order_relaxed);
+      last_window = window;
+      window = latency_histogram{};
+      min_delay = Delay;
+      interval_end = Now + interval;
+    } else if (Delay < min_delay) {
+      min_delay = Delay;
+    }
+    window.record(static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(Delay).count()
+    ));
+    if (is_overloaded.load(std::memory_order_relaxed) && Delay > 2 * target) {
+      shed_count.fetch_add(1, std::memory_order_relaxed);
+      return true;
+    }
+    return false;
+  }
+
+  // Called when a running ticket is released. Passes its slot on to deferred
+  // work, shedding any that has waited too long.
+  void finish() {
+    detail::waiter_list wake;
+    {
+      std::lock_guard<std::mutex> lg{lock};
+      running_count.fetch_sub(1, std::memory_order_relaxed);
+      pump_locked(wake);
+    }
+    wake.wake_all();
+  }
+
+  void pump_locked(detail::waiter_list& Wake);
+
+public:
+  controller() = default;
+  controller(const controller&) = delete;
+  controller& operator=(const controller&) = delete;
+
+  /// Builder func to set the queueing delay that the controller aims for.
+  /// The default is 5ms.
+  controller& set_target(clock::duration Target) {
+    target = Target;
+    return *this;
+  }
+
+  /// Builder func to set how long the delay must stay above the target
+  /// before work is shed. The default is 100ms.
+  controller& set_interval(clock::duration Interval) {
+    interval = Interval;
+    return *this;
+  }
+
+  /// Builder func to set the number of tickets that may be waiting to start.
+  /// Further arrivals are rejected. The default is unlimited.
+  controller& set_max_queued(size_t MaxQueued) {
+    max_queued = MaxQueued;
+    return *this;
+  }
+
+  /// Builder func to set the number of tickets that may be running. Further
+  /// enter() calls are deferred until a running ticket is released. The
+  /// default is unlimited.
+  controller& set_max_running(size_t MaxRunning) {
+    max_running = MaxRunning;
+    return *this;
+  }
+
+  /// Admits new work, unless max_queued tickets are already waiting to
+  /// start, in which case the returned ticket is empty.
+  [[nodiscard]] ticket arrive() {
+    if (queued_count.fetch_add(1, std::memory_order_relaxed) >= max_queued) {
+      queued_count.fetch_sub(1, std::memory_order_relaxed);
+      rejected_count.fetch_add(1, std::memory_order_relaxed);
+      return ticket{};
+    }
+    return ticket{this};
+  }
+
+  /// The number of tickets that have arrived but not started.
+  size_t queued() const { return queued_count.load(std::memory_order_relaxed); }
+
+  /// The number of tickets that have started and not been released.
+  size_t running() const { return running_count.load(std::memory_order_relaxed); }
+
+  /// True if the queueing delay stayed above the target for the last
+  /// interval.
+  bool overloaded() const { return is_overloaded.load(std::memory_order_relaxed); }
+
+  /// The number of arrivals that were rejected because the queue was full.
+  size_t rejected() const { return rejected_count.load(std::memory_order_relaxed); }
+
+  /// The number of tickets that were shed by enter().
+  size_t shed() const { return shed_count.load(std::memory_order_relaxed); }
+
+  /// A percentile of the queueing delay in the last full interval, in
+  /// nanoseconds.
+  uint64_t delay_percentile(double Percentile) {
+    std::lock_guard<std::mutex> lg{lock};
+    return last_window.percentile(Percentile);
+  }
+};
+
+class [[nodiscard]] aw_enter : detail::waiter {
+  friend class controller;
+
+  ticket* tkt;
+  bool admitted = false;
+
+public:
+  explicit aw_enter(ticket& Ticket) : tkt(&Ticket) {}
+
+  bool await_ready() { return false; }
+
+  bool await_suspend(std::coroutine_handle<> Outer) {
+    controller* ctl = tkt->ctl;
+    std::lock_guard<std::mutex> lg{ctl->lock};
+    if (ctl->running_count.load(std::memory_order_relaxed) >= ctl->max_running) {
+      capture(Outer);
+      ctl->deferred.push_back(this);
+      return true;
+    }
+    auto now = clock::now();
+    ctl->queued_count.fetch_sub(1, std::memory_order_relaxed);
+    if (ctl->shed_locked(now - tkt->arrival, now)) {
+      tkt->ctl = nullptr;
+    } else {
+      ctl->running_count.fetch_add(1, std::memory_order_relaxed);
+      tkt->running = true;
+      admitted = true;
+    }
+    return false;
+  }
+
+  bool await_resume() { return admitted; }
+};
+
+inline aw_enter ticket::enter() { return aw_enter(*this); }
+
+inline void ticket::release() {
+  controller* c = std::exchange(ctl, nullptr);
+  if (c == nullptr) {
+    return;
+  }
+  if (running) {
+    running = false;
+    c->finish();
+  } else {
+    c->queued_count.fetch_sub(1, std::memory_order_relaxed);
+  }
+}
+
+inline void controller::pump_locked(detail::waiter_list& Wake) {
+  auto now = clock::now();
+  while (!deferred.empty() &&
+         running_count.load(std::memory_order_relaxed) < max_running) {
+    auto w = static_cast<aw_enter*>(deferred.pop_front());
+    queued_count.fetch_sub(1, std::memory_order_relaxed);
+    if (shed_locked(now - w->tkt->arrival, now)) {
+      w->tkt->ctl = nullptr;
+    } else {
+      running_count.fetch_add(1, std::memory_order_relaxed);
+      w->tkt->running = true;
+      w->admitted = true;
+    }
+    Wake.push_back(w);
+  }
+}
+} // namespace admission
+
+// Implementation of tmc::detail::awaitable_traits, so that enter() can be
+// awaited by a tmc::task when TMC_NO_UNKNOWN_AWAITABLES is defined, without an
+// extra wrapper task for each request. A deferred enter() is resumed on its
+// own executor and priority, so it is awaited as-is.
+namespace tmc::detail {
+template <> struct awaitable_traits<admission::aw_enter> {
+  using result_type = bool;
+  using self_type = admission::aw_enter;
+
+  static decltype(auto) get_awaiter(self_type& awaitable) noexcept {
+    return awaitable;
+  }
+  static decltype(auto) get_awaiter(self_type&& awaitable) noexcept {
+    return static_cast<self_type&&>(awaitable);
+  }
+
+  static constexpr configure_mode mode = WRAPPER;
+};
+} // namespace tmc::detail
@@ -0,0 +1,167 @@
+// arena_scope(): runs a task tree with every frame allocated from one arena.
+//
+// A tree like skynet_one allocates 1,111,111 frames per run, and frees each
+// of them individually. arena_scope() allocates them from a bump arena
+// (frame_pool::arena) instead. Freeing a frame does nothing, and the whole
+// arena is released at once when the tree is done.
+//
+//   size_t count = co_await frame_pool::arena_scope(skynet_one<6>(0, 0));
+//
+// The root task runs on the current executor, through a thin executor that
+// installs the arena on the thread before running each work item. That
+// executor is the current executor while the tree runs, so children created
+// by spawn(), spawn_many(), and fork_group() run through it too, as do the
+// continuations of tasks that await them. Anything that the tree posts to the
+// underlying executor (the queue's own allocations) is allocated with the
+// arena uninstalled.
+//
+// Requirements:
+// - The program must install the frame pool as its global allocator
+//   (FRAME_POOL_IMPL, see frame_pool.hpp), and the pool must be enabled.
+//   Otherwise, frames are allocated as usual.
+// - While the tree runs, all heap allocations on its threads come from the
+//   arena, not just frames. Nothing that is allocated inside the tree may
+//   outlive the root: don't post detached tasks from it, and don't return
+//   heap-owning objects from it. The result type must be trivially copyable.
+// - The arena keeps every frame until the root completes, so its peak memory
+//   is the size of all frames of the tree, rather than the number of frames
+//   that are live at once.
+
+#pragma once
+
+#include "frame_pool.hpp"
+#include "tmc/current.hpp"
+#include "tmc/detail/compat.hpp"
+#include "tmc/detail/concepts_awaitable.hpp"
+#include "tmc/detail/thread_locals.hpp"
+#include "tmc/ex_any.hpp"
+#include "tmc/spawn.hpp"
+#include "tmc/task.hpp"
+#include "tmc/work_item.hpp"
+
+#include <atomic>
+#include <coroutine>
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+
+namespace frame_pool {
+namespace detail {
+// The executor that a tree runs on inside arena_scope(). It is destroyed when
+// the scope and every work item that was posted to it are done, because work
+// items may still be finishing after the root's continuation has resumed.
+class arena_executor {
+  frame_pool::arena arena_;
+  tmc::ex_any* parent;
+  tmc::ex_any type_erased_this;
+  std::atomic<size_t> refs{1};
+
+  // Runs Item with the arena installed and this as the current executor.
+  static tmc::task<void> run(arena_executor* Ex, tmc::work_item Item) {
+    tmc::ex_any* prevEx = tmc::detail::this_thread::executor();
+    frame_pool::arena* prevArena = set_this_thread_arena(&Ex->arena_);
+    tmc::detail::this_thread::executor() = &Ex->type_erased_this;
+    Item();
+    tmc::detail::this_thread::executor() = prevEx;
+    set_this_thread_arena(prevArena);
+    Ex->release();
+    co_return;
+  }
+
+public:
+  arena_executor(tmc::ex_any* Parent, size_t ChunkSize)
+      : arena_(ChunkSize), parent(Parent), type_erased_this(this) {}
+
+  void release() {
+    if (refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      delete this;
+    }
+  }
+
+  void post(tmc::work_item&& Item, size_t Priority = 0, size_t ThreadHint = NO_HINT) {
+    refs.fetch_add(1, std::memory_order_relaxed);
+    // The wrapper's frame and the parent's queue are not part of the tree.
+    frame_pool::arena* prevArena = set_this_thread_arena(nullptr);
+    parent->post(run(this, std::move(Item)), Priority, ThreadHint);
+    set_this_thread_arena(prevArena);
+  }
+
+  template <typename Iter>
+  void
+  post_bulk(Iter It, size_t Count, size_t Priority = 0, size_t ThreadHint = NO_HINT) {
+    for (size_t i = 0; i < Count; ++i) {
+      post(std::move(*It), Priority, ThreadHint);
+      ++It;
+    }
+  }
+
+  bool is_current() const {
+    return tmc::detail::this_thread::executor() == &type_erased_this;
+  }
+
+  tmc::ex_any* type_erased() TMC_LIFETIMEBOUND { return &type_erased_this; }
+};
+} // namespace detail
+
+/// Runs Root with all of its frames, and the frames of every task that it
+/// creates, allocated from a new arena. The arena is released when the tree
+/// is done. ChunkSize is the size of each block that the arena requests from
+/// the system allocator.
+template <typename Result>
+tmc::task<Result>
+arena_scope(tmc::task<Result> Root, size_t ChunkSize = ARENA_CHUNK_SIZE) {
+  static_assert(
+    std::is_void_v<Result> || std::is_trivially_copyable_v<Result>,
+    "The result of an arena_scope must not own memory in the arena."
+  );
+  // The executor must not live in an enclosing arena, which may be released
+  // before this one.
+  arena* outer = set_this_thread_arena(nullptr);
+  auto ex = new detail::arena_executor(tmc::current_executor(), ChunkSize);
+  set_this_thread_arena(outer);
+  if constexpr (std::is_void_v<Result>) {
+    co_await tmc::spawn(std::move(Root)).run_on(ex->type_erased());
+    ex->release();
+  } else {
+    Result result = co_await tmc::spawn(std::move(Root)).run_on(ex->type_erased());
+    ex->release();
+    co_return result;
+  }
+}
+} // namespace frame_pool
+
+namespace tmc::detail {
+template <> struct executor_traits<frame_pool::detail::arena_executor> {
+  static inline void post(
+    frame_pool::detail::arena_executor& Ex, tmc::work_item&& Item, size_t Priority,
+    size_t ThreadHint
+  ) {
+    Ex.post(std::move(Item), Priority, ThreadHint);
+  }
+
+  template <typename It>
+  static inline void post_bulk(
+    frame_pool::detail::arena_executor& Ex, It&& Items, size_t Count, size_t Priority,
+    size_t ThreadHint
+  ) {
+    Ex.post_bulk(std::forward<It>(Items), Count, Priority, ThreadHint);
+  }
+
+  static inline tmc::ex_any*
+  type_erased(frame_pool::detail::arena_executor& Ex TMC_LIFETIMEBOUND) {
+    return Ex.type_erased();
+  }
+
+  static inline std::coroutine_handle<> dispatch(
+    frame_pool::detail::arena_executor& Ex, std::coroutine_handle<> Outer,
+    size_t Priority
+  ) {
+    if (Ex.is_current()) {
+      tmc::detail::this_thread::this_task().prio = Priority;
+      return Outer;
+    }
+    Ex.post(std::move(Outer), Priority);
+    return std::noop_coroutine();
+  }
+};
+} // namespace tmc::detail
@@ -0,0 +1,449 @@
+// A bounded MPMC channel with awaitable push() and pull().
+//
+// tmc::channel is unbounded, so a producer that outpaces its consumers needs
+// a separate tmc::semaphore to get backpressure, which costs an extra acquire
+// and release per element. This channel has a fixed capacity instead:
+// push() suspends while the channel is full, and is resumed when a consumer
+// makes room.
+//
+// Elements are stored in a ring of cells that each carry a sequence number
+// (Dmitry Vyukov's bounded MPMC queue), so an uncontended push or pull is a
+// single CAS and never allocates. Only tasks that have to wait take the
+// waiter lock. When a push or pull makes progress while there are waiters, it
+// completes the waiting operations on their behalf (moving the element into
+// or out of the waiting awaitable) and posts the waiting tasks back to their
+// executors, so a woken task never has to retry.
+//
+// The interface mirrors tmc::chan_tok. make_bounded_channel<T>(Capacity)
+// returns a copyable token that shares ownership of the channel.
+// - co_await push(value) -> bool. Returns false if the channel is closed.
+// - co_await pull() -> std::optional<T>. Returns std::nullopt once the
+//   channel is closed and all elements have been consumed.
+// - close() wakes all waiters. Elements that were pushed before close() can
+//   still be pulled.
+
+#pragma once
+
+#include "tmc/current.hpp"
+#include "tmc/detail/concepts_awaitable.hpp"
+#include "tmc/ex_any.hpp"
+
+#include <atomic>
+#include <coroutine>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+template <typename T> class bounded_channel;
+
+namespace bounded_chan_detail {
+// Identifies the awaitables of this channel to tmc::detail::awaitable_traits.
+struct awaitable_tag {};
+
+// The common part of a suspended push() or pull().
+struct waiter {
+  waiter* next = nullptr;
+  std::coroutine_handle<> continuation;
+  tmc::ex_any* executor = nullptr;
+  size_t prio = 0;
+
+  void capture(std::coroutine_handle<> Outer) {
+    continuation = Outer;
+    executor = tmc::current_executor();
+    prio = tmc::current_priority();
+  }
+
+  // Resumes the waiting task on the executor that it was running on.
+  void wake() {
+    if (executor == nullptr) {
+      continuation.resume();
+    } else {
+      executor->post(std::move(continuation), prio);
+    }
+  }
+};
+
+// An intrusive FIFO list of waiters.
+struct waiter_list {
+  waiter* head = nullptr;
+  waiter* tail = nullptr;
+
+  bool empty() const { return head == nullptr; }
+
+  void push_back(waiter* W) {
+    W->next = nullptr;
+    if (tail == nullptr) {
+      head = W;
+    } else {
+      tail->next = W;
+    }
+    tail = W;
+  }
+
+  waiter* pop_front() {
+    waiter* w = head;
+    head = w->next;
+    if (head == nullptr) {
+      tail = nullptr;
+    }
+    return w;
+  }
+
+  // Wakes every waiter in the list. Must be called without holding the
+  // channel's waiter lock, since a waiter may be resumed inline.
+  void wake_all() {
+    while (!empty()) {
+      // The waiter may be destroyed as soon as it is woken.
+      pop_front()->wake();
+    }
+  }
+};
+} // namespace bounded_chan_detail
+
+template <typename T> class aw_bounded_push;
+template <typename T> class aw_bounded_pull;
+
+template <typename T> class bounded_channel {
+  friend class aw_bounded_push<T>;
+  friend class aw_bounded_pull<T>;
+
+  struct cell {
+    std::atomic<size_t> seq;
+    alignas(T) unsigned char storage[sizeof(T)];
+
+    T* ptr() { return std::launder(static_cast<T*>(static_cast<void*>(storage))); }
+  };
+
+  static constexpr size_t CACHE_LINE = 64;
+
+  std::unique_ptr<cell[]> cells;
+  size_t mask;
+
+  alignas(CACHE_LINE) std::atomic<size_t> enqueue_pos{0};
+  alignas(CACHE_LINE) std::atomic<size_t> dequeue_pos{0};
+
+  alignas(CACHE_LINE) std::atomic<size_t> push_waiting{0};
+  std::atomic<size_t> pull_waiting{0};
+  std::atomic<bool> closed{false};
+  std::mutex waiter_lock;
+  bounded_chan_detail::waiter_list push_waiters;
+  bounded_chan_detail::waiter_list pull_waiters;
+
+  bool try_push_raw(T& Value) {
+    size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+    while (true) {
+      cell& c = cells[pos & mask];
+      size_t seq = c.seq.load(std::memory_order_acquire);
+      auto diff = static_cast<ptrdiff_t>(seq - pos);
+      if (diff == 0) {
+        if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          ::new (static_cast<void*>(c.storage)) T(std::move(Value));
+          c.seq.store(pos + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        return false; // full
+      } else {
+        pos = enqueue_pos.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  bool try_pull_raw(std::optional<T>& Out) {
+    size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+    while (true) {
+      cell& c = cells[pos & mask];
+      size_t seq = c.seq.load(std::memory_order_acquire);
+      auto diff = static_cast<ptrdiff_t>(seq - (pos + 1));
+      if (diff == 0) {
+        if (dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+          T* p = c.ptr();
+          Out.emplace(std::move(*p));
+          p->~T();
+          c.seq.store(pos + mask + 1, std::memory_order_release);
+          return true;
+        }
+      } else if (diff < 0) {
+        return false; // empty
+      } else {
+        pos = dequeue_pos.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  // Completes as many waiting operations as possible, and moves the completed
+  // waiters to Wake. Must hold waiter_lock.
+  void pump_locked(bounded_chan_detail::waiter_list& Wake);
+
+  void pump() {
+    bounded_chan_detail::waiter_list wake;
+    {
+      std::lock_guard<std::mutex> lg{waiter_lock};
+      pump_locked(wake);
+    }
+    wake.wake_all();
+  }
+
+  // Called after a successful push or pull. The fence pairs with the one in
+  // the waiter registration path, so that either this thread sees the waiter,
+  // or the waiter's retry sees this thread's push or pull.
+  void notify_after_push() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (pull_waiting.load(std::memory_order_relaxed) != 0) {
+      pump();
+    }
+  }
+
+  void notify_after_pull() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (push_waiting.load(std::memory_order_relaxed) != 0) {
+      pump();
+    }
+  }
+
+public:
+  /// Capacity is rounded up to a power of 2.
+  explicit bounded_channel(size_t Capacity) {
+    size_t cap = 2;
+    while (cap < Capacity) {
+      cap *= 2;
+    }
+    mask = cap - 1;
+    cells = std::make_unique<cell[]>(cap);
+    for (size_t i = 0; i < cap; ++i) {
+      cells[i].seq.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  bounded_channel(const bounded_channel&) = delete;
+  bounded_channel& operator=(const bounded_channel&) = delete;
+
+  ~bounded_channel() {
+    std::optional<T> discard;
+    while (try_pull_raw(discard)) {
+    }
+  }
+
+  size_t capacity() const { return mask + 1; }
+
+  /// Pushes without waiting. Returns false if the channel is full or closed,
+  /// in which case Value is not moved from.
+  bool try_push(T& Value) {
+    if (closed.load(std::memory_order_relaxed) || !try_push_raw(Value)) {
+      return false;
+    }
+    notify_after_push();
+    return true;
+  }
+
+  /// Pulls without waiting. Returns std::nullopt if the channel is empty.
+  std::optional<T> try_pull() {
+    std::optional<T> result;
+    if (try_pull_raw(result)) {
+      notify_after_pull();
+    }
+    return result;
+  }
+
+  /// Wakes all waiters. Waiting pushes fail. Waiting pulls receive any
+  /// remaining elements, then std::nullopt.
+  void close() {
+    bounded_chan_detail::waiter_list wake;
+    {
+      std::lock_guard<std::mutex> lg{waiter_lock};
+      closed.store(true, std::memory_order_seq_cst);
+      pump_locked(wake);
+    }
+    wake.wake_all();
+  }
+
+  bool is_closed() const { return closed.load(std::memory_order_acquire); }
+};
+
+template <typename T>
+class [[nodiscard]] aw_bounded_push : bounded_chan_detail::waiter,
+                                      bounded_chan_detail::awaitable_tag {
+  friend class bounded_channel<T>;
+  bounded_channel<T>* chan;
+  T value;
+  bool ok = false;
+
+public:
+  aw_bounded_push(bounded_channel<T>& Chan, T&& Value)
+      : chan(&Chan), value(std::move(Value)) {}
+
+  bool await_ready() noexcept {
+    if (chan->closed.load(std::memory_order_relaxed)) {
+      return true;
+    }
+    ok = chan->try_push(value);
+    return ok;
+  }
+
+  bool await_suspend(std::coroutine_handle<> Outer) noexcept {
+    capture(Outer);
+    bounded_chan_detail::waiter_list wake;
+    bool suspend = false;
+    {
+      std::lock_guard<std::mutex> lg{chan->waiter_lock};
+      if (!chan->closed.load(std::memory_order_relaxed)) {
+        chan->push_waiting.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (chan->try_push_raw(value)) {
+          // A consumer made room since await_ready().
+          chan->push_waiting.fetch_sub(1, std::memory_order_relaxed);
+          ok = true;
+          chan->pump_locked(wake);
+        } else {
+          chan->push_waiters.push_back(this);
+          suspend = true;
+        }
+      }
+    }
+    wake.wake_all();
+    return suspend;
+  }
+
+  bool await_resume() noexcept { return ok; }
+};
+
+template <typename T>
+class [[nodiscard]] aw_bounded_pull : bounded_chan_detail::waiter,
+                                      bounded_chan_detail::awaitable_tag {
+  friend class bounded_channel<T>;
+  bounded_channel<T>* chan;
+  std::optional<T> result;
+
+public:
+  explicit aw_bounded_pull(bounded_channel<T>& Chan) : chan(&Chan) {}
+
+  bool await_ready() noexcept {
+    if (chan->try_pull_raw(result)) {
+      chan->notify_after_pull();
+      return true;
+    }
+    return false;
+  }
+
+  bool await_suspend(std::coroutine_handle<> Outer) noexcept {
+    capture(Outer);
+    bounded_chan_detail::waiter_list wake;
+    bool suspend = false;
+    {
+      std::lock_guard<std::mutex> lg{chan->waiter_lock};
+      chan->pull_waiting.fetch_add(1, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (chan->try_pull_raw(result)) {
+        // A producer pushed since await_ready().
+        chan->pull_waiting.fetch_sub(1, std::memory_order_relaxed);
+        chan->pump_locked(wake);
+      } else if (chan->closed.load(std::memory_order_relaxed)) {
+        chan->pull_waiting.fetch_sub(1, std::memory_order_relaxed);
+      } else {
+        chan->pull_waiters.push_back(this);
+        suspend = true;
+      }
+    }
+    wake.wake_all();
+    return suspend;
+  }
+
+  std::optional<T> await_resume() noexcept { return std::move(result); }
+};
+
+template <typename T>
+void bounded_channel<T>::pump_locked(bounded_chan_detail::waiter_list& Wake) {
+  bool progress = true;
+  while (progress) {
+    progress = false;
+    while (!pull_waiters.empty()) {
+      auto w = static_cast<aw_bounded_pull<T>*>(pull_waiters.head);
+      if (!try_pull_raw(w->result)) {
+        break;
+      }
+      pull_waiters.pop_front();
+      pull_waiting.fetch_sub(1, std::memory_order_relaxed);
+      Wake.push_back(w);
+      progress = true;
+    }
+    while (!push_waiters.empty()) {
+      auto w = static_cast<aw_bounded_push<T>*>(push_waiters.head);
+      if (closed.load(std::memory_order_relaxed)) {
+        w->ok = false;
+      } else if (try_push_raw(w->value)) {
+        w->ok = true;
+        progress = true;
+      } else {
+        break;
+      }
+      push_waiters.pop_front();
+      push_waiting.fetch_sub(1, std::memory_order_relaxed);
+      Wake.push_back(w);
+    }
+  }
+  if (closed.load(std::memory_order_relaxed)) {
+    // The channel is empty, so the remaining pulls get std::nullopt.
+    while (!pull_waiters.empty()) {
+      Wake.push_back(pull_waiters.pop_front());
+      pull_waiting.fetch_sub(1, std::memory_order_relaxed);
+    }
+  }
+}
+
+/// A copyable handle to a shared bounded_channel, like tmc::chan_tok.
+template <typename T> class bounded_chan_tok {
+  std::shared_ptr<bounded_channel<T>> chan;
+
+public:
+  explicit bounded_chan_tok(std::shared_ptr<bounded_channel<T>> Chan)
+      : chan(std::move(Chan)) {}
+
+  /// Suspends while the channel is full. Returns false if the channel is
+  /// closed.
+  aw_bounded_push<T> push(T Value) {
+    return aw_bounded_push<T>(*chan, std::move(Value));
+  }
+
+  /// Suspends while the channel is empty. Returns std::nullopt once the
+  /// channel is closed and empty.
+  aw_bounded_pull<T> pull() { return aw_bounded_pull<T>(*chan); }
+
+  bool try_push(T& Value) { return chan->try_push(Value); }
+  std::optional<T> try_pull() { return chan->try_pull(); }
+  void close() { chan->close(); }
+  bool is_closed() const { return chan->is_closed(); }
+  size_t capacity() const { return chan->capacity(); }
+};
+
+template <typename T> bounded_chan_tok<T> make_bounded_channel(size_t Capacity) {
+  return bounded_chan_tok<T>(std::make_shared<bounded_channel<T>>(Capacity));
+}
+
+// Implementation of tmc::detail::awaitable_traits, so that push() and pull()
+// can be awaited by a tmc::task when TMC_NO_UNKNOWN_AWAITABLES is defined, and
+// used with tmc::spawn*() without an extra wrapper task. They already resume
+// the awaiting task on its own executor and priority, so they are awaited
+// as-is.
+namespace tmc::detail {
+template <typename T>
+concept IsBoundedChannelAwaitable =
+  std::is_base_of_v<bounded_chan_detail::awaitable_tag, T>;
+
+template <IsBoundedChannelAwaitable Awaitable> struct awaitable_traits<Awaitable> {
+  using result_type = decltype(std::declval<Awaitable&>().await_resume());
+  using self_type = Awaitable;
+
+  static decltype(auto) get_awaiter(self_type& awaitable) noexcept {
+    return awaitable;
+  }
+  static decltype(auto) get_awaiter(self_type&& awaitable) noexcept {
+    return static_cast<self_type&&>(awaitable);
+  }
+
+  static constexpr configure_mode mode = WRAPPER;
+};
+} // namespace tmc::detail
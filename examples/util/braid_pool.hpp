@@ -0,0 +1,84 @@
+// A fixed set of braids that serializes work per key.
+//
+// Creating a tmc::ex_braid per entity (account, session, ...) gives each
+// entity its own serial order, but costs an allocation and the braid's
+// memory for every entity. braid_pool<N> has N braids, and maps each key
+// onto one of them by hash:
+//
+//   braid_pool<64> accounts;
+//   auto scope = co_await accounts.enter(accountId);
+//   // ... modify the account ...
+//   co_await scope.exit();
+//
+// Work for the same key always runs on the same braid, so it is serialized
+// and runs in the order it was posted, exactly as with a braid per key.
+// Unrelated keys that hash onto the same braid are also serialized with each
+// other, so N should be a few times the number of threads. Keys are mixed
+// with a 64-bit finalizer after std::hash, so that keys with poor hashes
+// (such as sequential integers, which std::hash maps to themselves) still
+// spread evenly.
+//
+// Each braid is on its own cache line. The braids use the current executor
+// as their parent, or tmc::cpu_executor() if the pool is not created on an
+// executor, like a default-constructed tmc::ex_braid. Braid may be any
+// default-constructible executor type that supports tmc::enter().
+
+#pragma once
+
+#include "tmc/aw_resume_on.hpp"
+#include "tmc/ex_braid.hpp"
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+template <size_t N, typename Braid = tmc::ex_braid> class braid_pool {
+  static_assert(N != 0);
+
+  struct alignas(64) slot {
+    Braid braid;
+  };
+
+  std::array<slot, N> slots;
+
+  static uint64_t mix(uint64_t X) {
+    X ^= X >> 33;
+    X *= 0xff51afd7ed558ccdULL;
+    X ^= X >> 33;
+    X *= 0xc4ceb9fe1a85ec53ULL;
+    X ^= X >> 33;
+    return X;
+  }
+
+public:
+  braid_pool() = default;
+  braid_pool(const braid_pool&) = delete;
+  braid_pool& operator=(const braid_pool&) = delete;
+
+  static constexpr size_t size() { return N; }
+
+  /// The index of the braid that Key maps to.
+  template <typename Key> static size_t index_of(const Key& K) {
+    uint64_t h = mix(static_cast<uint64_t>(std::hash<Key>{}(K)));
+    if constexpr ((N & (N - 1)) == 0) {
+      return static_cast<size_t>(h & (N - 1));
+    } else {
+      return static_cast<size_t>(h % N);
+    }
+  }
+
+  /// The braid that Key maps to. It may be used directly, for example with
+  /// tmc::spawn(...).run_on() or tmc::post().
+  template <typename Key> Braid& braid_for(const Key& K) {
+    return slots[index_of(K)].braid;
+  }
+
+  Braid& braid_at(size_t Index) { return slots[Index].braid; }
+
+  /// Moves the awaiting task onto the braid for Key. Returns a scope whose
+  /// exit() moves it back to its original executor.
+  template <typename Key> [[nodiscard]] auto enter(const Key& K) {
+    return tmc::enter(braid_for(K));
+  }
+};
@@ -0,0 +1,213 @@
+// A serializing executor that uses flat combining instead of a runner task.
+//
+// tmc::ex_braid runs its queue from a runner task that is posted to the
+// parent executor. When many producers post short items, each item pays for a
+// handoff: it is queued, and then the runner (on some other thread) picks it
+// up. flat_combining::ex_braid instead lets the posting thread run the queue:
+//
+// - If the braid is idle when an item is posted from an executor thread,
+//   that thread takes the braid and becomes the combiner. It runs the new
+//   item and any items that other threads queue in the meantime inline,
+//   before post() returns.
+// - If the braid is busy, post() only queues the item. The combiner picks it
+//   up in its next batch.
+// - The combiner runs at most batch_size() items. If more are queued after
+//   that, it posts a drain task to the parent executor to continue, and
+//   returns, so one poster is never stuck running other tasks' work for
+//   long. Raise the batch size for throughput, or lower it for latency.
+// - An item posted from a thread that is not running an executor is never
+//   run inline; a drain task is posted to the parent instead.
+//
+// This is a good fit for small critical sections that are entered from many
+// tasks, such as the consumer in exec_st_roundtrip_bench. Items that run for
+// a long time delay the task that happened to post while the braid was
+// idle, so they are better served by tmc::ex_braid.
+//
+// Use it like tmc::ex_braid: post to it, `co_await tmc::enter(braid)`, or
+// `tmc::spawn(...).run_on(braid)`. Items run one at a time, in FIFO order,
+// with the braid as the current executor.
+
+#pragma once
+
+#include "tmc/current.hpp"
+#include "tmc/detail/compat.hpp"
+#include "tmc/detail/concepts_awaitable.hpp"
+#include "tmc/detail/thread_locals.hpp"
+#include "tmc/ex_any.hpp"
+#include "tmc/ex_cpu.hpp"
+#include "tmc/task.hpp"
+#include "tmc/work_item.hpp"
+
+#include <algorithm>
+#include <coroutine>
+#include <cstddef>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace flat_combining {
+/// The default maximum number of items that one combiner runs.
+static inline constexpr size_t DEFAULT_BATCH_SIZE = 64;
+
+class ex_braid {
+  struct queued_item {
+    tmc::work_item item;
+    size_t prio;
+  };
+
+  tmc::ex_any* parent;
+  tmc::ex_any type_erased_this;
+  size_t batch_size_ = DEFAULT_BATCH_SIZE;
+
+  std::mutex queue_lock;
+  // The following are protected by queue_lock.
+  std::deque<queued_item> queue;
+  // True while a combiner or a drain task owns the braid.
+  bool running = false;
+
+  // Only accessed by the owner of the braid.
+  std::vector<queued_item> batch;
+
+  // Runs up to batch_size() items. Must own the braid. If items remain
+  // afterward, posts a drain task to continue, and returns with the braid
+  // still owned by it. Otherwise, releases the braid.
+  void combine() {
+    tmc::ex_any* prevEx = tmc::detail::this_thread::executor();
+    size_t prevPrio = tmc::detail::this_thread::this_task().prio;
+    tmc::detail::this_thread::executor() = &type_erased_this;
+    size_t budget = batch_size_;
+    while (true) {
+      {
+        std::lock_guard<std::mutex> lg{queue_lock};
+        if (queue.empty()) {
+          running = false;
+          break;
+        }
+        if (budget == 0) {
+          parent->post(drain(this), queue.front().prio);
+          break;
+        }
+        size_t count = std::min(budget, queue.size());
+        for (size_t i = 0; i < count; ++i) {
+          batch.push_back(std::move(queue.front()));
+          queue.pop_front();
+        }
+        budget -= count;
+      }
+      for (auto& q : batch) {
+        tmc::detail::this_thread::this_task().prio = q.prio;
+        q.item();
+      }
+      batch.clear();
+    }
+    tmc::detail::this_thread::executor() = prevEx;
+    tmc::detail::this_thread::this_task().prio = prevPrio;
+  }
+
+  static tmc::task<void> drain(ex_braid* Braid) {
+    Braid->combine();
+    co_return;
+  }
+
+public:
+  /// Items run on Parent when they are not run inline. If no parent is
+  /// given, the current executor is used, or tmc::cpu_executor() if this is
+  /// not called from an executor.
+  explicit ex_braid(tmc::ex_any* Parent = tmc::current_executor())
+      : parent(Parent != nullptr ? Parent : tmc::cpu_executor().type_erased()),
+        type_erased_this(this) {}
+
+  ex_braid(const ex_braid&) = delete;
+  ex_braid& operator=(const ex_braid&) = delete;
+
+  ~ex_braid() {
+    while (true) {
+      {
+        std::lock_guard<std::mutex> lg{queue_lock};
+        if (!running && queue.empty()) {
+          return;
+        }
+      }
+      std::this_thread::yield();
+    }
+  }
+
+  /// Sets the maximum number of items that one thread runs inline before it
+  /// hands the rest of the queue to the parent executor. Must be at least 1.
+  ex_braid& set_batch_size(size_t BatchSize) {
+    batch_size_ = BatchSize;
+    return *this;
+  }
+
+  size_t batch_size() const { return batch_size_; }
+
+  void post(tmc::work_item&& Item, size_t Priority = 0, size_t ThreadHint = NO_HINT) {
+    (void)ThreadHint;
+    bool runInline = tmc::detail::this_thread::executor() != nullptr;
+    {
+      std::lock_guard<std::mutex> lg{queue_lock};
+      queue.push_back(queued_item{std::move(Item), Priority});
+      if (running) {
+        return;
+      }
+      running = true;
+      if (!runInline) {
+        parent->post(drain(this), Priority);
+        return;
+      }
+    }
+    combine();
+  }
+
+  template <typename Iter>
+  void
+  post_bulk(Iter It, size_t Count, size_t Priority = 0, size_t ThreadHint = NO_HINT) {
+    for (size_t i = 0; i < Count; ++i) {
+      post(std::move(*It), Priority, ThreadHint);
+      ++It;
+    }
+  }
+
+  bool is_current() const {
+    return tmc::detail::this_thread::executor() == &type_erased_this;
+  }
+
+  tmc::ex_any* type_erased() TMC_LIFETIMEBOUND { return &type_erased_this; }
+};
+} // namespace flat_combining
+
+namespace tmc::detail {
+template <> struct executor_traits<flat_combining::ex_braid> {
+  static inline void post(
+    flat_combining::ex_braid& Ex, tmc::work_item&& Item, size_t Priority,
+    size_t ThreadHint
+  ) {
+    Ex.post(std::move(Item), Priority, ThreadHint);
+  }
+
+  template <typename It>
+  static inline void post_bulk(
+    flat_combining::ex_braid& Ex, It&& Items, size_t Count, size_t Priority,
+    size_t ThreadHint
+  ) {
+    Ex.post_bulk(std::forward<It>(Items), Count, Priority, ThreadHint);
+  }
+
+  static inline tmc::ex_any* type_erased(flat_combining::ex_braid& Ex TMC_LIFETIMEBOUND) {
+    return Ex.type_erased();
+  }
+
+  static inline std::coroutine_handle<> dispatch(
+    flat_combining::ex_braid& Ex, std::coroutine_handle<> Outer, size_t Priority
+  ) {
+    if (Ex.is_current()) {
+      tmc::detail::this_thread::this_task().prio = Priority;
+      return Outer;
+    }
+    Ex.post(std::move(Outer), Priority);
+    return std::noop_coroutine();
+  }
+};
+} // namespace tmc::detail
@@ -0,0 +1,188 @@
+// Changing the number of threads that a tmc::ex_cpu runs on, at runtime.
+//
+// ex_cpu's thread count is fixed by init(), and the container CPU quota is
+// only read once, at that point. If the quota is reduced while the process
+// runs, the executor's threads are throttled by the kernel as a group, which
+// stalls whichever tasks happen to be running for the rest of each period.
+//
+// elastic::thread_limiter parks some of an executor's threads, so that only
+// the requested number of them run tasks. The executor is initialized with
+// the largest thread count that it may need:
+//
+//   tmc::cpu_executor().set_thread_count(16).init();
+//   elastic::thread_limiter limiter(tmc::cpu_executor());
+//   limiter.set_active_threads(4); // 12 threads park
+//   ...
+//   limiter.set_active_threads(8); // 4 of them resume running tasks
+//
+// A thread is parked by posting it a task, at priority 0, that blocks on a
+// condition variable until it is released. A parked thread uses no CPU. The
+// executor sees it as busy, so it does not try to wake it, and work in its
+// local queue is stolen by the other threads. Threads park as soon as they
+// finish their current task, and resume as soon as they are released.
+//
+// This does not change the executor's steal and wake matrices, which belong
+// to ex_cpu; a parked thread is simply never idle, so the others steal around
+// it. Work that is posted with a ThreadHint for a parked thread waits for the
+// other threads to steal it.
+//
+// elastic::quota_watcher follows the container's CPU quota: it polls
+// tmc::detail::query_container_cpu_quota(), and sets the active thread count
+// to the quota rounded down (at least 1), the same rule that ex_cpu applies
+// in init().
+
+#pragma once
+
+#include "tmc/detail/container_cpu_quota.hpp"
+#include "tmc/ex_cpu.hpp"
+#include "tmc/task.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+
+namespace elastic {
+class thread_limiter {
+  tmc::ex_cpu* ex;
+  size_t max_threads;
+  std::mutex lock;
+  std::condition_variable cv;
+  // The number of threads that should be parked.
+  size_t target = 0;
+  // Parking tasks that have been posted and have not exited yet, including
+  // those that have not started.
+  size_t parkers = 0;
+  // Parking tasks that are blocked.
+  size_t parked = 0;
+
+  static tmc::task<void> park(thread_limiter* Limiter) {
+    std::unique_lock<std::mutex> lg{Limiter->lock};
+    ++Limiter->parked;
+    Limiter->cv.wait(lg, [Limiter]() { return Limiter->parkers > Limiter->target; });
+    --Limiter->parked;
+    --Limiter->parkers;
+    // The destructor may be waiting for the last parker to exit. Notify while
+    // holding the lock, since the limiter may be destroyed once it is released.
+    Limiter->cv.notify_all();
+    co_return;
+  }
+
+public:
+  /// Ex must be initialized. All of its threads are active at first.
+  explicit thread_limiter(tmc::ex_cpu& Ex)
+      : ex(&Ex), max_threads(Ex.thread_count()) {}
+
+  thread_limiter(const thread_limiter&) = delete;
+  thread_limiter& operator=(const thread_limiter&) = delete;
+
+  /// Releases every parked thread, and waits for them to resume. Must not be
+  /// called from one of the executor's threads.
+  ~thread_limiter() {
+    std::unique_lock<std::mutex> lg{lock};
+    target = 0;
+    cv.notify_all();
+    cv.wait(lg, [this]() { return parkers == 0; });
+  }
+
+  /// Sets the number of threads that may run tasks, between 1 and the
+  /// executor's thread count. Returns without waiting for threads to park.
+  void set_active_threads(size_t Count) {
+    Count = std::clamp(Count, size_t{1}, max_threads);
+    size_t toPost = 0;
+    {
+      std::lock_guard<std::mutex> lg{lock};
+      target = max_threads - Count;
+      if (parkers < target) {
+        toPost = target - parkers;
+        parkers = target;
+      }
+    }
+    if (toPost == 0) {
+      // Release any parkers above the new target.
+      cv.notify_all();
+      return;
+    }
+    for (size_t i = 0; i < toPost; ++i) {
+      ex->post(park(this), 0);
+    }
+  }
+
+  /// The number of threads that may run tasks.
+  size_t active_threads() {
+    std::lock_guard<std::mutex> lg{lock};
+    return max_threads - target;
+  }
+
+  /// The number of threads that are parked right now. This lags behind
+  /// set_active_threads() while threads finish their current tasks.
+  size_t parked_threads() {
+    std::lock_guard<std::mutex> lg{lock};
+    return parked;
+  }
+
+  size_t max_active_threads() const { return max_threads; }
+};
+
+/// The number of threads to run for a container CPU quota of CpuCount, if
+/// Limited, out of MaxThreads.
+inline size_t threads_for_quota(bool Limited, double CpuCount, size_t MaxThreads) {
+  if (!Limited) {
+    return MaxThreads;
+  }
+  size_t n = CpuCount < 1.0 ? 1 : static_cast<size_t>(CpuCount);
+  return std::min(n, MaxThreads);
+}
+
+/// Polls the container CPU quota on a background thread, and applies it to a
+/// thread_limiter.
+class quota_watcher {
+  thread_limiter* limiter;
+  std::chrono::milliseconds interval;
+  std::mutex lock;
+  std::condition_variable cv;
+  bool stop = false;
+  std::thread thread;
+
+  void poll() {
+    auto quota = tmc::detail::query_container_cpu_quota();
+    limiter->set_active_threads(threads_for_quota(
+      quota.is_container_limited(), static_cast<double>(quota.cpu_count),
+      limiter->max_active_threads()
+    ));
+  }
+
+public:
+  /// Applies the current quota, and then starts polling every Interval.
+  explicit quota_watcher(
+    thread_limiter& Limiter,
+    std::chrono::milliseconds Interval = std::chrono::milliseconds(1000)
+  )
+      : limiter(&Limiter), interval(Interval) {
+    poll();
+    thread = std::thread([this]() {
+      std::unique_lock<std::mutex> lg{lock};
+      while (!cv.wait_for(lg, interval, [this]() { return stop; })) {
+        lg.unlock();
+        poll();
+        lg.lock();
+      }
+    });
+  }
+
+  quota_watcher(const quota_watcher&) = delete;
+  quota_watcher& operator=(const quota_watcher&) = delete;
+
+  /// Stops polling. The limiter keeps the last active thread count.
+  ~quota_watcher() {
+    {
+      std::lock_guard<std::mutex> lg{lock};
+      stop = true;
+    }
+    cv.notify_one();
+    thread.join();
+  }
+};
+} // namespace elastic
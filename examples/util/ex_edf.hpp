@@ -0,0 +1,311 @@
+// ex_edf: an executor that runs the item with the earliest deadline first.
+//
+// tmc::ex_cpu's priorities are a small set of integer levels, which map
+// poorly onto requests that each have their own SLA: a request whose deadline
+// is 10ms away should run before one whose deadline is 1ms away, once it has
+// waited for 9.5ms. ex_edf orders its queue by deadline instead. The deadline
+// is passed in the Priority parameter, so the usual post functions work:
+//
+//   edf::ex_edf ex;
+//   ex.init();
+//   tmc::post(ex, handle(req), edf::deadline(req.arrival + req.budget));
+//   tmc::post(ex, background_work()); // no deadline
+//
+// TMC carries a task's priority across suspension, so a task keeps its
+// deadline when it is resumed on this executor, and tasks that it spawns
+// inherit it. A task that moves to another executor should set an ordinary
+// priority for it explicitly, e.g.
+// `co_await tmc::resume_on(other).with_priority(0)`, since a deadline is not a
+// valid priority level of an ex_cpu.
+//
+// Items without a deadline (Priority 0) run in FIFO order, when no item with
+// a deadline is waiting. So that a steady stream of deadline items can't
+// starve them, at most max_deadline_streak (16 by default) deadline items run
+// in a row while the FIFO queue is not empty; then the item at its front runs.
+//
+// Under overload, plain EDF degrades badly: once items start to miss their
+// deadlines, it keeps running the most overdue item first, so every item is
+// late. When an item is dequeued after its deadline has passed, ex_edf
+// applies the miss policy:
+// - DEMOTE (the default): move the item to the back of the FIFO queue, behind
+//   every item that can still meet its deadline. The item keeps its deadline,
+//   so it is demoted again each time it is resumed. The streak limit above
+//   bounds how long it waits there.
+// - RUN: run it anyway, which is plain EDF.
+// Items are never dropped by the executor, because a dropped task would never
+// resume its awaiter. Instead, a task can shed its own work by checking
+// edf::deadline_missed() and returning early.
+//
+// All threads share a single queue under a mutex, so this is meant for
+// request-sized work items (tens of microseconds or more), not for
+// fine-grained parallelism.
+
+#pragma once
+
+#include "tmc/current.hpp"
+#include "tmc/detail/compat.hpp"
+#include "tmc/detail/thread_locals.hpp"
+#include "tmc/ex_any.hpp"
+#include "tmc/work_item.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace edf {
+using clock = std::chrono::steady_clock;
+
+/// The Priority value of an item without a deadline.
+inline constexpr size_t NO_DEADLINE = 0;
+
+/// Converts a time point to a deadline that can be passed as the Priority
+/// parameter of a post function.
+inline size_t deadline(clock::time_point Deadline) {
+  auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+              Deadline.time_since_epoch()
+  )
+              .count();
+  return ns <= 0 ? 1 : static_cast<size_t>(ns);
+}
+
+/// A deadline Budget from now.
+inline size_t deadline_in(clock::duration Budget) {
+  return deadline(clock::now() + Budget);
+}
+
+/// The deadline of the current task, or NO_DEADLINE. Only meaningful on an
+/// ex_edf.
+inline size_t current_deadline() { return tmc::current_priority(); }
+
+/// True if the current task has a deadline, and it has passed.
+inline bool deadline_missed() {
+  size_t d = current_deadline();
+  return d != NO_DEADLINE && d < deadline(clock::now());
+}
+
+enum class miss_policy { DEMOTE, RUN };
+
+class ex_edf {
+  struct entry {
+    size_t deadline;
+    uint64_t seq;
+    tmc::work_item item;
+  };
+
+  // Orders std::push_heap / std::pop_heap as a min-heap on (deadline, seq).
+  struct later {
+    bool operator()(const entry& A, const entry& B) const {
+      return A.deadline != B.deadline ? A.deadline > B.deadline : A.seq > B.seq;
+    }
+  };
+
+  std::mutex lock;
+  std::condition_variable cv;
+  std::vector<entry> heap;
+  std::deque<entry> fifo;
+  uint64_t next_seq = 0;
+  bool stop = false;
+  std::vector<std::thread> threads;
+  size_t thread_count_ = 0;
+  miss_policy policy = miss_policy::DEMOTE;
+  size_t max_deadline_streak = 16;
+  // Deadline items that have run in a row while the FIFO queue was not empty.
+  size_t deadline_streak = 0;
+  std::atomic<size_t> miss_count{0};
+  tmc::ex_any type_erased_this;
+  bool is_initialized = false;
+
+  // Must be called with lock held.
+  void push(tmc::work_item&& Item, size_t Deadline) {
+    if (Deadline == NO_DEADLINE) {
+      fifo.push_back(entry{Deadline, 0, std::move(Item)});
+    } else {
+      heap.push_back(entry{Deadline, next_seq++, std::move(Item)});
+      std::push_heap(heap.begin(), heap.end(), later{});
+    }
+  }
+
+  void run_worker() {
+    tmc::detail::this_thread::executor() = &type_erased_this;
+    std::unique_lock<std::mutex> lg{lock};
+    while (true) {
+      cv.wait(lg, [this]() { return stop || !heap.empty() || !fifo.empty(); });
+      if (stop) {
+        break;
+      }
+      entry e;
+      bool fifoTurn =
+        !fifo.empty() &&
+        (heap.empty() ||
+         (max_deadline_streak != 0 && deadline_streak >= max_deadline_streak));
+      if (!fifoTurn) {
+        std::pop_heap(heap.begin(), heap.end(), later{});
+        e = std::move(heap.back());
+        heap.pop_back();
+        if (e.deadline < deadline(clock::now())) {
+          miss_count.fetch_add(1, std::memory_order_relaxed);
+          if (policy == miss_policy::DEMOTE) {
+            fifo.push_back(std::move(e));
+            continue;
+          }
+        }
+        deadline_streak = fifo.empty() ? 0 : deadline_streak + 1;
+      } else {
+        deadline_streak = 0;
+        e = std::move(fifo.front());
+        fifo.pop_front();
+      }
+      lg.unlock();
+      tmc::detail::this_thread::this_task().prio = e.deadline;
+      e.item();
+      lg.lock();
+    }
+    tmc::detail::this_thread::executor() = nullptr;
+  }
+
+public:
+  ex_edf() : type_erased_this(this) {}
+
+  /// Builder func to set the number of worker threads. The default (0) uses
+  /// std::thread::hardware_concurrency(). Must be called before `init()`.
+  ex_edf& set_thread_count(size_t ThreadCount) {
+    thread_count_ = ThreadCount;
+    return *this;
+  }
+
+  /// Builder func to set what happens to an item that is dequeued after its
+  /// deadline has passed. The default is DEMOTE.
+  ex_edf& set_miss_policy(miss_policy Policy) {
+    policy = Policy;
+    return *this;
+  }
+
+  /// Builder func to set how many deadline items may run in a row while an
+  /// item without a deadline (or a demoted item) is waiting. After that many,
+  /// the front of the FIFO queue runs. The default is 16. 0 removes the limit,
+  /// so FIFO items only run when no deadline item is waiting.
+  ex_edf& set_max_deadline_streak(size_t Count) {
+    max_deadline_streak = Count;
+    return *this;
+  }
+
+  /// Starts the worker threads.
+  void init() {
+    if (is_initialized) {
+      return;
+    }
+    is_initialized = true;
+    stop = false;
+    if (thread_count_ == 0) {
+      thread_count_ = std::max(1u, std::thread::hardware_concurrency());
+    }
+    threads.reserve(thread_count_);
+    for (size_t i = 0; i < thread_count_; ++i) {
+      threads.emplace_back([this]() { run_worker(); });
+    }
+  }
+
+  /// Stops the worker threads. Work that has not run yet is discarded.
+  void teardown() {
+    if (!is_initialized) {
+      return;
+    }
+    is_initialized = false;
+    {
+      std::lock_guard<std::mutex> lg{lock};
+      stop = true;
+    }
+    cv.notify_all();
+    for (auto& t : threads) {
+      t.join();
+    }
+    threads.clear();
+    heap.clear();
+    fifo.clear();
+  }
+
+  ~ex_edf() { teardown(); }
+
+  size_t thread_count() const { return thread_count_; }
+
+  /// The number of times an item was dequeued after its deadline had passed.
+  /// A demoted task is counted again each time it is resumed.
+  size_t missed() const { return miss_count.load(std::memory_order_relaxed); }
+
+  bool is_current() const {
+    return tmc::detail::this_thread::executor() == &type_erased_this;
+  }
+
+  /// Posts Item with a deadline created by edf::deadline(), or NO_DEADLINE.
+  /// ThreadHint is ignored.
+  void post(
+    tmc::work_item&& Item, size_t Deadline = NO_DEADLINE,
+    [[maybe_unused]] size_t ThreadHint = NO_HINT
+  ) {
+    {
+      std::lock_guard<std::mutex> lg{lock};
+      push(std::move(Item), Deadline);
+    }
+    cv.notify_one();
+  }
+
+  /// All of the items have the same deadline.
+  template <typename Iter>
+  void post_bulk(
+    Iter It, size_t Count, size_t Deadline = NO_DEADLINE,
+    [[maybe_unused]] size_t ThreadHint = NO_HINT
+  ) {
+    {
+      std::lock_guard<std::mutex> lg{lock};
+      for (size_t i = 0; i < Count; ++i) {
+        push(tmc::work_item{std::move(*It)}, Deadline);
+        ++It;
+      }
+    }
+    if (Count == 1) {
+      cv.notify_one();
+    } else if (Count > 1) {
+      cv.notify_all();
+    }
+  }
+
+  /// Returns a pointer to the type erased `ex_any` version of this executor.
+  tmc::ex_any* type_erased() TMC_LIFETIMEBOUND { return &type_erased_this; }
+};
+} // namespace edf
+
+namespace tmc::detail {
+template <> struct executor_traits<edf::ex_edf> {
+  static inline void
+  post(edf::ex_edf& Ex, tmc::work_item&& Item, size_t Priority, size_t ThreadHint) {
+    Ex.post(std::move(Item), Priority, ThreadHint);
+  }
+
+  template <typename It>
+  static inline void post_bulk(
+    edf::ex_edf& Ex, It&& Items, size_t Count, size_t Priority, size_t ThreadHint
+  ) {
+    Ex.post_bulk(std::forward<It>(Items), Count, Priority, ThreadHint);
+  }
+
+  static inline tmc::ex_any* type_erased(edf::ex_edf& Ex TMC_LIFETIMEBOUND) {
+    return Ex.type_erased();
+  }
+
+  static inline std::coroutine_handle<>
+  dispatch(edf::ex_edf& Ex, std::coroutine_handle<> Outer, size_t Priority) {
+    // Always post, so that the continuation is ordered against the queue.
+    Ex.post(std::move(Outer), Priority);
+    return std::noop_coroutine();
+  }
+};
+} // namespace tmc::detail
@@ -0,0 +1,322 @@
+// ex_numa: a single executor that keeps work on its NUMA node, and only moves
+// work to another node when that node has been idle for a while.
+//
+// A tmc::ex_cpu that spans several NUMA nodes may steal between any of its
+// threads. To keep work local, asio_server_per_cache.cpp creates one ex_cpu
+// per cache group by hand, and splits the work between them up front. That
+// layout cannot rebalance: if the load is skewed, one group is saturated while
+// the others sit idle.
+//
+// ex_numa owns one tmc::ex_cpu per NUMA node. Each of them is partitioned to
+// its node, so work stealing never crosses a node. Work that is posted to
+// ex_numa is sent to a home node:
+// - the Node passed to post(), which may be used to tag work with the node
+//   that owns its data. The executor_traits specialization passes ThreadHint
+//   as the Node, so tmc::post(ex, task, prio, node) works the same way.
+// - if no node is given, the node of the calling thread, if it is one of this
+//   executor's threads.
+// - otherwise, the node with the smallest backlog.
+//
+// Each node counts its backlog: the items posted through ex_numa that are
+// waiting to run or are running. A node has idle threads while its backlog is
+// less than its thread count. If the home node's backlog is at least the spill
+// threshold (by default, its thread count), and another node has had idle
+// threads for longer than the idle threshold, the item is posted to that node
+// instead. This is the only point at which work crosses a node; items that
+// are already queued on a node are not moved.
+//
+// Tasks that are spawned by a running task run on that task's node's ex_cpu,
+// which is their current executor, so they stay on that node. They are not
+// counted in the backlog. To move a running task to another node explicitly,
+// use `co_await tmc::resume_on(ex.node(n))`.
+//
+// Counting the backlog requires each posted item to be wrapped in a task, so
+// every post allocates 1 coroutine frame in addition to the work item.
+//
+// Without TMC_USE_HWLOC, there is a single node which uses all threads.
+
+#pragma once
+
+#include "tmc/detail/compat.hpp"
+#include "tmc/ex_any.hpp"
+#include "tmc/ex_cpu.hpp"
+#include "tmc/task.hpp"
+#include "tmc/work_item.hpp"
+
+#ifdef TMC_USE_HWLOC
+#include "tmc/topology.hpp"
+#endif
+
+#include <atomic>
+#include <chrono>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <utility>
+
+namespace numa {
+class ex_numa {
+  using clock_type = std::chrono::steady_clock;
+
+  struct alignas(64) node_state {
+    tmc::ex_cpu ex;
+    // Items posted to this node that have not finished running yet
+    std::atomic<size_t> backlog{0};
+    // When backlog last dropped below thread_count
+    std::atomic<int64_t> idle_since{0};
+    size_t thread_count = 0;
+    size_t spill_threshold = 0;
+  };
+
+  std::unique_ptr<node_state[]> nodes;
+  size_t node_count_ = 0;
+  size_t threads_per_node = 0;
+  size_t priority_count = 0;
+  size_t spill_threshold = 0;
+  clock_type::duration idle_threshold = std::chrono::milliseconds(1);
+  std::atomic<size_t> next_node{0};
+  std::atomic<size_t> migration_count{0};
+  tmc::ex_any type_erased_this;
+  bool is_initialized = false;
+
+  // The node of the current thread, if it belongs to an ex_numa
+  static inline thread_local const ex_numa* this_thread_owner = nullptr;
+  static inline thread_local size_t this_thread_node = 0;
+
+  static int64_t now_ticks() {
+    return clock_type::now().time_since_epoch().count();
+  }
+
+  // Runs Item and then removes it from the backlog of the node that it was
+  // posted to. Item() returns when the item completes or suspends.
+  static tmc::task<void> counted(node_state* Node, tmc::work_item Item) {
+    Item();
+    if (Node->backlog.fetch_sub(1, std::memory_order_acq_rel) == Node->thread_count) {
+      Node->idle_since.store(now_ticks(), std::memory_order_relaxed);
+    }
+    co_return;
+  }
+
+  size_t least_loaded_node() {
+    size_t start = next_node.fetch_add(1, std::memory_order_relaxed);
+    size_t best = start % node_count_;
+    size_t bestBacklog = std::numeric_limits<size_t>::max();
+    for (size_t i = 0; i < node_count_; ++i) {
+      size_t n = (start + i) % node_count_;
+      size_t b = nodes[n].backlog.load(std::memory_order_relaxed);
+      if (b < bestBacklog) {
+        best = n;
+        bestBacklog = b;
+      }
+    }
+    return best;
+  }
+
+  // Returns another node that has had idle threads for longer than
+  // idle_threshold, or Home if there is none.
+  size_t find_idle_node(size_t Home) {
+    if (idle_threshold == clock_type::duration::max()) {
+      return Home;
+    }
+    int64_t cutoff = now_ticks() - idle_threshold.count();
+    for (size_t i = 1; i < node_count_; ++i) {
+      size_t n = (Home + i) % node_count_;
+      auto& node = nodes[n];
+      if (node.backlog.load(std::memory_order_relaxed) < node.thread_count &&
+          node.idle_since.load(std::memory_order_relaxed) <= cutoff) {
+        return n;
+      }
+    }
+    return Home;
+  }
+
+  size_t choose_node(size_t Node) {
+    size_t home;
+    if (Node != NO_NODE) {
+      home = Node % node_count_;
+    } else if (this_thread_owner == this) {
+      home = this_thread_node;
+    } else {
+      return least_loaded_node();
+    }
+    if (nodes[home].backlog.load(std::memory_order_relaxed) >=
+        nodes[home].spill_threshold) {
+      size_t target = find_idle_node(home);
+      if (target != home) {
+        migration_count.fetch_add(1, std::memory_order_relaxed);
+        return target;
+      }
+    }
+    return home;
+  }
+
+  void post_to(size_t Node, tmc::work_item&& Item, size_t Priority) {
+    auto& node = nodes[Node];
+    node.backlog.fetch_add(1, std::memory_order_acq_rel);
+    node.ex.post(counted(&node, std::move(Item)), Priority);
+  }
+
+public:
+  /// Pass as the Node parameter to post() to let the executor choose a node.
+  static inline constexpr size_t NO_NODE = TMC_ALL_ONES;
+
+  ex_numa() : type_erased_this(this) {}
+
+  /// Builder func to set the number of threads per node. The default (0)
+  /// uses all of the cores on each node. Must be called before `init()`.
+  ex_numa& set_thread_count_per_node(size_t ThreadCount) {
+    threads_per_node = ThreadCount;
+    return *this;
+  }
+
+  /// Builder func to set the number of priority levels of each node's
+  /// executor. The default (0) uses the ex_cpu default. Must be called before
+  /// `init()`.
+  ex_numa& set_priority_count(size_t PriorityCount) {
+    priority_count = PriorityCount;
+    return *this;
+  }
+
+  /// Builder func to set the backlog at which work may be sent to another
+  /// node. The default (0) uses each node's thread count.
+  ex_numa& set_spill_threshold(size_t Backlog) {
+    spill_threshold = Backlog;
+    return *this;
+  }
+
+  /// Builder func to set how long a node must have had idle threads before it
+  /// accepts work from another node. The default is 1ms. Use
+  /// duration::max() to never move work between nodes.
+  ex_numa& set_idle_threshold(clock_type::duration Threshold) {
+    idle_threshold = Threshold;
+    return *this;
+  }
+
+  /// Creates and initializes one ex_cpu per NUMA node.
+  void init() {
+    if (is_initialized) {
+      return;
+    }
+    is_initialized = true;
+#ifdef TMC_USE_HWLOC
+    node_count_ = tmc::topology::query().numa_count();
+#else
+    node_count_ = 1;
+#endif
+    nodes = std::make_unique<node_state[]>(node_count_);
+    for (size_t i = 0; i < node_count_; ++i) {
+      auto& node = nodes[i];
+#ifdef TMC_USE_HWLOC
+      tmc::topology::topology_filter f;
+      f.set_numa_indexes({i});
+      node.ex.add_partition(f);
+#endif
+      if (threads_per_node != 0) {
+        node.ex.set_thread_count(threads_per_node);
+      }
+      if (priority_count != 0) {
+        node.ex.set_priority_count(priority_count);
+      }
+      node.ex.set_thread_init_hook([this, i](size_t) {
+        this_thread_owner = this;
+        this_thread_node = i;
+      });
+      node.ex.set_thread_teardown_hook([](size_t) {
+        this_thread_owner = nullptr;
+      });
+      node.idle_since.store(now_ticks(), std::memory_order_relaxed);
+      node.ex.init();
+      node.thread_count = node.ex.thread_count();
+      node.spill_threshold = spill_threshold != 0 ? spill_threshold : node.thread_count;
+    }
+  }
+
+  /// Stops each node's executor. Work that has not run yet is destroyed.
+  void teardown() {
+    if (!is_initialized) {
+      return;
+    }
+    is_initialized = false;
+    for (size_t i = 0; i < node_count_; ++i) {
+      nodes[i].ex.teardown();
+    }
+    nodes.reset();
+    node_count_ = 0;
+  }
+
+  ~ex_numa() { teardown(); }
+
+  size_t node_count() const { return node_count_; }
+
+  /// The executor of a single node. Work posted to it directly runs only on
+  /// that node, and is not counted in its backlog.
+  tmc::ex_cpu& node(size_t Node) { return nodes[Node].ex; }
+
+  /// The number of items that are waiting to run or running on Node.
+  size_t backlog(size_t Node) const {
+    return nodes[Node].backlog.load(std::memory_order_relaxed);
+  }
+
+  /// The number of posts that were sent to an idle node instead of their
+  /// home node.
+  size_t migrations() const {
+    return migration_count.load(std::memory_order_relaxed);
+  }
+
+  /// The node of the calling thread, or NO_NODE if it is not one of this
+  /// executor's threads.
+  size_t current_node() const {
+    return this_thread_owner == this ? this_thread_node : NO_NODE;
+  }
+
+  /// Posts Item to its home node: Node, if specified, otherwise the current
+  /// thread's node. It may be sent to another node that has been idle for
+  /// longer than the idle threshold instead.
+  void post(tmc::work_item&& Item, size_t Priority = 0, size_t Node = NO_NODE) {
+    post_to(choose_node(Node), std::move(Item), Priority);
+  }
+
+  /// All of the items are sent to the same node.
+  template <typename Iter>
+  void post_bulk(Iter It, size_t Count, size_t Priority = 0, size_t Node = NO_NODE) {
+    size_t target = choose_node(Node);
+    for (size_t i = 0; i < Count; ++i) {
+      post_to(target, tmc::work_item{std::move(*It)}, Priority);
+      ++It;
+    }
+  }
+
+  /// Returns a pointer to the type erased `ex_any` version of this executor.
+  tmc::ex_any* type_erased() TMC_LIFETIMEBOUND { return &type_erased_this; }
+};
+} // namespace numa
+
+namespace tmc::detail {
+template <> struct executor_traits<numa::ex_numa> {
+  static inline void
+  post(numa::ex_numa& Ex, tmc::work_item&& Item, size_t Priority, size_t ThreadHint) {
+    Ex.post(std::move(Item), Priority, ThreadHint);
+  }
+
+  template <typename It>
+  static inline void post_bulk(
+    numa::ex_numa& Ex, It&& Items, size_t Count, size_t Priority, size_t ThreadHint
+  ) {
+    Ex.post_bulk(std::forward<It>(Items), Count, Priority, ThreadHint);
+  }
+
+  static inline tmc::ex_any* type_erased(numa::ex_numa& Ex TMC_LIFETIMEBOUND) {
+    return Ex.type_erased();
+  }
+
+  static inline std::coroutine_handle<>
+  dispatch(numa::ex_numa& Ex, std::coroutine_handle<> Outer, size_t Priority) {
+    // Always post, even from one of this executor's threads, so that the
+    // continuation is counted in its node's backlog.
+    Ex.post(std::move(Outer), Priority);
+    return std::noop_coroutine();
+  }
+};
+} // namespace tmc::detail
@@ -0,0 +1,467 @@
+// A mutex and a semaphore with a compile-time fairness policy.
+//
+// tmc::mutex and tmc::semaphore are unfair: release() wakes a waiter, which
+// tries to acquire again when it runs, and any task that arrives in the
+// meantime takes the unit ahead of it. This gives high throughput, since
+// the unit is rarely idle while the woken waiter is queued, but a waiter may
+// lose this race many times in a row, which shows up as a long tail of wait
+// times. These types let the caller choose:
+//
+// - fair_sync::unfair: the same behavior as tmc::mutex / tmc::semaphore. One
+//   waiter at a time is woken, and it keeps its place at the front of the
+//   queue if it loses the race, but it can lose any number of times.
+// - fair_sync::fifo: strict FIFO with direct handoff. While there are
+//   waiters, release() transfers the unit to the oldest waiter instead of
+//   making it available, and an acquire that finds waiters always waits.
+// - fair_sync::bounded<N>: at most N acquisitions may barge ahead of the
+//   oldest waiter. After that, the next release() hands the unit off to it
+//   directly, as in fifo mode.
+//
+//   fair_sync::mutex<fair_sync::bounded<8>> mut;
+//   auto scope = co_await mut.lock_scope();
+//
+//   fair_sync::semaphore<fair_sync::fifo> sem(4);
+//   co_await sem;
+//   sem.release();
+//
+// An acquire that does not need to wait is a single CAS. Only tasks that
+// wait, and releases that find waiters, take the waiter lock. Like
+// std::mutex, these must not be destroyed while a call to release() or
+// unlock() may still be running.
+
+#pragma once
+
+#include "tmc/current.hpp"
+#include "tmc/detail/concepts_awaitable.hpp"
+#include "tmc/ex_any.hpp"
+#include "tmc/task.hpp"
+
+#include <atomic>
+#include <coroutine>
+#include <cstddef>
+#include <limits>
+#include <mutex>
+#include <type_traits>
+#include <utility>
+
+namespace fair_sync {
+/// Woken waiters race with new arrivals.
+struct unfair {
+  static inline constexpr size_t barge_limit = std::numeric_limits<size_t>::max();
+};
+
+/// Units are handed off to waiters in FIFO order.
+struct fifo {
+  static inline constexpr size_t barge_limit = 0;
+};
+
+/// At most N acquisitions may overtake the oldest waiter.
+template <size_t N> struct bounded {
+  static inline constexpr size_t barge_limit = N;
+};
+
+template <typename Policy> class semaphore;
+
+namespace detail {
+// Identifies aw_acquire and aw_lock_scope to tmc::detail::awaitable_traits.
+struct awaitable_tag {};
+
+// A suspended acquire.
+struct waiter {
+  waiter* next = nullptr;
+  std::coroutine_handle<> continuation;
+  tmc::ex_any* executor = nullptr;
+  size_t prio = 0;
+
+  void capture(std::coroutine_handle<> Outer) {
+    continuation = Outer;
+    executor = tmc::current_executor();
+    prio = tmc::current_priority();
+  }
+};
+
+// An intrusive FIFO list of waiters.
+struct waiter_list {
+  waiter* head = nullptr;
+  waiter* tail = nullptr;
+
+  bool empty() const { return head == nullptr; }
+
+  void push_back(waiter* W) {
+    W->next = nullptr;
+    if (tail == nullptr) {
+      head = W;
+    } else {
+      tail->next = W;
+    }
+    tail = W;
+  }
+
+  void push_front(waiter* W) {
+    W->next = head;
+    head = W;
+    if (tail == nullptr) {
+      tail = W;
+    }
+  }
+
+  waiter* pop_front() {
+    waiter* w = head;
+    head = w->next;
+    if (head == nullptr) {
+      tail = nullptr;
+    }
+    return w;
+  }
+};
+} // namespace detail
+
+template <typename Policy> class aw_acquire;
+
+template <typename Policy> class semaphore {
+  friend class aw_acquire<Policy>;
+
+  static inline constexpr size_t BARGE_LIMIT = Policy::barge_limit;
+  static inline constexpr bool UNFAIR =
+    BARGE_LIMIT == std::numeric_limits<size_t>::max();
+
+  std::atomic<size_t> count;
+  // The number of tasks that are waiting for a unit, including woken waiters
+  // that have not taken one yet.
+  std::atomic<size_t> waiting{0};
+  // The number of acquisitions that overtook a waiter since the last handoff.
+  std::atomic<size_t> barges{0};
+  std::mutex waiter_lock;
+  // The following are protected by waiter_lock.
+  detail::waiter_list waiters;
+  // The number of waiters that were removed from the list and woken to try
+  // to take a unit. At most one is woken at a time, so that the oldest
+  // waiter is always either woken, or at the front of the list.
+  size_t pending = 0;
+  // The number of units that were handed off to pending waiters.
+  size_t reserved = 0;
+
+  // Takes a unit if one is available, regardless of the policy.
+  bool take() {
+    size_t c = count.load(std::memory_order_relaxed);
+    while (c != 0) {
+      if (count.compare_exchange_weak(
+            c, c - 1, std::memory_order_acquire, std::memory_order_relaxed
+          )) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Takes a unit for W if the policy allows it, or adds W to the waiters.
+  // Returns true if W took a unit. The fence pairs with the one in release():
+  // either this sees the released unit, or release() sees this waiter.
+  bool take_or_wait(detail::waiter* W) {
+    detail::waiter* next = nullptr;
+    {
+      std::lock_guard<std::mutex> lg{waiter_lock};
+      // Every other waiter is either in the list or pending, since both are
+      // only changed under the lock.
+      size_t others = waiting.fetch_add(1, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      bool mayTake = true;
+      if constexpr (!UNFAIR) {
+        mayTake = others == 0 || barges.load(std::memory_order_relaxed) < BARGE_LIMIT;
+      }
+      if (mayTake && take()) {
+        waiting.fetch_sub(1, std::memory_order_relaxed);
+        if constexpr (!UNFAIR) {
+          if (others != 0) {
+            barges.fetch_add(1, std::memory_order_relaxed);
+          }
+        }
+        return true;
+      }
+      waiters.push_back(W);
+      // A unit that this left for an older waiter must not sit idle. If no
+      // waiter has been woken to take it, wake the oldest one, which is not W.
+      if (others != 0 && pending == 0 && count.load(std::memory_order_relaxed) != 0) {
+        next = waiters.pop_front();
+        ++pending;
+      }
+    }
+    if (next != nullptr) {
+      wake(next);
+    }
+    return false;
+  }
+
+  // Resumes a waiter that owns a unit.
+  static void resume(detail::waiter* W) {
+    if (W->executor == nullptr) {
+      W->continuation.resume();
+    } else {
+      W->executor->post(std::move(W->continuation), W->prio);
+    }
+  }
+
+  // Called by a woken waiter. Returns true if W took a unit. Otherwise, W
+  // goes back to the front of the list. If W took a unit and more are
+  // available, the next waiter is woken.
+  bool retry_take(detail::waiter* W) {
+    detail::waiter* next = nullptr;
+    bool owned;
+    {
+      std::lock_guard<std::mutex> lg{waiter_lock};
+      --pending;
+      if (reserved != 0) {
+        --reserved;
+        owned = true;
+      } else {
+        owned = take();
+      }
+      if (!owned) {
+        waiters.push_front(W);
+        return false;
+      }
+      waiting.fetch_sub(1, std::memory_order_relaxed);
+      if (pending == 0 && !waiters.empty() &&
+          count.load(std::memory_order_relaxed) != 0) {
+        next = waiters.pop_front();
+        ++pending;
+      }
+    }
+    if (next != nullptr) {
+      wake(next);
+    }
+    return true;
+  }
+
+  // Runs on the woken waiter's executor, at its priority.
+  static tmc::task<void> retry(semaphore* Sem, detail::waiter* W) {
+    if (Sem->retry_take(W)) {
+      W->continuation.resume();
+    }
+    co_return;
+  }
+
+  // Wakes a waiter that does not own a unit, to try to take one.
+  void wake(detail::waiter* W) {
+    if (W->executor == nullptr) {
+      if (retry_take(W)) {
+        W->continuation.resume();
+      }
+    } else {
+      W->executor->post(retry(this, W), W->prio);
+    }
+  }
+
+  // If the policy requires a handoff, gives the unit to the oldest waiter and
+  // returns true.
+  bool handoff() {
+    if constexpr (UNFAIR) {
+      return false;
+    } else {
+      if (waiting.load(std::memory_order_relaxed) == 0 ||
+          barges.load(std::memory_order_relaxed) < BARGE_LIMIT) {
+        return false;
+      }
+      detail::waiter* w;
+      {
+        std::lock_guard<std::mutex> lg{waiter_lock};
+        if (pending > reserved) {
+          // The oldest waiter has already been woken.
+          ++reserved;
+          barges.store(0, std::memory_order_relaxed);
+          return true;
+        }
+        if (waiters.empty()) {
+          return false;
+        }
+        w = waiters.pop_front();
+        waiting.fetch_sub(1, std::memory_order_relaxed);
+        barges.store(0, std::memory_order_relaxed);
+      }
+      resume(w);
+      return true;
+    }
+  }
+
+public:
+  explicit semaphore(size_t Count) : count(Count) {}
+  semaphore(const semaphore&) = delete;
+  semaphore& operator=(const semaphore&) = delete;
+
+  /// Takes a unit without waiting, if the policy allows it. Returns true if a
+  /// unit was taken.
+  bool try_acquire() {
+    if constexpr (!UNFAIR) {
+      if (waiting.load(std::memory_order_relaxed) != 0 &&
+          barges.load(std::memory_order_relaxed) >= BARGE_LIMIT) {
+        return false;
+      }
+    }
+    if (!take()) {
+      return false;
+    }
+    if constexpr (!UNFAIR) {
+      if (waiting.load(std::memory_order_relaxed) != 0) {
+        barges.fetch_add(1, std::memory_order_relaxed);
+      }
+    }
+    return true;
+  }
+
+  /// Returns a unit. If the policy requires a handoff, the unit is given
+  /// directly to the oldest waiter. Otherwise, it is made available, and the
+  /// oldest waiter is woken to try to take it.
+  void release() {
+    if (handoff()) {
+      return;
+    }
+    count.fetch_add(1, std::memory_order_release);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (waiting.load(std::memory_order_relaxed) == 0) {
+      return;
+    }
+    detail::waiter* w = nullptr;
+    {
+      std::lock_guard<std::mutex> lg{waiter_lock};
+      if (pending == 0 && !waiters.empty()) {
+        w = waiters.pop_front();
+        ++pending;
+      }
+    }
+    if (w != nullptr) {
+      wake(w);
+    }
+  }
+
+  /// The number of units that are available.
+  size_t count_available() const { return count.load(std::memory_order_relaxed); }
+
+  /// Suspends until a unit is taken.
+  aw_acquire<Policy> operator co_await() { return aw_acquire<Policy>(*this); }
+};
+
+template <typename Policy>
+class [[nodiscard]] aw_acquire : detail::waiter, detail::awaitable_tag {
+  semaphore<Policy>* sem;
+
+public:
+  explicit aw_acquire(semaphore<Policy>& Sem) : sem(&Sem) {}
+
+  bool await_ready() { return sem->try_acquire(); }
+
+  bool await_suspend(std::coroutine_handle<> Outer) {
+    capture(Outer);
+    // This may already have been resumed on another thread if it returns
+    // true.
+    return !sem->take_or_wait(this);
+  }
+
+  void await_resume() {}
+};
+
+template <typename Policy> class aw_lock_scope;
+
+/// A semaphore with a single unit.
+template <typename Policy> class mutex {
+  friend class aw_lock_scope<Policy>;
+
+  semaphore<Policy> sem{1};
+
+public:
+  mutex() = default;
+
+  bool try_lock() { return sem.try_acquire(); }
+
+  void unlock() { sem.release(); }
+
+  bool is_locked() const { return sem.count_available() == 0; }
+
+  /// Suspends until the lock is taken.
+  aw_acquire<Policy> operator co_await() { return aw_acquire<Policy>(sem); }
+
+  /// Suspends until the lock is taken. The result releases the lock when it
+  /// is destroyed.
+  aw_lock_scope<Policy> lock_scope() { return aw_lock_scope<Policy>(*this); }
+};
+
+/// Releases the lock when destroyed.
+template <typename Policy> class [[nodiscard]] mutex_scope {
+  mutex<Policy>* mut;
+
+public:
+  explicit mutex_scope(mutex<Policy>& Mut) : mut(&Mut) {}
+  mutex_scope(mutex_scope&& Other) : mut(std::exchange(Other.mut, nullptr)) {}
+  mutex_scope& operator=(mutex_scope&&) = delete;
+  mutex_scope(const mutex_scope&) = delete;
+  mutex_scope& operator=(const mutex_scope&) = delete;
+
+  ~mutex_scope() {
+    if (mut != nullptr) {
+      mut->unlock();
+    }
+  }
+};
+
+template <typename Policy>
+class [[nodiscard]] aw_lock_scope : detail::awaitable_tag {
+  mutex<Policy>* mut;
+  aw_acquire<Policy> acquire;
+
+public:
+  explicit aw_lock_scope(mutex<Policy>& Mut) : mut(&Mut), acquire(Mut.sem) {}
+
+  bool await_ready() { return acquire.await_ready(); }
+
+  bool await_suspend(std::coroutine_handle<> Outer) {
+    return acquire.await_suspend(Outer);
+  }
+
+  mutex_scope<Policy> await_resume() { return mutex_scope<Policy>(*mut); }
+};
+} // namespace fair_sync
+
+// Implementation of tmc::detail::awaitable_traits, so that these can be
+// awaited by a tmc::task when TMC_NO_UNKNOWN_AWAITABLES is defined, and used
+// with tmc::spawn*() without an extra wrapper task. The acquire awaitables
+// already resume the awaiting task on its own executor and priority, so they
+// are awaited as-is.
+namespace tmc::detail {
+template <typename T>
+concept IsFairSyncAwaitable = std::is_base_of_v<fair_sync::detail::awaitable_tag, T>;
+
+template <IsFairSyncAwaitable Awaitable> struct awaitable_traits<Awaitable> {
+  using result_type = decltype(std::declval<Awaitable&>().await_resume());
+  using self_type = Awaitable;
+
+  static decltype(auto) get_awaiter(self_type& awaitable) noexcept {
+    return awaitable;
+  }
+  static decltype(auto) get_awaiter(self_type&& awaitable) noexcept {
+    return static_cast<self_type&&>(awaitable);
+  }
+
+  static constexpr configure_mode mode = WRAPPER;
+};
+
+template <typename Policy> struct awaitable_traits<fair_sync::semaphore<Policy>> {
+  using result_type = void;
+  using self_type = fair_sync::semaphore<Policy>;
+
+  static fair_sync::aw_acquire<Policy> get_awaiter(self_type& awaitable) noexcept {
+    return awaitable.operator co_await();
+  }
+
+  static constexpr configure_mode mode = WRAPPER;
+};
+
+template <typename Policy> struct awaitable_traits<fair_sync::mutex<Policy>> {
+  using result_type = void;
+  using self_type = fair_sync::mutex<Policy>;
+
+  static fair_sync::aw_acquire<Policy> get_awaiter(self_type& awaitable) noexcept {
+    return awaitable.operator co_await();
+  }
+
+  static constexpr configure_mode mode = WRAPPER;
+};
+} // namespace tmc::detail
@@ -0,0 +1,621 @@
+#pragma once
+/// A size-classed, thread-local pool allocator for coroutine frames.
+///
+/// tmc::task frames are allocated with the global operator new, so this header
+/// provides replacements for it. Define FRAME_POOL_IMPL in exactly one
+/// translation unit before including this header to install them for the
+/// whole program (similar to TMC_IMPL for standalone compilation).
+///
+/// Each thread that allocates gets its own cache of free lists, one per size
+/// class. An executor worker thread allocates and frees from its own cache
+/// without any synchronization. Blocks freed by a thread other than the one
+/// that allocated them are collected into a per-size-class batch, and the whole
+/// batch is returned to the owning thread with a single CAS. The owner picks up
+/// returned blocks when its local free list runs dry.
+///
+/// Memory obtained by the pool is retained for the lifetime of the program and
+/// reused; it is never returned to the system allocator. When a thread exits,
+/// its cache is orphaned: any thread that runs out of blocks takes the
+/// orphan's free lists before growing, and a thread that starts later adopts
+/// the whole cache. Caches are never destroyed, so blocks can be safely
+/// returned to a thread that has already exited.
+///
+/// Whether the pool is enabled is fixed for the lifetime of the process. It is
+/// read from the FRAME_POOL environment variable on the first allocation ("0"
+/// or "off" disables it), and defaults to FRAME_POOL_DEFAULT_ENABLED. When
+/// disabled, allocations go straight to the system allocator without a header,
+/// so that mode is a clean baseline. The skynet and fib `--alloc-compare`
+/// modes use run_program() to run each allocator in its own process.
+///
+/// An arena can also be installed on the current thread with
+/// set_this_thread_arena(). While it is installed, allocations are served by
+/// bumping a pointer in the arena, and freeing them does nothing. The arena's
+/// memory is released all at once when it is destroyed. arena_scope.hpp uses
+/// this to allocate every frame of a task tree from a single arena. Arenas
+/// are only used while the pool is enabled.
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <thread>
+
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <spawn.h>
+#include <sys/wait.h>
+
+extern char** environ;
+#endif
+
+#ifndef FRAME_POOL_DEFAULT_ENABLED
+#define FRAME_POOL_DEFAULT_ENABLED 1
+#endif
+
+namespace frame_pool {
+// Allocations are rounded up to a multiple of this size.
+inline constexpr size_t SIZE_CLASS_GRANULARITY = 64;
+// Allocations larger than SIZE_CLASS_COUNT * SIZE_CLASS_GRANULARITY (including
+// the header) are forwarded to the system allocator.
+inline constexpr size_t SIZE_CLASS_COUNT = 16;
+// Cross-thread frees are returned to the owner after this many accumulate.
+inline constexpr size_t REMOTE_BATCH_SIZE = 32;
+// Size of each chunk requested from the system allocator to carve blocks from.
+inline constexpr size_t SLAB_SIZE = 64 * 1024;
+// Default size of each chunk requested by an arena from the system allocator.
+inline constexpr size_t ARENA_CHUNK_SIZE = 1024 * 1024;
+// Number of threads that can bump an arena without sharing a lock.
+inline constexpr size_t ARENA_SLOT_COUNT = 64;
+
+class arena;
+
+namespace detail {
+struct thread_cache;
+
+// Every allocation is prefixed with this header so that operator delete can
+// find the owning thread and size class without a lookup. A null owner
+// indicates that the block came from the system allocator.
+struct alignas(alignof(std::max_align_t)) block_header {
+  thread_cache* owner;
+  size_t size_class;
+};
+
+struct free_block {
+  free_block* next;
+};
+
+struct remote_batch {
+  thread_cache* owner;
+  free_block* head;
+  free_block* tail;
+  size_t count;
+};
+
+struct thread_cache {
+  // Owner-only data
+  free_block* local[SIZE_CLASS_COUNT];
+  remote_batch pending[SIZE_CLASS_COUNT];
+  // Written only by the owner, but may be read by any thread
+  std::atomic<size_t> alloc_count;
+  thread_cache* next_registered;
+  // Protected by orphans_lock
+  thread_cache* next_orphan;
+
+  // Blocks returned by other threads. Kept on separate cache lines from the
+  // owner-only data above.
+  alignas(64) std::atomic<free_block*> remote[SIZE_CLASS_COUNT];
+};
+
+inline std::atomic<thread_cache*> registry{nullptr};
+inline thread_local thread_cache* this_thread_cache = nullptr;
+inline thread_local arena* this_thread_arena = nullptr;
+
+// The caches of threads that have exited, which are not owned by any thread.
+inline std::mutex orphans_lock;
+inline thread_cache* orphans = nullptr;
+inline std::atomic<size_t> orphan_count{0};
+
+inline bool read_enabled() {
+  const char* value = std::getenv("FRAME_POOL");
+  if (value == nullptr) {
+    return FRAME_POOL_DEFAULT_ENABLED != 0;
+  }
+  return std::strcmp(value, "0") != 0 && std::strcmp(value, "off") != 0;
+}
+
+// Evaluated on the first allocation. This can happen during static
+// initialization, so it is a function-local static.
+inline bool enabled() {
+  static const bool value = read_enabled();
+  return value;
+}
+
+// The owner of every block that is allocated from an arena. Its address is
+// only used as a tag.
+inline thread_cache* arena_owner() {
+  static char tag;
+  return reinterpret_cast<thread_cache*>(&tag);
+}
+
+// Gives each thread its own slot in every arena.
+inline constexpr size_t NO_INDEX = ~size_t{0};
+inline std::atomic<size_t> next_thread_index{0};
+inline thread_local size_t this_thread_index = NO_INDEX;
+
+inline size_t thread_index() {
+  if (this_thread_index == NO_INDEX) [[unlikely]] {
+    this_thread_index = next_thread_index.fetch_add(1, std::memory_order_relaxed);
+  }
+  return this_thread_index;
+}
+
+inline thread_cache* make_thread_cache() {
+  // Use malloc directly to avoid recursing into operator new. Over-allocate so
+  // the cache can be aligned to a cache line.
+  void* raw = std::malloc(sizeof(thread_cache) + alignof(thread_cache));
+  if (raw == nullptr) {
+    return nullptr;
+  }
+  auto addr = reinterpret_cast<uintptr_t>(raw);
+  addr = (addr + alignof(thread_cache) - 1) & ~(alignof(thread_cache) - 1);
+  auto cache = new (reinterpret_cast<void*>(addr)) thread_cache{};
+
+  // Register the cache so its counters can be read by other threads.
+  auto head = registry.load(std::memory_order_relaxed);
+  do {
+    cache->next_registered = head;
+  } while (!registry.compare_exchange_weak(
+    head, cache, std::memory_order_release, std::memory_order_relaxed
+  ));
+  return cache;
+}
+
+inline thread_cache* adopt_orphan() {
+  if (orphan_count.load(std::memory_order_relaxed) == 0) {
+    return nullptr;
+  }
+  std::lock_guard<std::mutex> lock(orphans_lock);
+  auto cache = orphans;
+  if (cache != nullptr) {
+    orphans = cache->next_orphan;
+    orphan_count.fetch_sub(1, std::memory_order_relaxed);
+  }
+  return cache;
+}
+
+inline void release_thread_cache(thread_cache* Cache);
+
+// Gives up this thread's cache when the thread exits.
+struct thread_cache_holder {
+  thread_cache* cache = nullptr;
+  ~thread_cache_holder() {
+    this_thread_cache = nullptr;
+    if (cache != nullptr) {
+      release_thread_cache(cache);
+    }
+  }
+};
+
+inline thread_local thread_cache_holder this_thread_holder;
+// Set once this thread's cache has been released. Allocations that happen
+// after that (from the destructors of other thread_locals) go to the system
+// allocator.
+inline thread_local bool this_thread_exited = false;
+
+inline thread_cache* get_thread_cache() {
+  auto cache = this_thread_cache;
+  if (cache == nullptr) [[unlikely]] {
+    if (this_thread_exited) {
+      return nullptr;
+    }
+    cache = adopt_orphan();
+    if (cache == nullptr) {
+      cache = make_thread_cache();
+    }
+    this_thread_cache = cache;
+    this_thread_holder.cache = cache;
+  }
+  return cache;
+}
+
+inline void flush_batch(remote_batch& Batch, size_t SizeClass) {
+  if (Batch.count == 0) {
+    return;
+  }
+  auto& target = Batch.owner->remote[SizeClass];
+  auto head = target.load(std::memory_order_relaxed);
+  do {
+    Batch.tail->next = head;
+  } while (!target.compare_exchange_weak(
+    head, Batch.head, std::memory_order_release, std::memory_order_relaxed
+  ));
+  Batch = remote_batch{nullptr, nullptr, nullptr, 0};
+}
+
+inline void flush_all_batches(thread_cache* Cache) {
+  for (size_t i = 0; i < SIZE_CLASS_COUNT; ++i) {
+    flush_batch(Cache->pending[i], i);
+  }
+}
+
+inline void release_thread_cache(thread_cache* Cache) {
+  this_thread_exited = true;
+  flush_all_batches(Cache);
+  std::lock_guard<std::mutex> lock(orphans_lock);
+  Cache->next_orphan = orphans;
+  orphans = Cache;
+  orphan_count.fetch_add(1, std::memory_order_relaxed);
+}
+
+// Takes the free blocks of SizeClass, local or returned, from the first orphan
+// that has any.
+inline free_block* take_orphaned_blocks(size_t SizeClass) {
+  if (orphan_count.load(std::memory_order_relaxed) == 0) {
+    return nullptr;
+  }
+  std::lock_guard<std::mutex> lock(orphans_lock);
+  for (auto cache = orphans; cache != nullptr; cache = cache->next_orphan) {
+    if (auto head = cache->local[SizeClass]; head != nullptr) {
+      cache->local[SizeClass] = nullptr;
+      return head;
+    }
+    auto head =
+      cache->remote[SizeClass].exchange(nullptr, std::memory_order_acquire);
+    if (head != nullptr) {
+      return head;
+    }
+  }
+  return nullptr;
+}
+
+// Carve a new slab into blocks of the requested size class and push them onto
+// the local free list. Returns false if the system allocator is exhausted.
+inline bool refill(thread_cache* Cache, size_t SizeClass) {
+  // Since we are about to grow, release any blocks that we are holding on
+  // behalf of other threads so they can reuse them instead of growing too.
+  flush_all_batches(Cache);
+
+  if (auto head = take_orphaned_blocks(SizeClass); head != nullptr) {
+    Cache->local[SizeClass] = head;
+    return true;
+  }
+
+  size_t blockSize = (SizeClass + 1) * SIZE_CLASS_GRANULARITY;
+  size_t blockCount = SLAB_SIZE / blockSize;
+  auto slab = static_cast<char*>(std::malloc(blockSize * blockCount));
+  if (slab == nullptr) {
+    return false;
+  }
+  free_block* head = Cache->local[SizeClass];
+  for (size_t i = blockCount; i > 0; --i) {
+    auto block = reinterpret_cast<free_block*>(slab + (i - 1) * blockSize);
+    block->next = head;
+    head = block;
+  }
+  Cache->local[SizeClass] = head;
+  return true;
+}
+
+inline void* allocate_system(size_t Size, thread_cache* Cache) {
+  auto header =
+    static_cast<block_header*>(std::malloc(sizeof(block_header) + Size));
+  if (header == nullptr) {
+    return nullptr;
+  }
+  header->owner = nullptr;
+  header->size_class = 0;
+  if (Cache != nullptr) {
+    Cache->alloc_count.store(
+      Cache->alloc_count.load(std::memory_order_relaxed) + 1,
+      std::memory_order_relaxed
+    );
+  }
+  return header + 1;
+}
+} // namespace detail
+
+/// A bump allocator whose memory is released all at once when it is
+/// destroyed. Any number of threads may allocate from it concurrently. Each
+/// thread bumps its own chunk, so threads only contend if there are more than
+/// ARENA_SLOT_COUNT of them.
+class arena {
+  struct chunk {
+    chunk* next;
+  };
+
+  struct alignas(64) slot {
+    std::atomic<bool> busy{false};
+    char* cur = nullptr;
+    char* end = nullptr;
+  };
+
+  static constexpr size_t CHUNK_HEADER_SIZE =
+    (sizeof(chunk) + alignof(std::max_align_t) - 1) &
+    ~(alignof(std::max_align_t) - 1);
+
+  slot slots[ARENA_SLOT_COUNT];
+  std::atomic<chunk*> chunks{nullptr};
+  std::atomic<size_t> reserved_bytes{0};
+  size_t chunk_size;
+
+  // Returns a chunk with at least Size usable bytes, or null.
+  char* new_chunk(size_t Size) {
+    auto c = static_cast<chunk*>(std::malloc(CHUNK_HEADER_SIZE + Size));
+    if (c == nullptr) {
+      return nullptr;
+    }
+    auto head = chunks.load(std::memory_order_relaxed);
+    do {
+      c->next = head;
+    } while (!chunks.compare_exchange_weak(
+      head, c, std::memory_order_release, std::memory_order_relaxed
+    ));
+    reserved_bytes.fetch_add(CHUNK_HEADER_SIZE + Size, std::memory_order_relaxed);
+    return reinterpret_cast<char*>(c) + CHUNK_HEADER_SIZE;
+  }
+
+public:
+  explicit arena(size_t ChunkSize = ARENA_CHUNK_SIZE) : chunk_size(ChunkSize) {}
+
+  arena(const arena&) = delete;
+  arena& operator=(const arena&) = delete;
+
+  ~arena() {
+    auto c = chunks.load(std::memory_order_acquire);
+    while (c != nullptr) {
+      auto next = c->next;
+      std::free(c);
+      c = next;
+    }
+  }
+
+  /// Returns Size bytes aligned to alignof(std::max_align_t), or null on
+  /// failure.
+  void* allocate(size_t Size) {
+    Size = (Size + alignof(std::max_align_t) - 1) & ~(alignof(std::max_align_t) - 1);
+    if (Size > chunk_size / 4) {
+      // Don't waste the rest of the current chunk on a large allocation.
+      return new_chunk(Size);
+    }
+    auto& s = slots[detail::thread_index() % ARENA_SLOT_COUNT];
+    while (s.busy.exchange(true, std::memory_order_acquire)) {
+      // Only if more than ARENA_SLOT_COUNT threads are allocating.
+      std::this_thread::yield();
+    }
+    if (static_cast<size_t>(s.end - s.cur) < Size) {
+      char* c = new_chunk(chunk_size);
+      if (c == nullptr) {
+        s.busy.store(false, std::memory_order_release);
+        return nullptr;
+      }
+      s.cur = c;
+      s.end = c + chunk_size;
+    }
+    void* ptr = s.cur;
+    s.cur += Size;
+    s.busy.store(false, std::memory_order_release);
+    return ptr;
+  }
+
+  /// The total number of bytes that this arena has requested from the system
+  /// allocator.
+  size_t reserved() const {
+    return reserved_bytes.load(std::memory_order_relaxed);
+  }
+};
+
+/// Installs Arena on the calling thread, or uninstalls it if null. Returns the
+/// previously installed arena.
+inline arena* set_this_thread_arena(arena* Arena) {
+  arena* prev = detail::this_thread_arena;
+  detail::this_thread_arena = Arena;
+  return prev;
+}
+
+inline arena* this_thread_arena() { return detail::this_thread_arena; }
+
+/// Allocate Size bytes. Returns nullptr on failure.
+inline void* allocate(size_t Size) {
+  auto cache = detail::get_thread_cache();
+  if (!detail::enabled()) {
+    if (cache != nullptr) {
+      cache->alloc_count.store(
+        cache->alloc_count.load(std::memory_order_relaxed) + 1,
+        std::memory_order_relaxed
+      );
+    }
+    return std::malloc(Size == 0 ? 1 : Size);
+  }
+  size_t total = Size + sizeof(detail::block_header);
+  if (auto a = detail::this_thread_arena; a != nullptr) {
+    auto header = static_cast<detail::block_header*>(a->allocate(total));
+    if (header == nullptr) {
+      return nullptr;
+    }
+    header->owner = detail::arena_owner();
+    header->size_class = 0;
+    if (cache != nullptr) {
+      cache->alloc_count.store(
+        cache->alloc_count.load(std::memory_order_relaxed) + 1,
+        std::memory_order_relaxed
+      );
+    }
+    return header + 1;
+  }
+  size_t sizeClass = (total - 1) / SIZE_CLASS_GRANULARITY;
+  if (cache == nullptr || sizeClass >= SIZE_CLASS_COUNT) {
+    return detail::allocate_system(Size, cache);
+  }
+
+  auto block = cache->local[sizeClass];
+  if (block == nullptr) [[unlikely]] {
+    // Take everything that other threads have returned to us.
+    block = cache->remote[sizeClass].exchange(nullptr, std::memory_order_acquire);
+    if (block == nullptr) {
+      if (!detail::refill(cache, sizeClass)) {
+        return nullptr;
+      }
+      block = cache->local[sizeClass];
+    }
+  }
+  cache->local[sizeClass] = block->next;
+  cache->alloc_count.store(
+    cache->alloc_count.load(std::memory_order_relaxed) + 1,
+    std::memory_order_relaxed
+  );
+
+  auto header = reinterpret_cast<detail::block_header*>(block);
+  header->owner = cache;
+  header->size_class = sizeClass;
+  return header + 1;
+}
+
+/// Free memory that was returned by allocate().
+inline void deallocate(void* Ptr) noexcept {
+  if (Ptr == nullptr) {
+    return;
+  }
+  if (!detail::enabled()) {
+    std::free(Ptr);
+    return;
+  }
+  auto header = static_cast<detail::block_header*>(Ptr) - 1;
+  auto owner = header->owner;
+  if (owner == nullptr) {
+    std::free(header);
+    return;
+  }
+  if (owner == detail::arena_owner()) {
+    // Released when the arena is destroyed.
+    return;
+  }
+
+  size_t sizeClass = header->size_class;
+  auto block = reinterpret_cast<detail::free_block*>(header);
+  auto cache = detail::get_thread_cache();
+  if (cache == owner) {
+    block->next = cache->local[sizeClass];
+    cache->local[sizeClass] = block;
+    return;
+  }
+
+  if (cache == nullptr) [[unlikely]] {
+    // Couldn't allocate a cache for this thread; return the block directly.
+    detail::remote_batch single{owner, block, block, 1};
+    detail::flush_batch(single, sizeClass);
+    return;
+  }
+
+  auto& batch = cache->pending[sizeClass];
+  if (batch.owner != owner) {
+    detail::flush_batch(batch, sizeClass);
+    batch.owner = owner;
+    batch.tail = block;
+  }
+  block->next = batch.head;
+  batch.head = block;
+  ++batch.count;
+  if (batch.count >= REMOTE_BATCH_SIZE) {
+    detail::flush_batch(batch, sizeClass);
+  }
+}
+
+/// Return any blocks that this thread is holding in partial batches to their
+/// owning threads. This is optional; batches are also flushed when full, or
+/// when this thread needs to grow its own cache.
+inline void flush_this_thread() {
+  auto cache = detail::this_thread_cache;
+  if (cache != nullptr) {
+    detail::flush_all_batches(cache);
+  }
+}
+
+/// Whether the pool is enabled in this process. When it is disabled, every
+/// allocation is forwarded to the system allocator, and arenas are ignored.
+inline bool is_enabled() { return detail::enabled(); }
+
+/// Runs Argv[0] in a new process with the arguments Argv (terminated by a
+/// null pointer), with the pool enabled or disabled, and waits for it to
+/// exit. Returns its exit status, or -1 if it could not be started.
+inline int run_program(bool PoolEnabled, char* const Argv[]) {
+  std::fflush(nullptr);
+#ifdef _WIN32
+  _putenv_s("FRAME_POOL", PoolEnabled ? "on" : "off");
+  return static_cast<int>(_spawnv(_P_WAIT, Argv[0], Argv));
+#else
+  setenv("FRAME_POOL", PoolEnabled ? "on" : "off", 1);
+  pid_t pid;
+  if (posix_spawnp(&pid, Argv[0], nullptr, nullptr, Argv, environ) != 0) {
+    return -1;
+  }
+  int status;
+  if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status)) {
+    return -1;
+  }
+  return WEXITSTATUS(status);
+#endif
+}
+
+/// Returns the total number of allocations made by all threads, whether they
+/// were served by the pool or by the system allocator. This is approximate
+/// while other threads are actively allocating.
+inline size_t total_allocations() {
+  size_t total = 0;
+  for (auto cache = detail::registry.load(std::memory_order_acquire);
+       cache != nullptr; cache = cache->next_registered) {
+    total += cache->alloc_count.load(std::memory_order_relaxed);
+  }
+  return total;
+}
+} // namespace frame_pool
+
+#ifdef FRAME_POOL_IMPL
+void* operator new(std::size_t Size) {
+  void* ptr = frame_pool::allocate(Size);
+  if (ptr == nullptr) {
+    throw std::bad_alloc();
+  }
+  return ptr;
+}
+
+void* operator new[](std::size_t Size) {
+  void* ptr = frame_pool::allocate(Size);
+  if (ptr == nullptr) {
+    throw std::bad_alloc();
+  }
+  return ptr;
+}
+
+void* operator new(std::size_t Size, const std::nothrow_t&) noexcept {
+  return frame_pool::allocate(Size);
+}
+
+void* operator new[](std::size_t Size, const std::nothrow_t&) noexcept {
+  return frame_pool::allocate(Size);
+}
+
+void operator delete(void* Ptr) noexcept { frame_pool::deallocate(Ptr); }
+
+void operator delete[](void* Ptr) noexcept { frame_pool::deallocate(Ptr); }
+
+void operator delete(void* Ptr, std::size_t) noexcept {
+  frame_pool::deallocate(Ptr);
+}
+
+void operator delete[](void* Ptr, std::size_t) noexcept {
+  frame_pool::deallocate(Ptr);
+}
+
+void operator delete(void* Ptr, const std::nothrow_t&) noexcept {
+  frame_pool::deallocate(Ptr);
+}
+
+void operator delete[](void* Ptr, const std::nothrow_t&) noexcept {
+  frame_pool::deallocate(Ptr);
+}
+#endif
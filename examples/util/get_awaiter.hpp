@@ -0,0 +1,17 @@
+#pragma once
+/// Returns the awaiter that `co_await Aw` would use: the result of its member
+/// or free operator co_await, or Aw itself (by reference) if it has neither.
+/// Used by the wrappers that forward to another awaitable
+/// (wait_histograms.hpp, task_trace.hpp).
+
+#include <utility>
+
+template <typename Awaitable> decltype(auto) get_awaiter(Awaitable&& Aw) {
+  if constexpr (requires { std::forward<Awaitable>(Aw).operator co_await(); }) {
+    return std::forward<Awaitable>(Aw).operator co_await();
+  } else if constexpr (requires { operator co_await(std::forward<Awaitable>(Aw)); }) {
+    return operator co_await(std::forward<Awaitable>(Aw));
+  } else {
+    return static_cast<Awaitable&>(Aw);
+  }
+}
@@ -0,0 +1,355 @@
+// An incremental, zero-copy HTTP/1.1 request and response parser.
+//
+// The parser never copies or allocates. A parsed request (or response) is made
+// of string_views that point into the caller's read buffer, so they are only
+// valid until the caller modifies that buffer.
+//
+// Parsing is incremental: the parser remembers how far it has already scanned
+// for the end of the header block, so a request that arrives in many small
+// reads is not rescanned from the start each time. The scan for the end of the
+// header block, and the scan for line and field delimiters within it, use SSE2
+// on x86 and fall back to scalar code elsewhere.
+//
+// A buffer may hold several pipelined requests. Call parse() repeatedly,
+// advancing the start of the buffer by `consumed` after each COMPLETE result,
+// until it returns INCOMPLETE.
+//
+// Bodies are supported with Content-Length. Transfer-Encoding (chunked
+// bodies) is rejected as BAD_MESSAGE. Bare LF line endings are accepted in
+// addition to CRLF.
+
+#pragma once
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define HTTP_PARSER_SSE2
+#endif
+
+namespace http {
+inline constexpr size_t MAX_HEADERS = 32;
+
+struct header {
+  std::string_view name;
+  std::string_view value;
+};
+
+enum class parse_status { COMPLETE, INCOMPLETE, BAD_MESSAGE };
+
+struct parse_result {
+  parse_status status;
+  // On COMPLETE, the total size of the message, including the body.
+  size_t consumed;
+  // On INCOMPLETE, if the headers are complete, the total size that the
+  // message will have once its body has arrived. Otherwise 0.
+  size_t expected = 0;
+};
+
+namespace detail {
+inline char to_lower(char C) {
+  return (C >= 'A' && C <= 'Z') ? static_cast<char>(C - 'A' + 'a') : C;
+}
+
+inline bool iequals(std::string_view A, std::string_view B) {
+  if (A.size() != B.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < A.size(); ++i) {
+    if (to_lower(A[i]) != to_lower(B[i])) {
+      return false;
+    }
+  }
+  return true;
+}
+
+inline std::string_view trim(std::string_view S) {
+  while (!S.empty() && (S.front() == ' ' || S.front() == '\t')) {
+    S.remove_prefix(1);
+  }
+  while (!S.empty() && (S.back() == ' ' || S.back() == '\t' || S.back() == '\r')) {
+    S.remove_suffix(1);
+  }
+  return S;
+}
+
+// True if the '\n' at index I of Data ends an empty line, which ends the
+// header block.
+inline bool is_header_end(const char* Data, size_t I) {
+  return (I >= 1 && Data[I - 1] == '\n') ||
+         (I >= 2 && Data[I - 1] == '\r' && Data[I - 2] == '\n');
+}
+
+/// Returns the index one past the end of the header block (the final '\n'),
+/// or 0 if it is not present. Scanning starts at From.
+inline size_t find_header_end(const char* Data, size_t Size, size_t From) {
+  size_t i = From;
+#ifdef HTTP_PARSER_SSE2
+  const __m128i nl = _mm_set1_epi8('\n');
+  for (; i + 16 <= Size; i += 16) {
+    __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(Data + i));
+    auto mask = static_cast<unsigned>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, nl)));
+    while (mask != 0) {
+      size_t idx = i + static_cast<size_t>(std::countr_zero(mask));
+      if (is_header_end(Data, idx)) {
+        return idx + 1;
+      }
+      mask &= mask - 1;
+    }
+  }
+#endif
+  for (; i < Size; ++i) {
+    if (Data[i] == '\n' && is_header_end(Data, i)) {
+      return i + 1;
+    }
+  }
+  return 0;
+}
+
+/// Returns a pointer to the first '\n' or ':' in [Begin, End), or End.
+inline const char* find_field_delim(const char* Begin, const char* End) {
+  const char* p = Begin;
+#ifdef HTTP_PARSER_SSE2
+  const __m128i nl = _mm_set1_epi8('\n');
+  const __m128i colon = _mm_set1_epi8(':');
+  for (; p + 16 <= End; p += 16) {
+    __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    __m128i hits = _mm_or_si128(_mm_cmpeq_epi8(chunk, nl), _mm_cmpeq_epi8(chunk, colon));
+    auto mask = static_cast<unsigned>(_mm_movemask_epi8(hits));
+    if (mask != 0) {
+      return p + std::countr_zero(mask);
+    }
+  }
+#endif
+  for (; p < End; ++p) {
+    if (*p == '\n' || *p == ':') {
+      return p;
+    }
+  }
+  return End;
+}
+
+inline const char* find_newline(const char* Begin, const char* End) {
+  auto p = static_cast<const char*>(
+    std::memchr(Begin, '\n', static_cast<size_t>(End - Begin))
+  );
+  return p == nullptr ? End : p;
+}
+
+inline bool parse_size(std::string_view S, size_t& Out) {
+  if (S.empty() || S.size() > 18) {
+    return false;
+  }
+  size_t v = 0;
+  for (char c : S) {
+    if (c < '0' || c > '9') {
+      return false;
+    }
+    v = v * 10 + static_cast<size_t>(c - '0');
+  }
+  Out = v;
+  return true;
+}
+
+// The fields that are common to requests and responses.
+struct header_block {
+  header headers[MAX_HEADERS];
+  size_t header_count = 0;
+  size_t content_length = 0;
+  bool has_transfer_encoding = false;
+  // -1 if absent, 0 for "close", 1 for "keep-alive"
+  int connection = -1;
+};
+
+/// Parse the header fields in [P, End), where End is the end of the header
+/// block. Returns false if the block is malformed.
+inline bool parse_headers(const char* P, const char* End, header_block& Out) {
+  Out.header_count = 0;
+  Out.content_length = 0;
+  Out.has_transfer_encoding = false;
+  Out.connection = -1;
+  while (P < End) {
+    if (*P == '\n' || (*P == '\r' && P + 1 < End && P[1] == '\n')) {
+      // The empty line that ends the block
+      return true;
+    }
+    const char* colon = find_field_delim(P, End);
+    if (colon == End || *colon != ':' || colon == P) {
+      return false;
+    }
+    const char* eol = find_newline(colon, End);
+    if (eol == End) {
+      return false;
+    }
+    if (Out.header_count == MAX_HEADERS) {
+      return false;
+    }
+    header& h = Out.headers[Out.header_count++];
+    h.name = std::string_view(P, static_cast<size_t>(colon - P));
+    h.value = trim(std::string_view(colon + 1, static_cast<size_t>(eol - colon - 1)));
+    if (iequals(h.name, "content-length")) {
+      if (!parse_size(h.value, Out.content_length)) {
+        return false;
+      }
+    } else if (iequals(h.name, "transfer-encoding")) {
+      Out.has_transfer_encoding = true;
+    } else if (iequals(h.name, "connection")) {
+      if (iequals(h.value, "close")) {
+        Out.connection = 0;
+      } else if (iequals(h.value, "keep-alive")) {
+        Out.connection = 1;
+      }
+    }
+    P = eol + 1;
+  }
+  return true;
+}
+
+// Parse "HTTP/1.x" and return x, or -1.
+inline int parse_version(std::string_view S) {
+  if (S.size() != 8 || S.substr(0, 7) != "HTTP/1." || S[7] < '0' || S[7] > '9') {
+    return -1;
+  }
+  return S[7] - '0';
+}
+
+// Common implementation of the incremental parse loop. StartLine receives the
+// first line (without the line ending), fills in the message, and returns
+// false if the line is malformed.
+template <typename Message, typename ParseStartLine>
+parse_result parse_message(
+  const char* Data, size_t Size, size_t& Scanned, Message& Out,
+  ParseStartLine&& StartLine
+) {
+  // Back up a few bytes so that a terminator split across reads is found.
+  size_t from = Scanned > 3 ? Scanned - 3 : 0;
+  size_t headerEnd = find_header_end(Data, Size, from);
+  if (headerEnd == 0) {
+    Scanned = Size;
+    return {parse_status::INCOMPLETE, 0};
+  }
+  const char* end = Data + headerEnd;
+  const char* lineEnd = find_newline(Data, end);
+  std::string_view line(Data, static_cast<size_t>(lineEnd - Data));
+  if (!line.empty() && line.back() == '\r') {
+    line.remove_suffix(1);
+  }
+  if (!StartLine(line) || !parse_headers(lineEnd + 1, end, Out)) {
+    Scanned = 0;
+    return {parse_status::BAD_MESSAGE, 0};
+  }
+  if (Out.has_transfer_encoding) {
+    Scanned = 0;
+    return {parse_status::BAD_MESSAGE, 0};
+  }
+  size_t total = headerEnd + Out.content_length;
+  if (Size < total) {
+    // The headers are complete, but the body is not. Resume the scan just
+    // before the header terminator next time.
+    Scanned = headerEnd - 1;
+    return {parse_status::INCOMPLETE, 0, total};
+  }
+  Out.body = std::string_view(end, Out.content_length);
+  Scanned = 0;
+  return {parse_status::COMPLETE, total};
+}
+} // namespace detail
+
+struct request : detail::header_block {
+  std::string_view method;
+  std::string_view target;
+  int minor_version = 1;
+  std::string_view body;
+  // Whether the connection should stay open after the response.
+  bool keep_alive = true;
+
+  /// Returns the value of the first header named Name (case-insensitive), or
+  /// an empty string_view.
+  std::string_view find_header(std::string_view Name) const {
+    for (size_t i = 0; i < header_count; ++i) {
+      if (detail::iequals(headers[i].name, Name)) {
+        return headers[i].value;
+      }
+    }
+    return {};
+  }
+};
+
+struct response : detail::header_block {
+  int status = 0;
+  std::string_view reason;
+  int minor_version = 1;
+  std::string_view body;
+};
+
+class request_parser {
+  // How much of the current (incomplete) request has been scanned already.
+  size_t scanned = 0;
+
+public:
+  /// Data points to the start of the next request in the buffer, and Size is
+  /// the number of bytes that have been read from that point. After
+  /// INCOMPLETE, call again with the same start and more bytes. After
+  /// COMPLETE, the next request starts at Data + consumed.
+  parse_result parse(const char* Data, size_t Size, request& Out) {
+    auto result =
+      detail::parse_message(Data, Size, scanned, Out, [&Out](std::string_view Line) {
+        size_t sp1 = Line.find(' ');
+        if (sp1 == std::string_view::npos || sp1 == 0) {
+          return false;
+        }
+        size_t sp2 = Line.find(' ', sp1 + 1);
+        if (sp2 == std::string_view::npos || sp2 == sp1 + 1) {
+          return false;
+        }
+        Out.method = Line.substr(0, sp1);
+        Out.target = Line.substr(sp1 + 1, sp2 - sp1 - 1);
+        Out.minor_version = detail::parse_version(Line.substr(sp2 + 1));
+        return Out.minor_version >= 0;
+      });
+    if (result.status == parse_status::COMPLETE) {
+      Out.keep_alive = Out.minor_version >= 1 ? Out.connection != 0 : Out.connection == 1;
+    }
+    return result;
+  }
+
+  void reset() { scanned = 0; }
+};
+
+class response_parser {
+  size_t scanned = 0;
+
+public:
+  /// The same as request_parser::parse(), for responses.
+  parse_result parse(const char* Data, size_t Size, response& Out) {
+    return detail::parse_message(
+      Data, Size, scanned, Out, [&Out](std::string_view Line) {
+        size_t sp1 = Line.find(' ');
+        if (sp1 == std::string_view::npos) {
+          return false;
+        }
+        Out.minor_version = detail::parse_version(Line.substr(0, sp1));
+        std::string_view rest = Line.substr(sp1 + 1);
+        if (Out.minor_version < 0 || rest.size() < 3) {
+          return false;
+        }
+        size_t code = 0;
+        if (!detail::parse_size(rest.substr(0, 3), code)) {
+          return false;
+        }
+        Out.status = static_cast<int>(code);
+        Out.reason = rest.size() > 4 ? rest.substr(4) : std::string_view{};
+        return true;
+      }
+    );
+  }
+
+  void reset() { scanned = 0; }
+};
+} // namespace http
+
+#undef HTTP_PARSER_SSE2
@@ -0,0 +1,108 @@
+// A fixed-size log-linear histogram for latency measurements.
+//
+// Values below 2^SUB_BITS are recorded exactly. Above that, each power-of-two
+// range is split into 2^SUB_BITS equal buckets, so any recorded value is
+// reported with a relative error of less than 1 / 2^SUB_BITS (about 3%).
+// Recording is a few instructions and never allocates, so a histogram can be
+// kept per connection or per thread, and merged at the end.
+//
+// Units are up to the caller; the examples record nanoseconds.
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+
+class latency_histogram {
+  static constexpr size_t SUB_BITS = 5;
+  static constexpr size_t SUB_COUNT = size_t{1} << SUB_BITS;
+  static constexpr size_t BUCKET_COUNT = (64 - SUB_BITS + 1) * SUB_COUNT;
+
+  std::array<uint64_t, BUCKET_COUNT> counts{};
+  uint64_t total = 0;
+  uint64_t max_value = 0;
+  uint64_t min_value = UINT64_MAX;
+  double sum = 0.0;
+
+  static size_t bucket_of(uint64_t Value) {
+    if (Value < SUB_COUNT) {
+      return static_cast<size_t>(Value);
+    }
+    size_t msb = 63 - static_cast<size_t>(std::countl_zero(Value));
+    size_t shift = msb - SUB_BITS;
+    return (shift + 1) * SUB_COUNT + static_cast<size_t>(Value >> shift) - SUB_COUNT;
+  }
+
+  // The largest value that maps to Bucket.
+  static uint64_t bucket_upper(size_t Bucket) {
+    if (Bucket < SUB_COUNT) {
+      return Bucket;
+    }
+    size_t shift = Bucket / SUB_COUNT - 1;
+    uint64_t sub = Bucket % SUB_COUNT + SUB_COUNT;
+    return ((sub + 1) << shift) - 1;
+  }
+
+public:
+  void record(uint64_t Value) {
+    ++counts[bucket_of(Value)];
+    ++total;
+    max_value = std::max(max_value, Value);
+    min_value = std::min(min_value, Value);
+    sum += static_cast<double>(Value);
+  }
+
+  void merge(const latency_histogram& Other) {
+    for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+      counts[i] += Other.counts[i];
+    }
+    total += Other.total;
+    max_value = std::max(max_value, Other.max_value);
+    min_value = std::min(min_value, Other.min_value);
+    sum += Other.sum;
+  }
+
+  void reset() { *this = latency_histogram{}; }
+
+  uint64_t count() const { return total; }
+  uint64_t max() const { return max_value; }
+  uint64_t min() const { return total == 0 ? 0 : min_value; }
+  double mean() const { return total == 0 ? 0.0 : sum / static_cast<double>(total); }
+
+  /// Returns the value below which Percentile percent of the recorded values
+  /// fall (e.g. 99.9 for p999), rounded up to the end of its bucket.
+  uint64_t percentile(double Percentile) const {
+    if (total == 0) {
+      return 0;
+    }
+    auto target =
+      static_cast<uint64_t>(std::ceil(Percentile / 100.0 * static_cast<double>(total)));
+    target = std::clamp<uint64_t>(target, 1, total);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKET_COUNT; ++i) {
+      seen += counts[i];
+      if (seen >= target) {
+        return std::min(bucket_upper(i), max_value);
+      }
+    }
+    return max_value;
+  }
+
+  /// Prints one line of percentiles, with values divided by Divisor (e.g. 1000
+  /// to print nanosecond values as microseconds).
+  void print(const char* Label, const char* Unit = "us", double Divisor = 1000.0) const {
+    std::printf(
+      "%s: count %llu | mean %.1f | p50 %.1f | p99 %.1f | p999 %.1f | max %.1f %s\n",
+      Label, static_cast<unsigned long long>(total), mean() / Divisor,
+      static_cast<double>(percentile(50.0)) / Divisor,
+      static_cast<double>(percentile(99.0)) / Divisor,
+      static_cast<double>(percentile(99.9)) / Divisor,
+      static_cast<double>(max_value) / Divisor, Unit
+    );
+  }
+};
@@ -0,0 +1,263 @@
+// Cheap sampling of how much work is queued on a tmc::ex_cpu, and for how
+// long it waits.
+//
+// ex_cpu does not expose its queues, so an autoscaler or an admission
+// controller can't ask it how far behind it is. load_sampling::ex_sampled
+// wraps an initialized ex_cpu, and counts the work that passes through it:
+//
+//   tmc::cpu_executor().set_priority_count(4).init();
+//   load_sampling::ex_sampled sampled(tmc::cpu_executor());
+//   tmc::post(sampled, handle(req), prio);
+//   ...
+//   auto snap = sampled.load_snapshot(); // from any thread, e.g. every 1ms
+//
+// Each item that is posted to ex_sampled is wrapped in a task that runs it
+// with ex_sampled as the current executor, so the continuations of a task and
+// the tasks that it spawns are counted too. Work that is posted to the
+// underlying ex_cpu directly is not counted.
+//
+// A snapshot contains:
+// - queued: the number of items per priority that have been posted but have
+//   not started running. Items that are suspended (waiting on a mutex, a
+//   timer, ...) are not queued.
+// - active: the number of threads that are running an item.
+// - the enqueue-to-dequeue delay of 1 in every sample_every (64 by default)
+//   items that started running since the previous snapshot: the number of
+//   samples, and their mean and max. The age of the oldest queued item is
+//   not observable from outside ex_cpu; the max delay is the closest proxy.
+//
+// Counters are sharded over cache-line-sized slots by thread, so posting and
+// running do not all contend on a single line. A snapshot reads
+// SHARD_COUNT * (priority count + 4) atomics, so it is cheap enough to take
+// every millisecond. The counts are approximate: an item that is posted from
+// one thread and started on another may be counted in different shards at
+// slightly different times.
+//
+// Each item that is posted allocates 1 coroutine frame in addition to the
+// work item, as in ex_numa.
+
+#pragma once
+
+#include "tmc/detail/compat.hpp"
+#include "tmc/ex_any.hpp"
+#include "tmc/ex_cpu.hpp"
+#include "tmc/task.hpp"
+#include "tmc/work_item.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace load_sampling {
+/// The maximum priority count of the wrapped executor.
+static inline constexpr size_t MAX_PRIORITIES = 16;
+static inline constexpr size_t SHARD_COUNT = 16;
+
+struct snapshot {
+  /// Items per priority that were posted and have not started running.
+  std::vector<size_t> queued;
+  /// Threads that are running an item.
+  size_t active = 0;
+  /// The thread count of the wrapped executor.
+  size_t thread_count = 0;
+  /// Delay samples taken since the previous snapshot.
+  size_t delay_samples = 0;
+  std::chrono::nanoseconds mean_delay{0};
+  std::chrono::nanoseconds max_delay{0};
+
+  size_t total_queued() const {
+    size_t total = 0;
+    for (size_t q : queued) {
+      total += q;
+    }
+    return total;
+  }
+};
+
+class ex_sampled {
+  struct alignas(64) shard {
+    // Signed, since an item may be counted as posted in one shard and as
+    // started in another.
+    std::array<std::atomic<int64_t>, MAX_PRIORITIES> queued{};
+    std::atomic<int64_t> active{0};
+    std::atomic<int64_t> delay_sum{0};
+    std::atomic<int64_t> delay_count{0};
+    std::atomic<int64_t> delay_max{0};
+  };
+
+  tmc::ex_cpu* ex;
+  size_t priority_count;
+  size_t sample_every = 64;
+  std::array<shard, SHARD_COUNT> shards;
+  tmc::ex_any type_erased_this;
+
+  static inline std::atomic<size_t> next_shard{0};
+  static inline thread_local size_t this_thread_shard = SHARD_COUNT;
+  static inline thread_local size_t this_thread_posts = 0;
+
+  static int64_t now_ns() {
+    return static_cast<int64_t>(
+      std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()
+      )
+        .count()
+    );
+  }
+
+  static shard& shard_of(ex_sampled* Ex) {
+    if (this_thread_shard == SHARD_COUNT) [[unlikely]] {
+      this_thread_shard =
+        next_shard.fetch_add(1, std::memory_order_relaxed) % SHARD_COUNT;
+    }
+    return Ex->shards[this_thread_shard];
+  }
+
+  // Runs Item as a task of this executor. Priority has been clamped by post().
+  // PostedAt is 0 if the item was not sampled. Item() returns when the item
+  // completes or suspends.
+  static tmc::task<void> run(
+    ex_sampled* Ex, tmc::work_item Item, size_t Priority, int64_t PostedAt
+  ) {
+    assert(Priority < Ex->priority_count);
+    auto& s = shard_of(Ex);
+    s.queued[Priority].fetch_sub(1, std::memory_order_relaxed);
+    s.active.fetch_add(1, std::memory_order_relaxed);
+    if (PostedAt != 0) {
+      int64_t delay = now_ns() - PostedAt;
+      s.delay_sum.fetch_add(delay, std::memory_order_relaxed);
+      s.delay_count.fetch_add(1, std::memory_order_relaxed);
+      int64_t max = s.delay_max.load(std::memory_order_relaxed);
+      while (delay > max && !s.delay_max.compare_exchange_weak(
+                              max, delay, std::memory_order_relaxed
+                            )) {
+      }
+    }
+    tmc::ex_any* prevEx = tmc::detail::this_thread::executor();
+    tmc::detail::this_thread::executor() = &Ex->type_erased_this;
+    Item();
+    tmc::detail::this_thread::executor() = prevEx;
+    s.active.fetch_sub(1, std::memory_order_relaxed);
+    co_return;
+  }
+
+public:
+  /// Ex must be initialized, and have at most MAX_PRIORITIES priorities.
+  explicit ex_sampled(tmc::ex_cpu& Ex)
+      : ex(&Ex), priority_count(Ex.priority_count()), type_erased_this(this) {
+    assert(priority_count <= MAX_PRIORITIES);
+  }
+
+  ex_sampled(const ex_sampled&) = delete;
+  ex_sampled& operator=(const ex_sampled&) = delete;
+
+  /// Builder func to set how often items are sampled for their delay. The
+  /// default is 1 in every 64 posts from each thread.
+  ex_sampled& set_sample_every(size_t N) {
+    sample_every = N == 0 ? 1 : N;
+    return *this;
+  }
+
+  tmc::ex_cpu& inner() { return *ex; }
+
+  /// Reads the counters, and resets the delay samples. May be called from any
+  /// thread.
+  load_sampling::snapshot load_snapshot() {
+    load_sampling::snapshot result;
+    result.queued.resize(priority_count);
+    result.thread_count = ex->thread_count();
+    int64_t active = 0;
+    int64_t delaySum = 0;
+    int64_t delayCount = 0;
+    int64_t delayMax = 0;
+    std::array<int64_t, MAX_PRIORITIES> queued{};
+    for (auto& s : shards) {
+      for (size_t p = 0; p < priority_count; ++p) {
+        queued[p] += s.queued[p].load(std::memory_order_relaxed);
+      }
+      active += s.active.load(std::memory_order_relaxed);
+      delaySum += s.delay_sum.exchange(0, std::memory_order_relaxed);
+      delayCount += s.delay_count.exchange(0, std::memory_order_relaxed);
+      int64_t m = s.delay_max.exchange(0, std::memory_order_relaxed);
+      if (m > delayMax) {
+        delayMax = m;
+      }
+    }
+    for (size_t p = 0; p < priority_count; ++p) {
+      result.queued[p] = queued[p] > 0 ? static_cast<size_t>(queued[p]) : 0;
+    }
+    result.active = active > 0 ? static_cast<size_t>(active) : 0;
+    result.delay_samples = static_cast<size_t>(delayCount);
+    if (delayCount != 0) {
+      result.mean_delay = std::chrono::nanoseconds(delaySum / delayCount);
+    }
+    result.max_delay = std::chrono::nanoseconds(delayMax);
+    return result;
+  }
+
+  bool is_current() const {
+    return tmc::detail::this_thread::executor() == &type_erased_this;
+  }
+
+  void post(tmc::work_item&& Item, size_t Priority = 0, size_t ThreadHint = NO_HINT) {
+    // Out of range priorities are clamped, so that they index the counters.
+    Priority = std::min(Priority, priority_count - 1);
+    shard_of(this).queued[Priority].fetch_add(1, std::memory_order_relaxed);
+    int64_t postedAt = 0;
+    if (++this_thread_posts % sample_every == 0) {
+      postedAt = now_ns();
+    }
+    ex->post(run(this, std::move(Item), Priority, postedAt), Priority, ThreadHint);
+  }
+
+  template <typename Iter>
+  void
+  post_bulk(Iter It, size_t Count, size_t Priority = 0, size_t ThreadHint = NO_HINT) {
+    for (size_t i = 0; i < Count; ++i) {
+      post(tmc::work_item{std::move(*It)}, Priority, ThreadHint);
+      ++It;
+    }
+  }
+
+  /// Returns a pointer to the type erased `ex_any` version of this executor.
+  tmc::ex_any* type_erased() TMC_LIFETIMEBOUND { return &type_erased_this; }
+};
+} // namespace load_sampling
+
+namespace tmc::detail {
+template <> struct executor_traits<load_sampling::ex_sampled> {
+  static inline void post(
+    load_sampling::ex_sampled& Ex, tmc::work_item&& Item, size_t Priority,
+    size_t ThreadHint
+  ) {
+    Ex.post(std::move(Item), Priority, ThreadHint);
+  }
+
+  template <typename It>
+  static inline void post_bulk(
+    load_sampling::ex_sampled& Ex, It&& Items, size_t Count, size_t Priority,
+    size_t ThreadHint
+  ) {
+    Ex.post_bulk(std::forward<It>(Items), Count, Priority, ThreadHint);
+  }
+
+  static inline tmc::ex_any*
+  type_erased(load_sampling::ex_sampled& Ex TMC_LIFETIMEBOUND) {
+    return Ex.type_erased();
+  }
+
+  static inline std::coroutine_handle<> dispatch(
+    load_sampling::ex_sampled& Ex, std::coroutine_handle<> Outer, size_t Priority
+  ) {
+    // Always post, so that the continuation is counted.
+    Ex.post(std::move(Outer), Priority);
+    return std::noop_coroutine();
+  }
+};
+} // namespace tmc::detail
@@ -0,0 +1,131 @@
+#pragma once
+/// Allocation of per-thread data on the NUMA node of the thread that uses it.
+///
+/// Pinning a thread with tmc::topology::pin_thread() (or an executor's
+/// add_partition()) controls where it runs, but not where its memory lives.
+/// By default, a page is placed on the node of the thread that first touches
+/// it. When init() allocates every worker's hot structures on the calling
+/// thread, all of them end up on that thread's node. On a multi-socket
+/// machine, the workers on the other sockets then pay remote access latency
+/// on every operation.
+///
+/// alloc_local() should be called from the thread that will own the memory,
+/// after it has been pinned. With TMC_USE_HWLOC, the memory is bound with
+/// hwloc_alloc_membind() to the NUMA node of the thread's CPU binding.
+/// Without hwloc, or if the thread is not bound to a single node, the pages
+/// are touched by the calling thread so the OS's first-touch policy places
+/// them on its current node. Either way, the pages are faulted in before
+/// alloc_local() returns, so that page faults don't land on the hot path.
+
+#include <cstddef>
+#include <cstring>
+#include <new>
+#include <utility>
+
+#ifdef TMC_USE_HWLOC
+#include <hwloc.h>
+#endif
+
+namespace numa {
+inline constexpr size_t PAGE_SIZE = 4096;
+
+inline size_t round_to_pages(size_t Size) {
+  return (Size + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+}
+
+#ifdef TMC_USE_HWLOC
+namespace detail {
+// TMC does not expose its hwloc topology, so load a separate one.
+inline hwloc_topology_t topology() {
+  static hwloc_topology_t topo = []() {
+    hwloc_topology_t t;
+    hwloc_topology_init(&t);
+    hwloc_topology_load(t);
+    return t;
+  }();
+  return topo;
+}
+
+// Returns the nodeset of the calling thread's CPU binding, or null if the
+// thread may run on more than 1 NUMA node.
+inline hwloc_bitmap_t single_node_of_this_thread() {
+  hwloc_topology_t topo = topology();
+  hwloc_bitmap_t cpuset = hwloc_bitmap_alloc();
+  hwloc_bitmap_t nodeset = hwloc_bitmap_alloc();
+  if (hwloc_get_cpubind(topo, cpuset, HWLOC_CPUBIND_THREAD) == 0) {
+    hwloc_cpuset_to_nodeset(topo, cpuset, nodeset);
+  }
+  hwloc_bitmap_free(cpuset);
+  if (hwloc_bitmap_weight(nodeset) != 1) {
+    hwloc_bitmap_free(nodeset);
+    return nullptr;
+  }
+  return nodeset;
+}
+} // namespace detail
+#endif
+
+/// Allocates Size bytes, rounded up to a whole number of pages, on the NUMA
+/// node of the calling thread. The memory is zeroed. Returns null on failure.
+/// Free with free_local(), passing the same Size.
+inline void* alloc_local(size_t Size) {
+  size_t bytes = round_to_pages(Size);
+  void* ptr = nullptr;
+#ifdef TMC_USE_HWLOC
+  if (hwloc_bitmap_t nodeset = detail::single_node_of_this_thread()) {
+    ptr = hwloc_alloc_membind(
+      detail::topology(), bytes, nodeset, HWLOC_MEMBIND_BIND,
+      HWLOC_MEMBIND_BYNODESET
+    );
+    hwloc_bitmap_free(nodeset);
+  }
+  if (ptr == nullptr) {
+    ptr = hwloc_alloc(detail::topology(), bytes);
+  }
+#else
+  ptr = ::operator new(bytes, std::align_val_t{PAGE_SIZE}, std::nothrow);
+#endif
+  if (ptr != nullptr) {
+    // First touch
+    std::memset(ptr, 0, bytes);
+  }
+  return ptr;
+}
+
+inline void free_local(void* Ptr, size_t Size) {
+  if (Ptr == nullptr) {
+    return;
+  }
+#ifdef TMC_USE_HWLOC
+  hwloc_free(detail::topology(), Ptr, round_to_pages(Size));
+#else
+  (void)Size;
+  ::operator delete(Ptr, std::align_val_t{PAGE_SIZE});
+#endif
+}
+
+/// Constructs a T in memory allocated by alloc_local(). T's own allocations
+/// (e.g. a std::vector's buffer) are not affected, but they are also made by
+/// the calling thread, so they follow the first-touch policy.
+template <typename T, typename... Args> T* new_local(Args&&... Arguments) {
+  static_assert(alignof(T) <= PAGE_SIZE);
+  void* ptr = alloc_local(sizeof(T));
+  if (ptr == nullptr) {
+    throw std::bad_alloc();
+  }
+  try {
+    return ::new (ptr) T(std::forward<Args>(Arguments)...);
+  } catch (...) {
+    free_local(ptr, sizeof(T));
+    throw;
+  }
+}
+
+template <typename T> void delete_local(T* Ptr) {
+  if (Ptr == nullptr) {
+    return;
+  }
+  Ptr->~T();
+  free_local(Ptr, sizeof(T));
+}
+} // namespace numa
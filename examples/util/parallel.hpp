@@ -0,0 +1,313 @@
+// Parallel algorithms built from TMC tasks: for_each, transform,
+// transform_reduce, inclusive_scan, and sort.
+//
+// Each algorithm is a coroutine that runs on the current executor, and
+// completes when all of its work is done:
+//
+//   co_await parallel::for_each(v.begin(), v.end(), [](double& x) { x *= 2; });
+//   double sum = co_await parallel::transform_reduce(
+//     v.begin(), v.end(), 0.0, std::plus<>{}, [](double x) { return x * x; }
+//   );
+//
+// The range is split in half recursively. At each level, the upper half is
+// forked and the lower half runs inline, so the work that is waiting to be
+// stolen is always the largest remaining piece, and an idle thread that steals
+// it splits it further on its own. Splitting stops at the grain size. By
+// default, the grain is chosen so that each thread has about
+// CHUNKS_PER_THREAD chunks; pass a policy with a nonzero grain to override it.
+// Choose a larger grain if each element is very cheap to process, or a
+// smaller one if the cost of the elements is very uneven.
+//
+// A policy may also hold a std::stop_token. Once a stop is requested, chunks
+// that have not started yet are skipped. The output of a cancelled algorithm
+// is unspecified, and the result of a cancelled transform_reduce only
+// includes the chunks that ran.
+//
+// Iterators must be random access. The functions passed to these algorithms
+// are called concurrently from multiple threads. The elements of the range
+// are not copied, and must outlive the awaited algorithm.
+
+#pragma once
+
+#include "tmc/spawn.hpp"
+#include "tmc/task.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <optional>
+#include <stop_token>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace parallel {
+/// The default grain aims for this many chunks per thread, which leaves
+/// enough pieces to steal to balance an uneven workload.
+static inline constexpr size_t CHUNKS_PER_THREAD = 8;
+
+/// sort() never splits below this many elements. Partitioning a range costs
+/// about as much as sorting a range of this size.
+static inline constexpr size_t SORT_MIN_GRAIN = 2048;
+
+struct policy {
+  /// The maximum number of elements processed by one task. 0 chooses it
+  /// automatically.
+  size_t grain = 0;
+  /// If a stop is requested, chunks that have not started yet are skipped.
+  std::stop_token stop{};
+};
+
+namespace detail {
+inline size_t grain_for(size_t Count, const policy& Policy, size_t MinGrain = 1) {
+  if (Policy.grain != 0) {
+    return Policy.grain;
+  }
+  size_t threads = std::thread::hardware_concurrency();
+  if (threads == 0) {
+    threads = 1;
+  }
+  return std::max(MinGrain, Count / (CHUNKS_PER_THREAD * threads));
+}
+
+template <typename It> It offset(It Iter, size_t N) {
+  return Iter + static_cast<std::iter_difference_t<It>>(N);
+}
+
+template <typename It> size_t length(It First, It Last) {
+  return static_cast<size_t>(Last - First);
+}
+
+// Calls Leaf(Begin, End) on chunks of [Begin, End) of at most Grain indexes.
+template <typename Leaf>
+tmc::task<void> split(
+  size_t Begin, size_t End, size_t Grain, Leaf& L, const std::stop_token& Stop
+) {
+  if (Stop.stop_requested()) {
+    co_return;
+  }
+  if (End - Begin <= Grain) {
+    L(Begin, End);
+    co_return;
+  }
+  size_t mid = Begin + (End - Begin) / 2;
+  auto upper = tmc::spawn(split(mid, End, Grain, L, Stop)).fork();
+  co_await split(Begin, mid, Grain, L, Stop);
+  co_await std::move(upper);
+}
+
+// Returns the reduction of Leaf(Begin, End) over chunks of [Begin, End), or
+// nullopt if every chunk was skipped. [Begin, End) must not be empty.
+template <typename T, typename Leaf, typename Reduce>
+tmc::task<std::optional<T>> reduce_split(
+  size_t Begin, size_t End, size_t Grain, Leaf& L, Reduce& R,
+  const std::stop_token& Stop
+) {
+  if (Stop.stop_requested()) {
+    co_return std::nullopt;
+  }
+  if (End - Begin <= Grain) {
+    co_return L(Begin, End);
+  }
+  size_t mid = Begin + (End - Begin) / 2;
+  auto upper = tmc::spawn(reduce_split<T>(mid, End, Grain, L, R, Stop)).fork();
+  std::optional<T> lower = co_await reduce_split<T>(Begin, mid, Grain, L, R, Stop);
+  std::optional<T> higher = co_await std::move(upper);
+  if (!lower.has_value()) {
+    co_return higher;
+  }
+  if (!higher.has_value()) {
+    co_return lower;
+  }
+  co_return R(std::move(*lower), std::move(*higher));
+}
+
+template <typename It, typename Comp>
+const std::iter_value_t<It>& median_of_3(It A, It B, It C, Comp& Cmp) {
+  if (Cmp(*A, *B)) {
+    if (Cmp(*B, *C)) {
+      return *B;
+    }
+    return Cmp(*A, *C) ? *C : *A;
+  }
+  if (Cmp(*A, *C)) {
+    return *A;
+  }
+  return Cmp(*B, *C) ? *C : *B;
+}
+
+// Quicksort with a 3-way partition. The partition of each range is serial,
+// and the two sides are sorted in parallel. Once DepthLimit is exhausted (a
+// run of bad pivots) or the range is at most Grain elements, it is finished
+// with std::sort.
+template <typename It, typename Comp>
+tmc::task<void> sort_split(
+  It First, It Last, size_t Grain, Comp& Cmp, size_t DepthLimit,
+  const std::stop_token& Stop
+) {
+  if (Stop.stop_requested()) {
+    co_return;
+  }
+  size_t count = length(First, Last);
+  if (count <= Grain || DepthLimit == 0) {
+    std::sort(First, Last, Cmp);
+    co_return;
+  }
+  std::iter_value_t<It> pivot =
+    median_of_3(First, offset(First, count / 2), Last - 1, Cmp);
+  It lessEnd = std::partition(First, Last, [&](const auto& V) {
+    return Cmp(V, pivot);
+  });
+  It greaterBegin = std::partition(lessEnd, Last, [&](const auto& V) {
+    return !Cmp(pivot, V);
+  });
+  auto upper =
+    tmc::spawn(sort_split(greaterBegin, Last, Grain, Cmp, DepthLimit - 1, Stop))
+      .fork();
+  co_await sort_split(First, lessEnd, Grain, Cmp, DepthLimit - 1, Stop);
+  co_await std::move(upper);
+}
+} // namespace detail
+
+/// Calls F on each element of [First, Last).
+template <std::random_access_iterator It, typename Func>
+tmc::task<void> for_each(It First, It Last, Func F, policy Policy = {}) {
+  auto leaf = [&](size_t Begin, size_t End) {
+    for (It it = detail::offset(First, Begin), end = detail::offset(First, End);
+         it != end; ++it) {
+      F(*it);
+    }
+  };
+  size_t count = detail::length(First, Last);
+  co_await detail::split(
+    0, count, detail::grain_for(count, Policy), leaf, Policy.stop
+  );
+}
+
+/// Writes F(x) for each element x of [First, Last) to the range beginning
+/// at Out. Returns the end of the output range.
+template <
+  std::random_access_iterator It, std::random_access_iterator OutIt,
+  typename Func>
+tmc::task<OutIt> transform(It First, It Last, OutIt Out, Func F, policy Policy = {}) {
+  auto leaf = [&](size_t Begin, size_t End) {
+    OutIt out = detail::offset(Out, Begin);
+    for (It it = detail::offset(First, Begin), end = detail::offset(First, End);
+         it != end; ++it, ++out) {
+      *out = F(*it);
+    }
+  };
+  size_t count = detail::length(First, Last);
+  co_await detail::split(
+    0, count, detail::grain_for(count, Policy), leaf, Policy.stop
+  );
+  co_return detail::offset(Out, count);
+}
+
+/// Returns Init combined with Tf(x) for each element x of
+/// [First, Last), using R. R must be associative and commutative; the order
+/// in which the elements are combined is unspecified.
+template <
+  std::random_access_iterator It, typename T, typename Reduce, typename Transform>
+tmc::task<T> transform_reduce(
+  It First, It Last, T Init, Reduce R, Transform Tf, policy Policy = {}
+) {
+  size_t count = detail::length(First, Last);
+  if (count == 0) {
+    co_return Init;
+  }
+  auto leaf = [&](size_t Begin, size_t End) -> T {
+    It it = detail::offset(First, Begin);
+    It end = detail::offset(First, End);
+    T acc = Tf(*it);
+    for (++it; it != end; ++it) {
+      acc = R(std::move(acc), Tf(*it));
+    }
+    return acc;
+  };
+  std::optional<T> result = co_await detail::reduce_split<T>(
+    0, count, detail::grain_for(count, Policy), leaf, R, Policy.stop
+  );
+  if (!result.has_value()) {
+    co_return Init;
+  }
+  co_return R(std::move(Init), std::move(*result));
+}
+
+/// Writes the inclusive prefix sums of [First, Last), combined with O, to the
+/// range beginning at Out. O must be associative. Out may be equal to First.
+/// Returns the end of the output range.
+///
+/// The range is divided into blocks of the grain size. Each block is scanned
+/// in parallel, then the running total of the preceding blocks is computed
+/// serially, and then added to each block in parallel. This reads and writes
+/// the output twice.
+template <
+  std::random_access_iterator It, std::random_access_iterator OutIt,
+  typename Op = std::plus<>>
+tmc::task<OutIt>
+inclusive_scan(It First, It Last, OutIt Out, Op O = {}, policy Policy = {}) {
+  using value_type = std::iter_value_t<It>;
+  size_t count = detail::length(First, Last);
+  if (count == 0) {
+    co_return Out;
+  }
+  size_t grain = detail::grain_for(count, Policy);
+  size_t blocks = (count + grain - 1) / grain;
+
+  auto scanBlocks = [&](size_t Begin, size_t End) {
+    for (size_t b = Begin; b < End; ++b) {
+      It it = detail::offset(First, b * grain);
+      It end = detail::offset(First, std::min(count, (b + 1) * grain));
+      OutIt out = detail::offset(Out, b * grain);
+      value_type acc = *it;
+      *out = acc;
+      for (++it, ++out; it != end; ++it, ++out) {
+        acc = O(std::move(acc), *it);
+        *out = acc;
+      }
+    }
+  };
+  co_await detail::split(0, blocks, 1, scanBlocks, Policy.stop);
+  if (Policy.stop.stop_requested() || blocks == 1) {
+    co_return detail::offset(Out, count);
+  }
+
+  // carry[b - 1] is the total of all blocks before block b.
+  std::vector<value_type> carry;
+  carry.reserve(blocks - 1);
+  carry.push_back(*detail::offset(Out, grain - 1));
+  for (size_t b = 1; b < blocks - 1; ++b) {
+    carry.push_back(O(carry.back(), *detail::offset(Out, (b + 1) * grain - 1)));
+  }
+
+  auto addCarry = [&](size_t Begin, size_t End) {
+    for (size_t b = Begin; b < End; ++b) {
+      OutIt out = detail::offset(Out, b * grain);
+      OutIt end = detail::offset(Out, std::min(count, (b + 1) * grain));
+      for (; out != end; ++out) {
+        *out = O(carry[b - 1], std::move(*out));
+      }
+    }
+  };
+  co_await detail::split(1, blocks, 1, addCarry, Policy.stop);
+  co_return detail::offset(Out, count);
+}
+
+/// Sorts [First, Last) using Cmp. The sort is not stable. The element type must
+/// be copy constructible, as each pivot is copied.
+template <std::random_access_iterator It, typename Comp = std::less<>>
+tmc::task<void> sort(It First, It Last, Comp Cmp = {}, policy Policy = {}) {
+  size_t count = detail::length(First, Last);
+  // Like introsort, stop splitting after 2 * log2(count) levels.
+  size_t depthLimit = 0;
+  for (size_t n = count; n > 1; n >>= 1) {
+    depthLimit += 2;
+  }
+  co_await detail::sort_split(
+    First, Last, detail::grain_for(count, Policy, SORT_MIN_GRAIN), Cmp, depthLimit,
+    Policy.stop
+  );
+}
+} // namespace parallel
@@ -0,0 +1,236 @@
+// Time-sliced cooperative preemption for long-running tasks.
+//
+// tmc::yield_requested() becomes true when higher priority work is waiting
+// for the thread that is running the current task, but the task only yields
+// if it checks. Checking on every iteration of a hot loop with
+// tmc::yield_if_requested() yields as soon as anything is posted, so a
+// low-priority task can be interrupted before it does any useful work.
+// tmc::check_yield_counter<N>() polls every N iterations instead, and N has
+// to be tuned to the cost of an iteration.
+//
+// preempt::watchdog runs a thread that advances a coarse clock several times
+// per time slice. A task takes a slice_check from it, and awaits the check
+// in its loop:
+//
+//   preempt::watchdog wd(std::chrono::microseconds(500));
+//   ...
+//   auto check = wd.check();
+//   for (auto& item : items) {
+//     process(item);
+//     co_await check;
+//   }
+//
+// The watchdog keeps a slot for each thread that awaits one of its checks.
+// The slot holds the tick at which the current check started running on that
+// thread, and a yield flag. On each tick, the watchdog thread sets the flag of
+// every slot whose run has lasted a full slice. Awaiting the check reads the
+// flag of the current thread's slot with one relaxed load, so it can be done
+// on every iteration. Once the flag is set, each await also checks
+// tmc::yield_requested(), and yields if higher priority work is waiting.
+// So a low-priority task always gets at least one slice to run. High
+// priority work waits at most about one slice, plus one iteration, for a
+// thread that is running a task with a check.
+//
+// The run starts again when the check is created, reset, or yields, and when
+// it is awaited on a thread whose slot was last used by another check (the
+// task moved to another thread, or other tasks with checks ran on this one
+// while it was suspended). A task that suspends for another reason and
+// resumes on the same thread before any other check runs there keeps its
+// run start; call reset() after such an await to start a new slice.
+//
+// One watchdog may be shared by all of the tasks of an executor, or by many
+// executors. Each task should use a single check.
+
+#pragma once
+
+#include "tmc/aw_yield.hpp"
+#include "tmc/current.hpp"
+#include "tmc/detail/concepts_awaitable.hpp"
+#include "tmc/ex_any.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace preempt {
+/// The number of times the watchdog's clock advances per slice. A task
+/// becomes eligible to yield between (TICKS_PER_SLICE - 1) / TICKS_PER_SLICE
+/// and 1 slice after its check was reset.
+static inline constexpr uint64_t TICKS_PER_SLICE = 4;
+
+class slice_check;
+
+namespace detail {
+// The run of the check that was last awaited on a thread.
+struct alignas(64) worker_slot {
+  std::thread::id thread;
+  // The id of the check that owns the run, or 0. Only accessed by the slot's
+  // thread.
+  uint64_t owner = 0;
+  // The tick at which the run started, shifted left by 1. The low bit is the
+  // yield flag, which is set by the watchdog thread.
+  std::atomic<uint64_t> state{0};
+};
+} // namespace detail
+
+class watchdog {
+  std::atomic<uint64_t> clock{0};
+  std::atomic<bool> stop{false};
+  std::chrono::nanoseconds tick;
+  // Identifies this watchdog in the thread-local slot cache, since another
+  // watchdog may be created at the same address.
+  uint64_t id;
+  mutable std::mutex slots_lock;
+  mutable std::vector<std::unique_ptr<detail::worker_slot>> slots;
+  std::thread thread;
+
+  static inline std::atomic<uint64_t> next_id{1};
+  static inline thread_local uint64_t this_thread_watchdog = 0;
+  static inline thread_local detail::worker_slot* this_thread_slot = nullptr;
+
+  void set_flags(uint64_t Now) {
+    std::lock_guard<std::mutex> lg{slots_lock};
+    for (auto& slot : slots) {
+      uint64_t state = slot->state.load(std::memory_order_relaxed);
+      if ((state & 1) == 0 && Now - (state >> 1) >= TICKS_PER_SLICE) {
+        // Fails if the run was restarted in the meantime.
+        slot->state.compare_exchange_strong(
+          state, state | 1, std::memory_order_relaxed
+        );
+      }
+    }
+  }
+
+  detail::worker_slot& register_thread() const {
+    std::lock_guard<std::mutex> lg{slots_lock};
+    auto tid = std::this_thread::get_id();
+    for (auto& slot : slots) {
+      if (slot->thread == tid) {
+        return *slot;
+      }
+    }
+    slots.push_back(std::make_unique<detail::worker_slot>());
+    slots.back()->thread = tid;
+    return *slots.back();
+  }
+
+public:
+  /// Starts the watchdog thread.
+  explicit watchdog(std::chrono::nanoseconds Slice)
+      : tick(Slice / TICKS_PER_SLICE),
+        id(next_id.fetch_add(1, std::memory_order_relaxed)), thread([this]() {
+          auto next = std::chrono::steady_clock::now();
+          while (!stop.load(std::memory_order_relaxed)) {
+            next += tick;
+            std::this_thread::sleep_until(next);
+            set_flags(clock.fetch_add(1, std::memory_order_relaxed) + 1);
+          }
+        }) {}
+
+  watchdog(const watchdog&) = delete;
+  watchdog& operator=(const watchdog&) = delete;
+
+  /// Stops the watchdog thread. Checks that refer to this must not be awaited
+  /// afterward.
+  ~watchdog() {
+    stop.store(true, std::memory_order_relaxed);
+    thread.join();
+  }
+
+  /// The coarse clock, in ticks. Advances TICKS_PER_SLICE times per slice.
+  uint64_t now() const { return clock.load(std::memory_order_relaxed); }
+
+  std::chrono::nanoseconds slice() const { return tick * TICKS_PER_SLICE; }
+
+  /// The calling thread's slot.
+  detail::worker_slot& slot() const {
+    if (this_thread_watchdog != id) [[unlikely]] {
+      this_thread_slot = &register_thread();
+      this_thread_watchdog = id;
+    }
+    return *this_thread_slot;
+  }
+
+  /// Returns a check that starts its first slice now, on the calling thread.
+  [[nodiscard]] slice_check check() const;
+};
+
+/// An awaitable that yields if the current task has used up its slice and
+/// higher priority work is waiting. It may be awaited any number of times.
+class [[nodiscard]] slice_check {
+  const watchdog* wd;
+  // Identifies this check in a slot. Not its address, since a check may be
+  // copied when it is returned.
+  uint64_t id;
+
+  static inline std::atomic<uint64_t> next_id{1};
+
+  // Makes this the owner of the current thread's slot, and starts a new run.
+  void claim(detail::worker_slot& Slot) {
+    Slot.owner = id;
+    Slot.state.store(wd->now() << 1, std::memory_order_relaxed);
+  }
+
+public:
+  explicit slice_check(const watchdog& Watchdog)
+      : wd(&Watchdog), id(next_id.fetch_add(1, std::memory_order_relaxed)) {
+    claim(wd->slot());
+  }
+
+  /// Starts a new slice.
+  void reset() { claim(wd->slot()); }
+
+  /// True if this check's run on the current thread has lasted a full slice.
+  bool expired() const {
+    auto& slot = wd->slot();
+    return slot.owner == id &&
+           (slot.state.load(std::memory_order_relaxed) & 1) != 0;
+  }
+
+  bool await_ready() {
+    auto& slot = wd->slot();
+    if (slot.owner != id) [[unlikely]] {
+      claim(slot);
+      return true;
+    }
+    return (slot.state.load(std::memory_order_relaxed) & 1) == 0 ||
+           !tmc::yield_requested();
+  }
+
+  void await_suspend(std::coroutine_handle<> Outer) {
+    // The next await claims a slot wherever this resumes.
+    wd->slot().owner = 0;
+    tmc::current_executor()->post(std::move(Outer), tmc::current_priority());
+  }
+
+  void await_resume() {}
+};
+
+inline slice_check watchdog::check() const { return slice_check(*this); }
+} // namespace preempt
+
+// Implementation of tmc::detail::awaitable_traits, so that a check can be
+// awaited by a tmc::task when TMC_NO_UNKNOWN_AWAITABLES is defined, without an
+// extra wrapper task on every iteration. A check that yields posts the task
+// back to its own executor and priority, so it is awaited as-is.
+namespace tmc::detail {
+template <> struct awaitable_traits<preempt::slice_check> {
+  using result_type = void;
+  using self_type = preempt::slice_check;
+
+  static decltype(auto) get_awaiter(self_type& awaitable) noexcept {
+    return awaitable;
+  }
+  static decltype(auto) get_awaiter(self_type&& awaitable) noexcept {
+    return static_cast<self_type&&>(awaitable);
+  }
+
+  static constexpr configure_mode mode = WRAPPER;
+};
+} // namespace tmc::detail
@@ -0,0 +1,650 @@
+// A mutex and a braid whose waiters are ordered by priority, and whose holder
+// inherits the priority of the highest waiter.
+//
+// With tmc::mutex, if a priority 1 task holds the lock and suspends (to do
+// I/O, or to yield), its continuation is queued at priority 1. A priority 0
+// task that is waiting for the lock is stuck until every priority 1 task that
+// is ahead of the holder has run. Likewise, tmc::ex_braid runs its queue from
+// a single runner task; while that runner is queued at priority 1, priority 0
+// work that enters the braid must wait behind it.
+//
+// prio_inherit::mutex
+// - Waiters are kept in a list per priority, and unlock() wakes the highest
+//   priority waiter first (FIFO within a priority).
+// - The lock is not handed off. A woken waiter is posted at its own priority
+//   and tries to take the lock again when it runs, so a lock is never owned by
+//   a task that is sitting in an executor's queue. A task that finds the lock
+//   free may take it ahead of the woken waiter; the waiter then waits again.
+// - While holding the lock, wrap each awaitable that may suspend with held():
+//
+//     co_await mut;
+//     co_await mut.held(tmc::yield());
+//     mut.unlock();
+//
+//   If a waiter has a higher priority than the holder when held() suspends,
+//   the holder's priority is raised to it, so its continuation is queued at
+//   the waiter's priority. unlock() restores the priority that the holder
+//   acquired the lock with.
+// - While the holder is suspended in held(), its current executor is a relay
+//   that forwards to the real one. An awaiter that queues the continuation on
+//   the current executor (tmc::yield(), tmc::mutex, ...) queues it through
+//   the relay. A waiter that arrives while the continuation is queued posts
+//   it again, at the waiter's priority; whichever of the two runs first
+//   resumes the holder, and the other does nothing. Awaiters that captured
+//   their executor before held() suspended bypass the relay, and the holder
+//   is boosted at its next held() suspension instead. Each held() suspension
+//   allocates the relay.
+// - Like std::mutex, it must not be destroyed while a call to unlock() may
+//   still be running.
+//
+// prio_inherit::ex_braid
+// - A serializing executor built on prio_inherit::mutex instead of a single
+//   runner task. Each posted item is posted to the parent executor at its own
+//   priority, and takes the braid's lock before it runs. Priority 0 work is
+//   never queued behind a priority 1 runner, and when the braid is released,
+//   the highest priority item that is waiting runs next.
+// - Items of the same priority may run out of order.
+//
+// Priorities must be less than PRIORITY_LIMIT.
+
+#pragma once
+
+#include "get_awaiter.hpp"
+
+#include "tmc/current.hpp"
+#include "tmc/detail/compat.hpp"
+#include "tmc/detail/concepts_awaitable.hpp"
+#include "tmc/detail/thread_locals.hpp"
+#include "tmc/ex_any.hpp"
+#include "tmc/ex_cpu.hpp"
+#include "tmc/task.hpp"
+#include "tmc/work_item.hpp"
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <coroutine>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+namespace prio_inherit {
+/// The maximum number of priority levels of a TMC executor.
+static inline constexpr size_t PRIORITY_LIMIT = 16;
+
+class mutex;
+
+namespace detail {
+// Identifies aw_lock and aw_lock_scope to tmc::detail::awaitable_traits.
+struct awaitable_tag {};
+
+// A suspended lock().
+struct waiter {
+  waiter* next = nullptr;
+  std::coroutine_handle<> continuation;
+  tmc::ex_any* executor = nullptr;
+  size_t prio = 0;
+};
+
+// An intrusive FIFO list of waiters.
+struct waiter_list {
+  waiter* head = nullptr;
+  waiter* tail = nullptr;
+
+  bool empty() const { return head == nullptr; }
+
+  void push_back(waiter* W) {
+    W->next = nullptr;
+    if (tail == nullptr) {
+      head = W;
+    } else {
+      tail->next = W;
+    }
+    tail = W;
+  }
+
+  waiter* pop_front() {
+    waiter* w = head;
+    head = w->next;
+    if (head == nullptr) {
+      tail = nullptr;
+    }
+    return w;
+  }
+};
+
+inline size_t& this_task_prio() {
+  return tmc::detail::this_thread::this_task().prio;
+}
+
+// The current executor of a holder that is suspended in held(). It holds the
+// holder's continuation while it is queued on the real executor, so that a
+// waiter can post it again at a higher priority.
+class relay : public std::enable_shared_from_this<relay> {
+  tmc::ex_any* target;
+  tmc::ex_any type_erased_this;
+  std::mutex lock;
+  tmc::work_item item;
+  // The item is set, and has not been taken by run().
+  bool queued = false;
+  // The highest priority that the item has been posted at, or was requested
+  // by boost() before the item arrived.
+  size_t prio = PRIORITY_LIMIT;
+
+  static tmc::task<void> run(std::shared_ptr<relay> R) {
+    tmc::work_item taken;
+    {
+      std::lock_guard<std::mutex> lg{R->lock};
+      if (!R->queued) {
+        co_return;
+      }
+      R->queued = false;
+      taken = std::move(R->item);
+    }
+    taken();
+  }
+
+public:
+  explicit relay(tmc::ex_any* Target) : target(Target), type_erased_this(this) {}
+
+  relay(const relay&) = delete;
+  relay& operator=(const relay&) = delete;
+
+  void post(tmc::work_item&& Item, size_t Priority, size_t ThreadHint = NO_HINT) {
+    bool relayed = false;
+    {
+      std::lock_guard<std::mutex> lg{lock};
+      if (!queued) {
+        queued = true;
+        item = std::move(Item);
+        prio = std::min(prio, Priority);
+        Priority = prio;
+        relayed = true;
+      }
+    }
+    if (relayed) {
+      target->post(run(shared_from_this()), Priority, ThreadHint);
+    } else {
+      // Only one item is held at a time; anything else is passed through.
+      target->post(std::move(Item), Priority, ThreadHint);
+    }
+  }
+
+  template <typename Iter>
+  void post_bulk(Iter It, size_t Count, size_t Priority, size_t ThreadHint) {
+    for (size_t i = 0; i < Count; ++i) {
+      post(tmc::work_item{std::move(*It)}, Priority, ThreadHint);
+      ++It;
+    }
+  }
+
+  /// Raises the priority of the item to Priority. If it is queued, it is
+  /// posted again. Returns true if the priority was raised.
+  bool boost(size_t Priority) {
+    bool repost;
+    {
+      std::lock_guard<std::mutex> lg{lock};
+      if (Priority >= prio) {
+        return false;
+      }
+      prio = Priority;
+      repost = queued;
+    }
+    if (repost) {
+      target->post(run(shared_from_this()), Priority);
+    }
+    return true;
+  }
+
+  tmc::ex_any* type_erased() TMC_LIFETIMEBOUND { return &type_erased_this; }
+};
+} // namespace detail
+
+template <typename Awaitable> class aw_held;
+class aw_lock;
+class aw_lock_scope;
+
+class mutex {
+  friend class aw_lock;
+  template <typename Awaitable> friend class aw_held;
+
+  static inline constexpr size_t NO_WAITER = PRIORITY_LIMIT;
+
+  std::atomic<size_t> state{0};
+  // The number of waiters in the lists.
+  std::atomic<size_t> waiting{0};
+  // The highest priority (lowest value) of any waiter, or NO_WAITER.
+  std::atomic<size_t> ceiling{NO_WAITER};
+  std::atomic<size_t> boost_count{0};
+  // The priority that the current holder acquired the lock with.
+  size_t holder_prio = 0;
+  std::mutex waiter_lock;
+  // Set while the holder is suspended in held(). Protected by waiter_lock.
+  std::shared_ptr<detail::relay> holder_relay;
+  std::array<detail::waiter_list, PRIORITY_LIMIT> waiters;
+
+  bool try_lock_raw() {
+    size_t expected = 0;
+    return state.compare_exchange_strong(
+      expected, 1, std::memory_order_acquire, std::memory_order_relaxed
+    );
+  }
+
+  // Takes the lock for W, or adds W to the waiters. Returns true if W owns
+  // the lock. The fence pairs with the one in unlock(): either this sees the
+  // lock released, or unlock() sees this waiter. If the holder is suspended
+  // in held(), it is boosted to W's priority.
+  bool lock_or_wait(detail::waiter* W) {
+    // W may be woken and destroyed as soon as waiter_lock is released.
+    size_t prio = W->prio;
+    std::shared_ptr<detail::relay> holder;
+    {
+      std::lock_guard<std::mutex> lg{waiter_lock};
+      waiting.fetch_add(1, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_seq_cst);
+      if (try_lock_raw()) {
+        waiting.fetch_sub(1, std::memory_order_relaxed);
+        return true;
+      }
+      waiters[prio].push_back(W);
+      if (prio < ceiling.load(std::memory_order_relaxed)) {
+        ceiling.store(prio, std::memory_order_relaxed);
+      }
+      holder = holder_relay;
+    }
+    if (holder != nullptr && holder->boost(prio)) {
+      boost_count.fetch_add(1, std::memory_order_relaxed);
+    }
+    return false;
+  }
+
+  detail::waiter* pop_highest_locked() {
+    for (size_t p = 0; p < PRIORITY_LIMIT; ++p) {
+      if (!waiters[p].empty()) {
+        detail::waiter* w = waiters[p].pop_front();
+        waiting.fetch_sub(1, std::memory_order_relaxed);
+        size_t next = p;
+        while (next < PRIORITY_LIMIT && waiters[next].empty()) {
+          ++next;
+        }
+        ceiling.store(next, std::memory_order_relaxed);
+        return w;
+      }
+    }
+    return nullptr;
+  }
+
+  // Runs at the woken waiter's priority, on its executor.
+  static tmc::task<void> retry(mutex* Mut, detail::waiter* W) {
+    if (Mut->try_lock_raw() || Mut->lock_or_wait(W)) {
+      Mut->holder_prio = W->prio;
+      W->continuation.resume();
+    }
+    co_return;
+  }
+
+  void wake(detail::waiter* W) {
+    if (W->executor == nullptr) {
+      if (try_lock_raw() || lock_or_wait(W)) {
+        holder_prio = W->prio;
+        W->continuation.resume();
+      }
+    } else {
+      W->executor->post(retry(this, W), W->prio);
+    }
+  }
+
+public:
+  mutex() = default;
+  mutex(const mutex&) = delete;
+  mutex& operator=(const mutex&) = delete;
+
+  /// Returns true if the lock was taken.
+  bool try_lock() {
+    if (try_lock_raw()) {
+      holder_prio = tmc::current_priority();
+      return true;
+    }
+    return false;
+  }
+
+  /// Restores the priority that the calling task acquired the lock with, and
+  /// releases the lock. If there are waiters, the highest priority waiter is
+  /// woken.
+  void unlock() {
+    detail::this_task_prio() = holder_prio;
+    state.store(0, std::memory_order_release);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (waiting.load(std::memory_order_relaxed) == 0) {
+      return;
+    }
+    detail::waiter* w;
+    {
+      std::lock_guard<std::mutex> lg{waiter_lock};
+      w = pop_highest_locked();
+    }
+    if (w != nullptr) {
+      wake(w);
+    }
+  }
+
+  bool is_locked() const { return state.load(std::memory_order_relaxed) != 0; }
+
+  /// The number of times that a holder's priority was raised by held(), or
+  /// by a waiter while the holder was suspended in held().
+  size_t boosts() const { return boost_count.load(std::memory_order_relaxed); }
+
+  /// Suspends until the lock is taken.
+  aw_lock operator co_await();
+
+  /// Suspends until the lock is taken. The result releases the lock when it
+  /// is destroyed.
+  aw_lock_scope lock_scope();
+
+  /// Wraps an awaitable that is awaited while holding this lock. If it
+  /// suspends while a higher priority task is waiting for the lock, the
+  /// holder's priority is raised to that of the waiter first. The result must
+  /// be awaited immediately.
+  template <typename Awaitable> aw_held<Awaitable> held(Awaitable&& Aw) {
+    return aw_held<Awaitable>(*this, std::forward<Awaitable>(Aw));
+  }
+};
+
+class [[nodiscard]] aw_lock : protected detail::waiter, detail::awaitable_tag {
+  friend class mutex;
+
+protected:
+  mutex* mut;
+
+public:
+  explicit aw_lock(mutex& Mut) : mut(&Mut) {}
+
+  bool await_ready() { return mut->try_lock(); }
+
+  bool await_suspend(std::coroutine_handle<> Outer) {
+    continuation = Outer;
+    executor = tmc::current_executor();
+    prio = std::min(tmc::current_priority(), PRIORITY_LIMIT - 1);
+    if (mut->lock_or_wait(this)) {
+      mut->holder_prio = prio;
+      return false;
+    }
+    // This may already have been resumed on another thread.
+    return true;
+  }
+
+  void await_resume() {}
+};
+
+/// Releases the lock when destroyed.
+class [[nodiscard]] mutex_scope {
+  mutex* mut;
+
+public:
+  explicit mutex_scope(mutex& Mut) : mut(&Mut) {}
+  mutex_scope(mutex_scope&& Other) : mut(std::exchange(Other.mut, nullptr)) {}
+  mutex_scope& operator=(mutex_scope&&) = delete;
+  mutex_scope(const mutex_scope&) = delete;
+  mutex_scope& operator=(const mutex_scope&) = delete;
+
+  ~mutex_scope() {
+    if (mut != nullptr) {
+      mut->unlock();
+    }
+  }
+};
+
+class [[nodiscard]] aw_lock_scope : public aw_lock {
+public:
+  using aw_lock::aw_lock;
+
+  mutex_scope await_resume() { return mutex_scope(*mut); }
+};
+
+inline aw_lock mutex::operator co_await() { return aw_lock(*this); }
+
+inline aw_lock_scope mutex::lock_scope() { return aw_lock_scope(*this); }
+
+// Forwards to the awaiter of Awaitable. The awaitable is held by reference, so
+// this must be awaited in the same full-expression that created it. If
+// Awaitable is known to TMC, so is this (see the awaitable_traits
+// specialization below), so the raised priority is not undone by a wrapper
+// task.
+template <typename Awaitable> class [[nodiscard]] aw_held {
+  using awaiter_type = decltype(get_awaiter(std::declval<Awaitable&&>()));
+
+  awaiter_type awaiter;
+  mutex* mut;
+  std::shared_ptr<detail::relay> relay;
+
+public:
+  aw_held(mutex& Mut, Awaitable&& Aw)
+      : awaiter(get_awaiter(std::forward<Awaitable>(Aw))), mut(&Mut) {}
+
+  aw_held(const aw_held&) = delete;
+  aw_held& operator=(const aw_held&) = delete;
+
+  bool await_ready() { return awaiter.await_ready(); }
+
+  template <typename Promise>
+  auto await_suspend(std::coroutine_handle<Promise> Outer) {
+    tmc::ex_any*& currentEx = tmc::detail::this_thread::executor();
+    tmc::ex_any* prevEx = currentEx;
+    size_t ceiling;
+    if (prevEx != nullptr) {
+      relay = std::make_shared<detail::relay>(prevEx);
+      // Waiters that arrive after this boost the relay.
+      std::lock_guard<std::mutex> lg{mut->waiter_lock};
+      mut->holder_relay = relay;
+      ceiling = mut->ceiling.load(std::memory_order_relaxed);
+    } else {
+      ceiling = mut->ceiling.load(std::memory_order_relaxed);
+    }
+    // The awaiter reads the task's priority when it queues the continuation.
+    size_t& prio = detail::this_task_prio();
+    if (ceiling < prio) {
+      prio = ceiling;
+      mut->boost_count.fetch_add(1, std::memory_order_relaxed);
+    }
+    if (prevEx == nullptr) {
+      return awaiter.await_suspend(Outer);
+    }
+    // This may be resumed on another thread before await_suspend() returns,
+    // so only locals are used after it.
+    currentEx = relay->type_erased();
+    if constexpr (std::is_void_v<decltype(awaiter.await_suspend(Outer))>) {
+      awaiter.await_suspend(Outer);
+      currentEx = prevEx;
+    } else {
+      auto result = awaiter.await_suspend(Outer);
+      currentEx = prevEx;
+      return result;
+    }
+  }
+
+  decltype(auto) await_resume() {
+    if (relay != nullptr) {
+      std::lock_guard<std::mutex> lg{mut->waiter_lock};
+      mut->holder_relay = nullptr;
+    }
+    return awaiter.await_resume();
+  }
+};
+
+/// A serializing executor that runs the highest priority waiting item next.
+/// Use it like tmc::ex_braid: post to it, `co_await tmc::enter(braid)`, or
+/// `co_await tmc::resume_on(braid)`.
+class ex_braid {
+  mutex lock;
+  tmc::ex_any* parent;
+  tmc::ex_any type_erased_this;
+  // Items that have been posted and have not finished. The destructor waits
+  // for this to reach 0.
+  std::atomic<size_t> in_flight{0};
+
+  static tmc::task<void> run(ex_braid* Braid, tmc::work_item Item) {
+    co_await Braid->lock;
+    tmc::ex_any* prevEx = tmc::detail::this_thread::executor();
+    tmc::detail::this_thread::executor() = &Braid->type_erased_this;
+    Item();
+    tmc::detail::this_thread::executor() = prevEx;
+    Braid->lock.unlock();
+    Braid->in_flight.fetch_sub(1, std::memory_order_release);
+  }
+
+public:
+  /// Items run on Parent. If no parent is given, the current executor is
+  /// used, or tmc::cpu_executor() if this is not called from an executor.
+  explicit ex_braid(tmc::ex_any* Parent = tmc::current_executor())
+      : parent(Parent != nullptr ? Parent : tmc::cpu_executor().type_erased()),
+        type_erased_this(this) {}
+
+  ex_braid(const ex_braid&) = delete;
+  ex_braid& operator=(const ex_braid&) = delete;
+
+  ~ex_braid() {
+    while (in_flight.load(std::memory_order_acquire) != 0) {
+      std::this_thread::yield();
+    }
+  }
+
+  void post(tmc::work_item&& Item, size_t Priority = 0, size_t ThreadHint = NO_HINT) {
+    in_flight.fetch_add(1, std::memory_order_relaxed);
+    parent->post(run(this, std::move(Item)), Priority, ThreadHint);
+  }
+
+  template <typename Iter>
+  void
+  post_bulk(Iter It, size_t Count, size_t Priority = 0, size_t ThreadHint = NO_HINT) {
+    for (size_t i = 0; i < Count; ++i) {
+      post(std::move(*It), Priority, ThreadHint);
+      ++It;
+    }
+  }
+
+  bool is_current() const {
+    return tmc::detail::this_thread::executor() == &type_erased_this;
+  }
+
+  tmc::ex_any* type_erased() TMC_LIFETIMEBOUND { return &type_erased_this; }
+};
+} // namespace prio_inherit
+
+// Implementation of tmc::detail::awaitable_traits, so that the mutex can be
+// awaited by a tmc::task when TMC_NO_UNKNOWN_AWAITABLES is defined, and so that
+// held() is not wrapped in a task that would restore the priority that it
+// raised. The lock awaitables already resume the awaiting task on its own
+// executor and priority, so they are awaited as-is.
+namespace tmc::detail {
+template <typename T>
+concept IsPrioInheritLockAwaitable =
+  std::is_base_of_v<prio_inherit::detail::awaitable_tag, T>;
+
+template <IsPrioInheritLockAwaitable Awaitable> struct awaitable_traits<Awaitable> {
+  using result_type = decltype(std::declval<Awaitable&>().await_resume());
+  using self_type = Awaitable;
+
+  static decltype(auto) get_awaiter(self_type& awaitable) noexcept {
+    return awaitable;
+  }
+  static decltype(auto) get_awaiter(self_type&& awaitable) noexcept {
+    return static_cast<self_type&&>(awaitable);
+  }
+
+  static constexpr configure_mode mode = WRAPPER;
+};
+
+template <> struct awaitable_traits<prio_inherit::mutex> {
+  using result_type = void;
+  using self_type = prio_inherit::mutex;
+
+  static prio_inherit::aw_lock get_awaiter(self_type& awaitable) noexcept {
+    return awaitable.operator co_await();
+  }
+
+  static constexpr configure_mode mode = WRAPPER;
+};
+
+// The wrapped awaitable is awaited directly by aw_held. It is only known if
+// the wrapped awaitable is.
+template <typename Awaitable>
+  requires(is_known_awaitable<std::remove_cvref_t<Awaitable>>)
+struct awaitable_traits<prio_inherit::aw_held<Awaitable>> {
+  using result_type =
+    typename awaitable_traits<std::remove_cvref_t<Awaitable>>::result_type;
+  using self_type = prio_inherit::aw_held<Awaitable>;
+
+  static decltype(auto) get_awaiter(self_type& awaitable) noexcept {
+    return awaitable;
+  }
+  static decltype(auto) get_awaiter(self_type&& awaitable) noexcept {
+    return static_cast<self_type&&>(awaitable);
+  }
+
+  static constexpr configure_mode mode = WRAPPER;
+};
+
+template <> struct executor_traits<prio_inherit::detail::relay> {
+  static inline void post(
+    prio_inherit::detail::relay& Ex, tmc::work_item&& Item, size_t Priority,
+    size_t ThreadHint
+  ) {
+    Ex.post(std::move(Item), Priority, ThreadHint);
+  }
+
+  template <typename It>
+  static inline void post_bulk(
+    prio_inherit::detail::relay& Ex, It&& Items, size_t Count, size_t Priority,
+    size_t ThreadHint
+  ) {
+    Ex.post_bulk(std::forward<It>(Items), Count, Priority, ThreadHint);
+  }
+
+  static inline tmc::ex_any*
+  type_erased(prio_inherit::detail::relay& Ex TMC_LIFETIMEBOUND) {
+    return Ex.type_erased();
+  }
+
+  static inline std::coroutine_handle<> dispatch(
+    prio_inherit::detail::relay& Ex, std::coroutine_handle<> Outer, size_t Priority
+  ) {
+    Ex.post(std::move(Outer), Priority);
+    return std::noop_coroutine();
+  }
+};
+
+template <> struct executor_traits<prio_inherit::ex_braid> {
+  static inline void post(
+    prio_inherit::ex_braid& Ex, tmc::work_item&& Item, size_t Priority,
+    size_t ThreadHint
+  ) {
+    Ex.post(std::move(Item), Priority, ThreadHint);
+  }
+
+  template <typename It>
+  static inline void post_bulk(
+    prio_inherit::ex_braid& Ex, It&& Items, size_t Count, size_t Priority,
+    size_t ThreadHint
+  ) {
+    Ex.post_bulk(std::forward<It>(Items), Count, Priority, ThreadHint);
+  }
+
+  static inline tmc::ex_any* type_erased(prio_inherit::ex_braid& Ex TMC_LIFETIMEBOUND) {
+    return Ex.type_erased();
+  }
+
+  static inline std::coroutine_handle<> dispatch(
+    prio_inherit::ex_braid& Ex, std::coroutine_handle<> Outer, size_t Priority
+  ) {
+    if (Ex.is_current()) {
+      tmc::detail::this_thread::this_task().prio = Priority;
+      return Outer;
+    }
+    Ex.post(std::move(Outer), Priority);
+    return std::noop_coroutine();
+  }
+};
+} // namespace tmc::detail
@@ -0,0 +1,73 @@
+// pull_bulk() for tmc::chan_tok, the tmc::qu_* queues, and bounded_channel.
+//
+// These only provide a single-element pull(), so a consumer pays for a
+// co_await (and a suspend / resume when the queue runs dry) per element.
+// pull_bulk() awaits pull() only for the first element, which suspends only
+// if the queue is empty. It then takes up to Max - 1 more elements that are
+// already available with try_pull(), without suspending. The consumer gets a
+// contiguous batch that it can process in a tight (vectorizable) loop.
+//
+// Returns the number of elements written to Out. Returns 0 only when the
+// queue is closed and empty.
+//
+//   std::array<size_t, 64> buf;
+//   while (size_t n = co_await pull_bulk(chan, std::span{buf})) {
+//     for (size_t i = 0; i < n; ++i) { ... buf[i] ... }
+//   }
+//
+// Queue is taken by reference, so it must outlive the returned task. For
+// tmc::chan_tok and bounded_chan_tok, pass the token that belongs to the
+// consumer.
+
+#pragma once
+
+#include "tmc/channel.hpp"
+#include "tmc/task.hpp"
+
+#include <cstddef>
+#include <span>
+#include <utility>
+#include <variant>
+
+namespace pull_bulk_detail {
+// tmc::chan_tok::try_pull() returns a std::variant indexed by tmc::chan_err.
+// The queues' try_pull() and pull() return a result that converts to bool and
+// dereferences to the element.
+template <typename Result, typename OutIt> bool take(Result&& R, OutIt& Out) {
+  if constexpr (requires { R.index(); }) {
+    if (R.index() != tmc::chan_err::OK) {
+      return false;
+    }
+    *Out = std::move(std::get<tmc::chan_err::OK>(R));
+  } else {
+    if (!R) {
+      return false;
+    }
+    *Out = std::move(*R);
+  }
+  ++Out;
+  return true;
+}
+} // namespace pull_bulk_detail
+
+/// Writes between 1 and Max elements to Out. Suspends only if the queue is
+/// empty. Returns 0 if the queue is closed and empty.
+template <typename Queue, typename OutIt>
+tmc::task<size_t> pull_bulk(Queue& Q, OutIt Out, size_t Max) {
+  if (Max == 0) {
+    co_return 0;
+  }
+  if (!pull_bulk_detail::take(co_await Q.pull(), Out)) {
+    co_return 0;
+  }
+  size_t count = 1;
+  while (count < Max && pull_bulk_detail::take(Q.try_pull(), Out)) {
+    ++count;
+  }
+  co_return count;
+}
+
+template <typename Queue, typename T>
+tmc::task<size_t> pull_bulk(Queue& Q, std::span<T> Out) {
+  return pull_bulk(Q, Out.begin(), Out.size());
+}
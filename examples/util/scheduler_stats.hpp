@@ -0,0 +1,344 @@
+#pragma once
+/// Per-thread scheduler statistics for tmc::ex_cpu.
+///
+/// Usage:
+/// - Call install() on a collector before calling init() on the executor. This
+///   installs a thread init hook that assigns each worker thread its own
+///   cache-line-padded counter slot. The executor only holds one hook, so pass
+///   any other hook that the program needs to install(), which calls it too.
+/// - Call record_task(Origin) at the start of each task that should be
+///   counted, passing the value of task_origin() that was captured when the
+///   task was created (e.g. as a default argument). A task that begins running
+///   on a different worker than the one that created it was migrated by work
+///   stealing or by waking another thread. If the two workers are in different
+///   cache groups, it is also counted as a cross-cache migration.
+/// - Call stats() at any time to get a snapshot of all threads' counters.
+///
+/// On Linux, two values are also read from the OS (/proc/self/task):
+/// - voluntary_switches: the number of voluntary context switches, i.e. the
+///   number of times the worker blocked. This includes parking while idle, but
+///   also any other blocking call.
+/// - off_cpu_us: the time since the worker started that it was neither running
+///   nor waiting on a runqueue. This includes time spent parked, but also time
+///   spent blocked for any other reason.
+/// These values are reported as 0 on other platforms.
+///
+/// Everything is compiled out unless TMC_ENABLE_STATS is defined (see the
+/// TMC_ENABLE_STATS CMake option). When disabled, record_task() is a no-op,
+/// stats() returns an empty snapshot, and origin should not be captured at
+/// all, so that tasks don't carry it (see skynet_one in skynet.cpp).
+
+#include "tmc/current.hpp"
+#include "tmc/ex_cpu.hpp"
+
+#ifdef TMC_USE_HWLOC
+#include "tmc/topology.hpp"
+#endif
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef TMC_ENABLE_STATS
+#ifdef __linux__
+#include <fstream>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+#endif
+
+namespace sched_stats {
+struct thread_stats {
+  size_t tasks_executed = 0;
+  size_t tasks_migrated = 0;
+  size_t tasks_migrated_cross_cache = 0;
+  size_t voluntary_switches = 0;
+  size_t off_cpu_us = 0;
+
+  thread_stats& operator+=(const thread_stats& Other) {
+    tasks_executed += Other.tasks_executed;
+    tasks_migrated += Other.tasks_migrated;
+    tasks_migrated_cross_cache += Other.tasks_migrated_cross_cache;
+    voluntary_switches += Other.voluntary_switches;
+    off_cpu_us += Other.off_cpu_us;
+    return *this;
+  }
+
+  thread_stats operator-(const thread_stats& Earlier) const {
+    return thread_stats{
+      tasks_executed - Earlier.tasks_executed,
+      tasks_migrated - Earlier.tasks_migrated,
+      tasks_migrated_cross_cache - Earlier.tasks_migrated_cross_cache,
+      voluntary_switches - Earlier.voluntary_switches,
+      off_cpu_us - Earlier.off_cpu_us
+    };
+  }
+};
+
+struct snapshot {
+  std::vector<thread_stats> threads;
+
+  thread_stats total() const {
+    thread_stats result;
+    for (auto& t : threads) {
+      result += t;
+    }
+    return result;
+  }
+
+  /// Returns the change in each counter since an Earlier snapshot.
+  snapshot operator-(const snapshot& Earlier) const {
+    snapshot result;
+    result.threads.resize(threads.size());
+    for (size_t i = 0; i < threads.size(); ++i) {
+      if (i < Earlier.threads.size()) {
+        result.threads[i] = threads[i] - Earlier.threads[i];
+      } else {
+        result.threads[i] = threads[i];
+      }
+    }
+    return result;
+  }
+
+  /// Print the totals on a single line.
+  void print_summary(const char* Label) const {
+#ifdef TMC_ENABLE_STATS
+    auto t = total();
+    std::printf(
+      "%s: executed %zu | migrated %zu (cross-cache %zu) | vol. switches %zu | "
+      "off-CPU %.2f ms\n",
+      Label, t.tasks_executed, t.tasks_migrated, t.tasks_migrated_cross_cache,
+      t.voluntary_switches, static_cast<double>(t.off_cpu_us) / 1000.0
+    );
+#else
+    std::printf(
+      "%s: stats disabled (configure with -DTMC_ENABLE_STATS=ON)\n", Label
+    );
+#endif
+  }
+
+  /// Print a table with a row per thread, followed by the totals.
+  void print([[maybe_unused]] const char* Label) const {
+#ifdef TMC_ENABLE_STATS
+    std::printf("%s:\n", Label);
+    std::printf(
+      "| thread\t| executed\t| migrated\t| cross-cache\t| vol. switches\t| "
+      "off-CPU ms\t|\n"
+    );
+    for (size_t i = 0; i < threads.size(); ++i) {
+      auto& t = threads[i];
+      std::printf(
+        "| %zu\t\t| %zu\t\t| %zu\t\t| %zu\t\t| %zu\t\t| %.2f\t\t|\n", i,
+        t.tasks_executed, t.tasks_migrated, t.tasks_migrated_cross_cache,
+        t.voluntary_switches, static_cast<double>(t.off_cpu_us) / 1000.0
+      );
+    }
+#endif
+    print_summary("total");
+  }
+};
+
+namespace detail {
+inline int64_t now_ns() {
+  return static_cast<int64_t>(
+    std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()
+    )
+      .count()
+  );
+}
+
+// Each counter has a single writer (the owning thread), so a relaxed
+// load + store is sufficient and avoids a locked RMW.
+inline void relaxed_inc(std::atomic<size_t>& Counter) {
+  Counter.store(
+    Counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed
+  );
+}
+
+struct alignas(64) slot {
+  std::atomic<size_t> tasks_executed{0};
+  std::atomic<size_t> tasks_migrated{0};
+  std::atomic<size_t> tasks_migrated_cross_cache{0};
+  std::atomic<int64_t> os_tid{0};
+  std::atomic<int64_t> start_ns{0};
+};
+
+inline thread_local slot* this_thread_slot = nullptr;
+inline thread_local size_t this_thread_group = 0;
+
+#ifdef TMC_ENABLE_STATS
+inline void read_os_thread_stats(const slot& Slot, thread_stats& Out) {
+#ifdef __linux__
+  int64_t tid = Slot.os_tid.load(std::memory_order_acquire);
+  if (tid == 0) {
+    return;
+  }
+  std::string base = "/proc/self/task/" + std::to_string(tid);
+
+  // Voluntary context switches occur when the thread blocks, whether it parks
+  // or blocks on something else.
+  std::ifstream status(base + "/status");
+  std::string line;
+  static constexpr char VCSW[] = "voluntary_ctxt_switches:";
+  while (std::getline(status, line)) {
+    if (line.rfind(VCSW, 0) == 0) {
+      Out.voluntary_switches = std::stoull(line.substr(sizeof(VCSW) - 1));
+      break;
+    }
+  }
+
+  // schedstat contains time spent running and time spent waiting on a
+  // runqueue. Any remaining time since the thread started was spent off the
+  // CPU: parked, or blocked on something else.
+  std::ifstream schedstat(base + "/schedstat");
+  unsigned long long runNs = 0;
+  unsigned long long waitNs = 0;
+  if (schedstat >> runNs >> waitNs) {
+    int64_t elapsed = now_ns() - Slot.start_ns.load(std::memory_order_relaxed);
+    int64_t offCpu = elapsed - static_cast<int64_t>(runNs + waitNs);
+    Out.off_cpu_us = offCpu > 0 ? static_cast<size_t>(offCpu / 1000) : 0;
+  }
+#else
+  (void)Slot;
+  (void)Out;
+#endif
+}
+#endif
+} // namespace detail
+
+/// The worker thread and cache group that created a task.
+struct origin {
+#ifdef TMC_ENABLE_STATS
+  size_t thread;
+  size_t group;
+#endif
+};
+
+/// Returns the location of the calling worker thread. Capture this when a task
+/// is created, and pass it to record_task() when the task starts.
+inline origin task_origin() {
+#ifdef TMC_ENABLE_STATS
+  return origin{tmc::current_thread_index(), detail::this_thread_group};
+#else
+  return origin{};
+#endif
+}
+
+/// Record that a task created at Origin has started running.
+inline void record_task([[maybe_unused]] origin Origin) {
+#ifdef TMC_ENABLE_STATS
+  auto s = detail::this_thread_slot;
+  if (s == nullptr) {
+    return;
+  }
+  detail::relaxed_inc(s->tasks_executed);
+  if (Origin.thread != tmc::current_thread_index()) {
+    detail::relaxed_inc(s->tasks_migrated);
+    if (Origin.group != detail::this_thread_group) {
+      detail::relaxed_inc(s->tasks_migrated_cross_cache);
+    }
+  }
+#endif
+}
+
+class collector {
+#ifdef TMC_ENABLE_STATS
+  std::unique_ptr<detail::slot[]> slots;
+  size_t slot_count = 0;
+
+  void init_thread(size_t Slot, size_t Group) {
+    detail::this_thread_group = Group;
+    if (Slot >= slot_count) {
+      return;
+    }
+    auto& s = slots[Slot];
+    s.start_ns.store(detail::now_ns(), std::memory_order_relaxed);
+#ifdef __linux__
+    s.os_tid.store(
+      static_cast<int64_t>(syscall(SYS_gettid)), std::memory_order_release
+    );
+#endif
+    detail::this_thread_slot = &s;
+  }
+#endif
+
+public:
+  /// Installs a thread init hook on Executor. This must be called before
+  /// init(). Executors with more than MaxThreads threads will only report
+  /// stats for the first MaxThreads.
+  void install(
+    tmc::ex_cpu& Executor, size_t MaxThreads = std::thread::hardware_concurrency()
+  ) {
+    install(Executor, nullptr, MaxThreads);
+  }
+
+  /// Installs a thread init hook on Executor that also calls Next with the
+  /// thread's index. The executor only holds one hook, so use this instead of
+  /// calling set_thread_init_hook() for Next separately. When stats are
+  /// compiled out, only Next is installed.
+  void install(
+    tmc::ex_cpu& Executor, std::function<void(size_t)> Next,
+    [[maybe_unused]] size_t MaxThreads = std::thread::hardware_concurrency()
+  ) {
+#ifdef TMC_ENABLE_STATS
+    slot_count = MaxThreads;
+    slots = std::make_unique<detail::slot[]>(MaxThreads);
+#ifdef TMC_USE_HWLOC
+    Executor.set_thread_init_hook(
+      [this, Next = std::move(Next)](tmc::topology::thread_info Info) {
+        init_thread(Info.index, Info.group.index);
+        if (Next) {
+          Next(Info.index);
+        }
+      }
+    );
+#else
+    Executor.set_thread_init_hook([this, Next = std::move(Next)](size_t Slot) {
+      init_thread(Slot, 0);
+      if (Next) {
+        Next(Slot);
+      }
+    });
+#endif
+#else
+    if (Next) {
+      Executor.set_thread_init_hook(std::move(Next));
+    }
+#endif
+  }
+
+  /// Returns a snapshot of the current per-thread counters. Values are read
+  /// with relaxed ordering, so they are approximate while the executor is busy.
+  snapshot stats() const {
+    snapshot result;
+#ifdef TMC_ENABLE_STATS
+    result.threads.resize(slot_count);
+    for (size_t i = 0; i < slot_count; ++i) {
+      auto& s = slots[i];
+      auto& t = result.threads[i];
+      t.tasks_executed = s.tasks_executed.load(std::memory_order_relaxed);
+      t.tasks_migrated = s.tasks_migrated.load(std::memory_order_relaxed);
+      t.tasks_migrated_cross_cache =
+        s.tasks_migrated_cross_cache.load(std::memory_order_relaxed);
+      detail::read_os_thread_stats(s, t);
+    }
+    // Trim slots that were never used by a worker thread.
+    while (!result.threads.empty() &&
+           slots[result.threads.size() - 1].start_ns.load(
+             std::memory_order_relaxed
+           ) == 0) {
+      result.threads.pop_back();
+    }
+#endif
+    return result;
+  }
+};
+} // namespace sched_stats
@@ -0,0 +1,251 @@
+#pragma once
+/// A work-stealing deque with the same interface as tmc::detail::chase_lev_deque
+/// (push / try_pop / steal / post_bulk), plus steal_batch(), which lets a thief
+/// take up to half of the victim's items with a single CAS.
+///
+/// In a classic Chase-Lev deque, the owner pops from the bottom without a CAS
+/// unless it is racing for the last element. That is only safe because each
+/// thief claims exactly one element at the top. A thief that claims a range
+/// could be delayed between reading the bottom index and committing its CAS,
+/// while the owner pops down into that range without noticing.
+///
+/// To make batch stealing safe, the top and bottom indexes are packed into a
+/// single 64-bit word. The owner's pop and every steal are CASes on that word,
+/// so a thief's CAS fails if the owner has popped (or pushed) since the thief
+/// read the indexes. push() and post_bulk() are a single fetch_add on the
+/// bottom of the word. On x86 this costs the owner about the same as the
+/// seq_cst fence in a Chase-Lev pop.
+///
+/// The indexes alone are not enough: a pop followed by a push restores the
+/// same (top, bottom) pair, with a different element in the popped slot. A
+/// thief that read the indexes before the pop would then commit its CAS and
+/// take the popped element, and the pushed one would be lost. Each pop also
+/// increments a 24-bit generation tag in the word, so the word only repeats
+/// after 2^24 (about 16.7 million) pops. A thief would have to stall for that
+/// many pops, and find the same top and bottom when it resumes.
+///
+/// The word holds a 20-bit top, a 24-bit tag and a 20-bit bottom. A wider tag
+/// would leave too few index bits: a 32-bit tag would cap the deque at 2^15
+/// elements. Indexes wrap around modulo 2^20, so capacity is limited to
+/// MAX_CAPACITY (2^19) elements. Constructing a deque with a larger capacity,
+/// or pushing past it, throws std::length_error. Buffers replaced by growth are
+/// retained until the deque is destroyed, since a thief may still be reading
+/// from them.
+///
+/// T must be trivially copyable and lock-free when wrapped in std::atomic, as
+/// thieves speculatively read elements before their CAS commits.
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+template <typename T> class steal_half_deque {
+  static_assert(std::is_trivially_copyable_v<T>);
+  static_assert(std::atomic<T>::is_always_lock_free);
+
+  struct buffer {
+    size_t mask;
+    std::unique_ptr<std::atomic<T>[]> slots;
+
+    explicit buffer(size_t Capacity)
+        : mask(Capacity - 1),
+          slots(std::make_unique<std::atomic<T>[]>(Capacity)) {}
+
+    size_t capacity() const { return mask + 1; }
+    std::atomic<T>& at(uint32_t Index) { return slots[Index & mask]; }
+  };
+
+  static constexpr uint32_t INDEX_BITS = 20;
+  static constexpr uint32_t TAG_BITS = 24;
+  static constexpr uint32_t INDEX_MASK = (uint32_t{1} << INDEX_BITS) - 1;
+  static constexpr uint32_t TAG_MASK = (uint32_t{1} << TAG_BITS) - 1;
+  // bottom is in the high bits so that push can fetch_add on it, and let the
+  // carry fall off the end of the word when it wraps.
+  static constexpr uint32_t BOTTOM_SHIFT = INDEX_BITS + TAG_BITS;
+  static constexpr uint64_t BOTTOM_ONE = uint64_t{1} << BOTTOM_SHIFT;
+
+  static uint32_t top_of(uint64_t Word) {
+    return static_cast<uint32_t>(Word) & INDEX_MASK;
+  }
+  static uint32_t tag_of(uint64_t Word) {
+    return static_cast<uint32_t>(Word >> INDEX_BITS) & TAG_MASK;
+  }
+  static uint32_t bottom_of(uint64_t Word) {
+    return static_cast<uint32_t>(Word >> BOTTOM_SHIFT);
+  }
+  static uint32_t size_of(uint32_t Top, uint32_t Bottom) {
+    return (Bottom - Top) & INDEX_MASK;
+  }
+  static uint64_t pack(uint32_t Top, uint32_t Bottom, uint32_t Tag) {
+    return (static_cast<uint64_t>(Bottom & INDEX_MASK) << BOTTOM_SHIFT) |
+           (static_cast<uint64_t>(Tag & TAG_MASK) << INDEX_BITS) |
+           (Top & INDEX_MASK);
+  }
+
+  alignas(64) std::atomic<uint64_t> indexes;
+  std::atomic<buffer*> buf;
+  // Owner-only
+  std::vector<std::unique_ptr<buffer>> buffers;
+
+  static size_t round_up_pow2(size_t Value) {
+    size_t result = 1;
+    while (result < Value) {
+      result <<= 1;
+    }
+    return result;
+  }
+
+  // Ensure that there is room for Count more elements. Owner-only.
+  buffer* reserve(uint32_t Top, uint32_t Bottom, size_t Count) {
+    buffer* b = buf.load(std::memory_order_relaxed);
+    size_t size = size_of(Top, Bottom);
+    size_t needed = size + Count;
+    if (needed <= b->capacity()) {
+      return b;
+    }
+    if (needed > MAX_CAPACITY) {
+      throw std::length_error("steal_half_deque: exceeded MAX_CAPACITY");
+    }
+    size_t newCap = b->capacity() * 2;
+    while (newCap < needed) {
+      newCap *= 2;
+    }
+    auto next = std::make_unique<buffer>(newCap);
+    // Copy using the same logical indexes. Elements in [Top, Bottom) that are
+    // stolen concurrently are copied needlessly, but never observed again,
+    // since the thieves that took them have already advanced top.
+    for (size_t i = 0; i < size; ++i) {
+      uint32_t idx = Top + static_cast<uint32_t>(i);
+      next->at(idx).store(
+        b->at(idx).load(std::memory_order_relaxed), std::memory_order_relaxed
+      );
+    }
+    b = next.get();
+    buffers.push_back(std::move(next));
+    buf.store(b, std::memory_order_release);
+    return b;
+  }
+
+public:
+  static constexpr size_t MAX_CAPACITY = size_t{1} << (INDEX_BITS - 1);
+
+  /// Throws std::length_error if InitialCapacity is more than MAX_CAPACITY.
+  explicit steal_half_deque(size_t InitialCapacity = 64) : indexes(0) {
+    if (InitialCapacity > MAX_CAPACITY) {
+      throw std::length_error("steal_half_deque: exceeded MAX_CAPACITY");
+    }
+    buffers.push_back(std::make_unique<buffer>(round_up_pow2(InitialCapacity)));
+    buf.store(buffers.back().get(), std::memory_order_relaxed);
+  }
+
+  steal_half_deque(const steal_half_deque&) = delete;
+  steal_half_deque& operator=(const steal_half_deque&) = delete;
+
+  /// Owner-only. Push an element onto the bottom. Throws std::length_error if
+  /// the deque already holds MAX_CAPACITY elements.
+  void push(T Value) {
+    uint64_t w = indexes.load(std::memory_order_relaxed);
+    uint32_t bottom = bottom_of(w);
+    buffer* b = reserve(top_of(w), bottom, 1);
+    b->at(bottom).store(Value, std::memory_order_relaxed);
+    indexes.fetch_add(BOTTOM_ONE, std::memory_order_release);
+  }
+
+  /// Owner-only. Push Count elements starting at Begin onto the bottom, in
+  /// order. They become visible to thieves all at once. Throws
+  /// std::length_error, without pushing any, if they don't fit in
+  /// MAX_CAPACITY.
+  template <typename It> void post_bulk(It Begin, size_t Count) {
+    if (Count == 0) {
+      return;
+    }
+    uint64_t w = indexes.load(std::memory_order_relaxed);
+    uint32_t bottom = bottom_of(w);
+    buffer* b = reserve(top_of(w), bottom, Count);
+    for (size_t i = 0; i < Count; ++i) {
+      b->at(bottom + static_cast<uint32_t>(i))
+        .store(*Begin, std::memory_order_relaxed);
+      ++Begin;
+    }
+    indexes.fetch_add(
+      static_cast<uint64_t>(Count) * BOTTOM_ONE, std::memory_order_release
+    );
+  }
+
+  /// Owner-only. Pop an element from the bottom (LIFO order).
+  bool try_pop(T& Out) {
+    uint64_t w = indexes.load(std::memory_order_relaxed);
+    while (true) {
+      uint32_t top = top_of(w);
+      uint32_t bottom = bottom_of(w);
+      if (top == bottom) {
+        return false;
+      }
+      uint32_t last = (bottom - 1) & INDEX_MASK;
+      T value = buf.load(std::memory_order_relaxed)
+                  ->at(last)
+                  .load(std::memory_order_relaxed);
+      // Bump the tag so that a thief that read the indexes before this pop
+      // can't commit, even if a push restores the same bottom.
+      if (indexes.compare_exchange_weak(
+            w, pack(top, last, tag_of(w) + 1), std::memory_order_acquire,
+            std::memory_order_relaxed
+          )) {
+        Out = value;
+        return true;
+      }
+    }
+  }
+
+  /// Any thread. Steal up to Max elements, but no more than half (rounded up)
+  /// of the current size, from the top (FIFO order) into Out. Returns the
+  /// number of elements stolen, which is 0 only if the deque was empty.
+  size_t steal_batch(T* Out, size_t Max) {
+    if (Max == 0) {
+      return 0;
+    }
+    uint64_t w = indexes.load(std::memory_order_acquire);
+    while (true) {
+      uint32_t top = top_of(w);
+      uint32_t size = size_of(top, bottom_of(w));
+      if (size == 0) {
+        return 0;
+      }
+      size_t count = size - size / 2;
+      if (count > Max) {
+        count = Max;
+      }
+      // The acquire load of indexes synchronizes with the push that published
+      // these elements, and any buffer that is at least that new holds them.
+      buffer* b = buf.load(std::memory_order_acquire);
+      for (size_t i = 0; i < count; ++i) {
+        Out[i] =
+          b->at(top + static_cast<uint32_t>(i)).load(std::memory_order_relaxed);
+      }
+      if (indexes.compare_exchange_weak(
+            w,
+            pack(top + static_cast<uint32_t>(count), bottom_of(w), tag_of(w)),
+            std::memory_order_acq_rel, std::memory_order_acquire
+          )) {
+        return count;
+      }
+    }
+  }
+
+  /// Any thread. Steal a single element from the top.
+  bool steal(T& Out) { return steal_batch(&Out, 1) == 1; }
+
+  bool empty() const {
+    uint64_t w = indexes.load(std::memory_order_relaxed);
+    return top_of(w) == bottom_of(w);
+  }
+
+  size_t size_approx() const {
+    uint64_t w = indexes.load(std::memory_order_relaxed);
+    return size_of(top_of(w), bottom_of(w));
+  }
+};
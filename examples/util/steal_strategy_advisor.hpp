@@ -0,0 +1,94 @@
+#pragma once
+/// Chooses between the LATTICE_MATRIX and HIERARCHY_MATRIX work stealing
+/// strategies based on the scheduler stats observed over the previous interval.
+///
+/// - If a large fraction of tasks migrate between workers, the workload is
+///   dominated by fan-out / nested parallelism. LATTICE_MATRIX spreads steals
+///   across all cache groups more quickly, so it is preferred.
+/// - If migrations are rare but most of them cross a cache boundary, the
+///   workload benefits more from locality. HIERARCHY_MATRIX exhausts the
+///   thief's own cache group before moving further away, so it is preferred.
+/// - Otherwise the current strategy is kept.
+///
+/// A new strategy must be recommended for several consecutive intervals before
+/// the advisor switches to it, to avoid flapping on noisy workloads.
+///
+/// The advisor only recommends a strategy; it doesn't switch the strategy of a
+/// running executor. The stealing order is fixed when tmc::ex_cpu::init() is
+/// called, so the caller applies a change by tearing the executor down and
+/// building a new one at a quiescent point.
+/// The advisor requires TMC_ENABLE_STATS; without it, it never switches.
+
+#include "scheduler_stats.hpp"
+
+#include "tmc/ex_cpu.hpp"
+
+#include <cstddef>
+
+class steal_strategy_advisor {
+  tmc::work_stealing_strategy current;
+  tmc::work_stealing_strategy candidate;
+  size_t streak = 0;
+
+public:
+  // Fraction of executed tasks that migrated, above which the workload is
+  // considered fan-out heavy.
+  static constexpr double FANOUT_MIGRATION_RATE = 0.10;
+  // Fraction of migrations that crossed a cache boundary, above which the
+  // workload is considered locality sensitive.
+  static constexpr double CROSS_CACHE_RATE = 0.50;
+  // Number of consecutive intervals a new strategy must be recommended for.
+  static constexpr size_t HYSTERESIS = 2;
+
+  explicit steal_strategy_advisor(
+    tmc::work_stealing_strategy Initial =
+      tmc::work_stealing_strategy::LATTICE_MATRIX
+  )
+      : current(Initial), candidate(Initial) {}
+
+  tmc::work_stealing_strategy strategy() const { return current; }
+
+  /// Feed the stats collected over the last interval. Returns true if the
+  /// recommended strategy changed.
+  bool update(const sched_stats::thread_stats& Interval) {
+    if (Interval.tasks_executed == 0) {
+      return false;
+    }
+    double migrationRate = static_cast<double>(Interval.tasks_migrated) /
+                           static_cast<double>(Interval.tasks_executed);
+    double crossCacheRate =
+      Interval.tasks_migrated == 0
+        ? 0.0
+        : static_cast<double>(Interval.tasks_migrated_cross_cache) /
+            static_cast<double>(Interval.tasks_migrated);
+
+    tmc::work_stealing_strategy recommended = current;
+    if (migrationRate >= FANOUT_MIGRATION_RATE) {
+      recommended = tmc::work_stealing_strategy::LATTICE_MATRIX;
+    } else if (crossCacheRate >= CROSS_CACHE_RATE) {
+      recommended = tmc::work_stealing_strategy::HIERARCHY_MATRIX;
+    }
+
+    if (recommended == current) {
+      streak = 0;
+      return false;
+    }
+    if (recommended != candidate) {
+      candidate = recommended;
+      streak = 0;
+    }
+    ++streak;
+    if (streak < HYSTERESIS) {
+      return false;
+    }
+    current = candidate;
+    streak = 0;
+    return true;
+  }
+};
+
+inline const char* strategy_name(tmc::work_stealing_strategy Strategy) {
+  return Strategy == tmc::work_stealing_strategy::LATTICE_MATRIX
+           ? "LATTICE_MATRIX"
+           : "HIERARCHY_MATRIX";
+}
@@ -0,0 +1,369 @@
+#pragma once
+/// A timeline of which thread ran what, and when tasks were suspended, that
+/// can be written as a Chrome trace file and opened in chrome://tracing or
+/// https://ui.perfetto.dev.
+///
+/// Usage:
+/// - Mark synchronous work with a slice. It is recorded when the slice is
+///   destroyed, on the thread that ran it:
+///
+///     task_trace::slice s("parse");
+///
+/// - Wrap an awaitable with traced(), and co_await the result immediately:
+///
+///     auto v = co_await task_trace::traced("pull", chan.pull());
+///
+///   If the awaitable suspends, the wait is recorded as an async slice that
+///   begins on the thread that suspended and ends on the thread that resumed.
+///   If those are different threads, a "migrated" instant is also recorded on
+///   the resuming thread. An await that completes without suspending is not
+///   recorded. There is no separate steal event: the executor doesn't tell
+///   the task whether its continuation was stolen or posted to another thread,
+///   so a steal shows up as a "migrated" instant.
+/// - Replace `tmc::change_priority(P)` with `task_trace::change_priority(P)`
+///   to record the priority change as an instant.
+/// - Call write_chrome_trace() at the end of the run.
+///
+/// Each thread records into its own ring buffer of TMC_TRACE_BUFFER_SIZE
+/// events, without locks or atomic RMW operations. When a buffer is full, the
+/// oldest events are overwritten, so the file contains the most recent events
+/// of each thread. Buffers are allocated the first time a thread records an
+/// event, and are never freed, so they can be read after the thread has
+/// exited. write_chrome_trace() and reset() read other threads' buffers
+/// without synchronization, so they should be called while no instrumented
+/// code is running.
+///
+/// Event names are stored as pointers and written without escaping, so they
+/// should be string literals.
+///
+/// Everything is compiled out unless TMC_ENABLE_TRACE is defined (see the
+/// CMake option of the same name). When disabled, slice is empty, traced()
+/// returns its argument unchanged, and write_chrome_trace() writes nothing.
+
+#include "get_awaiter.hpp"
+
+#include "tmc/current.hpp"
+#include "tmc/detail/concepts_awaitable.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <utility>
+
+#ifndef TMC_TRACE_BUFFER_SIZE
+#define TMC_TRACE_BUFFER_SIZE (size_t{1} << 16)
+#endif
+
+namespace task_trace {
+inline constexpr bool ENABLED =
+#ifdef TMC_ENABLE_TRACE
+  true;
+#else
+  false;
+#endif
+
+namespace detail {
+static_assert(
+  (TMC_TRACE_BUFFER_SIZE & (TMC_TRACE_BUFFER_SIZE - 1)) == 0,
+  "TMC_TRACE_BUFFER_SIZE must be a power of 2"
+);
+
+enum class phase : uint8_t {
+  // Synchronous work. ts is its start, and value is its duration.
+  SLICE,
+  // A suspended await. ts is when it suspended, value is its duration, and
+  // from_thread is the thread that suspended.
+  AWAIT,
+  // A priority change. value is the new priority.
+  PRIORITY
+};
+
+struct event {
+  int64_t ts;
+  int64_t value;
+  const char* name;
+  uint32_t from_thread;
+  phase ph;
+};
+
+struct thread_buffer {
+  std::unique_ptr<event[]> events{new event[TMC_TRACE_BUFFER_SIZE]};
+  // Only written by the owning thread. The number of events that have ever
+  // been recorded; the newest is at (head - 1) % TMC_TRACE_BUFFER_SIZE.
+  std::atomic<size_t> head{0};
+  uint32_t index = 0;
+  std::string name;
+  thread_buffer* next_registered = nullptr;
+};
+
+inline std::atomic<thread_buffer*> registry{nullptr};
+inline std::atomic<uint32_t> next_index{0};
+inline thread_local thread_buffer* this_thread_buffer = nullptr;
+
+inline thread_buffer& get_thread_buffer() {
+  auto b = this_thread_buffer;
+  if (b == nullptr) [[unlikely]] {
+    b = new thread_buffer;
+    b->index = next_index.fetch_add(1, std::memory_order_relaxed);
+    b->name = "thread " + std::to_string(b->index);
+    auto head = registry.load(std::memory_order_relaxed);
+    do {
+      b->next_registered = head;
+    } while (!registry.compare_exchange_weak(
+      head, b, std::memory_order_release, std::memory_order_relaxed
+    ));
+    this_thread_buffer = b;
+  }
+  return *b;
+}
+
+inline void record(const event& Event) {
+  auto& b = get_thread_buffer();
+  size_t head = b.head.load(std::memory_order_relaxed);
+  b.events[head & (TMC_TRACE_BUFFER_SIZE - 1)] = Event;
+  b.head.store(head + 1, std::memory_order_release);
+}
+
+inline int64_t now_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+           std::chrono::steady_clock::now().time_since_epoch()
+  )
+    .count();
+}
+
+// Forwards to the awaiter of Awaitable, and records the suspension. The
+// awaitable is held by reference, so this must be awaited in the same
+// full-expression that created it.
+template <typename Awaitable> class traced_awaitable {
+  using awaiter_type = decltype(get_awaiter(std::declval<Awaitable&&>()));
+
+  awaiter_type awaiter;
+  const char* name;
+  int64_t suspended_at = -1;
+  uint32_t suspended_on = 0;
+
+public:
+  traced_awaitable(const char* Name, Awaitable&& Aw)
+      : awaiter(get_awaiter(std::forward<Awaitable>(Aw))), name(Name) {}
+
+  traced_awaitable(const traced_awaitable&) = delete;
+  traced_awaitable& operator=(const traced_awaitable&) = delete;
+
+  bool await_ready() { return awaiter.await_ready(); }
+
+  template <typename Promise>
+  auto await_suspend(std::coroutine_handle<Promise> Outer) {
+    // The awaiter may resume Outer on another thread before await_suspend()
+    // returns, so this must be written first.
+    suspended_on = get_thread_buffer().index;
+    suspended_at = now_ns();
+    using result_type = decltype(awaiter.await_suspend(Outer));
+    if constexpr (std::is_same_v<result_type, bool>) {
+      bool suspended = awaiter.await_suspend(Outer);
+      if (!suspended) {
+        suspended_at = -1;
+      }
+      return suspended;
+    } else {
+      return awaiter.await_suspend(Outer);
+    }
+  }
+
+  decltype(auto) await_resume() {
+    if (suspended_at >= 0) {
+      record(event{
+        suspended_at, now_ns() - suspended_at, name, suspended_on, phase::AWAIT
+      });
+    }
+    return awaiter.await_resume();
+  }
+};
+} // namespace detail
+
+/// Records the time from its construction to its destruction as a slice on
+/// the current thread, if TMC_ENABLE_TRACE is defined. Must not be held
+/// across a co_await.
+class slice {
+#ifdef TMC_ENABLE_TRACE
+  const char* name;
+  int64_t start;
+
+public:
+  explicit slice(const char* Name) : name(Name), start(detail::now_ns()) {}
+  ~slice() {
+    detail::record(
+      detail::event{start, detail::now_ns() - start, name, 0, detail::phase::SLICE}
+    );
+  }
+#else
+public:
+  explicit slice(const char*) {}
+#endif
+
+  slice(const slice&) = delete;
+  slice& operator=(const slice&) = delete;
+};
+
+/// Records the suspension of Aw, if TMC_ENABLE_TRACE is defined. The result
+/// must be awaited immediately.
+template <typename Awaitable>
+decltype(auto) traced(const char* Name, Awaitable&& Aw) {
+#ifdef TMC_ENABLE_TRACE
+  return detail::traced_awaitable<Awaitable>(Name, std::forward<Awaitable>(Aw));
+#else
+  (void)Name;
+  return std::forward<Awaitable>(Aw);
+#endif
+}
+
+/// Equivalent to `tmc::change_priority(Priority)`, and records the change.
+/// The result must be awaited immediately. The awaitable is returned
+/// unwrapped, so TMC still applies the new priority when it resumes.
+inline auto change_priority(size_t Priority) {
+#ifdef TMC_ENABLE_TRACE
+  detail::record(detail::event{
+    detail::now_ns(), static_cast<int64_t>(Priority), "change_priority", 0,
+    detail::phase::PRIORITY
+  });
+#endif
+  return tmc::change_priority(Priority);
+}
+
+/// Names the current thread in the trace. The default is "thread N", in the
+/// order in which threads recorded their first event.
+inline void set_thread_name(std::string Name) {
+#ifdef TMC_ENABLE_TRACE
+  detail::get_thread_buffer().name = std::move(Name);
+#else
+  (void)Name;
+#endif
+}
+
+/// Discards the events of all threads.
+inline void reset() {
+  for (auto b = detail::registry.load(std::memory_order_acquire); b != nullptr;
+       b = b->next_registered) {
+    b->head.store(0, std::memory_order_relaxed);
+  }
+}
+
+/// Writes the events of all threads to Path in the Chrome trace event format.
+/// Returns false if the file could not be written, or if tracing is disabled.
+inline bool write_chrome_trace(const char* Path) {
+#ifdef TMC_ENABLE_TRACE
+  std::FILE* f = std::fopen(Path, "w");
+  if (f == nullptr) {
+    return false;
+  }
+  // Timestamps are in microseconds, relative to the oldest event.
+  int64_t origin = INT64_MAX;
+  for (auto b = detail::registry.load(std::memory_order_acquire); b != nullptr;
+       b = b->next_registered) {
+    size_t head = b->head.load(std::memory_order_acquire);
+    size_t count = head < TMC_TRACE_BUFFER_SIZE ? head : TMC_TRACE_BUFFER_SIZE;
+    for (size_t i = head - count; i < head; ++i) {
+      int64_t ts = b->events[i & (TMC_TRACE_BUFFER_SIZE - 1)].ts;
+      if (ts < origin) {
+        origin = ts;
+      }
+    }
+  }
+  auto us = [origin](int64_t Ns) {
+    return static_cast<double>(Ns - origin) / 1000.0;
+  };
+
+  std::fprintf(f, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n");
+  const char* sep = "";
+  size_t asyncId = 0;
+  for (auto b = detail::registry.load(std::memory_order_acquire); b != nullptr;
+       b = b->next_registered) {
+    std::fprintf(
+      f,
+      "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,"
+      "\"args\":{\"name\":\"%s\"}}",
+      sep, b->index, b->name.c_str()
+    );
+    sep = ",\n";
+    size_t head = b->head.load(std::memory_order_acquire);
+    size_t count = head < TMC_TRACE_BUFFER_SIZE ? head : TMC_TRACE_BUFFER_SIZE;
+    for (size_t i = head - count; i < head; ++i) {
+      auto& e = b->events[i & (TMC_TRACE_BUFFER_SIZE - 1)];
+      switch (e.ph) {
+      case detail::phase::SLICE:
+        std::fprintf(
+          f,
+          "%s{\"name\":\"%s\",\"cat\":\"work\",\"ph\":\"X\",\"ts\":%.3f,"
+          "\"dur\":%.3f,\"pid\":1,\"tid\":%u}",
+          sep, e.name, us(e.ts), static_cast<double>(e.value) / 1000.0, b->index
+        );
+        break;
+      case detail::phase::AWAIT:
+        ++asyncId;
+        std::fprintf(
+          f,
+          "%s{\"name\":\"%s\",\"cat\":\"await\",\"ph\":\"b\",\"id\":%zu,"
+          "\"ts\":%.3f,\"pid\":1,\"tid\":%u}",
+          sep, e.name, asyncId, us(e.ts), e.from_thread
+        );
+        std::fprintf(
+          f,
+          "%s{\"name\":\"%s\",\"cat\":\"await\",\"ph\":\"e\",\"id\":%zu,"
+          "\"ts\":%.3f,\"pid\":1,\"tid\":%u}",
+          sep, e.name, asyncId, us(e.ts + e.value), b->index
+        );
+        if (e.from_thread != b->index) {
+          std::fprintf(
+            f,
+            "%s{\"name\":\"migrated\",\"cat\":\"await\",\"ph\":\"i\",\"s\":\"t\","
+            "\"ts\":%.3f,\"pid\":1,\"tid\":%u,\"args\":{\"from\":%u,\"await\":\"%s\"}}",
+            sep, us(e.ts + e.value), b->index, e.from_thread, e.name
+          );
+        }
+        break;
+      case detail::phase::PRIORITY:
+        std::fprintf(
+          f,
+          "%s{\"name\":\"%s\",\"cat\":\"priority\",\"ph\":\"i\",\"s\":\"t\","
+          "\"ts\":%.3f,\"pid\":1,\"tid\":%u,\"args\":{\"priority\":%lld}}",
+          sep, e.name, us(e.ts), b->index, static_cast<long long>(e.value)
+        );
+        break;
+      }
+    }
+  }
+  std::fprintf(f, "\n]}\n");
+  return std::fclose(f) == 0;
+#else
+  (void)Path;
+  return false;
+#endif
+}
+} // namespace task_trace
+
+namespace tmc::detail {
+// The wrapped awaitable is awaited directly by traced_awaitable, and restores
+// its own executor and priority, so the wrapper is awaited as-is. It is only
+// known if the wrapped awaitable is.
+template <typename Awaitable>
+  requires(is_known_awaitable<std::remove_cvref_t<Awaitable>>)
+struct awaitable_traits<task_trace::detail::traced_awaitable<Awaitable>> {
+  using result_type =
+    typename awaitable_traits<std::remove_cvref_t<Awaitable>>::result_type;
+  using self_type = task_trace::detail::traced_awaitable<Awaitable>;
+
+  static decltype(auto) get_awaiter(self_type& awaitable) noexcept {
+    return awaitable;
+  }
+  static decltype(auto) get_awaiter(self_type&& awaitable) noexcept {
+    return static_cast<self_type&&>(awaitable);
+  }
+
+  static constexpr configure_mode mode = WRAPPER;
+};
+} // namespace tmc::detail
@@ -0,0 +1,517 @@
+#pragma once
+/// A timer service based on a hierarchical timing wheel, driven by a single
+/// background thread. It is an alternative to asio::steady_timer when there
+/// are a very large number of outstanding timers.
+///
+/// Usage:
+/// - `co_await timer_wheel::sleep_for(duration)` or
+///   `co_await timer_wheel::sleep_until(time_point)` to suspend the current
+///   task. It resumes on its original executor after the deadline.
+/// - To cancel a wait, keep the timer as an lvalue and pass it to
+///   tmc::cancellable(). This allows it to be used with tmc::select():
+///     auto t = timer_wheel::sleep_for(100ms);
+///     co_await tmc::select(tmc::cancellable(op, ...), tmc::cancellable(t, t));
+/// - Or, construct a timer_wheel::timer and call wait() to get an awaitable
+///   that refers to it, similar to asio::steady_timer::async_wait(). Unlike
+///   sleep_for(), timer is movable until it is awaited, so it can be stored in
+///   a vector.
+///
+/// A cancelled timer resumes its awaiter as if it had expired. There is no
+/// separate result; use the index of the tmc::select() result to determine
+/// which operation completed first.
+///
+/// Each timer is an intrusive node, so a pending timer requires no allocation
+/// beyond the coroutine frame that contains it, and occupies less than 100
+/// bytes in that frame. Timers are submitted and cancelled via lock-free
+/// inboxes, and only the driver thread accesses the wheel itself.
+///
+/// Deadlines are rounded up to the tick duration (1ms by default), so a timer
+/// may fire up to 1 tick late (plus the time to post the continuation back to
+/// its executor). While any timer is pending, the driver thread wakes once per
+/// tick. While no timers are pending, it sleeps until a new one is submitted.
+///
+/// A timer must not be destroyed while it is pending. Timers that are still
+/// pending when the service is destroyed are never resumed.
+
+#include "tmc/current.hpp"
+#include "tmc/detail/awaitable_customizer.hpp"
+#include "tmc/detail/concepts_awaitable.hpp" // for awaitable_traits
+
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+
+namespace timer_wheel {
+using clock = std::chrono::steady_clock;
+
+class service;
+class timer;
+
+namespace detail {
+// Each level of the wheel has 2^LEVEL_BITS slots. A timer is placed in the
+// lowest level that can represent its distance from the current tick, and
+// cascades down to lower levels as the current tick approaches it.
+inline constexpr size_t LEVEL_BITS = 8;
+inline constexpr size_t LEVEL_SIZE = size_t{1} << LEVEL_BITS;
+inline constexpr size_t LEVEL_COUNT = 4;
+
+enum state : uint32_t {
+  IDLE,            // not yet awaited
+  SUBMITTED,       // in the submit inbox, not yet seen by the driver
+  PENDING,         // in the wheel
+  CANCELLING,      // in the wheel and the cancel inbox
+  CANCELLED_EARLY, // cancelled before it was placed in the wheel
+  DONE
+};
+
+struct node {
+  node* next = nullptr;
+  node** pprev = nullptr;
+  node* inbox_next = nullptr;
+  service* svc;
+  clock::time_point deadline;
+  std::atomic<uint32_t> state{IDLE};
+  tmc::detail::awaitable_customizer<void> customizer;
+
+  node(service* Svc, clock::time_point Deadline) : svc(Svc), deadline(Deadline) {
+    if (tmc::current_executor() == nullptr) {
+      customizer.flags = 0;
+    }
+  }
+
+  void resume() {
+    auto cont = customizer.resume_continuation();
+    if (cont != std::noop_coroutine()) {
+      cont.resume();
+    }
+  }
+};
+
+// Multi-producer, single-consumer intrusive stack.
+class inbox {
+  std::atomic<node*> head{nullptr};
+
+public:
+  void push(node* Node) {
+    node* h = head.load(std::memory_order_relaxed);
+    do {
+      Node->inbox_next = h;
+    } while (!head.compare_exchange_weak(
+      h, Node, std::memory_order_seq_cst, std::memory_order_relaxed
+    ));
+  }
+
+  node* take_all() { return head.exchange(nullptr, std::memory_order_acquire); }
+
+  bool empty() const { return head.load(std::memory_order_seq_cst) == nullptr; }
+};
+} // namespace detail
+
+class service {
+  friend class timer;
+
+  const clock::time_point start;
+  const clock::duration tick;
+
+  detail::inbox submitted;
+  detail::inbox cancelled;
+
+  std::mutex mutex;
+  std::condition_variable cv;
+  std::atomic<bool> idle{false};
+  bool stop = false;
+
+  // Driver-only data
+  detail::node* slots[detail::LEVEL_COUNT][detail::LEVEL_SIZE] = {};
+  uint64_t current_tick = 0;
+  size_t pending_count = 0;
+
+  std::thread driver;
+
+  uint64_t expiry_tick(clock::time_point Deadline) const {
+    if (Deadline <= start) {
+      return 0;
+    }
+    // Round up so that a timer never fires before its deadline.
+    auto since = Deadline - start;
+    return static_cast<uint64_t>((since + tick - clock::duration{1}) / tick);
+  }
+
+  uint64_t elapsed_ticks(clock::time_point Now) const {
+    return Now <= start ? 0 : static_cast<uint64_t>((Now - start) / tick);
+  }
+
+  void wake_if_idle() {
+    if (idle.load(std::memory_order_seq_cst)) {
+      { std::lock_guard<std::mutex> lg{mutex}; }
+      cv.notify_one();
+    }
+  }
+
+  void submit(detail::node* Node) {
+    submitted.push(Node);
+    wake_if_idle();
+  }
+
+  void cancel(detail::node* Node) {
+    cancelled.push(Node);
+    wake_if_idle();
+  }
+
+  static void link(detail::node*& Head, detail::node* Node) {
+    Node->next = Head;
+    Node->pprev = &Head;
+    if (Head != nullptr) {
+      Head->pprev = &Node->next;
+    }
+    Head = Node;
+  }
+
+  static void unlink(detail::node* Node) {
+    *Node->pprev = Node->next;
+    if (Node->next != nullptr) {
+      Node->next->pprev = Node->pprev;
+    }
+    Node->next = nullptr;
+    Node->pprev = nullptr;
+  }
+
+  // Called when a node leaves the wheel because its deadline was reached.
+  void expire(detail::node* Node) {
+    --pending_count;
+    uint32_t expected = detail::PENDING;
+    if (Node->state.compare_exchange_strong(
+          expected, detail::DONE, std::memory_order_acq_rel
+        )) {
+      Node->resume();
+    }
+    // Otherwise it is CANCELLING, and will be resumed when the cancel inbox
+    // is processed.
+  }
+
+  // Put a node into the appropriate slot, or expire it immediately.
+  void place(detail::node* Node) {
+    uint64_t when = expiry_tick(Node->deadline);
+    if (when <= current_tick) {
+      expire(Node);
+      return;
+    }
+    uint64_t delta = when - current_tick;
+    for (size_t level = 0; level < detail::LEVEL_COUNT; ++level) {
+      size_t shift = level * detail::LEVEL_BITS;
+      if (delta < (uint64_t{1} << (shift + detail::LEVEL_BITS))) {
+        link(slots[level][(when >> shift) & (detail::LEVEL_SIZE - 1)], Node);
+        return;
+      }
+    }
+    // Further out than the wheel can represent. Put it in the slot of the top
+    // level that will be visited last; it will be placed again from there.
+    size_t shift = (detail::LEVEL_COUNT - 1) * detail::LEVEL_BITS;
+    link(
+      slots[detail::LEVEL_COUNT - 1]
+           [((current_tick >> shift) - 1) & (detail::LEVEL_SIZE - 1)],
+      Node
+    );
+  }
+
+  void process_inboxes() {
+    // A node only enters the cancel inbox after the driver has moved it to
+    // PENDING and placed it in the wheel.
+    for (auto n = submitted.take_all(); n != nullptr;) {
+      auto next = n->inbox_next;
+      uint32_t expected = detail::SUBMITTED;
+      if (n->state.compare_exchange_strong(
+            expected, detail::PENDING, std::memory_order_acq_rel
+          )) {
+        ++pending_count;
+        place(n);
+      } else {
+        // CANCELLED_EARLY
+        n->state.store(detail::DONE, std::memory_order_relaxed);
+        n->resume();
+      }
+      n = next;
+    }
+    for (auto n = cancelled.take_all(); n != nullptr;) {
+      auto next = n->inbox_next;
+      if (n->pprev != nullptr) {
+        unlink(n);
+        --pending_count;
+      }
+      n->state.store(detail::DONE, std::memory_order_relaxed);
+      n->resume();
+      n = next;
+    }
+  }
+
+  void cascade(size_t Level, size_t Index) {
+    detail::node* n = slots[Level][Index];
+    slots[Level][Index] = nullptr;
+    while (n != nullptr) {
+      auto next = n->next;
+      n->next = nullptr;
+      n->pprev = nullptr;
+      place(n);
+      n = next;
+    }
+  }
+
+  void advance() {
+    ++current_tick;
+    for (size_t level = 1; level < detail::LEVEL_COUNT; ++level) {
+      size_t shift = level * detail::LEVEL_BITS;
+      if ((current_tick & ((uint64_t{1} << shift) - 1)) != 0) {
+        break;
+      }
+      cascade(level, (current_tick >> shift) & (detail::LEVEL_SIZE - 1));
+    }
+    auto& slot = slots[0][current_tick & (detail::LEVEL_SIZE - 1)];
+    detail::node* n = slot;
+    slot = nullptr;
+    while (n != nullptr) {
+      // Read next before resuming, as that may destroy the node.
+      auto next = n->next;
+      n->next = nullptr;
+      n->pprev = nullptr;
+      expire(n);
+      n = next;
+    }
+  }
+
+  void run() {
+    while (true) {
+      process_inboxes();
+      uint64_t target = elapsed_ticks(clock::now());
+      while (current_tick < target) {
+        advance();
+      }
+
+      std::unique_lock<std::mutex> lock{mutex};
+      if (stop) {
+        return;
+      }
+      if (pending_count == 0) {
+        idle.store(true, std::memory_order_seq_cst);
+        cv.wait(lock, [this]() {
+          return stop || !submitted.empty() || !cancelled.empty();
+        });
+        idle.store(false, std::memory_order_relaxed);
+      } else {
+        cv.wait_until(lock, start + tick * static_cast<int64_t>(current_tick + 1));
+      }
+    }
+  }
+
+public:
+  explicit service(clock::duration Tick = std::chrono::milliseconds(1))
+      : start(clock::now()), tick(Tick) {
+    driver = std::thread([this]() { run(); });
+  }
+
+  service(const service&) = delete;
+  service& operator=(const service&) = delete;
+
+  ~service() {
+    {
+      std::lock_guard<std::mutex> lg{mutex};
+      stop = true;
+    }
+    cv.notify_one();
+    driver.join();
+  }
+
+  clock::duration tick_duration() const { return tick; }
+};
+
+/// Returns the process-wide timer service, starting it on first use.
+inline service& default_service() {
+  static service svc;
+  return svc;
+}
+
+class aw_timer;
+
+/// A single-use timer that can be awaited via wait(), and cancelled via
+/// cancel(). It is movable until wait() is called.
+class timer : private detail::node {
+public:
+  // Exposed for awaitable_traits.
+  using detail::node::customizer;
+
+  explicit timer(clock::time_point Deadline, service& Service = default_service())
+      : detail::node(&Service, Deadline) {}
+
+  template <typename Rep, typename Period>
+  explicit timer(
+    std::chrono::duration<Rep, Period> Duration,
+    service& Service = default_service()
+  )
+      : detail::node(
+          &Service,
+          clock::now() + std::chrono::ceil<clock::duration>(Duration)
+        ) {}
+
+  timer(timer&& Other) noexcept : detail::node(Other.svc, Other.deadline) {
+    assert(Other.state.load(std::memory_order_relaxed) == detail::IDLE);
+    customizer = Other.customizer;
+  }
+
+  timer& operator=(timer&&) = delete;
+  timer(const timer&) = delete;
+  timer& operator=(const timer&) = delete;
+
+  /// Submit this timer to the service. Called by the awaitable.
+  void async_initiate() {
+    uint32_t expected = detail::IDLE;
+    if (state.compare_exchange_strong(
+          expected, detail::SUBMITTED, std::memory_order_acq_rel
+        )) {
+      svc->submit(this);
+    } else {
+      // cancel() was called before this was awaited.
+      state.store(detail::DONE, std::memory_order_relaxed);
+      resume();
+    }
+  }
+
+  /// Cause the awaiter to resume as soon as possible. Safe to call from any
+  /// thread, at any time before the timer is destroyed. Has no effect if the
+  /// timer already expired.
+  void cancel() {
+    uint32_t s = state.load(std::memory_order_acquire);
+    while (true) {
+      switch (s) {
+      case detail::IDLE:
+      case detail::SUBMITTED:
+        if (state.compare_exchange_weak(
+              s, detail::CANCELLED_EARLY, std::memory_order_acq_rel
+            )) {
+          return;
+        }
+        break;
+      case detail::PENDING:
+        if (state.compare_exchange_weak(
+              s, detail::CANCELLING, std::memory_order_acq_rel
+            )) {
+          svc->cancel(this);
+          return;
+        }
+        break;
+      default:
+        return;
+      }
+    }
+  }
+
+  clock::time_point expiry() const { return deadline; }
+
+  /// Returns an awaitable that refers to this timer.
+  aw_timer wait() TMC_LIFETIMEBOUND;
+
+  // Allows a timer prvalue (such as the result of sleep_for()) to be awaited
+  // directly.
+  bool await_ready() const noexcept {
+    return state.load(std::memory_order_relaxed) == detail::DONE;
+  }
+  void await_suspend(std::coroutine_handle<> Outer) noexcept {
+    customizer.continuation = Outer.address();
+    async_initiate();
+  }
+  void await_resume() const noexcept {}
+};
+
+/// A lightweight awaitable referring to a timer, returned by timer::wait().
+class [[nodiscard]] aw_timer {
+  timer* t;
+
+public:
+  explicit aw_timer(timer& Timer TMC_LIFETIMEBOUND) : t(&Timer) {}
+
+  timer& get_timer() { return *t; }
+
+  bool await_ready() const noexcept { return t->await_ready(); }
+  void await_suspend(std::coroutine_handle<> Outer) noexcept {
+    t->await_suspend(Outer);
+  }
+  void await_resume() const noexcept {}
+};
+
+inline aw_timer timer::wait() { return aw_timer(*this); }
+
+/// Returns a timer that expires after Duration. Await it directly.
+template <typename Rep, typename Period>
+[[nodiscard]] timer sleep_for(
+  std::chrono::duration<Rep, Period> Duration,
+  service& Service = default_service()
+) {
+  return timer(Duration, Service);
+}
+
+/// Returns a timer that expires at Deadline. Await it directly.
+[[nodiscard]] inline timer
+sleep_until(clock::time_point Deadline, service& Service = default_service()) {
+  return timer(Deadline, Service);
+}
+} // namespace timer_wheel
+
+// Implementation of tmc::detail::awaitable_traits which allows timers to be
+// used with tmc::spawn*(), tmc::cancellable() and tmc::select().
+namespace tmc::detail {
+template <typename T>
+concept IsTimerWheelAwaitable =
+  std::is_same_v<T, timer_wheel::timer> || std::is_same_v<T, timer_wheel::aw_timer>;
+
+template <IsTimerWheelAwaitable Awaitable> struct awaitable_traits<Awaitable> {
+  using result_type = void;
+  using self_type = Awaitable;
+
+  static timer_wheel::timer& get_timer(self_type& awaitable) {
+    if constexpr (std::is_same_v<self_type, timer_wheel::timer>) {
+      return awaitable;
+    } else {
+      return awaitable.get_timer();
+    }
+  }
+
+  static decltype(auto) get_awaiter(self_type& awaitable) noexcept {
+    return awaitable;
+  }
+  static decltype(auto) get_awaiter(self_type&& awaitable) noexcept {
+    return static_cast<self_type&>(awaitable);
+  }
+
+  static constexpr configure_mode mode = ASYNC_INITIATE;
+  static void async_initiate(
+    self_type& awaitable, [[maybe_unused]] tmc::ex_any* Executor,
+    [[maybe_unused]] size_t Priority
+  ) {
+    get_timer(awaitable).async_initiate();
+  }
+  static void async_initiate(
+    self_type&& awaitable, [[maybe_unused]] tmc::ex_any* Executor,
+    [[maybe_unused]] size_t Priority
+  ) {
+    get_timer(awaitable).async_initiate();
+  }
+
+  static void set_continuation(self_type& awaitable, void* Continuation) {
+    get_timer(awaitable).customizer.continuation = Continuation;
+  }
+  static void set_continuation_executor(self_type& awaitable, void* ContExec) {
+    get_timer(awaitable).customizer.continuation_executor = ContExec;
+  }
+  static void set_done_count(self_type& awaitable, void* DoneCount) {
+    get_timer(awaitable).customizer.done_count = DoneCount;
+  }
+  static void set_flags(self_type& awaitable, size_t Flags) {
+    get_timer(awaitable).customizer.flags = Flags;
+  }
+};
+} // namespace tmc::detail
@@ -0,0 +1,211 @@
+#pragma once
+/// Histograms of how long coroutines stay suspended on synchronization
+/// primitives and executors.
+///
+/// Usage: wrap an awaitable with wait_stats::timed(), passing the kind of
+/// primitive that it waits on, and co_await the result immediately:
+///
+///   auto scope = co_await wait_stats::timed(
+///     wait_stats::kind::MUTEX, mut.lock_scope()
+///   );
+///
+/// If the awaitable suspends, the time from await_suspend() until the
+/// coroutine resumes is recorded in a histogram that belongs to the calling
+/// thread (util/latency_histogram.hpp), keyed by kind. An await that completes
+/// without suspending is not recorded. Call dump_wait_histograms() to print
+/// the histograms of all threads, merged per kind.
+///
+/// Each thread's histograms are allocated the first time it records a value,
+/// and are never freed, so they can be read after the thread has exited.
+/// merged(), dump_wait_histograms() and reset() read other threads'
+/// histograms without synchronization, so they should be called while no
+/// instrumented awaits are running.
+///
+/// Everything is compiled out unless TMC_ENABLE_WAIT_HISTOGRAMS is defined
+/// (see the CMake option of the same name). When disabled, timed() returns
+/// its argument unchanged and the histograms are always empty.
+
+#include "get_awaiter.hpp"
+#include "latency_histogram.hpp"
+#include "tmc/detail/concepts_awaitable.hpp"
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <type_traits>
+#include <utility>
+
+namespace wait_stats {
+enum class kind : size_t {
+  MUTEX,
+  SEMAPHORE,
+  RW_LOCK,
+  CHANNEL,
+  BRAID,
+  EXECUTOR,
+  COUNT
+};
+
+inline constexpr std::array<const char*, static_cast<size_t>(kind::COUNT)> KIND_NAMES{
+  "mutex", "semaphore", "rw_lock", "channel", "ex_braid", "executor"
+};
+
+inline constexpr bool ENABLED =
+#ifdef TMC_ENABLE_WAIT_HISTOGRAMS
+  true;
+#else
+  false;
+#endif
+
+namespace detail {
+struct thread_histograms {
+  std::array<latency_histogram, static_cast<size_t>(kind::COUNT)> kinds;
+  thread_histograms* next_registered = nullptr;
+};
+
+inline std::atomic<thread_histograms*> registry{nullptr};
+inline thread_local thread_histograms* this_thread_histograms = nullptr;
+
+inline thread_histograms& get_thread_histograms() {
+  auto h = this_thread_histograms;
+  if (h == nullptr) [[unlikely]] {
+    h = new thread_histograms;
+    auto head = registry.load(std::memory_order_relaxed);
+    do {
+      h->next_registered = head;
+    } while (!registry.compare_exchange_weak(
+      head, h, std::memory_order_release, std::memory_order_relaxed
+    ));
+    this_thread_histograms = h;
+  }
+  return *h;
+}
+
+inline int64_t now_ns() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+           std::chrono::steady_clock::now().time_since_epoch()
+  )
+    .count();
+}
+
+// Forwards to the awaiter of Awaitable, and times the suspension. The
+// awaitable is held by reference, so this must be awaited in the same
+// full-expression that created it. If Awaitable is known to TMC, so is this
+// (see the awaitable_traits specialization below), so awaiting it from a
+// tmc::task doesn't add a wrapper task.
+template <typename Awaitable> class timed_awaitable {
+  using awaiter_type = decltype(get_awaiter(std::declval<Awaitable&&>()));
+
+  awaiter_type awaiter;
+  kind which;
+  int64_t suspended_at = -1;
+
+public:
+  timed_awaitable(kind Kind, Awaitable&& Aw)
+      : awaiter(get_awaiter(std::forward<Awaitable>(Aw))), which(Kind) {}
+
+  timed_awaitable(const timed_awaitable&) = delete;
+  timed_awaitable& operator=(const timed_awaitable&) = delete;
+
+  bool await_ready() { return awaiter.await_ready(); }
+
+  template <typename Promise>
+  auto await_suspend(std::coroutine_handle<Promise> Outer) {
+    suspended_at = now_ns();
+    using result_type = decltype(awaiter.await_suspend(Outer));
+    if constexpr (std::is_same_v<result_type, bool>) {
+      bool suspended = awaiter.await_suspend(Outer);
+      if (!suspended) {
+        suspended_at = -1;
+      }
+      return suspended;
+    } else {
+      return awaiter.await_suspend(Outer);
+    }
+  }
+
+  decltype(auto) await_resume() {
+    if (suspended_at >= 0) {
+      get_thread_histograms().kinds[static_cast<size_t>(which)].record(
+        static_cast<uint64_t>(now_ns() - suspended_at)
+      );
+    }
+    return awaiter.await_resume();
+  }
+};
+} // namespace detail
+
+/// Times the suspension of Aw, if TMC_ENABLE_WAIT_HISTOGRAMS is defined.
+/// The result must be awaited immediately.
+template <typename Awaitable> decltype(auto) timed(kind Kind, Awaitable&& Aw) {
+#ifdef TMC_ENABLE_WAIT_HISTOGRAMS
+  return detail::timed_awaitable<Awaitable>(Kind, std::forward<Awaitable>(Aw));
+#else
+  (void)Kind;
+  return std::forward<Awaitable>(Aw);
+#endif
+}
+
+/// Returns the histograms of all threads for Kind, merged.
+inline latency_histogram merged(kind Kind) {
+  latency_histogram result;
+  for (auto h = detail::registry.load(std::memory_order_acquire); h != nullptr;
+       h = h->next_registered) {
+    result.merge(h->kinds[static_cast<size_t>(Kind)]);
+  }
+  return result;
+}
+
+/// Clears the histograms of all threads.
+inline void reset() {
+  for (auto h = detail::registry.load(std::memory_order_acquire); h != nullptr;
+       h = h->next_registered) {
+    for (auto& k : h->kinds) {
+      k.reset();
+    }
+  }
+}
+
+/// Prints a line of percentiles (in microseconds) for each kind that has
+/// recorded any waits.
+inline void dump_wait_histograms() {
+#ifdef TMC_ENABLE_WAIT_HISTOGRAMS
+  for (size_t i = 0; i < static_cast<size_t>(kind::COUNT); ++i) {
+    auto h = merged(static_cast<kind>(i));
+    if (h.count() != 0) {
+      h.print(KIND_NAMES[i]);
+    }
+  }
+#else
+  std::printf(
+    "wait histograms disabled (configure with -DTMC_ENABLE_WAIT_HISTOGRAMS=ON)\n"
+  );
+#endif
+}
+} // namespace wait_stats
+
+namespace tmc::detail {
+// The wrapped awaitable is awaited directly by timed_awaitable, and restores
+// its own executor and priority, so the wrapper is awaited as-is. It is only
+// known if the wrapped awaitable is.
+template <typename Awaitable>
+  requires(is_known_awaitable<std::remove_cvref_t<Awaitable>>)
+struct awaitable_traits<wait_stats::detail::timed_awaitable<Awaitable>> {
+  using result_type =
+    typename awaitable_traits<std::remove_cvref_t<Awaitable>>::result_type;
+  using self_type = wait_stats::detail::timed_awaitable<Awaitable>;
+
+  static decltype(auto) get_awaiter(self_type& awaitable) noexcept {
+    return awaitable;
+  }
+  static decltype(auto) get_awaiter(self_type&& awaitable) noexcept {
+    return static_cast<self_type&&>(awaitable);
+  }
+
+  static constexpr configure_mode mode = WRAPPER;
+};
+} // namespace tmc::detail
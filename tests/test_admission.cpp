@@ -0,0 +1,111 @@
+// Tests for admission::controller (examples/util/admission.hpp).
+
+#include "../examples/util/admission.hpp"
+#include "test_common.hpp"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#define CATEGORY test_admission
+
+namespace {
+
+class CATEGORY : public testing::Test {
+protected:
+  static void SetUpTestSuite() { tmc::cpu_executor().set_thread_count(4).init(); }
+
+  static void TearDownTestSuite() { tmc::cpu_executor().teardown(); }
+
+  static tmc::ex_cpu& ex() { return tmc::cpu_executor(); }
+};
+
+TEST_F(CATEGORY, rejects_when_full) {
+  admission::controller ctl;
+  ctl.set_max_queued(2);
+  auto a = ctl.arrive();
+  auto b = ctl.arrive();
+  auto c = ctl.arrive();
+  EXPECT_TRUE(a);
+  EXPECT_TRUE(b);
+  EXPECT_FALSE(c);
+  EXPECT_EQ(ctl.queued(), 2);
+  EXPECT_EQ(ctl.rejected(), 1);
+  a.release();
+  EXPECT_FALSE(a);
+  EXPECT_EQ(ctl.queued(), 1);
+  auto d = ctl.arrive();
+  EXPECT_TRUE(d);
+}
+
+// Work is only shed after the delay stays above the target for an interval,
+// and only if its own delay is long.
+TEST_F(CATEGORY, sheds_when_overloaded) {
+  test_async_main(ex(), []() -> tmc::task<void> {
+    using std::chrono::milliseconds;
+    admission::controller ctl;
+    ctl.set_target(milliseconds(1)).set_interval(milliseconds(50));
+    auto t1 = ctl.arrive();
+    auto t2 = ctl.arrive();
+    auto t3 = ctl.arrive();
+    auto t4 = ctl.arrive();
+    std::this_thread::sleep_for(milliseconds(5));
+    EXPECT_TRUE(co_await t1.enter());
+    EXPECT_TRUE(co_await t2.enter());
+    EXPECT_FALSE(ctl.overloaded());
+    EXPECT_EQ(ctl.running(), 2);
+
+    std::this_thread::sleep_for(milliseconds(60));
+    EXPECT_FALSE(co_await t3.enter());
+    EXPECT_FALSE(t3);
+    EXPECT_TRUE(ctl.overloaded());
+    EXPECT_EQ(ctl.shed(), 1);
+    EXPECT_GE(ctl.delay_percentile(50.0), 5000000);
+
+    // New work with a short delay is admitted while overloaded.
+    auto t5 = ctl.arrive();
+    EXPECT_TRUE(co_await t5.enter());
+
+    // After an idle interval, the controller is no longer overloaded.
+    std::this_thread::sleep_for(milliseconds(120));
+    EXPECT_TRUE(co_await t4.enter());
+    EXPECT_FALSE(ctl.overloaded());
+    EXPECT_EQ(ctl.queued(), 0);
+    EXPECT_EQ(ctl.running(), 4);
+  }());
+}
+
+TEST_F(CATEGORY, defers_when_running) {
+  test_async_main(ex(), []() -> tmc::task<void> {
+    admission::controller ctl;
+    ctl.set_max_running(1);
+    auto a = ctl.arrive();
+    EXPECT_TRUE(co_await a.enter());
+    auto b = ctl.arrive();
+    std::atomic<bool> entered{false};
+    auto t =
+      tmc::spawn(
+        [](admission::ticket& B, std::atomic<bool>& Entered) -> tmc::task<void> {
+          EXPECT_TRUE(co_await B.enter());
+          Entered.store(true);
+        }(b, entered)
+      )
+        .fork();
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    EXPECT_FALSE(entered.load());
+    EXPECT_EQ(ctl.queued(), 1);
+    EXPECT_EQ(ctl.running(), 1);
+    a.release();
+    co_await std::move(t);
+    EXPECT_TRUE(entered.load());
+    EXPECT_EQ(ctl.queued(), 0);
+    EXPECT_EQ(ctl.running(), 1);
+    b.release();
+    EXPECT_EQ(ctl.running(), 0);
+  }());
+}
+} // namespace
+
+#undef CATEGORY
@@ -0,0 +1,185 @@
+// Tests for bounded_channel (examples/util/bounded_channel.hpp).
+
+#include "../examples/util/bounded_channel.hpp"
+#include "test_common.hpp"
+
+#include <gtest/gtest.h>
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <thread>
+
+#define CATEGORY test_bounded_channel
+
+namespace {
+
+class CATEGORY : public testing::Test {
+protected:
+  static void SetUpTestSuite() { tmc::cpu_executor().init(); }
+
+  static void TearDownTestSuite() { tmc::cpu_executor().teardown(); }
+
+  static tmc::ex_cpu& ex() { return tmc::cpu_executor(); }
+};
+
+TEST_F(CATEGORY, capacity) {
+  EXPECT_EQ(make_bounded_channel<size_t>(0).capacity(), 2);
+  EXPECT_EQ(make_bounded_channel<size_t>(2).capacity(), 2);
+  EXPECT_EQ(make_bounded_channel<size_t>(5).capacity(), 8);
+  EXPECT_EQ(make_bounded_channel<size_t>(64).capacity(), 64);
+}
+
+TEST_F(CATEGORY, try_push_try_pull) {
+  auto chan = make_bounded_channel<size_t>(4);
+  for (size_t i = 0; i < 4; ++i) {
+    EXPECT_TRUE(chan.try_push(i));
+  }
+  size_t v = 4;
+  EXPECT_FALSE(chan.try_push(v));
+  for (size_t i = 0; i < 4; ++i) {
+    auto r = chan.try_pull();
+    EXPECT_TRUE(r.has_value());
+    EXPECT_EQ(r.value(), i);
+  }
+  EXPECT_FALSE(chan.try_pull().has_value());
+
+  // Wrap around the ring a few times.
+  for (size_t i = 0; i < 10; ++i) {
+    EXPECT_TRUE(chan.try_push(i));
+    EXPECT_EQ(chan.try_pull().value(), i);
+  }
+
+  chan.close();
+  EXPECT_FALSE(chan.try_push(v));
+}
+
+TEST_F(CATEGORY, mpmc) {
+  test_async_main(ex(), []() -> tmc::task<void> {
+    static constexpr size_t NPRODUCERS = 4;
+    static constexpr size_t NCONSUMERS = 4;
+    static constexpr size_t NITEMS = 10000;
+    struct result {
+      size_t count;
+      size_t sum;
+    };
+
+    // A small capacity forces producers and consumers to wait on each other.
+    auto chan = make_bounded_channel<size_t>(2);
+    std::array<tmc::task<void>, NPRODUCERS> producers;
+    for (size_t i = 0; i < NPRODUCERS; ++i) {
+      producers[i] = [](auto Chan, size_t Base) -> tmc::task<void> {
+        for (size_t j = 0; j < NITEMS; ++j) {
+          bool ok = co_await Chan.push(Base + j);
+          EXPECT_TRUE(ok);
+        }
+      }(chan, i * NITEMS);
+    }
+    std::array<tmc::task<result>, NCONSUMERS> consumers;
+    for (size_t i = 0; i < NCONSUMERS; ++i) {
+      consumers[i] = [](auto Chan) -> tmc::task<result> {
+        result r{0, 0};
+        while (auto v = co_await Chan.pull()) {
+          ++r.count;
+          r.sum += v.value();
+        }
+        co_return r;
+      }(chan);
+    }
+    auto cons = tmc::spawn_many<NCONSUMERS>(consumers.data()).fork();
+    co_await tmc::spawn_many<NPRODUCERS>(producers.data());
+    chan.close();
+    auto results = co_await std::move(cons);
+
+    size_t count = 0;
+    size_t sum = 0;
+    for (auto& r : results) {
+      count += r.count;
+      sum += r.sum;
+    }
+    static constexpr size_t TOTAL = NPRODUCERS * NITEMS;
+    EXPECT_EQ(count, TOTAL);
+    EXPECT_EQ(sum, TOTAL * (TOTAL - 1) / 2);
+  }());
+}
+
+TEST_F(CATEGORY, close_wakes_pushers) {
+  test_async_main(ex(), []() -> tmc::task<void> {
+    auto chan = make_bounded_channel<size_t>(2);
+    EXPECT_TRUE(co_await chan.push(0));
+    EXPECT_TRUE(co_await chan.push(1));
+    auto prod = tmc::spawn([](auto Chan) -> tmc::task<bool> {
+                  co_return co_await Chan.push(2);
+                }(chan))
+                  .fork();
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    chan.close();
+    EXPECT_FALSE(co_await std::move(prod));
+
+    // Elements that were pushed before close() can still be pulled.
+    EXPECT_EQ((co_await chan.pull()).value(), 0);
+    EXPECT_EQ((co_await chan.pull()).value(), 1);
+    EXPECT_FALSE((co_await chan.pull()).has_value());
+    EXPECT_FALSE(co_await chan.push(3));
+  }());
+}
+
+TEST_F(CATEGORY, close_wakes_pullers) {
+  test_async_main(ex(), []() -> tmc::task<void> {
+    auto chan = make_bounded_channel<size_t>(2);
+    std::array<tmc::task<void>, 5> cons;
+    for (size_t i = 0; i < 5; ++i) {
+      cons[i] = [](auto Chan) -> tmc::task<void> {
+        auto v = co_await Chan.pull();
+        EXPECT_FALSE(v.has_value());
+      }(chan);
+    }
+    auto t = tmc::spawn_many<5>(cons.data()).fork();
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    chan.close();
+    co_await std::move(t);
+  }());
+}
+
+TEST_F(CATEGORY, move_only) {
+  test_async_main(ex(), []() -> tmc::task<void> {
+    auto chan = make_bounded_channel<std::unique_ptr<size_t>>(2);
+    auto cons = tmc::spawn([](auto Chan) -> tmc::task<size_t> {
+                  size_t sum = 0;
+                  while (auto v = co_await Chan.pull()) {
+                    sum += *v.value();
+                  }
+                  co_return sum;
+                }(chan))
+                  .fork();
+    for (size_t i = 0; i < 100; ++i) {
+      co_await chan.push(std::make_unique<size_t>(i));
+    }
+    chan.close();
+    EXPECT_EQ(co_await std::move(cons), 4950);
+  }());
+}
+
+TEST_F(CATEGORY, destroy_with_data) {
+  std::atomic<size_t> count{0};
+  {
+    auto chan = make_bounded_channel<destructor_counter>(8);
+    for (size_t i = 0; i < 6; ++i) {
+      destructor_counter d{&count};
+      EXPECT_TRUE(chan.try_push(d));
+    }
+    for (size_t i = 0; i < 2; ++i) {
+      chan.try_pull();
+    }
+    EXPECT_EQ(count.load(), 2);
+  }
+  // Now chan goes out of scope; remaining data's destructors are called
+  EXPECT_EQ(count.load(), 6);
+}
+
+} // namespace
+
+#undef CATEGORY
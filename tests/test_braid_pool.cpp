@@ -0,0 +1,92 @@
+// Tests for braid_pool (examples/util/braid_pool.hpp).
+
+#include "../examples/util/braid_pool.hpp"
+#include "test_common.hpp"
+
+#include <gtest/gtest.h>
+
+#include <array>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#define CATEGORY test_braid_pool
+
+namespace {
+
+class CATEGORY : public testing::Test {
+protected:
+  static void SetUpTestSuite() { tmc::cpu_executor().set_thread_count(4).init(); }
+
+  static void TearDownTestSuite() { tmc::cpu_executor().teardown(); }
+
+  static tmc::ex_cpu& ex() { return tmc::cpu_executor(); }
+};
+
+// Sequential keys, which std::hash maps to themselves, are spread evenly.
+TEST_F(CATEGORY, spread) {
+  static constexpr size_t KEYS = 64000;
+  std::array<size_t, 64> counts{};
+  for (size_t key = 0; key < KEYS; ++key) {
+    size_t idx = braid_pool<64>::index_of(key);
+    ASSERT_LT(idx, 64);
+    ++counts[idx];
+  }
+  for (size_t c : counts) {
+    EXPECT_GT(c, KEYS / 64 / 2);
+    EXPECT_LT(c, KEYS / 64 * 2);
+  }
+  // Not a power of 2.
+  for (size_t key = 0; key < 1000; ++key) {
+    EXPECT_LT(braid_pool<10>::index_of(key), 10);
+  }
+  EXPECT_EQ(
+    braid_pool<64>::index_of(std::string("account")),
+    braid_pool<64>::index_of(std::string("account"))
+  );
+}
+
+TEST_F(CATEGORY, enter) {
+  test_async_main(ex(), []() -> tmc::task<void> {
+    braid_pool<8> pool;
+    for (size_t key = 0; key < 100; ++key) {
+      auto scope = co_await pool.enter(key);
+      EXPECT_TRUE(pool.braid_for(key).is_current());
+      co_await scope.exit();
+      EXPECT_FALSE(pool.braid_for(key).is_current());
+    }
+  }());
+}
+
+// Updates to the same key are serialized, even with more keys than braids.
+TEST_F(CATEGORY, serializes_per_key) {
+  test_async_main(ex(), []() -> tmc::task<void> {
+    static constexpr size_t KEYS = 32;
+    static constexpr size_t TASKS = 64;
+    static constexpr size_t OPS = 1000;
+    braid_pool<4> pool;
+    std::vector<size_t> values(KEYS);
+    std::vector<tmc::task<void>> tasks;
+    for (size_t t = 0; t < TASKS; ++t) {
+      tasks.push_back([](braid_pool<4>& Pool, std::vector<size_t>& Values,
+                         size_t T) -> tmc::task<void> {
+        for (size_t i = 0; i < OPS; ++i) {
+          size_t key = (T + i) % KEYS;
+          auto scope = co_await Pool.enter(key);
+          ++Values[key];
+          co_await scope.exit();
+        }
+      }(pool, values, t));
+    }
+    co_await tmc::spawn_many(tasks.begin(), tasks.size());
+    size_t total = 0;
+    for (size_t v : values) {
+      total += v;
+    }
+    EXPECT_EQ(total, TASKS * OPS);
+    EXPECT_EQ(values[0], TASKS * OPS / KEYS);
+  }());
+}
+} // namespace
+
+#undef CATEGORY
@@ -0,0 +1,93 @@
+// Tests for flat_combining::ex_braid (examples/util/combining_braid.hpp).
+
+#include "../examples/util/combining_braid.hpp"
+#include "test_common.hpp"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+#define CATEGORY test_combining_braid
+
+namespace {
+
+class CATEGORY : public testing::Test {
+protected:
+  static void SetUpTestSuite() { tmc::cpu_executor().set_thread_count(4).init(); }
+
+  static void TearDownTestSuite() { tmc::cpu_executor().teardown(); }
+
+  static tmc::ex_cpu& ex() { return tmc::cpu_executor(); }
+};
+
+static tmc::task<void> append(std::vector<size_t>& Order, size_t Value) {
+  Order.push_back(Value);
+  co_return;
+}
+
+// An item posted while the braid is idle runs before post() returns.
+TEST_F(CATEGORY, runs_inline) {
+  test_async_main(ex(), []() -> tmc::task<void> {
+    flat_combining::ex_braid br;
+    std::vector<size_t> order;
+    br.post(append(order, 0), 0);
+    EXPECT_EQ(order, (std::vector<size_t>{0}));
+    co_return;
+  }());
+}
+
+// Items posted from outside an executor run on the parent, in FIFO order,
+// including those beyond the batch size.
+TEST_F(CATEGORY, fifo_batches) {
+  static constexpr size_t COUNT = 100;
+  std::vector<size_t> order;
+  std::atomic<size_t> done = 0;
+  {
+    flat_combining::ex_braid br(ex().type_erased());
+    br.set_batch_size(3);
+    for (size_t i = 0; i < COUNT; ++i) {
+      br.post(
+        [](std::vector<size_t>& Order, size_t I,
+           std::atomic<size_t>& Done) -> tmc::task<void> {
+          Order.push_back(I);
+          ++Done;
+          co_return;
+        }(order, i, done),
+        0
+      );
+    }
+    while (done.load() != COUNT) {
+      std::this_thread::yield();
+    }
+  }
+  ASSERT_EQ(order.size(), COUNT);
+  for (size_t i = 0; i < COUNT; ++i) {
+    EXPECT_EQ(order[i], i);
+  }
+}
+
+TEST_F(CATEGORY, serializes) {
+  test_async_main(ex(), []() -> tmc::task<void> {
+    static constexpr size_t COUNT = 10000;
+    flat_combining::ex_braid br;
+    br.set_batch_size(8);
+    size_t value = 0;
+    std::vector<tmc::task<void>> tasks;
+    for (size_t i = 0; i < COUNT; ++i) {
+      tasks.push_back([](flat_combining::ex_braid& Braid, size_t& V) -> tmc::task<void> {
+        auto scope = co_await tmc::enter(Braid);
+        EXPECT_TRUE(Braid.is_current());
+        ++V;
+        co_await scope.exit();
+      }(br, value));
+    }
+    co_await tmc::spawn_many(tasks.begin(), tasks.size());
+    EXPECT_EQ(value, COUNT);
+  }());
+}
+} // namespace
+
+#undef CATEGORY
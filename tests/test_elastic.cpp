@@ -0,0 +1,125 @@
+// Tests for elastic::thread_limiter and elastic::threads_for_quota
+// (examples/util/elastic.hpp).
+
+#include "../examples/util/elastic.hpp"
+#include "test_common.hpp"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <future>
+#include <thread>
+#include <vector>
+
+#define CATEGORY test_elastic
+
+namespace {
+
+class CATEGORY : public testing::Test {
+protected:
+  static void SetUpTestSuite() { tmc::cpu_executor().set_thread_count(4).init(); }
+
+  static void TearDownTestSuite() { tmc::cpu_executor().teardown(); }
+
+  static tmc::ex_cpu& ex() { return tmc::cpu_executor(); }
+
+  static void wait_for_parked(elastic::thread_limiter& Limiter, size_t Count) {
+    while (Limiter.parked_threads() != Count) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }
+
+  // Runs Count tasks that each sleep for a while, and returns the largest
+  // number of them that ran at the same time.
+  static size_t max_concurrency(size_t Count) {
+    std::atomic<size_t> running{0};
+    std::atomic<size_t> max{0};
+    std::vector<std::future<void>> results;
+    for (size_t i = 0; i < Count; ++i) {
+      results.push_back(tmc::post_waitable(
+        ex(),
+        [](std::atomic<size_t>& Running, std::atomic<size_t>& Max)
+          -> tmc::task<void> {
+          size_t r = Running.fetch_add(1) + 1;
+          size_t m = Max.load();
+          while (r > m && !Max.compare_exchange_weak(m, r)) {
+          }
+          std::this_thread::sleep_for(std::chrono::milliseconds(10));
+          Running.fetch_sub(1);
+          co_return;
+        }(running, max),
+        0
+      ));
+    }
+    for (auto& r : results) {
+      r.wait();
+    }
+    return max.load();
+  }
+};
+
+TEST_F(CATEGORY, threads_for_quota) {
+  EXPECT_EQ(elastic::threads_for_quota(false, 0.0, 8), 8);
+  EXPECT_EQ(elastic::threads_for_quota(true, 1.5, 8), 1);
+  EXPECT_EQ(elastic::threads_for_quota(true, 0.5, 8), 1);
+  EXPECT_EQ(elastic::threads_for_quota(true, 4.0, 8), 4);
+  EXPECT_EQ(elastic::threads_for_quota(true, 16.0, 8), 8);
+}
+
+TEST_F(CATEGORY, shrink_and_grow) {
+  elastic::thread_limiter limiter(ex());
+  EXPECT_EQ(limiter.active_threads(), 4);
+
+  limiter.set_active_threads(1);
+  EXPECT_EQ(limiter.active_threads(), 1);
+  wait_for_parked(limiter, 3);
+  EXPECT_EQ(max_concurrency(8), 1);
+
+  limiter.set_active_threads(2);
+  wait_for_parked(limiter, 2);
+  EXPECT_LE(max_concurrency(8), 2);
+
+  limiter.set_active_threads(4);
+  wait_for_parked(limiter, 0);
+  EXPECT_GT(max_concurrency(8), 1);
+}
+
+TEST_F(CATEGORY, clamps) {
+  elastic::thread_limiter limiter(ex());
+  limiter.set_active_threads(0);
+  EXPECT_EQ(limiter.active_threads(), 1);
+  wait_for_parked(limiter, 3);
+  limiter.set_active_threads(100);
+  EXPECT_EQ(limiter.active_threads(), 4);
+  wait_for_parked(limiter, 0);
+}
+
+// The destructor releases parked threads.
+TEST_F(CATEGORY, destroy_while_parked) {
+  {
+    elastic::thread_limiter limiter(ex());
+    limiter.set_active_threads(2);
+    wait_for_parked(limiter, 2);
+  }
+  EXPECT_GT(max_concurrency(8), 2);
+}
+
+TEST_F(CATEGORY, quota_watcher) {
+  elastic::thread_limiter limiter(ex());
+  {
+    elastic::quota_watcher watcher(limiter, std::chrono::milliseconds(10));
+    auto quota = tmc::detail::query_container_cpu_quota();
+    EXPECT_EQ(
+      limiter.active_threads(),
+      elastic::threads_for_quota(
+        quota.is_container_limited(), static_cast<double>(quota.cpu_count), 4
+      )
+    );
+    std::this_thread::sleep_for(std::chrono::milliseconds(30));
+  }
+}
+} // namespace
+
+#undef CATEGORY
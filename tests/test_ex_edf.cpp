@@ -0,0 +1,179 @@
+// Tests for edf::ex_edf (examples/util/ex_edf.hpp).
+
+#include "../examples/util/ex_edf.hpp"
+#include "test_common.hpp"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <future>
+#include <vector>
+
+#define CATEGORY test_ex_edf
+
+namespace {
+
+class CATEGORY : public testing::Test {
+protected:
+  // Occupies the executor's only thread until the returned flag is set, so
+  // that items posted in the meantime are queued together.
+  static std::future<void> block(edf::ex_edf& Ex, std::atomic<bool>& Go) {
+    std::atomic<bool> started{false};
+    auto f = tmc::post_waitable(
+      Ex,
+      [](std::atomic<bool>& Started, std::atomic<bool>& G) -> tmc::task<void> {
+        Started.store(true);
+        while (!G.load()) {
+        }
+        co_return;
+      }(started, Go)
+    );
+    while (!started.load()) {
+    }
+    return f;
+  }
+
+  static tmc::task<void> record(std::vector<int>& Order, int Id) {
+    Order.push_back(Id);
+    co_return;
+  }
+};
+
+TEST_F(CATEGORY, deadline_order) {
+  edf::ex_edf ex;
+  ex.set_thread_count(1).init();
+  std::atomic<bool> go{false};
+  auto blocked = block(ex, go);
+  auto now = edf::clock::now();
+  std::vector<int> order;
+  std::vector<std::future<void>> results;
+  results.push_back(tmc::post_waitable(ex, record(order, 4)));
+  for (int i = 3; i >= 0; --i) {
+    results.push_back(tmc::post_waitable(
+      ex, record(order, i), edf::deadline(now + std::chrono::seconds(10 + i))
+    ));
+  }
+  results.push_back(tmc::post_waitable(ex, record(order, 5)));
+  // Same deadline as 1; runs after it.
+  results.push_back(tmc::post_waitable(
+    ex, record(order, 2), edf::deadline(now + std::chrono::seconds(11))
+  ));
+  go.store(true);
+  blocked.wait();
+  for (auto& r : results) {
+    r.wait();
+  }
+  EXPECT_EQ(order, (std::vector<int>{0, 1, 2, 2, 3, 4, 5}));
+  EXPECT_EQ(ex.missed(), 0);
+}
+
+// An item whose deadline has passed runs after the items without a deadline.
+TEST_F(CATEGORY, miss_demote) {
+  edf::ex_edf ex;
+  ex.set_thread_count(1).init();
+  std::atomic<bool> go{false};
+  auto blocked = block(ex, go);
+  auto now = edf::clock::now();
+  std::vector<int> order;
+  std::vector<std::future<void>> results;
+  results.push_back(tmc::post_waitable(
+    ex, record(order, 2), edf::deadline(now - std::chrono::milliseconds(1))
+  ));
+  results.push_back(tmc::post_waitable(
+    ex, record(order, 0), edf::deadline(now + std::chrono::seconds(10))
+  ));
+  results.push_back(tmc::post_waitable(ex, record(order, 1)));
+  go.store(true);
+  blocked.wait();
+  for (auto& r : results) {
+    r.wait();
+  }
+  EXPECT_EQ(order, (std::vector<int>{0, 1, 2}));
+  EXPECT_EQ(ex.missed(), 1);
+}
+
+TEST_F(CATEGORY, miss_run) {
+  edf::ex_edf ex;
+  ex.set_thread_count(1).set_miss_policy(edf::miss_policy::RUN).init();
+  std::atomic<bool> go{false};
+  auto blocked = block(ex, go);
+  auto now = edf::clock::now();
+  std::vector<int> order;
+  std::vector<std::future<void>> results;
+  results.push_back(tmc::post_waitable(
+    ex, record(order, 0), edf::deadline(now - std::chrono::milliseconds(1))
+  ));
+  results.push_back(tmc::post_waitable(
+    ex, record(order, 1), edf::deadline(now + std::chrono::seconds(10))
+  ));
+  results.push_back(tmc::post_waitable(ex, record(order, 2)));
+  go.store(true);
+  blocked.wait();
+  for (auto& r : results) {
+    r.wait();
+  }
+  EXPECT_EQ(order, (std::vector<int>{0, 1, 2}));
+  EXPECT_EQ(ex.missed(), 1);
+}
+
+// An item without a deadline runs after at most max_deadline_streak deadline
+// items.
+TEST_F(CATEGORY, deadline_streak) {
+  edf::ex_edf ex;
+  ex.set_thread_count(1).set_max_deadline_streak(2).init();
+  std::atomic<bool> go{false};
+  auto blocked = block(ex, go);
+  auto now = edf::clock::now();
+  std::vector<int> order;
+  std::vector<std::future<void>> results;
+  results.push_back(tmc::post_waitable(ex, record(order, 100)));
+  for (int i = 4; i >= 0; --i) {
+    results.push_back(tmc::post_waitable(
+      ex, record(order, i), edf::deadline(now + std::chrono::seconds(10 + i))
+    ));
+  }
+  go.store(true);
+  blocked.wait();
+  for (auto& r : results) {
+    r.wait();
+  }
+  EXPECT_EQ(order, (std::vector<int>{0, 1, 100, 2, 3, 4}));
+}
+
+// A task keeps its deadline after it suspends, and its children inherit it.
+TEST_F(CATEGORY, keeps_deadline) {
+  edf::ex_edf ex;
+  ex.set_thread_count(2).init();
+  size_t d = edf::deadline_in(std::chrono::seconds(10));
+  tmc::post_waitable(
+    ex,
+    [](edf::ex_edf& Ex, size_t D) -> tmc::task<void> {
+      EXPECT_TRUE(Ex.is_current());
+      EXPECT_EQ(edf::current_deadline(), D);
+      EXPECT_FALSE(edf::deadline_missed());
+      co_await tmc::yield();
+      EXPECT_EQ(edf::current_deadline(), D);
+      co_await tmc::spawn([](size_t Dl) -> tmc::task<void> {
+        EXPECT_EQ(edf::current_deadline(), Dl);
+        co_return;
+      }(D));
+    }(ex, d),
+    d
+  )
+    .wait();
+
+  tmc::post_waitable(
+    ex,
+    []() -> tmc::task<void> {
+      EXPECT_TRUE(edf::deadline_missed());
+      co_return;
+    }(),
+    edf::deadline(edf::clock::now() - std::chrono::milliseconds(1))
+  )
+    .wait();
+}
+} // namespace
+
+#undef CATEGORY
@@ -0,0 +1,244 @@
+// Tests for ex_numa (examples/util/ex_numa.hpp).
+
+#include "../examples/util/ex_numa.hpp"
+#include "test_common.hpp"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+#define CATEGORY test_ex_numa
+
+namespace {
+
+class CATEGORY : public testing::Test {
+protected:
+  static void SetUpTestSuite() { tmc::cpu_executor().init(); }
+
+  static void TearDownTestSuite() { tmc::cpu_executor().teardown(); }
+
+  static tmc::ex_cpu& ex() { return tmc::cpu_executor(); }
+};
+
+// Items finish running shortly after their result is delivered.
+static void wait_for_empty_backlog(numa::ex_numa& Ex) {
+  for (size_t n = 0; n < Ex.node_count(); ++n) {
+    while (Ex.backlog(n) != 0) {
+      std::this_thread::yield();
+    }
+  }
+}
+
+// Occupies the calling node's thread until Release is set.
+static tmc::task<void> block(std::atomic<bool>& Started, std::atomic<bool>& Release) {
+  Started.store(true);
+  while (!Release.load()) {
+    std::this_thread::yield();
+  }
+  co_return;
+}
+
+// Records the node that it ran on.
+static tmc::task<void> record_node(numa::ex_numa& Ex, std::atomic<size_t>& RanOn) {
+  RanOn.store(Ex.current_node());
+  co_return;
+}
+
+static void wait_for_node(std::atomic<size_t>& RanOn) {
+  while (RanOn.load() == numa::ex_numa::NO_NODE) {
+    std::this_thread::yield();
+  }
+}
+
+TEST_F(CATEGORY, post_waitable) {
+  numa::ex_numa ex;
+  ex.set_thread_count_per_node(2).init();
+  EXPECT_GE(ex.node_count(), 1);
+  EXPECT_EQ(ex.current_node(), numa::ex_numa::NO_NODE);
+  size_t node = tmc::post_waitable(
+                  ex,
+                  [](numa::ex_numa& Ex) -> tmc::task<size_t> {
+                    co_return Ex.current_node();
+                  }(ex),
+                  0
+  )
+                  .get();
+  EXPECT_LT(node, ex.node_count());
+  wait_for_empty_backlog(ex);
+}
+
+TEST_F(CATEGORY, post_to_node) {
+  numa::ex_numa ex;
+  ex.set_thread_count_per_node(1)
+    .set_idle_threshold(std::chrono::steady_clock::duration::max())
+    .init();
+  static constexpr size_t NITEMS = 100;
+  std::vector<std::atomic<size_t>> ranOn(ex.node_count());
+  std::atomic<size_t> done = 0;
+  for (size_t i = 0; i < NITEMS; ++i) {
+    size_t home = i % ex.node_count();
+    ex.post(
+      [](numa::ex_numa& Ex, size_t Home, std::atomic<size_t>& RanOn,
+         std::atomic<size_t>& Done) -> tmc::task<void> {
+        if (Ex.current_node() == Home) {
+          ++RanOn;
+        }
+        ++Done;
+        co_return;
+      }(ex, home, ranOn[home], done),
+      0, home
+    );
+  }
+  while (done.load() != NITEMS) {
+    std::this_thread::yield();
+  }
+  for (size_t n = 0; n < ex.node_count(); ++n) {
+    EXPECT_EQ(ranOn[n].load(), (NITEMS + ex.node_count() - 1 - n) / ex.node_count());
+  }
+  // Spilling is disabled.
+  EXPECT_EQ(ex.migrations(), 0);
+  wait_for_empty_backlog(ex);
+}
+
+// Work spills from a saturated home node to another node only after that
+// node has been idle for longer than the idle threshold.
+TEST_F(CATEGORY, spill_to_idle_node) {
+  numa::ex_numa ex;
+  ex.set_thread_count_per_node(1)
+    .set_spill_threshold(1)
+    .set_idle_threshold(std::chrono::milliseconds(200))
+    .init();
+  if (ex.node_count() < 2) {
+    GTEST_SKIP() << "System has a single NUMA node. Skipping spill test.";
+  }
+  std::atomic<bool> started{false};
+  std::atomic<bool> release{false};
+  ex.post(block(started, release), 0, 0);
+  while (!started.load()) {
+    std::this_thread::yield();
+  }
+  EXPECT_EQ(ex.backlog(0), 1);
+
+  // Node 1 has been idle since init(), but not for long enough yet.
+  std::atomic<size_t> early{numa::ex_numa::NO_NODE};
+  ex.post(record_node(ex, early), 0, 0);
+  EXPECT_EQ(ex.migrations(), 0);
+  EXPECT_EQ(ex.backlog(0), 2);
+
+  std::this_thread::sleep_for(std::chrono::milliseconds(250));
+  std::atomic<size_t> late{numa::ex_numa::NO_NODE};
+  ex.post(record_node(ex, late), 0, 0);
+  // It runs while node 0 is still blocked.
+  wait_for_node(late);
+  EXPECT_EQ(late.load(), 1);
+  EXPECT_EQ(ex.migrations(), 1);
+
+  release.store(true);
+  wait_for_node(early);
+  EXPECT_EQ(early.load(), 0);
+  wait_for_empty_backlog(ex);
+}
+
+// With an idle threshold of duration::max(), work stays on its home node even
+// while that node is saturated and the others are idle.
+TEST_F(CATEGORY, idle_threshold_max_never_spills) {
+  numa::ex_numa ex;
+  ex.set_thread_count_per_node(1)
+    .set_spill_threshold(1)
+    .set_idle_threshold(std::chrono::steady_clock::duration::max())
+    .init();
+  std::atomic<bool> started{false};
+  std::atomic<bool> release{false};
+  ex.post(block(started, release), 0, 0);
+  while (!started.load()) {
+    std::this_thread::yield();
+  }
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+  std::atomic<size_t> ranOn{numa::ex_numa::NO_NODE};
+  ex.post(record_node(ex, ranOn), 0, 0);
+  std::this_thread::sleep_for(std::chrono::milliseconds(20));
+  // Still queued behind the blocked task.
+  EXPECT_EQ(ranOn.load(), numa::ex_numa::NO_NODE);
+  EXPECT_EQ(ex.migrations(), 0);
+
+  release.store(true);
+  wait_for_node(ranOn);
+  EXPECT_EQ(ranOn.load(), 0);
+  EXPECT_EQ(ex.migrations(), 0);
+  wait_for_empty_backlog(ex);
+}
+
+// With a single node, every post goes to it, whatever its home node and
+// backlog.
+TEST_F(CATEGORY, single_node) {
+  numa::ex_numa ex;
+  ex.set_thread_count_per_node(1)
+    .set_spill_threshold(1)
+    .set_idle_threshold(std::chrono::steady_clock::duration::zero())
+    .init();
+  if (ex.node_count() != 1) {
+    GTEST_SKIP() << "System has multiple NUMA nodes. Skipping single node test.";
+  }
+  std::atomic<bool> started{false};
+  std::atomic<bool> release{false};
+  ex.post(block(started, release), 0, 0);
+  while (!started.load()) {
+    std::this_thread::yield();
+  }
+  std::atomic<size_t> noHome{numa::ex_numa::NO_NODE};
+  std::atomic<size_t> outOfRange{numa::ex_numa::NO_NODE};
+  ex.post(record_node(ex, noHome), 0);
+  ex.post(record_node(ex, outOfRange), 0, 3);
+  EXPECT_EQ(ex.backlog(0), 3);
+
+  release.store(true);
+  wait_for_node(noHome);
+  wait_for_node(outOfRange);
+  EXPECT_EQ(noHome.load(), 0);
+  EXPECT_EQ(outOfRange.load(), 0);
+  EXPECT_EQ(ex.migrations(), 0);
+  wait_for_empty_backlog(ex);
+}
+
+TEST_F(CATEGORY, resume_on) {
+  numa::ex_numa numaEx;
+  numaEx.set_thread_count_per_node(1).init();
+  test_async_main(ex(), [](numa::ex_numa& NumaEx) -> tmc::task<void> {
+    EXPECT_EQ(NumaEx.current_node(), numa::ex_numa::NO_NODE);
+    co_await tmc::resume_on(NumaEx);
+    EXPECT_LT(NumaEx.current_node(), NumaEx.node_count());
+    co_await tmc::resume_on(tmc::cpu_executor());
+    EXPECT_EQ(NumaEx.current_node(), numa::ex_numa::NO_NODE);
+  }(numaEx));
+  wait_for_empty_backlog(numaEx);
+}
+
+TEST_F(CATEGORY, spawn_stays_on_node) {
+  numa::ex_numa ex;
+  ex.set_thread_count_per_node(2).init();
+  bool sameNode = tmc::post_waitable(
+                    ex,
+                    [](numa::ex_numa& Ex) -> tmc::task<bool> {
+                      size_t parent = Ex.current_node();
+                      size_t child = co_await tmc::spawn(
+                        [](numa::ex_numa& E) -> tmc::task<size_t> {
+                          co_return E.current_node();
+                        }(Ex)
+                      );
+                      co_return parent == child;
+                    }(ex),
+                    0
+  )
+                    .get();
+  EXPECT_TRUE(sameNode);
+  wait_for_empty_backlog(ex);
+}
+
+} // namespace
+
+#undef CATEGORY
@@ -0,0 +1,181 @@
+// Tests for fair_sync::mutex and fair_sync::semaphore
+// (examples/util/fair_sync.hpp).
+
+#include "../examples/util/fair_sync.hpp"
+#include "test_common.hpp"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <cstddef>
+#include <future>
+#include <vector>
+
+#define CATEGORY test_fair_sync
+
+namespace {
+
+// A single thread, so that the order in which tasks run is deterministic.
+// contended uses its own multi-threaded executor.
+class CATEGORY : public testing::Test {
+protected:
+  static void SetUpTestSuite() { tmc::cpu_executor().set_thread_count(1).init(); }
+
+  static void TearDownTestSuite() { tmc::cpu_executor().teardown(); }
+
+  static tmc::ex_cpu& ex() { return tmc::cpu_executor(); }
+};
+
+template <typename Policy>
+static tmc::task<void>
+locker(fair_sync::mutex<Policy>& Mut, std::vector<size_t>& Order, size_t Id) {
+  auto scope = co_await Mut.lock_scope();
+  Order.push_back(Id);
+}
+
+// Holds Mut while WaiterCount tasks start waiting for it, then releases it
+// and counts how many times try_lock() succeeds before it fails, up to
+// MaxTries. Returns the number of successful try_lock() calls, and the order
+// in which the waiters acquired the lock.
+template <typename Policy>
+static tmc::task<size_t> barge(
+  fair_sync::mutex<Policy>& Mut, std::vector<size_t>& Order, size_t WaiterCount,
+  size_t MaxTries
+) {
+  EXPECT_TRUE(Mut.try_lock());
+  for (size_t i = 0; i < WaiterCount; ++i) {
+    tmc::post(tmc::cpu_executor(), locker(Mut, Order, i), 0);
+  }
+  // Lets the waiters run and wait.
+  co_await tmc::yield();
+  EXPECT_TRUE(Order.empty());
+  Mut.unlock();
+  size_t barged = 0;
+  while (barged < MaxTries && Mut.try_lock()) {
+    ++barged;
+    Mut.unlock();
+  }
+  while (Order.size() < WaiterCount) {
+    co_await tmc::yield();
+  }
+  EXPECT_FALSE(Mut.is_locked());
+  co_return barged;
+}
+
+TEST_F(CATEGORY, unfair) {
+  test_async_main(ex(), []() -> tmc::task<void> {
+    fair_sync::mutex<fair_sync::unfair> mut;
+    std::vector<size_t> order;
+    EXPECT_EQ(co_await barge(mut, order, 3, 100), 100);
+    EXPECT_EQ(order, (std::vector<size_t>{0, 1, 2}));
+  }());
+}
+
+TEST_F(CATEGORY, fifo) {
+  test_async_main(ex(), []() -> tmc::task<void> {
+    fair_sync::mutex<fair_sync::fifo> mut;
+    std::vector<size_t> order;
+    EXPECT_EQ(co_await barge(mut, order, 3, 100), 0);
+    EXPECT_EQ(order, (std::vector<size_t>{0, 1, 2}));
+  }());
+}
+
+TEST_F(CATEGORY, bounded) {
+  test_async_main(ex(), []() -> tmc::task<void> {
+    fair_sync::mutex<fair_sync::bounded<4>> mut;
+    std::vector<size_t> order;
+    EXPECT_EQ(co_await barge(mut, order, 3, 100), 4);
+    EXPECT_EQ(order, (std::vector<size_t>{0, 1, 2}));
+  }());
+}
+
+TEST_F(CATEGORY, semaphore) {
+  test_async_main(ex(), []() -> tmc::task<void> {
+    fair_sync::semaphore<fair_sync::fifo> sem(2);
+    co_await sem;
+    EXPECT_TRUE(sem.try_acquire());
+    EXPECT_FALSE(sem.try_acquire());
+
+    std::vector<size_t> order;
+    for (size_t i = 0; i < 3; ++i) {
+      tmc::post(
+        ex(),
+        [](fair_sync::semaphore<fair_sync::fifo>& Sem, std::vector<size_t>& Order,
+           size_t Id) -> tmc::task<void> {
+          co_await Sem;
+          Order.push_back(Id);
+        }(sem, order, i),
+        0
+      );
+    }
+    co_await tmc::yield();
+    EXPECT_TRUE(order.empty());
+    sem.release();
+    sem.release();
+    while (order.size() < 2) {
+      co_await tmc::yield();
+    }
+    EXPECT_EQ(order, (std::vector<size_t>{0, 1}));
+    EXPECT_EQ(sem.count_available(), 0);
+    sem.release();
+    while (order.size() < 3) {
+      co_await tmc::yield();
+    }
+    EXPECT_EQ(order, (std::vector<size_t>{0, 1, 2}));
+    sem.release();
+    sem.release();
+    sem.release();
+    EXPECT_EQ(sem.count_available(), 3);
+  }());
+}
+
+// Takes Mut Iterations times, and counts the times that another task was
+// holding it at the same time.
+template <typename Policy>
+static tmc::task<void> contend(
+  fair_sync::mutex<Policy>& Mut, std::atomic<size_t>& InSection,
+  std::atomic<size_t>& Overlaps, size_t& Total, size_t Iterations
+) {
+  for (size_t i = 0; i < Iterations; ++i) {
+    auto scope = co_await Mut.lock_scope();
+    if (InSection.fetch_add(1) != 0) {
+      Overlaps.fetch_add(1);
+    }
+    ++Total;
+    InSection.fetch_sub(1);
+  }
+}
+
+template <typename Policy> static void contend_on(tmc::ex_cpu& Ex) {
+  static constexpr size_t TASKS = 16;
+  static constexpr size_t ITERATIONS = 2000;
+  fair_sync::mutex<Policy> mut;
+  std::atomic<size_t> inSection{0};
+  std::atomic<size_t> overlaps{0};
+  size_t total = 0;
+  std::vector<std::future<void>> results;
+  for (size_t i = 0; i < TASKS; ++i) {
+    results.push_back(tmc::post_waitable(
+      Ex, contend(mut, inSection, overlaps, total, ITERATIONS)
+    ));
+  }
+  for (auto& r : results) {
+    r.wait();
+  }
+  EXPECT_EQ(overlaps.load(), 0);
+  EXPECT_EQ(total, TASKS * ITERATIONS);
+  EXPECT_FALSE(mut.is_locked());
+}
+
+// Many tasks on several threads take the lock at once. Each policy must keep
+// mutual exclusion, and must not lose a release while tasks are waiting.
+TEST_F(CATEGORY, contended) {
+  tmc::ex_cpu ex;
+  ex.set_thread_count(4).init();
+  contend_on<fair_sync::unfair>(ex);
+  contend_on<fair_sync::fifo>(ex);
+  contend_on<fair_sync::bounded<8>>(ex);
+}
+} // namespace
+
+#undef CATEGORY
@@ -0,0 +1,185 @@
+// Tests for frame_pool (examples/util/frame_pool.hpp).
+//
+// These call frame_pool::allocate() and deallocate() directly; the test
+// program doesn't install the pool as its global allocator. They cover reuse
+// within a size class, the fallback to the system allocator for large sizes,
+// cross-thread frees, and the release of a thread's cache when it exits.
+
+#include "../examples/util/frame_pool.hpp"
+
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#define CATEGORY test_frame_pool
+
+namespace {
+
+// Larger than the largest size class, including the header.
+static constexpr size_t LARGE_SIZE =
+  frame_pool::SIZE_CLASS_COUNT * frame_pool::SIZE_CLASS_GRANULARITY;
+
+static frame_pool::detail::block_header* header_of(void* Ptr) {
+  return static_cast<frame_pool::detail::block_header*>(Ptr) - 1;
+}
+
+class CATEGORY : public testing::Test {
+protected:
+  void SetUp() override {
+    if (!frame_pool::is_enabled()) {
+      GTEST_SKIP() << "FRAME_POOL disables the pool in this process";
+    }
+  }
+};
+
+TEST_F(CATEGORY, reuses_size_class) {
+  void* a = frame_pool::allocate(100);
+  ASSERT_NE(a, nullptr);
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(a) % alignof(std::max_align_t), 0);
+  EXPECT_EQ(header_of(a)->size_class, 1);
+  frame_pool::deallocate(a);
+
+  // Sizes in the same class reuse the block that was just freed.
+  void* b = frame_pool::allocate(60);
+  EXPECT_EQ(b, a);
+  void* c = frame_pool::allocate(100);
+  EXPECT_NE(c, b);
+  frame_pool::deallocate(b);
+
+  // A different class doesn't.
+  void* d = frame_pool::allocate(200);
+  EXPECT_NE(d, b);
+  EXPECT_EQ(header_of(d)->size_class, 3);
+  frame_pool::deallocate(c);
+  frame_pool::deallocate(d);
+}
+
+TEST_F(CATEGORY, counts_allocations) {
+  size_t before = frame_pool::total_allocations();
+  void* a = frame_pool::allocate(10);
+  void* b = frame_pool::allocate(LARGE_SIZE);
+  EXPECT_EQ(frame_pool::total_allocations() - before, 2);
+  frame_pool::deallocate(a);
+  frame_pool::deallocate(b);
+}
+
+// Allocations that don't fit in a size class come from the system allocator.
+TEST_F(CATEGORY, large_fallback) {
+  void* a = frame_pool::allocate(LARGE_SIZE);
+  ASSERT_NE(a, nullptr);
+  EXPECT_EQ(header_of(a)->owner, nullptr);
+  EXPECT_EQ(reinterpret_cast<uintptr_t>(a) % alignof(std::max_align_t), 0);
+  std::memset(a, 0xAB, LARGE_SIZE);
+  frame_pool::deallocate(a);
+
+  // The largest size that fits.
+  size_t maxSize = LARGE_SIZE - sizeof(frame_pool::detail::block_header);
+  void* b = frame_pool::allocate(maxSize);
+  EXPECT_NE(header_of(b)->owner, nullptr);
+  EXPECT_EQ(header_of(b)->size_class, frame_pool::SIZE_CLASS_COUNT - 1);
+  frame_pool::deallocate(b);
+}
+
+// Blocks freed by another thread are returned to the owner's remote list.
+TEST_F(CATEGORY, cross_thread_free) {
+  static constexpr size_t COUNT = frame_pool::REMOTE_BATCH_SIZE * 3 + 5;
+  std::vector<void*> blocks;
+  for (size_t i = 0; i < COUNT; ++i) {
+    blocks.push_back(frame_pool::allocate(300));
+  }
+  auto owner = header_of(blocks[0])->owner;
+  size_t sizeClass = header_of(blocks[0])->size_class;
+  EXPECT_EQ(owner, frame_pool::detail::this_thread_cache);
+  auto& remote = owner->remote[sizeClass];
+  remote.exchange(nullptr);
+
+  std::thread freer([&]() {
+    for (void* p : blocks) {
+      frame_pool::deallocate(p);
+    }
+    // Full batches have been returned already.
+    size_t returned = 0;
+    for (auto b = remote.load(); b != nullptr; b = b->next) {
+      ++returned;
+    }
+    EXPECT_EQ(returned, COUNT - COUNT % frame_pool::REMOTE_BATCH_SIZE);
+    frame_pool::flush_this_thread();
+  });
+  freer.join();
+
+  std::set<void*> returned;
+  for (auto b = remote.exchange(nullptr); b != nullptr; b = b->next) {
+    returned.insert(b);
+  }
+  EXPECT_EQ(returned.size(), COUNT);
+  for (void* p : blocks) {
+    EXPECT_TRUE(returned.count(header_of(p)));
+  }
+}
+
+// A thread that exits returns partial batches to their owners, and the next
+// thread that starts adopts its cache, including its free lists.
+TEST_F(CATEGORY, thread_exit) {
+  void* owned = frame_pool::allocate(500);
+  auto& remote = frame_pool::detail::this_thread_cache
+                   ->remote[header_of(owned)->size_class];
+  remote.exchange(nullptr);
+
+  void* freed = nullptr;
+  std::thread first([&]() {
+    freed = frame_pool::allocate(700);
+    frame_pool::deallocate(freed);
+    // Stays in a partial batch until the thread exits.
+    frame_pool::deallocate(owned);
+    EXPECT_EQ(remote.load(), nullptr);
+  });
+  first.join();
+  EXPECT_EQ(
+    static_cast<void*>(remote.exchange(nullptr)), static_cast<void*>(header_of(owned))
+  );
+
+  void* reused = nullptr;
+  std::thread second([&]() {
+    reused = frame_pool::allocate(700);
+    frame_pool::deallocate(reused);
+  });
+  second.join();
+  EXPECT_EQ(reused, freed);
+}
+
+// Values of the FRAME_POOL environment variable.
+TEST_F(CATEGORY, read_enabled) {
+  const char* prev = std::getenv("FRAME_POOL");
+  std::string saved = prev == nullptr ? "" : prev;
+#ifdef _WIN32
+  _putenv_s("FRAME_POOL", "off");
+  EXPECT_FALSE(frame_pool::detail::read_enabled());
+  _putenv_s("FRAME_POOL", "0");
+  EXPECT_FALSE(frame_pool::detail::read_enabled());
+  _putenv_s("FRAME_POOL", "on");
+  EXPECT_TRUE(frame_pool::detail::read_enabled());
+  _putenv_s("FRAME_POOL", saved.c_str());
+#else
+  setenv("FRAME_POOL", "off", 1);
+  EXPECT_FALSE(frame_pool::detail::read_enabled());
+  setenv("FRAME_POOL", "0", 1);
+  EXPECT_FALSE(frame_pool::detail::read_enabled());
+  setenv("FRAME_POOL", "on", 1);
+  EXPECT_TRUE(frame_pool::detail::read_enabled());
+  unsetenv("FRAME_POOL");
+  EXPECT_EQ(frame_pool::detail::read_enabled(), FRAME_POOL_DEFAULT_ENABLED != 0);
+  if (prev != nullptr) {
+    setenv("FRAME_POOL", saved.c_str(), 1);
+  }
+#endif
+}
+} // namespace
+
+#undef CATEGORY
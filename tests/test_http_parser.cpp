@@ -0,0 +1,207 @@
+// Tests for the HTTP/1.1 parser (examples/util/http_parser.hpp).
+
+#include "../examples/util/http_parser.hpp"
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <string_view>
+
+#define CATEGORY test_http_parser
+
+class CATEGORY : public testing::Test {};
+
+TEST_F(CATEGORY, simple_get) {
+  std::string buf = "GET /index.html HTTP/1.1\r\n"
+                    "Host: localhost\r\n"
+                    "Accept: */*\r\n"
+                    "\r\n";
+  http::request_parser parser;
+  http::request req;
+  auto r = parser.parse(buf.data(), buf.size(), req);
+  ASSERT_EQ(http::parse_status::COMPLETE, r.status);
+  EXPECT_EQ(buf.size(), r.consumed);
+  EXPECT_EQ("GET", req.method);
+  EXPECT_EQ("/index.html", req.target);
+  EXPECT_EQ(1, req.minor_version);
+  ASSERT_EQ(2u, req.header_count);
+  EXPECT_EQ("Host", req.headers[0].name);
+  EXPECT_EQ("localhost", req.headers[0].value);
+  EXPECT_EQ("*/*", req.find_header("accept"));
+  EXPECT_TRUE(req.body.empty());
+  EXPECT_TRUE(req.keep_alive);
+
+  // The parsed fields point into the buffer; nothing was copied.
+  EXPECT_EQ(buf.data(), req.method.data());
+  EXPECT_EQ(buf.data() + 4, req.target.data());
+}
+
+TEST_F(CATEGORY, keep_alive_rules) {
+  http::request_parser parser;
+  http::request req;
+
+  std::string close11 = "GET / HTTP/1.1\r\nConnection: close\r\n\r\n";
+  ASSERT_EQ(
+    http::parse_status::COMPLETE, parser.parse(close11.data(), close11.size(), req).status
+  );
+  EXPECT_FALSE(req.keep_alive);
+
+  std::string plain10 = "GET / HTTP/1.0\r\n\r\n";
+  ASSERT_EQ(
+    http::parse_status::COMPLETE, parser.parse(plain10.data(), plain10.size(), req).status
+  );
+  EXPECT_EQ(0, req.minor_version);
+  EXPECT_FALSE(req.keep_alive);
+
+  std::string keep10 = "GET / HTTP/1.0\r\nConnection: Keep-Alive\r\n\r\n";
+  ASSERT_EQ(
+    http::parse_status::COMPLETE, parser.parse(keep10.data(), keep10.size(), req).status
+  );
+  EXPECT_TRUE(req.keep_alive);
+}
+
+TEST_F(CATEGORY, pipelined_requests) {
+  std::string buf;
+  for (int i = 0; i < 20; ++i) {
+    buf += "GET /" + std::to_string(i) + " HTTP/1.1\r\nHost: x\r\n\r\n";
+  }
+  http::request_parser parser;
+  http::request req;
+  size_t offset = 0;
+  int count = 0;
+  while (true) {
+    auto r = parser.parse(buf.data() + offset, buf.size() - offset, req);
+    if (r.status != http::parse_status::COMPLETE) {
+      EXPECT_EQ(http::parse_status::INCOMPLETE, r.status);
+      break;
+    }
+    EXPECT_EQ("/" + std::to_string(count), req.target);
+    offset += r.consumed;
+    ++count;
+  }
+  EXPECT_EQ(20, count);
+  EXPECT_EQ(buf.size(), offset);
+}
+
+TEST_F(CATEGORY, byte_at_a_time) {
+  // Feed the request one byte at a time, as if each read returned 1 byte.
+  std::string buf = "POST /submit HTTP/1.1\r\n"
+                    "Host: localhost\r\n"
+                    "Content-Type: text/plain\r\n"
+                    "Content-Length: 11\r\n"
+                    "\r\n"
+                    "hello world"
+                    "GET /next HTTP/1.1\r\n\r\n";
+  size_t firstSize = buf.find("GET");
+  http::request_parser parser;
+  http::request req;
+  for (size_t len = 1; len < firstSize; ++len) {
+    auto r = parser.parse(buf.data(), len, req);
+    ASSERT_EQ(http::parse_status::INCOMPLETE, r.status) << "at length " << len;
+  }
+  auto r = parser.parse(buf.data(), firstSize, req);
+  ASSERT_EQ(http::parse_status::COMPLETE, r.status);
+  EXPECT_EQ(firstSize, r.consumed);
+  EXPECT_EQ("POST", req.method);
+  EXPECT_EQ(11u, req.content_length);
+  EXPECT_EQ("hello world", req.body);
+
+  r = parser.parse(buf.data() + firstSize, buf.size() - firstSize, req);
+  ASSERT_EQ(http::parse_status::COMPLETE, r.status);
+  EXPECT_EQ("/next", req.target);
+}
+
+// Once the headers are complete, an incomplete request reports the size that
+// it will have, so that an oversized body can be rejected before it arrives.
+TEST_F(CATEGORY, incomplete_body_reports_expected_size) {
+  std::string buf = "POST /upload HTTP/1.1\r\n"
+                    "Content-Length: 1000000\r\n"
+                    "\r\n"
+                    "partial";
+  size_t headerSize = buf.find("partial");
+  http::request_parser parser;
+  http::request req;
+  auto r = parser.parse(buf.data(), headerSize - 1, req);
+  ASSERT_EQ(http::parse_status::INCOMPLETE, r.status);
+  EXPECT_EQ(0u, r.expected);
+
+  r = parser.parse(buf.data(), buf.size(), req);
+  ASSERT_EQ(http::parse_status::INCOMPLETE, r.status);
+  EXPECT_EQ(headerSize + 1000000, r.expected);
+}
+
+TEST_F(CATEGORY, long_headers_cross_simd_chunks) {
+  std::string value(100, 'v');
+  std::string buf = "GET /long HTTP/1.1\r\n"
+                    "X-Long-Header-Name-That-Spans-Chunks: " +
+                    value + "\r\nX-Other:" + value + "\r\n\r\n";
+  http::request_parser parser;
+  http::request req;
+  auto r = parser.parse(buf.data(), buf.size(), req);
+  ASSERT_EQ(http::parse_status::COMPLETE, r.status);
+  ASSERT_EQ(2u, req.header_count);
+  EXPECT_EQ("X-Long-Header-Name-That-Spans-Chunks", req.headers[0].name);
+  EXPECT_EQ(value, req.headers[0].value);
+  EXPECT_EQ(value, req.headers[1].value);
+}
+
+TEST_F(CATEGORY, bare_lf_line_endings) {
+  std::string buf = "GET / HTTP/1.1\nHost: localhost\n\n";
+  http::request_parser parser;
+  http::request req;
+  auto r = parser.parse(buf.data(), buf.size(), req);
+  ASSERT_EQ(http::parse_status::COMPLETE, r.status);
+  EXPECT_EQ(buf.size(), r.consumed);
+  EXPECT_EQ("localhost", req.find_header("host"));
+}
+
+TEST_F(CATEGORY, malformed_requests) {
+  http::request_parser parser;
+  http::request req;
+  for (std::string bad : {
+         "GET\r\n\r\n", "GET / HTTP/2.0\r\n\r\n", "GET / HTTP/1.1\r\nNoColon\r\n\r\n",
+         "GET / HTTP/1.1\r\nContent-Length: abc\r\n\r\n",
+         "POST / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n"
+       }) {
+    auto r = parser.parse(bad.data(), bad.size(), req);
+    EXPECT_EQ(http::parse_status::BAD_MESSAGE, r.status) << bad;
+  }
+
+  std::string tooMany = "GET / HTTP/1.1\r\n";
+  for (size_t i = 0; i <= http::MAX_HEADERS; ++i) {
+    tooMany += "X-H: v\r\n";
+  }
+  tooMany += "\r\n";
+  EXPECT_EQ(
+    http::parse_status::BAD_MESSAGE,
+    parser.parse(tooMany.data(), tooMany.size(), req).status
+  );
+}
+
+TEST_F(CATEGORY, response_parser) {
+  std::string buf = "HTTP/1.1 200 OK\r\n"
+                    "Content-Length: 12\r\n"
+                    "Content-Type: text/plain; charset=utf-8\r\n"
+                    "\r\n"
+                    "Hello World!"
+                    "HTTP/1.1 404 Not Found\r\n"
+                    "Content-Length: 0\r\n"
+                    "\r\n";
+  http::response_parser parser;
+  http::response resp;
+  auto r = parser.parse(buf.data(), buf.size(), resp);
+  ASSERT_EQ(http::parse_status::COMPLETE, r.status);
+  EXPECT_EQ(200, resp.status);
+  EXPECT_EQ("OK", resp.reason);
+  EXPECT_EQ("Hello World!", resp.body);
+
+  size_t offset = r.consumed;
+  r = parser.parse(buf.data() + offset, buf.size() - offset, resp);
+  ASSERT_EQ(http::parse_status::COMPLETE, r.status);
+  EXPECT_EQ(404, resp.status);
+  EXPECT_EQ("Not Found", resp.reason);
+  EXPECT_TRUE(resp.body.empty());
+  EXPECT_EQ(buf.size(), offset + r.consumed);
+}
+
+#undef CATEGORY
@@ -0,0 +1,86 @@
+// Tests for latency_histogram (examples/util/latency_histogram.hpp).
+
+#include "../examples/util/latency_histogram.hpp"
+
+#include <gtest/gtest.h>
+
+#include <cstdint>
+
+#define CATEGORY test_latency_histogram
+
+class CATEGORY : public testing::Test {};
+
+TEST_F(CATEGORY, empty) {
+  latency_histogram h;
+  EXPECT_EQ(0u, h.count());
+  EXPECT_EQ(0u, h.percentile(50.0));
+  EXPECT_EQ(0u, h.min());
+  EXPECT_EQ(0u, h.max());
+}
+
+TEST_F(CATEGORY, small_values_are_exact) {
+  latency_histogram h;
+  for (uint64_t i = 1; i <= 20; ++i) {
+    h.record(i);
+  }
+  EXPECT_EQ(20u, h.count());
+  EXPECT_EQ(10u, h.percentile(50.0));
+  EXPECT_EQ(20u, h.percentile(99.0));
+  EXPECT_EQ(20u, h.percentile(100.0));
+  EXPECT_EQ(1u, h.percentile(0.0));
+  EXPECT_EQ(1u, h.min());
+  EXPECT_EQ(20u, h.max());
+  EXPECT_DOUBLE_EQ(10.5, h.mean());
+}
+
+TEST_F(CATEGORY, relative_error_is_bounded) {
+  for (uint64_t v : {33ull, 100ull, 1000ull, 123456ull, 987654321ull, 1ull << 40}) {
+    latency_histogram h;
+    h.record(v);
+    h.record(v * 4);
+    // p50 is the first value, rounded up to the end of its bucket.
+    uint64_t p = h.percentile(50.0);
+    EXPECT_GE(p, v);
+    EXPECT_LE(static_cast<double>(p - v), static_cast<double>(v) / 32.0) << v;
+  }
+}
+
+TEST_F(CATEGORY, percentiles_of_uniform_distribution) {
+  latency_histogram h;
+  for (uint64_t i = 1; i <= 100000; ++i) {
+    h.record(i);
+  }
+  auto near = [](uint64_t Actual, double Expected) {
+    return std::abs(static_cast<double>(Actual) - Expected) <= Expected / 32.0;
+  };
+  EXPECT_TRUE(near(h.percentile(50.0), 50000.0)) << h.percentile(50.0);
+  EXPECT_TRUE(near(h.percentile(99.0), 99000.0)) << h.percentile(99.0);
+  EXPECT_TRUE(near(h.percentile(99.9), 99900.0)) << h.percentile(99.9);
+  EXPECT_EQ(100000u, h.percentile(100.0));
+}
+
+TEST_F(CATEGORY, merge) {
+  latency_histogram a;
+  latency_histogram b;
+  for (uint64_t i = 0; i < 100; ++i) {
+    a.record(10);
+    b.record(1000000);
+  }
+  b.record(5);
+  a.merge(b);
+  EXPECT_EQ(201u, a.count());
+  EXPECT_EQ(5u, a.min());
+  EXPECT_EQ(1000000u, a.max());
+  EXPECT_EQ(10u, a.percentile(50.0));
+  EXPECT_GE(a.percentile(99.0), 1000000u * 31 / 32);
+}
+
+TEST_F(CATEGORY, largest_values) {
+  latency_histogram h;
+  h.record(UINT64_MAX);
+  h.record(0);
+  EXPECT_EQ(UINT64_MAX, h.percentile(100.0));
+  EXPECT_EQ(0u, h.percentile(50.0));
+}
+
+#undef CATEGORY
@@ -0,0 +1,156 @@
+// Tests for load_sampling::ex_sampled (examples/util/load_sampling.hpp).
+
+#include "../examples/util/load_sampling.hpp"
+#include "test_common.hpp"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <thread>
+#include <vector>
+
+#define CATEGORY test_load_sampling
+
+namespace {
+
+class CATEGORY : public testing::Test {
+protected:
+  static void SetUpTestSuite() {
+    tmc::cpu_executor().set_thread_count(1).set_priority_count(2).init();
+  }
+
+  static void TearDownTestSuite() { tmc::cpu_executor().teardown(); }
+
+  static tmc::ex_cpu& ex() { return tmc::cpu_executor(); }
+
+  // Waits for the items that have finished to leave the active count.
+  static load_sampling::snapshot idle_snapshot(load_sampling::ex_sampled& Ex) {
+    auto snap = Ex.load_snapshot();
+    while (snap.active != 0) {
+      std::this_thread::yield();
+      snap = Ex.load_snapshot();
+    }
+    return snap;
+  }
+};
+
+TEST_F(CATEGORY, counts_queued) {
+  load_sampling::ex_sampled sampled(ex());
+  std::atomic<bool> started{false};
+  std::atomic<bool> go{false};
+  auto blocked = tmc::post_waitable(
+    sampled,
+    [](std::atomic<bool>& Started, std::atomic<bool>& Go) -> tmc::task<void> {
+      Started.store(true);
+      while (!Go.load()) {
+      }
+      co_return;
+    }(started, go),
+    0
+  );
+  while (!started.load()) {
+  }
+  std::vector<std::future<void>> results;
+  for (size_t i = 0; i < 5; ++i) {
+    results.push_back(
+      tmc::post_waitable(sampled, []() -> tmc::task<void> { co_return; }(), i % 2)
+    );
+  }
+  auto snap = sampled.load_snapshot();
+  ASSERT_EQ(snap.queued.size(), 2);
+  EXPECT_EQ(snap.queued[0], 3);
+  EXPECT_EQ(snap.queued[1], 2);
+  EXPECT_EQ(snap.total_queued(), 5);
+  EXPECT_EQ(snap.active, 1);
+  EXPECT_EQ(snap.thread_count, 1);
+
+  go.store(true);
+  blocked.wait();
+  for (auto& r : results) {
+    r.wait();
+  }
+  snap = idle_snapshot(sampled);
+  EXPECT_EQ(snap.total_queued(), 0);
+}
+
+// Priorities above the executor's range are counted at the lowest priority.
+TEST_F(CATEGORY, clamps_priority) {
+  load_sampling::ex_sampled sampled(ex());
+  std::atomic<bool> started{false};
+  std::atomic<bool> go{false};
+  auto blocked = tmc::post_waitable(
+    sampled,
+    [](std::atomic<bool>& Started, std::atomic<bool>& Go) -> tmc::task<void> {
+      Started.store(true);
+      while (!Go.load()) {
+      }
+      co_return;
+    }(started, go),
+    0
+  );
+  while (!started.load()) {
+  }
+  auto result =
+    tmc::post_waitable(sampled, []() -> tmc::task<void> { co_return; }(), 5);
+  auto snap = sampled.load_snapshot();
+  ASSERT_EQ(snap.queued.size(), 2);
+  EXPECT_EQ(snap.queued[0], 0);
+  EXPECT_EQ(snap.queued[1], 1);
+
+  go.store(true);
+  blocked.wait();
+  result.wait();
+  snap = idle_snapshot(sampled);
+  EXPECT_EQ(snap.total_queued(), 0);
+}
+
+TEST_F(CATEGORY, samples_delay) {
+  load_sampling::ex_sampled sampled(ex());
+  sampled.set_sample_every(1);
+  // Post from a single thread, so that every post is sampled.
+  std::vector<std::future<void>> results;
+  for (size_t i = 0; i < 10; ++i) {
+    results.push_back(
+      tmc::post_waitable(sampled, []() -> tmc::task<void> { co_return; }(), 0)
+    );
+  }
+  for (auto& r : results) {
+    r.wait();
+  }
+  auto snap = idle_snapshot(sampled);
+  EXPECT_EQ(snap.delay_samples, 10);
+  EXPECT_GE(snap.max_delay, snap.mean_delay);
+  EXPECT_GT(snap.max_delay.count(), 0);
+  // Samples are reset by each snapshot.
+  snap = sampled.load_snapshot();
+  EXPECT_EQ(snap.delay_samples, 0);
+  EXPECT_EQ(snap.max_delay.count(), 0);
+}
+
+// Spawned tasks and continuations run on ex_sampled, so they are counted.
+TEST_F(CATEGORY, children_are_counted) {
+  load_sampling::ex_sampled sampled(ex());
+  sampled.set_sample_every(1);
+  tmc::post_waitable(
+    sampled,
+    [](load_sampling::ex_sampled& Ex) -> tmc::task<void> {
+      EXPECT_TRUE(Ex.is_current());
+      co_await tmc::spawn([](load_sampling::ex_sampled& E) -> tmc::task<void> {
+        EXPECT_TRUE(E.is_current());
+        co_return;
+      }(Ex));
+      EXPECT_TRUE(Ex.is_current());
+    }(sampled),
+    0
+  )
+    .wait();
+  auto snap = idle_snapshot(sampled);
+  // The task, its child, and its continuation after the child completes.
+  EXPECT_GE(snap.delay_samples, 2);
+  EXPECT_EQ(snap.total_queued(), 0);
+}
+} // namespace
+
+#undef CATEGORY
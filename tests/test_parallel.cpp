@@ -0,0 +1,166 @@
+// Tests for the parallel algorithms (examples/util/parallel.hpp).
+
+#include "../examples/util/parallel.hpp"
+#include "test_common.hpp"
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <numeric>
+#include <stop_token>
+#include <vector>
+
+#define CATEGORY test_parallel
+
+namespace {
+
+class CATEGORY : public testing::Test {
+protected:
+  static void SetUpTestSuite() { tmc::cpu_executor().init(); }
+
+  static void TearDownTestSuite() { tmc::cpu_executor().teardown(); }
+
+  static tmc::ex_cpu& ex() { return tmc::cpu_executor(); }
+};
+
+static std::vector<uint64_t> make_input(size_t Count) {
+  std::vector<uint64_t> v(Count);
+  uint64_t x = 1;
+  for (auto& e : v) {
+    x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+    e = x >> 48;
+  }
+  return v;
+}
+
+// Each test runs with the default grain, and with a grain of 1 to maximize
+// the number of tasks.
+static constexpr size_t GRAINS[] = {0, 1};
+static constexpr size_t COUNTS[] = {0, 1, 7, 1000, 100000};
+
+TEST_F(CATEGORY, for_each) {
+  test_async_main(ex(), []() -> tmc::task<void> {
+    for (size_t grain : GRAINS) {
+      for (size_t count : COUNTS) {
+        auto v = make_input(count);
+        auto expected = v;
+        for (auto& e : expected) {
+          e += 1;
+        }
+        co_await parallel::for_each(
+          v.begin(), v.end(), [](uint64_t& X) { X += 1; }, {grain}
+        );
+        EXPECT_EQ(v, expected);
+      }
+    }
+  }());
+}
+
+TEST_F(CATEGORY, transform) {
+  test_async_main(ex(), []() -> tmc::task<void> {
+    for (size_t grain : GRAINS) {
+      for (size_t count : COUNTS) {
+        auto v = make_input(count);
+        std::vector<uint64_t> out(count);
+        auto end = co_await parallel::transform(
+          v.begin(), v.end(), out.begin(), [](uint64_t X) { return X * 3; }, {grain}
+        );
+        EXPECT_EQ(end, out.end());
+        for (size_t i = 0; i < count; ++i) {
+          EXPECT_EQ(out[i], v[i] * 3);
+        }
+      }
+    }
+  }());
+}
+
+TEST_F(CATEGORY, transform_reduce) {
+  test_async_main(ex(), []() -> tmc::task<void> {
+    for (size_t grain : GRAINS) {
+      for (size_t count : COUNTS) {
+        auto v = make_input(count);
+        auto square = [](uint64_t X) { return X * X; };
+        uint64_t expected =
+          std::transform_reduce(v.begin(), v.end(), uint64_t{5}, std::plus<>{}, square);
+        uint64_t result = co_await parallel::transform_reduce(
+          v.begin(), v.end(), uint64_t{5}, std::plus<>{}, square, {grain}
+        );
+        EXPECT_EQ(result, expected);
+      }
+    }
+  }());
+}
+
+TEST_F(CATEGORY, inclusive_scan) {
+  test_async_main(ex(), []() -> tmc::task<void> {
+    for (size_t grain : GRAINS) {
+      for (size_t count : COUNTS) {
+        auto v = make_input(count);
+        std::vector<uint64_t> expected(count);
+        std::inclusive_scan(v.begin(), v.end(), expected.begin());
+        std::vector<uint64_t> out(count);
+        co_await parallel::inclusive_scan(
+          v.begin(), v.end(), out.begin(), std::plus<>{}, {grain}
+        );
+        EXPECT_EQ(out, expected);
+        // In place
+        co_await parallel::inclusive_scan(
+          v.begin(), v.end(), v.begin(), std::plus<>{}, {grain}
+        );
+        EXPECT_EQ(v, expected);
+      }
+    }
+  }());
+}
+
+TEST_F(CATEGORY, sort) {
+  test_async_main(ex(), []() -> tmc::task<void> {
+    for (size_t grain : GRAINS) {
+      for (size_t count : COUNTS) {
+        auto v = make_input(count);
+        auto expected = v;
+        std::sort(expected.begin(), expected.end());
+        co_await parallel::sort(v.begin(), v.end(), std::less<>{}, {grain});
+        EXPECT_EQ(v, expected);
+        // Already sorted, in reverse order
+        co_await parallel::sort(v.begin(), v.end(), std::greater<>{}, {grain});
+        std::reverse(expected.begin(), expected.end());
+        EXPECT_EQ(v, expected);
+      }
+    }
+  }());
+}
+
+TEST_F(CATEGORY, cancel) {
+  test_async_main(ex(), []() -> tmc::task<void> {
+    std::stop_source stop;
+    std::atomic<size_t> calls = 0;
+    std::vector<uint64_t> v(100000);
+    // Each chunk requests a stop, so only the chunks that have already
+    // started may run.
+    co_await parallel::for_each(
+      v.begin(), v.end(),
+      [&](uint64_t&) {
+        ++calls;
+        stop.request_stop();
+      },
+      {1000, stop.get_token()}
+    );
+    EXPECT_GE(calls.load(), 1);
+    EXPECT_LT(calls.load(), v.size());
+
+    uint64_t sum = co_await parallel::transform_reduce(
+      v.begin(), v.end(), uint64_t{7}, std::plus<>{}, [](uint64_t) { return uint64_t{1}; },
+      {0, stop.get_token()}
+    );
+    EXPECT_EQ(sum, 7);
+  }());
+}
+
+} // namespace
+
+#undef CATEGORY
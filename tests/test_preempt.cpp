@@ -0,0 +1,104 @@
+// Tests for preempt::watchdog and preempt::slice_check
+// (examples/util/preempt.hpp).
+
+#include "../examples/util/preempt.hpp"
+#include "test_common.hpp"
+
+#include <gtest/gtest.h>
+
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <future>
+#include <thread>
+
+#define CATEGORY test_preempt
+
+namespace {
+
+class CATEGORY : public testing::Test {
+protected:
+  static void SetUpTestSuite() {
+    tmc::cpu_executor().set_thread_count(2).set_priority_count(2).init();
+  }
+
+  static void TearDownTestSuite() { tmc::cpu_executor().teardown(); }
+
+  static tmc::ex_cpu& ex() { return tmc::cpu_executor(); }
+};
+
+TEST_F(CATEGORY, expired) {
+  preempt::watchdog wd(std::chrono::milliseconds(1));
+  EXPECT_EQ(wd.slice(), std::chrono::milliseconds(1));
+  auto check = wd.check();
+  EXPECT_FALSE(check.expired());
+  std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  EXPECT_TRUE(check.expired());
+  check.reset();
+  EXPECT_FALSE(check.expired());
+}
+
+// A check's run restarts when another check has run on the same thread.
+TEST_F(CATEGORY, other_check_restarts_run) {
+  preempt::watchdog wd(std::chrono::milliseconds(1));
+  auto first = wd.check();
+  std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  EXPECT_TRUE(first.expired());
+  auto second = wd.check();
+  EXPECT_FALSE(first.expired());
+  EXPECT_FALSE(second.expired());
+  EXPECT_TRUE(first.await_ready());
+  EXPECT_FALSE(first.expired());
+  std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  EXPECT_TRUE(first.expired());
+  EXPECT_FALSE(second.expired());
+}
+
+// An expired check does not suspend unless a yield was requested.
+TEST_F(CATEGORY, no_request) {
+  test_async_main(ex(), []() -> tmc::task<void> {
+    preempt::watchdog wd(std::chrono::milliseconds(1));
+    auto check = wd.check();
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    EXPECT_TRUE(check.expired());
+    EXPECT_TRUE(check.await_ready());
+    co_await check;
+    EXPECT_TRUE(check.expired());
+  }());
+}
+
+// Low priority tasks that await a check let high priority tasks run.
+TEST_F(CATEGORY, yields_to_higher_priority) {
+  test_async_main(ex(), []() -> tmc::task<void> {
+    static constexpr size_t COUNT = 20;
+    preempt::watchdog wd(std::chrono::microseconds(200));
+    std::array<std::future<void>, COUNT> results;
+    for (size_t i = 0; i < COUNT; ++i) {
+      size_t prio = 1 - i % 2;
+      results[i] = tmc::post_waitable(
+        ex(),
+        [](preempt::watchdog& Watchdog) -> tmc::task<void> {
+          unsigned int a = 0;
+          unsigned int b = 1;
+          auto check = Watchdog.check();
+          for (unsigned int j = 0; j < 1000; ++j) {
+            for (unsigned int k = 0; k < 500; ++k) {
+              a = a + b;
+              b = b + a;
+            }
+            co_await check;
+          }
+        }(wd),
+        prio
+      );
+      std::this_thread::sleep_for(std::chrono::microseconds(1));
+    }
+    for (auto& f : results) {
+      f.wait();
+    }
+    co_return;
+  }());
+}
+} // namespace
+
+#undef CATEGORY
@@ -0,0 +1,184 @@
+// Tests for prio_inherit::mutex and prio_inherit::ex_braid
+// (examples/util/priority_inheritance.hpp).
+
+#include "../examples/util/priority_inheritance.hpp"
+#include "test_common.hpp"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+#define CATEGORY test_priority_inheritance
+
+namespace {
+
+// A single thread, so that the order in which tasks run is deterministic.
+// braid_serializes uses its own multi-threaded executor.
+class CATEGORY : public testing::Test {
+protected:
+  static void SetUpTestSuite() {
+    tmc::cpu_executor().set_thread_count(1).set_priority_count(2).init();
+  }
+
+  static void TearDownTestSuite() { tmc::cpu_executor().teardown(); }
+
+  static tmc::ex_cpu& ex() { return tmc::cpu_executor(); }
+};
+
+// Takes the lock, and appends the priority it was taken at to Order.
+static tmc::task<void> locker(prio_inherit::mutex& Mut, std::vector<size_t>& Order) {
+  auto scope = co_await Mut.lock_scope();
+  Order.push_back(tmc::current_priority());
+}
+
+static tmc::task<void> record(std::vector<size_t>& Order, size_t Value) {
+  Order.push_back(Value);
+  co_return;
+}
+
+TEST_F(CATEGORY, try_lock) {
+  prio_inherit::mutex mut;
+  EXPECT_FALSE(mut.is_locked());
+  EXPECT_TRUE(mut.try_lock());
+  EXPECT_TRUE(mut.is_locked());
+  EXPECT_FALSE(mut.try_lock());
+  mut.unlock();
+  EXPECT_FALSE(mut.is_locked());
+}
+
+// Waiters are woken in priority order, not arrival order.
+TEST_F(CATEGORY, wake_order) {
+  test_async_main(ex(), []() -> tmc::task<void> {
+    prio_inherit::mutex mut;
+    std::vector<size_t> order;
+    EXPECT_TRUE(mut.try_lock());
+    tmc::post(ex(), locker(mut, order), 1);
+    tmc::post(ex(), locker(mut, order), 0);
+    // Both lockers run and wait before this resumes.
+    co_await tmc::change_priority(1);
+    EXPECT_TRUE(order.empty());
+    mut.unlock();
+    co_await tmc::change_priority(1);
+    while (order.size() < 2) {
+      co_await tmc::yield();
+    }
+    EXPECT_EQ(order, (std::vector<size_t>{0, 1}));
+    EXPECT_FALSE(mut.is_locked());
+    co_await tmc::change_priority(0);
+  }());
+}
+
+// A priority 1 holder that suspends with held() while a priority 0 task is
+// waiting resumes at priority 0, ahead of other priority 1 work, and its
+// priority is restored by unlock().
+TEST_F(CATEGORY, held_boost) {
+  test_async_main(ex(), []() -> tmc::task<void> {
+    prio_inherit::mutex mut;
+    std::vector<size_t> order;
+    co_await tmc::change_priority(1);
+    co_await mut;
+    tmc::post(ex(), locker(mut, order), 0);
+    // Lets the locker run and wait.
+    co_await tmc::yield();
+    EXPECT_EQ(mut.boosts(), 0);
+
+    tmc::post(ex(), record(order, 100), 1);
+    co_await mut.held(tmc::yield());
+    EXPECT_EQ(mut.boosts(), 1);
+    EXPECT_EQ(tmc::current_priority(), 0);
+    EXPECT_TRUE(order.empty());
+    mut.unlock();
+    EXPECT_EQ(tmc::current_priority(), 1);
+
+    while (order.size() < 2) {
+      co_await tmc::yield();
+    }
+    EXPECT_EQ(order, (std::vector<size_t>{0, 100}));
+    co_await tmc::change_priority(0);
+  }());
+}
+
+// A priority 0 task that starts waiting while the holder's continuation is
+// already queued at priority 1 posts it again at priority 0.
+TEST_F(CATEGORY, held_boost_queued) {
+  test_async_main(ex(), []() -> tmc::task<void> {
+    prio_inherit::mutex mut;
+    std::vector<size_t> order;
+    co_await tmc::change_priority(1);
+    co_await mut;
+    tmc::post(ex(), record(order, 100), 1);
+    tmc::post(ex(), locker(mut, order), 0);
+    // The locker runs and waits while this is queued behind record().
+    co_await mut.held(tmc::yield());
+    EXPECT_EQ(mut.boosts(), 1);
+    EXPECT_EQ(tmc::current_priority(), 0);
+    EXPECT_TRUE(order.empty());
+    mut.unlock();
+    EXPECT_EQ(tmc::current_priority(), 1);
+
+    while (order.size() < 2) {
+      co_await tmc::yield();
+    }
+    EXPECT_EQ(order, (std::vector<size_t>{0, 100}));
+    co_await tmc::change_priority(0);
+  }());
+}
+
+// Items posted to the braid run in priority order, because each one is
+// posted to the parent at its own priority.
+TEST_F(CATEGORY, braid_priority_order) {
+  test_async_main(ex(), []() -> tmc::task<void> {
+    std::vector<size_t> order;
+    {
+      prio_inherit::ex_braid br(ex().type_erased());
+      br.post(record(order, 1), 1);
+      br.post(record(order, 0), 0);
+      co_await tmc::change_priority(1);
+      while (order.size() < 2) {
+        co_await tmc::yield();
+      }
+    }
+    EXPECT_EQ(order, (std::vector<size_t>{0, 1}));
+    co_await tmc::change_priority(0);
+  }());
+}
+
+// Items posted to the braid never run at the same time, even though its
+// parent runs them on several threads.
+TEST_F(CATEGORY, braid_serializes) {
+  tmc::ex_cpu parent;
+  parent.set_thread_count(4).set_priority_count(2).init();
+  test_async_main(parent, [](tmc::ex_cpu& Parent) -> tmc::task<void> {
+    static constexpr size_t COUNT = 1000;
+    std::atomic<size_t> inSection{0};
+    std::atomic<size_t> overlaps{0};
+    size_t value = 0;
+    prio_inherit::ex_braid br(Parent.type_erased());
+    std::vector<tmc::task<void>> tasks;
+    for (size_t i = 0; i < COUNT; ++i) {
+      tasks.push_back(
+        [](
+          std::atomic<size_t>& InSection, std::atomic<size_t>& Overlaps, size_t& V
+        ) -> tmc::task<void> {
+          if (InSection.fetch_add(1) != 0) {
+            Overlaps.fetch_add(1);
+          }
+          // Gives another item time to enter, if the braid lets it.
+          std::this_thread::yield();
+          ++V;
+          InSection.fetch_sub(1);
+          co_return;
+        }(inSection, overlaps, value)
+      );
+    }
+    co_await tmc::spawn_many(tasks.begin(), tasks.size()).run_on(br);
+    EXPECT_EQ(overlaps.load(), 0);
+    EXPECT_EQ(value, COUNT);
+  }(parent));
+}
+} // namespace
+
+#undef CATEGORY
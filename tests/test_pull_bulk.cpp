@@ -0,0 +1,166 @@
+// Tests for pull_bulk (examples/util/pull_bulk.hpp).
+
+#include "../examples/util/bounded_channel.hpp"
+#include "../examples/util/pull_bulk.hpp"
+#include "test_common.hpp"
+#include "tmc/channel.hpp"
+#include "tmc/qu_mpsc_unbounded.hpp"
+#include "tmc/qu_spsc_bounded.hpp"
+#include "tmc/qu_spsc_unbounded.hpp"
+
+#include <array>
+#include <cstddef>
+#include <gtest/gtest.h>
+#include <span>
+#include <vector>
+
+#define CATEGORY test_pull_bulk
+
+namespace {
+
+class CATEGORY : public testing::Test {
+protected:
+  static void SetUpTestSuite() { tmc::cpu_executor().init(); }
+
+  static void TearDownTestSuite() { tmc::cpu_executor().teardown(); }
+
+  static tmc::ex_cpu& ex() { return tmc::cpu_executor(); }
+};
+
+struct mpsc_config : tmc::qu_mpsc_unbounded_default_config {
+  // Use a small block size to ensure that batches span blocks.
+  static inline constexpr size_t BlockSize = 2;
+  static inline constexpr bool ConsumerCanSuspend = true;
+};
+
+struct spsc_config : tmc::qu_spsc_unbounded_default_config {
+  static inline constexpr size_t BlockSize = 2;
+  static inline constexpr bool ConsumerCanSuspend = true;
+};
+
+struct spsc_bounded_config : tmc::qu_spsc_bounded_default_config {
+  static inline constexpr bool ConsumerCanSuspend = true;
+};
+
+template <typename Queue>
+tmc::task<void> fill(Queue& Q, size_t Begin, size_t End) {
+  for (size_t i = Begin; i < End; ++i) {
+    if constexpr (requires { Q.post(i); }) {
+      Q.post(i);
+    } else {
+      co_await Q.push(i);
+    }
+  }
+  co_return;
+}
+
+// Elements that are already in the queue are returned in batches of up to Max,
+// then 0 once the queue is closed.
+template <typename Queue> tmc::task<void> ready_batches(Queue& Q) {
+  co_await fill(Q, 0, 10);
+  std::array<size_t, 4> buf;
+  std::vector<size_t> out;
+  std::array<size_t, 3> batches{4, 4, 2};
+  for (size_t expected : batches) {
+    size_t n = co_await pull_bulk(Q, std::span{buf});
+    EXPECT_EQ(n, expected);
+    out.insert(out.end(), buf.begin(), buf.begin() + static_cast<ptrdiff_t>(n));
+  }
+  for (size_t i = 0; i < 10; ++i) {
+    EXPECT_EQ(out[i], i);
+  }
+  Q.close();
+  EXPECT_EQ(co_await pull_bulk(Q, std::span{buf}), 0);
+}
+
+// The consumer suspends while the queue is empty and receives every element.
+template <typename Queue> tmc::task<void> concurrent(Queue& Q) {
+  static constexpr size_t NITEMS = 10000;
+  auto cons = tmc::spawn([](Queue& Qu) -> tmc::task<size_t> {
+                std::array<size_t, 16> buf;
+                size_t next = 0;
+                while (size_t n = co_await pull_bulk(Qu, buf.begin(), buf.size())) {
+                  EXPECT_LE(n, buf.size());
+                  for (size_t i = 0; i < n; ++i) {
+                    // A single producer, so elements arrive in order.
+                    EXPECT_EQ(buf[i], next);
+                    ++next;
+                  }
+                }
+                co_return next;
+              }(Q))
+                .fork();
+  co_await fill(Q, 0, NITEMS);
+  Q.close();
+  EXPECT_EQ(co_await std::move(cons), NITEMS);
+}
+
+TEST_F(CATEGORY, chan_tok) {
+  test_async_main(ex(), []() -> tmc::task<void> {
+    {
+      auto chan = tmc::make_channel<size_t>();
+      co_await ready_batches(chan);
+    }
+    {
+      auto chan = tmc::make_channel<size_t>();
+      co_await concurrent(chan);
+    }
+  }());
+}
+
+TEST_F(CATEGORY, qu_mpsc_unbounded) {
+  test_async_main(ex(), []() -> tmc::task<void> {
+    {
+      auto q = tmc::qu_mpsc_unbounded<size_t, mpsc_config>{};
+      co_await ready_batches(q);
+    }
+    {
+      auto q = tmc::qu_mpsc_unbounded<size_t, mpsc_config>{};
+      co_await concurrent(q);
+    }
+  }());
+}
+
+TEST_F(CATEGORY, qu_spsc_unbounded) {
+  test_async_main(ex(), []() -> tmc::task<void> {
+    {
+      auto q = tmc::qu_spsc_unbounded<size_t, spsc_config>{};
+      co_await ready_batches(q);
+    }
+    {
+      auto q = tmc::qu_spsc_unbounded<size_t, spsc_config>{};
+      co_await concurrent(q);
+    }
+  }());
+}
+
+TEST_F(CATEGORY, qu_spsc_bounded) {
+  test_async_main(ex(), []() -> tmc::task<void> {
+    {
+      auto q = tmc::qu_spsc_bounded<size_t, spsc_bounded_config>{16};
+      co_await ready_batches(q);
+    }
+    {
+      // Smaller than the consumer's batch size
+      auto q = tmc::qu_spsc_bounded<size_t, spsc_bounded_config>{8};
+      co_await concurrent(q);
+    }
+  }());
+}
+
+TEST_F(CATEGORY, bounded_channel) {
+  test_async_main(ex(), []() -> tmc::task<void> {
+    {
+      auto chan = make_bounded_channel<size_t>(16);
+      co_await ready_batches(chan);
+    }
+    {
+      auto chan = make_bounded_channel<size_t>(8);
+      co_await concurrent(chan);
+    }
+  }());
+}
+
+} // namespace
+
+#undef CATEGORY
@@ -0,0 +1,426 @@
+// Tests for steal_half_deque (examples/util/steal_half_deque.hpp).
+//
+// The push / pop / steal / post_bulk behavior matches
+// tmc::detail::chase_lev_deque, so these focus on steal_batch: the
+// half-size limit, FIFO order of the stolen range, interaction with
+// growth and wrap-around, and multi-threaded owner-vs-batch-stealers
+// scenarios where each item must be observed exactly once.
+
+#include "../examples/util/steal_half_deque.hpp"
+
+#include <gtest/gtest.h>
+
+#include <atomic>
+#include <numeric>
+#include <set>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#define CATEGORY test_steal_half_deque
+
+namespace {
+
+template <typename T> std::vector<T> drain_pop(steal_half_deque<T>& Q) {
+  std::vector<T> out;
+  T v{};
+  while (Q.try_pop(v)) {
+    out.push_back(v);
+  }
+  return out;
+}
+
+// An element whose loads can be paused, to hold a thief between reading the
+// indexes and committing its CAS.
+struct gated_item {
+  size_t value;
+};
+
+struct load_gate {
+  // Set on the thread whose next element load should pause.
+  static inline thread_local bool pause_here = false;
+  static inline std::atomic<bool> paused{false};
+  static inline std::atomic<bool> released{false};
+};
+
+} // namespace
+
+template <> struct std::atomic<gated_item> {
+  std::atomic<size_t> value{0};
+
+  static constexpr bool is_always_lock_free = true;
+
+  gated_item load(std::memory_order Order) const {
+    gated_item result{value.load(Order)};
+    if (load_gate::pause_here) {
+      load_gate::pause_here = false;
+      load_gate::paused.store(true);
+      while (!load_gate::released.load()) {
+        std::this_thread::yield();
+      }
+    }
+    return result;
+  }
+
+  void store(gated_item Item, std::memory_order Order) {
+    value.store(Item.value, Order);
+  }
+};
+
+class CATEGORY : public testing::Test {};
+
+TEST_F(CATEGORY, default_construct_is_empty) {
+  steal_half_deque<size_t> q;
+  EXPECT_TRUE(q.empty());
+  EXPECT_EQ(0u, q.size_approx());
+
+  size_t v = 42;
+  EXPECT_FALSE(q.try_pop(v));
+  EXPECT_FALSE(q.steal(v));
+  EXPECT_EQ(0u, q.steal_batch(&v, 8));
+}
+
+TEST_F(CATEGORY, push_pop_lifo_and_steal_fifo) {
+  steal_half_deque<size_t> q;
+  for (size_t i = 0; i < 8; ++i) {
+    q.push(i);
+  }
+  size_t v = 0;
+  EXPECT_TRUE(q.steal(v));
+  EXPECT_EQ(0u, v);
+  EXPECT_TRUE(q.steal(v));
+  EXPECT_EQ(1u, v);
+
+  auto popped = drain_pop(q);
+  std::vector<size_t> expected{7, 6, 5, 4, 3, 2};
+  EXPECT_EQ(expected, popped);
+}
+
+TEST_F(CATEGORY, steal_batch_takes_half_rounded_up) {
+  steal_half_deque<size_t> q;
+  for (size_t i = 0; i < 9; ++i) {
+    q.push(i);
+  }
+  std::vector<size_t> out(16);
+  ASSERT_EQ(5u, q.steal_batch(out.data(), out.size()));
+  for (size_t i = 0; i < 5; ++i) {
+    EXPECT_EQ(i, out[i]);
+  }
+  EXPECT_EQ(4u, q.size_approx());
+
+  ASSERT_EQ(2u, q.steal_batch(out.data(), out.size()));
+  EXPECT_EQ(5u, out[0]);
+  EXPECT_EQ(6u, out[1]);
+
+  ASSERT_EQ(1u, q.steal_batch(out.data(), out.size()));
+  EXPECT_EQ(7u, out[0]);
+  ASSERT_EQ(1u, q.steal_batch(out.data(), out.size()));
+  EXPECT_EQ(8u, out[0]);
+  EXPECT_EQ(0u, q.steal_batch(out.data(), out.size()));
+  EXPECT_TRUE(q.empty());
+}
+
+TEST_F(CATEGORY, steal_batch_respects_max) {
+  steal_half_deque<size_t> q;
+  for (size_t i = 0; i < 100; ++i) {
+    q.push(i);
+  }
+  std::vector<size_t> out(3);
+  ASSERT_EQ(3u, q.steal_batch(out.data(), 3));
+  std::vector<size_t> expected{0, 1, 2};
+  EXPECT_EQ(expected, out);
+  EXPECT_EQ(0u, q.steal_batch(out.data(), 0));
+  EXPECT_EQ(97u, q.size_approx());
+}
+
+TEST_F(CATEGORY, steal_batch_leaves_owner_tail) {
+  steal_half_deque<size_t> q;
+  for (size_t i = 0; i < 10; ++i) {
+    q.push(i);
+  }
+  std::vector<size_t> out(10);
+  ASSERT_EQ(5u, q.steal_batch(out.data(), out.size()));
+
+  auto popped = drain_pop(q);
+  std::vector<size_t> expected{9, 8, 7, 6, 5};
+  EXPECT_EQ(expected, popped);
+}
+
+TEST_F(CATEGORY, steal_batch_into_thief_deque) {
+  // The thief pushes the stolen batch into its own deque, where it can be
+  // stolen again by other thieves.
+  steal_half_deque<size_t> victim;
+  steal_half_deque<size_t> thief;
+  std::vector<size_t> src(64);
+  std::iota(src.begin(), src.end(), 0);
+  victim.post_bulk(src.begin(), src.size());
+
+  std::vector<size_t> out(64);
+  size_t n = victim.steal_batch(out.data(), out.size());
+  ASSERT_EQ(32u, n);
+  thief.post_bulk(out.begin(), n);
+  EXPECT_EQ(32u, thief.size_approx());
+
+  size_t v = 0;
+  ASSERT_TRUE(thief.steal(v));
+  EXPECT_EQ(0u, v);
+  ASSERT_TRUE(thief.try_pop(v));
+  EXPECT_EQ(31u, v);
+}
+
+TEST_F(CATEGORY, grow_preserves_partial_window) {
+  steal_half_deque<size_t> q(4);
+  for (size_t i = 0; i < 4; ++i) {
+    q.push(i);
+  }
+  std::vector<size_t> out(4);
+  ASSERT_EQ(2u, q.steal_batch(out.data(), out.size()));
+  // Logical contents are [2,3] at indices 2,3. Force a grow.
+  std::vector<size_t> src{4, 5, 6, 7, 8};
+  q.post_bulk(src.begin(), src.size());
+  EXPECT_EQ(7u, q.size_approx());
+
+  std::vector<size_t> stolen;
+  size_t v = 0;
+  while (q.steal(v)) {
+    stolen.push_back(v);
+  }
+  std::vector<size_t> expected{2, 3, 4, 5, 6, 7, 8};
+  EXPECT_EQ(expected, stolen);
+}
+
+TEST_F(CATEGORY, push_steal_batch_wraparound) {
+  steal_half_deque<size_t> q(4);
+  std::vector<size_t> out(4);
+  size_t next = 0;
+  size_t expected = 0;
+  for (size_t i = 0; i < 1000; ++i) {
+    q.push(next++);
+    q.push(next++);
+    q.push(next++);
+    while (size_t n = q.steal_batch(out.data(), out.size())) {
+      for (size_t j = 0; j < n; ++j) {
+        ASSERT_EQ(expected++, out[j]);
+      }
+    }
+  }
+  EXPECT_EQ(next, expected);
+  EXPECT_TRUE(q.empty());
+}
+
+// A thief reads the indexes and the only element, and then stalls. The owner
+// pops that element and pushes another, which restores the same top and
+// bottom. The thief's CAS must fail, so that it takes the new element instead
+// of the popped one.
+TEST_F(CATEGORY, stale_steal_after_pop_and_push) {
+  steal_half_deque<gated_item> q;
+  q.push(gated_item{1});
+
+  gated_item stolen{0};
+  size_t stolenCount = 0;
+  std::thread thief([&]() {
+    load_gate::pause_here = true;
+    stolenCount = q.steal_batch(&stolen, 1);
+  });
+  while (!load_gate::paused.load()) {
+    std::this_thread::yield();
+  }
+
+  gated_item v{0};
+  ASSERT_TRUE(q.try_pop(v));
+  EXPECT_EQ(1u, v.value);
+  q.push(gated_item{2});
+  load_gate::released.store(true);
+  thief.join();
+
+  EXPECT_EQ(1u, stolenCount);
+  EXPECT_EQ(2u, stolen.value);
+  EXPECT_FALSE(q.try_pop(v));
+  EXPECT_TRUE(q.empty());
+}
+
+// Like stale_steal_after_pop_and_push, but the owner pops and pushes 2^16
+// times, which wrapped the tag around when it was 16 bits wide.
+TEST_F(CATEGORY, stale_steal_after_tag_wrap) {
+  steal_half_deque<gated_item> q;
+  q.push(gated_item{1});
+
+  gated_item stolen{0};
+  size_t stolenCount = 0;
+  load_gate::paused.store(false);
+  load_gate::released.store(false);
+  std::thread thief([&]() {
+    load_gate::pause_here = true;
+    stolenCount = q.steal_batch(&stolen, 1);
+  });
+  while (!load_gate::paused.load()) {
+    std::this_thread::yield();
+  }
+
+  gated_item v{0};
+  for (size_t i = 0; i < (size_t{1} << 16); ++i) {
+    ASSERT_TRUE(q.try_pop(v));
+    q.push(gated_item{i + 2});
+  }
+  load_gate::released.store(true);
+  thief.join();
+
+  EXPECT_EQ(1u, stolenCount);
+  EXPECT_EQ((size_t{1} << 16) + 1, stolen.value);
+  EXPECT_TRUE(q.empty());
+}
+
+TEST_F(CATEGORY, max_capacity) {
+  using deque = steal_half_deque<size_t>;
+  EXPECT_THROW(deque(deque::MAX_CAPACITY + 1), std::length_error);
+
+  deque q(deque::MAX_CAPACITY);
+  std::vector<size_t> items(deque::MAX_CAPACITY, 7);
+  q.post_bulk(items.begin(), items.size());
+  EXPECT_EQ(q.size_approx(), deque::MAX_CAPACITY);
+  EXPECT_THROW(q.push(8), std::length_error);
+  EXPECT_THROW(q.post_bulk(items.begin(), 2), std::length_error);
+  EXPECT_EQ(q.size_approx(), deque::MAX_CAPACITY);
+
+  size_t v = 0;
+  EXPECT_TRUE(q.try_pop(v));
+  q.push(8);
+  EXPECT_TRUE(q.try_pop(v));
+  EXPECT_EQ(v, 8);
+}
+
+// Owner pushes and pops while several threads steal in batches. Every item
+// must be observed exactly once.
+TEST_F(CATEGORY, concurrent_owner_and_batch_stealers) {
+  constexpr size_t N = 100000;
+  constexpr size_t NUM_STEALERS = 4;
+  constexpr size_t MAX_BATCH = 32;
+
+  steal_half_deque<size_t> q(8);
+  std::atomic<bool> producer_done{false};
+  std::vector<std::vector<size_t>> stolen(NUM_STEALERS);
+  std::vector<size_t> popped;
+
+  std::vector<std::thread> stealers;
+  stealers.reserve(NUM_STEALERS);
+  for (size_t s = 0; s < NUM_STEALERS; ++s) {
+    stealers.emplace_back([&, s]() {
+      auto& out = stolen[s];
+      size_t buf[MAX_BATCH];
+      while (true) {
+        size_t n = q.steal_batch(buf, MAX_BATCH);
+        if (n != 0) {
+          out.insert(out.end(), buf, buf + n);
+        } else {
+          if (producer_done.load(std::memory_order_acquire) && q.empty()) {
+            return;
+          }
+          std::this_thread::yield();
+        }
+      }
+    });
+  }
+
+  std::thread owner([&]() {
+    std::vector<size_t> chunk(16);
+    size_t v = 0;
+    size_t i = 0;
+    while (i < N) {
+      if ((i % 3) == 0 && i + chunk.size() <= N) {
+        std::iota(chunk.begin(), chunk.end(), i);
+        q.post_bulk(chunk.begin(), chunk.size());
+        i += chunk.size();
+      } else {
+        q.push(i);
+        ++i;
+      }
+      if ((i % 5) == 0 && q.try_pop(v)) {
+        popped.push_back(v);
+      }
+    }
+    while (q.try_pop(v)) {
+      popped.push_back(v);
+    }
+    producer_done.store(true, std::memory_order_release);
+  });
+
+  owner.join();
+  for (auto& t : stealers) {
+    t.join();
+  }
+
+  std::vector<bool> seen(N, false);
+  size_t total = 0;
+  auto mark = [&](size_t v) {
+    ASSERT_LT(v, N);
+    ASSERT_FALSE(seen[v]) << "value " << v << " duplicated";
+    seen[v] = true;
+    ++total;
+  };
+  for (size_t v : popped) {
+    mark(v);
+  }
+  for (auto& s : stolen) {
+    for (size_t v : s) {
+      mark(v);
+    }
+  }
+  EXPECT_EQ(N, total);
+}
+
+// Every stealer also owns a deque, and re-posts what it steals so that other
+// stealers can take from it, as a work-stealing executor would.
+TEST_F(CATEGORY, concurrent_chained_batch_stealing) {
+  constexpr size_t N = 50000;
+  constexpr size_t NUM_THREADS = 4;
+  constexpr size_t MAX_BATCH = 64;
+
+  std::vector<std::unique_ptr<steal_half_deque<size_t>>> qs;
+  for (size_t i = 0; i < NUM_THREADS; ++i) {
+    qs.push_back(std::make_unique<steal_half_deque<size_t>>(8));
+  }
+  std::atomic<size_t> remaining{N};
+  std::vector<std::vector<size_t>> taken(NUM_THREADS);
+
+  std::vector<size_t> src(N);
+  std::iota(src.begin(), src.end(), 0);
+  qs[0]->post_bulk(src.begin(), src.size());
+
+  std::vector<std::thread> threads;
+  for (size_t t = 0; t < NUM_THREADS; ++t) {
+    threads.emplace_back([&, t]() {
+      auto& own = *qs[t];
+      auto& out = taken[t];
+      size_t buf[MAX_BATCH];
+      size_t v = 0;
+      while (remaining.load(std::memory_order_relaxed) != 0) {
+        if (own.try_pop(v)) {
+          out.push_back(v);
+          remaining.fetch_sub(1, std::memory_order_relaxed);
+          continue;
+        }
+        for (size_t i = 1; i < NUM_THREADS; ++i) {
+          auto& victim = *qs[(t + i) % NUM_THREADS];
+          size_t n = victim.steal_batch(buf, MAX_BATCH);
+          if (n != 0) {
+            own.post_bulk(buf, n);
+            break;
+          }
+        }
+      }
+    });
+  }
+  for (auto& t : threads) {
+    t.join();
+  }
+
+  std::set<size_t> seen;
+  for (auto& s : taken) {
+    for (size_t v : s) {
+      ASSERT_TRUE(seen.insert(v).second) << "duplicate value " << v;
+    }
+  }
+  EXPECT_EQ(N, seen.size());
+}
+
+#undef CATEGORY
@@ -0,0 +1,91 @@
+// Tests for task_trace (examples/util/task_trace.hpp).
+
+// Enable the instrumentation for this file only.
+#define TMC_ENABLE_TRACE
+#include "../examples/util/task_trace.hpp"
+#include "test_common.hpp"
+
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#define CATEGORY test_task_trace
+
+namespace {
+
+class CATEGORY : public testing::Test {
+protected:
+  static void SetUpTestSuite() {
+    tmc::cpu_executor().set_thread_count(2).set_priority_count(2).init();
+  }
+
+  static void TearDownTestSuite() { tmc::cpu_executor().teardown(); }
+
+  static tmc::ex_cpu& ex() { return tmc::cpu_executor(); }
+};
+
+static std::string write_and_read(const char* Path) {
+  EXPECT_TRUE(task_trace::write_chrome_trace(Path));
+  std::ifstream f(Path);
+  std::stringstream ss;
+  ss << f.rdbuf();
+  std::remove(Path);
+  return ss.str();
+}
+
+// The number of events in Trace with the given name, category, and phase.
+static size_t
+count_of(const std::string& Trace, const char* Name, const char* Cat, const char* Phase) {
+  std::string needle = std::string("\"name\":\"") + Name + "\",\"cat\":\"" + Cat +
+                       "\",\"ph\":\"" + Phase + "\"";
+  size_t count = 0;
+  for (size_t pos = Trace.find(needle); pos != std::string::npos;
+       pos = Trace.find(needle, pos + 1)) {
+    ++count;
+  }
+  return count;
+}
+
+TEST_F(CATEGORY, slice) {
+  test_async_main(ex(), []() -> tmc::task<void> {
+    task_trace::reset();
+    {
+      task_trace::slice s("test_slice");
+    }
+    auto trace = write_and_read("test_task_trace_slice.json");
+    EXPECT_EQ(count_of(trace, "test_slice", "work", "X"), 1);
+    co_return;
+  }());
+}
+
+TEST_F(CATEGORY, suspended_await) {
+  test_async_main(ex(), []() -> tmc::task<void> {
+    task_trace::reset();
+    tmc::ex_cpu other;
+    other.set_thread_count(1).init();
+    int result = co_await task_trace::traced(
+      "test_await", tmc::spawn([]() -> tmc::task<int> { co_return 1; }()).run_on(other)
+    );
+    EXPECT_EQ(result, 1);
+    auto trace = write_and_read("test_task_trace_await.json");
+    EXPECT_EQ(count_of(trace, "test_await", "await", "b"), 1);
+    EXPECT_EQ(count_of(trace, "test_await", "await", "e"), 1);
+  }());
+}
+
+TEST_F(CATEGORY, change_priority) {
+  test_async_main(ex(), []() -> tmc::task<void> {
+    task_trace::reset();
+    co_await task_trace::change_priority(1);
+    EXPECT_EQ(tmc::current_priority(), 1);
+    auto trace = write_and_read("test_task_trace_prio.json");
+    EXPECT_EQ(count_of(trace, "change_priority", "priority", "i"), 1);
+  }());
+}
+
+} // namespace
+
+#undef CATEGORY
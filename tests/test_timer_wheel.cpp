@@ -0,0 +1,204 @@
+// Tests for timer_wheel::service and timer_wheel::timer
+// (examples/util/timer_wheel.hpp).
+
+#include "../examples/util/timer_wheel.hpp"
+#include "test_common.hpp"
+
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <cstddef>
+#include <future>
+#include <iterator>
+#include <thread>
+#include <variant>
+#include <vector>
+
+#define CATEGORY test_timer_wheel
+
+namespace {
+
+using namespace std::chrono_literals;
+
+class CATEGORY : public testing::Test {
+protected:
+  static void SetUpTestSuite() { tmc::cpu_executor().set_thread_count(2).init(); }
+
+  static void TearDownTestSuite() { tmc::cpu_executor().teardown(); }
+
+  static tmc::ex_cpu& ex() { return tmc::cpu_executor(); }
+};
+
+// A timer resumes on its awaiter's executor, and not before its deadline.
+TEST_F(CATEGORY, expires) {
+  test_async_main(ex(), []() -> tmc::task<void> {
+    timer_wheel::service svc;
+    auto start = timer_wheel::clock::now();
+    co_await timer_wheel::sleep_for(5ms, svc);
+    EXPECT_GE(timer_wheel::clock::now() - start, 5ms);
+    EXPECT_EQ(tmc::current_executor(), ex().type_erased());
+
+    auto deadline = timer_wheel::clock::now() + 3ms;
+    co_await timer_wheel::sleep_until(deadline, svc);
+    EXPECT_GE(timer_wheel::clock::now(), deadline);
+
+    // Already expired.
+    co_await timer_wheel::sleep_until(deadline - 1s, svc);
+  }());
+}
+
+// A timer that is cancelled before it is awaited completes immediately.
+TEST_F(CATEGORY, cancel_before_wait) {
+  test_async_main(ex(), []() -> tmc::task<void> {
+    timer_wheel::service svc;
+    timer_wheel::timer t(10s, svc);
+    t.cancel();
+    auto start = timer_wheel::clock::now();
+    co_await t.wait();
+    EXPECT_LT(timer_wheel::clock::now() - start, 1s);
+  }());
+}
+
+// A timer that is cancelled while it is pending resumes its awaiter, and later
+// calls to cancel() do nothing.
+TEST_F(CATEGORY, cancel_pending) {
+  timer_wheel::service svc;
+  timer_wheel::timer t(10s, svc);
+  auto start = timer_wheel::clock::now();
+  auto done = tmc::post_waitable(
+    ex(), [](timer_wheel::timer& T) -> tmc::task<void> { co_await T.wait(); }(t)
+  );
+  // Let the driver place it in the wheel.
+  std::this_thread::sleep_for(20ms);
+  EXPECT_EQ(done.wait_for(0s), std::future_status::timeout);
+  t.cancel();
+  done.wait();
+  EXPECT_LT(timer_wheel::clock::now() - start, 5s);
+  t.cancel();
+}
+
+// Cancelling one of several timers doesn't affect the others.
+TEST_F(CATEGORY, cancel_one) {
+  test_async_main(ex(), []() -> tmc::task<void> {
+    timer_wheel::service svc;
+    std::vector<timer_wheel::timer> timers;
+    for (size_t i = 0; i < 3; ++i) {
+      timers.emplace_back(5ms, svc);
+    }
+    timers[1].cancel();
+    auto start = timer_wheel::clock::now();
+    for (auto& t : timers) {
+      co_await t.wait();
+    }
+    EXPECT_GE(timer_wheel::clock::now() - start, 4ms);
+  }());
+}
+
+// A task can arm a new timer after each one expires or is cancelled.
+TEST_F(CATEGORY, rearm) {
+  test_async_main(ex(), []() -> tmc::task<void> {
+    timer_wheel::service svc;
+    for (size_t i = 0; i < 20; ++i) {
+      auto start = timer_wheel::clock::now();
+      timer_wheel::timer t(2ms, svc);
+      if (i % 2 == 0) {
+        co_await t.wait();
+        EXPECT_GE(timer_wheel::clock::now() - start, 2ms);
+      } else {
+        t.cancel();
+        co_await t.wait();
+      }
+    }
+    // The wheel was idle between the timers; a new one still wakes it.
+    std::this_thread::sleep_for(5ms);
+    auto start = timer_wheel::clock::now();
+    co_await timer_wheel::sleep_for(2ms, svc);
+    EXPECT_GE(timer_wheel::clock::now() - start, 2ms);
+  }());
+}
+
+// With a 1us tick, these deadlines are placed in levels 0, 1 and 2 of the
+// wheel, and cascade down to level 0 before they expire. Each one must expire
+// in deadline order, and not before its deadline.
+TEST_F(CATEGORY, cascade) {
+  timer_wheel::service svc(1us);
+  static constexpr std::chrono::microseconds DELAYS[] = {
+    100us, 2ms, 30ms, 70ms, 100ms,
+  };
+  static constexpr size_t COUNT = std::size(DELAYS);
+  auto start = timer_wheel::clock::now();
+  std::vector<timer_wheel::clock::time_point> expired(COUNT);
+  std::vector<std::future<void>> results;
+  // Submitted in reverse so that the expiry order isn't the submission order.
+  for (size_t i = COUNT; i > 0; --i) {
+    results.push_back(tmc::post_waitable(
+      ex(),
+      [](
+        timer_wheel::service& Svc, timer_wheel::clock::time_point Deadline,
+        timer_wheel::clock::time_point& Expired
+      ) -> tmc::task<void> {
+        co_await timer_wheel::sleep_until(Deadline, Svc);
+        Expired = timer_wheel::clock::now();
+      }(svc, start + DELAYS[i - 1], expired[i - 1])
+    ));
+  }
+  for (auto& r : results) {
+    r.wait();
+  }
+  for (size_t i = 0; i < COUNT; ++i) {
+    EXPECT_GE(expired[i], start + DELAYS[i]) << i;
+    // A timer that was placed in the wrong slot is early, or late by a
+    // rotation of its level (65ms for level 1, 16.7s for level 2).
+    EXPECT_LT(expired[i], start + DELAYS[i] + 1s) << i;
+    if (i > 0) {
+      EXPECT_GT(expired[i], expired[i - 1]) << i;
+    }
+  }
+}
+
+// tmc::select() resumes with the timer that expired first, and cancels the
+// other one.
+TEST_F(CATEGORY, select) {
+  test_async_main(ex(), []() -> tmc::task<void> {
+    timer_wheel::service svc;
+    auto start = timer_wheel::clock::now();
+    {
+      auto slow = timer_wheel::sleep_for(10s, svc);
+      auto fast = timer_wheel::sleep_for(5ms, svc);
+      std::variant<std::monostate, std::monostate> result = co_await tmc::select(
+        tmc::cancellable(slow, slow), tmc::cancellable(fast, fast)
+      );
+      EXPECT_EQ(result.index(), 1u);
+      EXPECT_GE(timer_wheel::clock::now() - start, 5ms);
+      EXPECT_LT(timer_wheel::clock::now() - start, 5s);
+    }
+    {
+      // The single-argument overload, with an awaitable from wait().
+      timer_wheel::timer fast(5ms, svc);
+      timer_wheel::timer slow(10s, svc);
+      std::variant<std::monostate, std::monostate> result = co_await tmc::select(
+        tmc::cancellable(fast), tmc::cancellable(slow.wait(), slow)
+      );
+      EXPECT_EQ(result.index(), 0u);
+      EXPECT_LT(timer_wheel::clock::now() - start, 5s);
+    }
+  }());
+}
+
+// A timer can also be cancelled by select() before the driver has seen it.
+TEST_F(CATEGORY, select_cancel_submitted) {
+  test_async_main(ex(), []() -> tmc::task<void> {
+    timer_wheel::service svc;
+    for (size_t i = 0; i < 100; ++i) {
+      auto slow = timer_wheel::sleep_for(10s, svc);
+      auto winner = []() -> tmc::task<void> { co_return; };
+      std::variant<std::monostate, std::monostate> result = co_await tmc::select(
+        tmc::cancellable(slow, slow), tmc::cancellable(winner(), [] {})
+      );
+      EXPECT_EQ(result.index(), 1u);
+    }
+  }());
+}
+} // namespace
+
+#undef CATEGORY
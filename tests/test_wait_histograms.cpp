@@ -0,0 +1,85 @@
+// Tests for wait_histograms (examples/util/wait_histograms.hpp).
+
+// Enable the instrumentation for this file only.
+#define TMC_ENABLE_WAIT_HISTOGRAMS
+#include "../examples/util/wait_histograms.hpp"
+#include "atomic_awaitable.hpp"
+#include "test_common.hpp"
+#include "tmc/mutex.hpp"
+#include "waiter_count_accessor.hpp"
+
+#include <gtest/gtest.h>
+
+#define CATEGORY test_wait_histograms
+
+namespace {
+
+class CATEGORY : public testing::Test {
+protected:
+  static void SetUpTestSuite() { tmc::cpu_executor().set_thread_count(2).init(); }
+
+  static void TearDownTestSuite() { tmc::cpu_executor().teardown(); }
+
+  static tmc::ex_cpu& ex() { return tmc::cpu_executor(); }
+
+  using waiter_count_accessor = tmc::tests::waiter_count_accessor;
+};
+
+TEST_F(CATEGORY, uncontended_is_not_recorded) {
+  test_async_main(ex(), []() -> tmc::task<void> {
+    wait_stats::reset();
+    tmc::mutex mut;
+    {
+      auto s = co_await wait_stats::timed(wait_stats::kind::MUTEX, mut.lock_scope());
+      EXPECT_EQ(mut.is_locked(), true);
+    }
+    EXPECT_EQ(mut.is_locked(), false);
+    EXPECT_EQ(wait_stats::merged(wait_stats::kind::MUTEX).count(), 0);
+  }());
+}
+
+TEST_F(CATEGORY, contended_mutex) {
+  test_async_main(ex(), []() -> tmc::task<void> {
+    wait_stats::reset();
+    tmc::mutex mut;
+    co_await mut;
+    atomic_awaitable<int> aa(1);
+    auto t =
+      tmc::spawn([](tmc::mutex& Mut, atomic_awaitable<int>& AA) -> tmc::task<void> {
+        co_await wait_stats::timed(wait_stats::kind::MUTEX, Mut);
+        AA.inc();
+        Mut.unlock();
+      }(mut, aa))
+        .fork();
+    co_await waiter_count_accessor::wait_for_waiter_count(mut, 1);
+    mut.unlock();
+    co_await aa;
+    co_await std::move(t);
+    EXPECT_EQ(wait_stats::merged(wait_stats::kind::MUTEX).count(), 1);
+    EXPECT_EQ(wait_stats::merged(wait_stats::kind::SEMAPHORE).count(), 0);
+  }());
+}
+
+TEST_F(CATEGORY, spawn_run_on) {
+  test_async_main(ex(), []() -> tmc::task<void> {
+    wait_stats::reset();
+    tmc::ex_cpu other;
+    other.set_thread_count(1).init();
+    for (int i = 0; i < 10; ++i) {
+      int result = co_await wait_stats::timed(
+        wait_stats::kind::EXECUTOR,
+        tmc::spawn([](int I) -> tmc::task<int> { co_return I; }(i)).run_on(other)
+      );
+      EXPECT_EQ(result, i);
+    }
+    auto h = wait_stats::merged(wait_stats::kind::EXECUTOR);
+    EXPECT_EQ(h.count(), 10);
+    EXPECT_GT(h.max(), 0);
+    wait_stats::reset();
+    EXPECT_EQ(wait_stats::merged(wait_stats::kind::EXECUTOR).count(), 0);
+  }());
+}
+
+} // namespace
+
+#undef CATEGORY